@@ -0,0 +1,24 @@
+//How open the room is around each point, cone traced through the scene SDF on the CPU by AmbientOcclusion::Generate in Content/AmbientOcclusion.cpp.
+//With the volume off a single open voxel is bound instead, so the shaders always sample it.
+
+Texture3D<float> txOcclusion : register(t5);
+
+#define OCCLUSION_BOX 5.0	//half size of the room's box, which the volume covers
+
+//Same as AmbientOcclusion::Sample
+float AmbientOcclusion(SamplerState linearSampler, float3 Position)
+{
+	uint width, height, depth;
+	txOcclusion.GetDimensions(width, height, depth);
+	float3 halfTexel = 0.5 / float3(width, height, depth);
+	float3 uvw = clamp((Position + OCCLUSION_BOX) / (2.0 * OCCLUSION_BOX), halfTexel, 1.0 - halfTexel);
+	return txOcclusion.SampleLevel(linearSampler, uvw, 0);
+}
+
+//Same as AmbientOcclusion::SurfaceSamplePoint, one voxel out from the surface so that it reads the open side
+float SurfaceOcclusion(SamplerState linearSampler, float3 Position, float3 normal)
+{
+	uint width, height, depth;
+	txOcclusion.GetDimensions(width, height, depth);
+	return AmbientOcclusion(linearSampler, Position + normal * (2.0 * OCCLUSION_BOX / width));
+}
@@ -0,0 +1,259 @@
+//Ray marches a hall holding a square grid of pillars instead of the room, its floor and its four pillars.
+//The pillars are one cylinder repeated over grid cells, so a pixel costs the same whether the hall has 400 or 40,000 of them.
+//Smaller halls are cheaper, their rays cross fewer cells.
+//Colonnade.cpp is the CPU reference of this shader.
+
+Texture2D txTexture : register(t0);
+Texture2D txNormal : register(t1);
+SamplerState txSampler : register(s0);
+
+#ifndef NUMLIGHTS	//set by the variant wrappers in the Permutations folder
+#define NUMLIGHTS 3	//lights in the shading loops
+#endif
+
+#define MAX_STEPS 128
+#define HIT_EPSILON 0.001
+#define CELL_EPSILON 0.001	//added to a step cut at a cell boundary, so the next step starts in the next cell
+#define FAR 1e30
+
+cbuffer PixelShaderConstantBuffer : register(b0)
+{
+float4 Eye;
+float4 LightColor;
+float4 backgroundColor;
+float4 LightPos[3];
+float nearPlane;
+float farPlane;
+float2 padding;
+};
+
+cbuffer ColonnadeConstantBuffer : register(b4)
+{
+	uint pillarsPerSide;
+	float spacing;
+	float radius;
+	float jitter;	//largest offset of a pillar from the centre of its cell
+	float4 hallSize;	//half extents of the hall
+};
+
+struct Ray
+{
+	float3 o;	//origin
+	float3 d;	//direction
+};
+
+//Canvas
+struct VS_Canvas
+{
+	float4 Position : SV_POSITION;	//vertex position
+	float2 canvasXY : TEXCOORD0;	//vertex texture coordinates
+	float2 tex : TEXCOORD1;
+};
+
+//------------------------------------------------------------------------------------------------------------------
+
+uint Hash(uint x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352d;
+	x ^= x >> 15;
+	x *= 0x846ca68b;
+	x ^= x >> 16;
+	return x;
+}
+
+//Pillars are moved off their cell centres by a hash of the cell, but always stay inside the cell
+float2 PillarCentre(float2 cell)
+{
+	uint h = Hash(Hash((uint)cell.x) + (uint)cell.y);
+	float2 offset = (float2(h & 0xffff, h >> 16) / 65535.0 * 2.0 - 1.0) * jitter;
+	return (cell - 0.5 * (pillarsPerSide - 1)) * spacing + offset;
+}
+
+//Position in cell units, 0 at the centre of the first cell
+float2 CellCoordinate(float2 xz)
+{
+	return xz / spacing + 0.5 * (pillarsPerSide - 1);
+}
+
+float2 CellIndex(float2 cells)
+{
+	return clamp(floor(cells + 0.5), 0.0, pillarsPerSide - 1.0);
+}
+
+//Distance to the nearest pillar and where it stands. A moved pillar can be nearer than the one of the cell p is in, so the
+//neighbour cells on p's side are checked too. Every other pillar is beyond the edge of that 2x2 block, which clamps the distance.
+float Pillars(float3 p, out float2 nearest)
+{
+	float lastCell = pillarsPerSide - 1.0;
+	float2 cells = CellCoordinate(p.xz);
+	float2 cell = CellIndex(cells);
+	float2 neighbour = cells >= cell ? cell + 1.0 : cell - 1.0;
+	bool2 inside = neighbour >= 0.0 && neighbour <= lastCell;
+	float2 first = inside ? min(cell, neighbour) : cell;
+	float2 last = inside ? max(cell, neighbour) : cell;
+
+	//The outer cells have nothing beyond them
+	float2 edge = (float2)FAR;
+	edge = first > 0.0 ? min(edge, (cells - (first - 0.5)) * spacing) : edge;
+	edge = last < lastCell ? min(edge, (last + 0.5 - cells) * spacing) : edge;
+
+	float Fun = min(edge.x, edge.y);
+	nearest = PillarCentre(cell);
+	for (float j = first.y; j <= last.y; j++)
+	{
+		for (float i = first.x; i <= last.x; i++)
+		{
+			float2 centre = PillarCentre(float2(i, j));
+			float d = length(p.xz - centre) - radius;
+			if (d < Fun)
+			{
+				Fun = d;
+				nearest = centre;
+			}
+		}
+	}
+
+	return Fun;
+}
+
+//Distance along d to where p leaves its cell, the outer cells reach the walls
+float CellExit(float3 p, float3 d)
+{
+	float lastCell = pillarsPerSide - 1.0;
+	float2 cell = CellIndex(CellCoordinate(p.xz));
+	float2 centre = (cell - 0.5 * (pillarsPerSide - 1)) * spacing;
+
+	float2 exit = (float2)FAR;
+	if (d.x > 0.0 && cell.x < lastCell)
+		exit.x = max(centre.x + 0.5 * spacing - p.x, 0.0) / d.x;
+	if (d.x < 0.0 && cell.x > 0.0)
+		exit.x = max(p.x - (centre.x - 0.5 * spacing), 0.0) / -d.x;
+	if (d.z > 0.0 && cell.y < lastCell)
+		exit.y = max(centre.y + 0.5 * spacing - p.z, 0.0) / d.z;
+	if (d.z < 0.0 && cell.y > 0.0)
+		exit.y = max(p.z - (centre.y - 0.5 * spacing), 0.0) / -d.z;
+
+	return min(exit.x, exit.y);
+}
+
+bool IntersectBox(in Ray ray, in float3 minimum, in float3 maximum, out float timeIn, out float timeOut)
+{
+	float3 OMIN = (minimum - ray.o) / ray.d;
+	float3 OMAX = (maximum - ray.o) / ray.d;
+	float3 MAX = max(OMAX, OMIN);
+	float3 MIN = min(OMAX, OMIN);
+	timeOut = min(MAX.x, min(MAX.y, MAX.z));
+	timeIn = max(max(MIN.x, 0.0), max(MIN.y, MIN.z));
+
+	return timeOut > timeIn;
+}
+
+//The inward normal of the wall, floor or ceiling Position is on
+float3 HallNormal(float3 Position)
+{
+	float3 q = Position / hallSize.xyz;
+	float3 a = abs(q);
+	if (a.x > a.y && a.x > a.z)
+		return float3(-sign(q.x), 0, 0);
+	if (a.y > a.z)
+		return float3(0, -sign(q.y), 0);
+	return float3(0, 0, -sign(q.z));
+}
+
+float4 Phong(float3 n, float3 l, float3 v, float shininess, float4 diffuseColor, float4 specularColor)
+{
+	float NdotL = dot(n, l);
+	float diff = saturate(NdotL);
+	float3 r = reflect(l, n);
+	float spec = pow(saturate(dot(v, r)), shininess) * (NdotL > 0.0);
+	return diff * diffuseColor + spec * specularColor;
+}
+
+//Lighting of the room pass
+float4 ShadeRoom(float3 Position, float3 normal, float3 viewDir, float3 color)
+{
+	float4 diff = float4(1, 1, 1, 1);
+	float4 spec = float4(0, 1, 0, 1);
+
+	float4 output = (float4)0;
+	float3 lightDir;
+
+	for (int i = 0; i < NUMLIGHTS; i++)
+	{
+		lightDir = normalize(LightPos[i] - Position);
+		output += float4(color, 1.0) * Phong(normal, lightDir, viewDir, 40, diff, spec);
+	}
+
+	return saturate(LightColor * output);
+}
+
+//Lighting of the pillar pass
+float4 ShadePillar(float3 Position, float3 normal, float3 viewDir, float3 color)
+{
+	float4 spec = float4(1, 1, 1, 1);
+
+	float4 output = (float4)0;
+	float3 lightDir;
+
+	for (int i = 0; i < NUMLIGHTS; i++)
+	{
+		lightDir = normalize(LightPos[i] - Position);
+		output += Phong(normal, lightDir, viewDir, 40, float4(color, 1.0f), spec);
+	}
+
+	return saturate(LightColor * output);
+}
+
+float2 CalcUV(float3 Position, float3 normal)
+{
+	float3 u = float3(normal.y, -normal.x, 0);
+	u = normalize(u);
+	float3 v = cross(normal, u);
+
+	return float2(dot(u, Position), dot(v, Position));
+
+}
+
+float4 main(VS_Canvas input) : SV_TARGET
+{
+	float zoom = 0.004;
+	float2 xy = zoom * input.canvasXY;
+	float distEye2Canvas = nearPlane;
+	float3 PixelPos = float3(xy, distEye2Canvas);
+
+	Ray ray;
+	ray.o = Eye.xyz;
+	ray.d = normalize(PixelPos - Eye.xyz);	//view direction
+
+	float start, final;
+	if (!IntersectBox(ray, -hallSize.xyz, hallSize.xyz, start, final))
+		return (float4)0;
+
+	//Sphere tracing, each step stopping at the boundary of the cell it starts in so the pillars it checks stay the right ones
+	float t = start;
+	float2 nearest;
+	for (int i = 0; i < MAX_STEPS && t < final; i++)
+	{
+		float3 Position = ray.o + t * ray.d;
+		float d = Pillars(Position, nearest);
+		if (d < HIT_EPSILON)
+		{
+			float3 normal = normalize(float3(Position.x - nearest.x, 0.0, Position.z - nearest.y));
+			float2 UV = CalcUV(Position, normal);
+			float3 color = txTexture.Sample(txSampler, 0.5 * UV);
+			float3 texNormal = normalize(2 * txNormal.Sample(txSampler, 0.5 * UV).rgb - float3(1, 1, 1));
+
+			return ShadePillar(Position, texNormal, ray.d, color);
+		}
+
+		t += min(d, CellExit(Position, ray.d) + CELL_EPSILON);
+	}
+
+	//Out of steps or past the pillars: the hall's walls, floor or ceiling
+	float3 Position = ray.o + final * ray.d;
+	float3 normal = HallNormal(Position);
+	float3 color = txTexture.Sample(txSampler, CalcUV(Position, normal));
+
+	return ShadeRoom(Position, normal, ray.d, color);
+}
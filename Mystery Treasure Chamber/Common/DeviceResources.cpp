@@ -68,6 +68,7 @@ namespace ScreenRotation
 DX::DeviceResources::DeviceResources() :
 	m_screenViewport(),
 	m_d3dFeatureLevel(D3D_FEATURE_LEVEL_9_1),
+	m_d3dDriverType(D3D_DRIVER_TYPE_HARDWARE),
 	m_d3dRenderTargetSize(),
 	m_outputSize(),
 	m_logicalSize(),
@@ -159,6 +160,7 @@ void DX::DeviceResources::CreateDeviceResources()
 	ComPtr<ID3D11Device> device;
 	ComPtr<ID3D11DeviceContext> context;
 
+	m_d3dDriverType = D3D_DRIVER_TYPE_HARDWARE;
 	HRESULT hr = D3D11CreateDevice(
 		nullptr,					// Specify nullptr to use the default adapter.
 		D3D_DRIVER_TYPE_HARDWARE,	// Create a device using the hardware graphics driver.
@@ -177,6 +179,7 @@ void DX::DeviceResources::CreateDeviceResources()
 		// If the initialization fails, fall back to the WARP device.
 		// For more information on WARP, see: 
 		// https://go.microsoft.com/fwlink/?LinkId=286690
+		m_d3dDriverType = D3D_DRIVER_TYPE_WARP;
 		DX::ThrowIfFailed(
 			D3D11CreateDevice(
 				nullptr,
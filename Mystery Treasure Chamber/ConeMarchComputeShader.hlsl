@@ -0,0 +1,109 @@
+//Marches one cone per 8x8 tile of pixels, wide enough to hold every pixel ray of the tile, through the room and the pillars.
+//Writes how far along those rays the scene is known to be empty, so the room and pillar passes can skip that part of their march.
+//ConeMarch.cpp is the CPU reference of this shader.
+
+RWTexture2D<float> txConeBound : register(u0);	//one distance per tile
+
+#define TILE_SIZE 8
+#define MAX_STEPS 48
+#define MINIMUM_START 0.01	//the field is 0 at the eye, which sits on the room's wall
+#define MARGIN 0.01
+
+#define MIN_XYZ -5.0
+#define MAX_XYZ 5.0
+static const float3 BoxMinimum = (float3)MIN_XYZ;
+static const float3 BoxMaximum = (float3)MAX_XYZ;
+
+cbuffer PixelShaderConstantBuffer : register(b0)
+{
+float4 Eye;
+float4 LightColor;
+float4 backgroundColor;
+float4 LightPos[3];
+float nearPlane;
+float farPlane;
+float2 padding;
+};
+
+cbuffer ChangesOnResizeConstantBuffer : register(b1)
+{
+	float height;
+	float width;
+	float2 resizePadding;
+}
+
+struct Ray
+{
+	float3 o;	//origin
+	float3 d;	//direction
+};
+
+//sdBox, sdCylinder, room(), pillars() and their gradients, generated from the scene in Content/SdfScene.h
+#include "SdfScene.hlsli"
+
+float Function(float3 Position)
+{
+	return min(room(Position), pillars(Position));
+}
+
+bool IntersectBox(in Ray ray, in float3 minimum, in float3 maximum, out float timeIn, out float timeOut)
+{
+	float3 OMIN = (minimum - ray.o) / ray.d;
+	float3 OMAX = (maximum - ray.o) / ray.d;
+	float3 MAX = max(OMAX, OMIN);
+	float3 MIN = min(OMAX, OMIN);
+	timeOut = min(MAX.x, min(MAX.y, MAX.z));
+	timeIn = max(max(MIN.x, 0.0), max(MIN.y, MIN.z));
+
+	return timeOut > timeIn;
+}
+
+//Same ray as the canvas vertex shader and the ray marching passes give the pixel at this position
+float3 CanvasRay(float2 pixel)
+{
+	float zoom = 0.004;
+	float2 canvasXY = float2(2.0 * pixel.x / width - 1.0, 1.0 - 2.0 * pixel.y / height) * float2(width, height);
+	float3 PixelPos = float3(zoom * canvasXY, nearPlane);
+	return normalize(PixelPos - Eye.xyz);
+}
+
+[numthreads(TILE_SIZE, TILE_SIZE, 1)]
+void main(uint3 tile : SV_DispatchThreadID)
+{
+	uint tilesX, tilesY;
+	txConeBound.GetDimensions(tilesX, tilesY);
+	if (tile.x >= tilesX || tile.y >= tilesY)
+		return;
+
+	Ray axis;
+	axis.o = Eye.xyz;
+	axis.d = CanvasRay((tile.xy + 0.5) * TILE_SIZE);
+
+	//The tile's rays meet the canvas in a rectangle, so the one furthest from the axis goes through a corner
+	float spread = 0.0;
+	for (uint corner = 0; corner < 4; corner++)
+	{
+		float2 pixel = (tile.xy + float2(corner & 1, corner >> 1)) * TILE_SIZE;
+		spread = max(spread, length(CanvasRay(pixel) - axis.d));
+	}
+
+	float start, final;
+	float bound = 0.0;
+	if (IntersectBox(axis, BoxMinimum, BoxMaximum, start, final))
+	{
+		//Along any ray of the cone, t + dt is within t * spread + dt of the axis at t, so the cone is empty up to where that reaches the field
+		float t = max(start, MINIMUM_START);
+		for (int i = 0; i < MAX_STEPS && t < final; i++)
+		{
+			float clear = Function(axis.o + t * axis.d) - t * spread;
+			if (clear <= 0.0)
+				break;
+
+			t += clear / (1.0 + spread);
+		}
+
+		bound = max(start, min(t, final) - MARGIN);
+	}
+
+	txConeBound[tile.xy] = bound;
+}
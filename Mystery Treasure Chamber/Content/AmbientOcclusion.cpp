@@ -0,0 +1,220 @@
+﻿#include "AmbientOcclusion.h"
+#include "FusedRaymarch.h"
+#include "PassCache.h"
+#include "SdfScene.h"
+
+#include <cstdio>
+#include <fstream>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	const uint32_t Magic = 0x4C4F5641;	// "AVOL"
+
+	const float GoldenAngle = 2.39996323f;
+
+	float3 Gradient(const float3& Position)
+	{
+		const float h = 0.001f;
+		return normalize(float3(
+			FusedRaymarch::Scene(Position + float3(h, 0, 0)) - FusedRaymarch::Scene(Position - float3(h, 0, 0)),
+			FusedRaymarch::Scene(Position + float3(0, h, 0)) - FusedRaymarch::Scene(Position - float3(0, h, 0)),
+			FusedRaymarch::Scene(Position + float3(0, 0, h)) - FusedRaymarch::Scene(Position - float3(0, 0, h))));
+	}
+
+	// Direction i of count spread over the hemisphere around normal, more of them towards the
+	// normal the way a cosine weighted integral wants them.
+	float3 HemisphereDirection(uint32_t i, uint32_t count, const float3& normal)
+	{
+		float r = std::sqrt((i + 0.5f) / count);
+		float phi = i * GoldenAngle;
+
+		float3 helper = std::fabs(normal.y) < 0.99f ? float3(0.0f, 1.0f, 0.0f) : float3(1.0f, 0.0f, 0.0f);
+		float3 tangent = normalize(cross(helper, normal));
+		float3 bitangent = cross(normal, tangent);
+		return r * std::cos(phi) * tangent + r * std::sin(phi) * bitangent + std::sqrt(std::max(0.0f, 1.0f - r * r)) * normal;
+	}
+
+	float VoxelSize(uint32_t resolution)
+	{
+		return 2.0f * AmbientOcclusion::BoxSize / resolution;
+	}
+
+	float3 VoxelCentre(uint32_t resolution, uint32_t x, uint32_t y, uint32_t z)
+	{
+		return float3(-AmbientOcclusion::BoxSize) + VoxelSize(resolution) * float3(x + 0.5f, y + 0.5f, z + 0.5f);
+	}
+}
+
+AmbientOcclusion::Settings AmbientOcclusion::DefaultSettings()
+{
+	Settings settings;
+	settings.resolution = 64;
+	settings.cones = 16;
+	settings.coneSlope = 0.15f;
+	settings.steps = 12;
+	settings.distance = 2.0f;
+	return settings;
+}
+
+uint64_t AmbientOcclusion::Key(const Settings& settings)
+{
+	PassHash hash;
+	hash.Add(Version);
+	hash.Add(BoxSize);
+	hash.Add(SdfScene::PillarRadius);
+	hash.Add(SdfScene::PillarOffsets);
+	hash.Add(settings);
+	return hash.GetValue();
+}
+
+float AmbientOcclusion::Evaluate(const Settings& settings, const float3& Position, const float3& normal)
+{
+	float open = 0.0f;
+	for (uint32_t c = 0; c < settings.cones; c++)
+	{
+		float3 direction = HemisphereDirection(c, settings.cones, normal);
+
+		// A cone is as open as it is at its narrowest, relative to its width there. A cone leaning
+		// away from the normal narrows against the plane it starts on alone, by the cosine over
+		// the slope, so it is measured against that and an open floor comes out at 1.
+		float flat = std::min(1.0f, dot(direction, normal) / settings.coneSlope);
+		float visibility = 1.0f;
+		for (uint32_t i = 1; i <= settings.steps && visibility > 0.0f; i++)
+		{
+			float t = settings.distance * i / settings.steps;
+			float d = FusedRaymarch::Scene(Position + t * direction);
+			visibility = std::min(visibility, saturate(d / (t * settings.coneSlope * flat)));
+		}
+		open += visibility;
+	}
+	return settings.cones > 0 ? open / settings.cones : 1.0f;
+}
+
+AmbientOcclusionVolume AmbientOcclusion::Generate(const Settings& settings, WorkStealingPool& pool)
+{
+	uint32_t resolution = settings.resolution;
+
+	AmbientOcclusionVolume volume;
+	volume.key = Key(settings);
+	volume.resolution = resolution;
+	volume.values.assign(size_t(resolution) * resolution * resolution, 1.0f);
+
+	float clearance = 0.5f * VoxelSize(resolution);
+	pool.Run(resolution, [&](uint32_t z, uint32_t) {
+		float* slice = &volume.values[size_t(z) * resolution * resolution];
+		for (uint32_t y = 0; y < resolution; y++)
+		{
+			for (uint32_t x = 0; x < resolution; x++)
+			{
+				float3 centre = VoxelCentre(resolution, x, y, z);
+				float distance = FusedRaymarch::Scene(centre);
+				float3 normal = Gradient(centre);
+
+				// Voxels in or at a surface look from half a voxel outside it.
+				if (distance < clearance)
+					centre += (clearance - distance) * normal;
+
+				slice[y * resolution + x] = Evaluate(settings, centre, normal);
+			}
+		}
+	});
+
+	return volume;
+}
+
+float AmbientOcclusion::Sample(const AmbientOcclusionVolume& volume, const float3& Position)
+{
+	int resolution = static_cast<int>(volume.resolution);
+	float3 voxel = (Position + float3(BoxSize)) * (resolution / (2.0f * BoxSize)) - float3(0.5f);
+
+	int corner[3];
+	float weight[3];
+	for (int i = 0; i < 3; i++)
+	{
+		float t = clamp(voxel[i], 0.0f, float(resolution - 1));
+		corner[i] = std::min(static_cast<int>(t), resolution - 2);
+		weight[i] = t - corner[i];
+	}
+
+	float result = 0.0f;
+	for (int i = 0; i < 8; i++)
+	{
+		int x = corner[0] + (i & 1), y = corner[1] + ((i >> 1) & 1), z = corner[2] + ((i >> 2) & 1);
+		float w = ((i & 1) ? weight[0] : 1.0f - weight[0]) *
+			((i & 2) ? weight[1] : 1.0f - weight[1]) *
+			((i & 4) ? weight[2] : 1.0f - weight[2]);
+		result += w * volume.values[(size_t(z) * resolution + y) * resolution + x];
+	}
+	return result;
+}
+
+float3 AmbientOcclusion::SurfaceSamplePoint(const Settings& settings, const float3& surface, const float3& normal)
+{
+	return surface + VoxelSize(settings.resolution) * normal;
+}
+
+bool AmbientOcclusion::Save(const AmbientOcclusionVolume& volume, std::ostream& stream)
+{
+	stream.write(reinterpret_cast<const char*>(&Magic), sizeof(Magic));
+	stream.write(reinterpret_cast<const char*>(&Version), sizeof(Version));
+	stream.write(reinterpret_cast<const char*>(&volume.key), sizeof(volume.key));
+	stream.write(reinterpret_cast<const char*>(&volume.resolution), sizeof(volume.resolution));
+	stream.write(reinterpret_cast<const char*>(volume.values.data()), volume.values.size() * sizeof(float));
+	return static_cast<bool>(stream);
+}
+
+bool AmbientOcclusion::Load(std::istream& stream, uint64_t key, AmbientOcclusionVolume& volume)
+{
+	uint32_t magic = 0, version = 0, resolution = 0;
+	uint64_t fileKey = 0;
+	stream.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+	stream.read(reinterpret_cast<char*>(&version), sizeof(version));
+	stream.read(reinterpret_cast<char*>(&fileKey), sizeof(fileKey));
+	stream.read(reinterpret_cast<char*>(&resolution), sizeof(resolution));
+	if (!stream || magic != Magic || version != Version || fileKey != key || resolution < 2 || resolution > 1024)
+		return false;
+
+	std::vector<float> values(size_t(resolution) * resolution * resolution);
+	stream.read(reinterpret_cast<char*>(values.data()), values.size() * sizeof(float));
+	if (!stream)
+		return false;
+
+	volume.key = fileKey;
+	volume.resolution = resolution;
+	volume.values.swap(values);
+	return true;
+}
+
+std::string AmbientOcclusion::CacheFileName(uint64_t key)
+{
+	char name[64];
+	std::snprintf(name, sizeof(name), "AmbientOcclusion_%016llx.bin", static_cast<unsigned long long>(key));
+	return name;
+}
+
+AmbientOcclusionVolume AmbientOcclusion::LoadOrGenerate(const std::string& directory, const Settings& settings,
+	WorkStealingPool& pool, bool* fromCache)
+{
+	uint64_t key = Key(settings);
+	std::string path = directory.empty() ? CacheFileName(key) : directory + "/" + CacheFileName(key);
+
+	AmbientOcclusionVolume volume;
+	std::ifstream cached(path, std::ios::binary);
+	bool loaded = cached && Load(cached, key, volume);
+	if (fromCache)
+		*fromCache = loaded;
+	if (loaded)
+		return volume;
+
+	volume = Generate(settings, pool);
+
+	// A cache that cannot be written only costs the next run.
+	std::ofstream file(path, std::ios::binary);
+	if (file)
+		Save(volume, file);
+
+	return volume;
+}
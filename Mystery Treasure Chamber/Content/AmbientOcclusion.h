@@ -0,0 +1,76 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "SdfMath.h"
+#include "TemporalReprojection.h"
+#include "TileRenderer.h"
+#include "WorkStealingPool.h"
+
+namespace Mystery_Treasure_Chamber
+{
+	// How open the space around each voxel of the room's box is, 1 in the open and towards 0 in
+	// corners and next to the pillars. x is fastest, then y, then z.
+	struct AmbientOcclusionVolume
+	{
+		uint64_t			key;
+		uint32_t			resolution;
+		std::vector<float>	values;
+	};
+
+	// Offline CPU generator of the volume AmbientOcclusion.hlsli samples. Each voxel traces a few
+	// cones over the hemisphere around the field's gradient through the scene SDF, and keeps the
+	// average of how far each cone stays clear of it. Voxels inside or touching the walls and the
+	// pillars are traced from just outside, so samples next to a surface are not darkened by the
+	// inside. Voxels are generated a slice at a time on a WorkStealingPool and cached on disk
+	// under their key, like LightmapBaker.
+	namespace AmbientOcclusion
+	{
+		// Half size of the room's box, which the volume covers.
+		const float BoxSize = 5.0f;
+
+		// Written at the start of a cache file, and part of every key. Change it with the cone tracing.
+		const uint32_t Version = 1;
+
+		struct Settings
+		{
+			uint32_t	resolution;		// Voxels along each side of the room.
+			uint32_t	cones;			// Cones per voxel.
+			float		coneSlope;		// Tangent of the cones' half angle.
+			uint32_t	steps;			// Samples along each cone.
+			float		distance;		// How far the cones reach.
+		};
+
+		Settings DefaultSettings();
+
+		// Hash of the scene and the settings. Equal keys generate the same volume.
+		uint64_t Key(const Settings& settings);
+
+		// Cone traced occlusion of a point in free space, looking around normal.
+		float Evaluate(const Settings& settings, const Sdf::float3& Position, const Sdf::float3& normal);
+
+		// The result does not depend on the pool's thread count.
+		AmbientOcclusionVolume Generate(const Settings& settings, WorkStealingPool& pool);
+
+		// Trilinear sample at Position, the same as AmbientOcclusion in AmbientOcclusion.hlsli.
+		float Sample(const AmbientOcclusionVolume& volume, const Sdf::float3& Position);
+
+		// Where the shaders sample for a surface point: one voxel out along the normal.
+		Sdf::float3 SurfaceSamplePoint(const Settings& settings, const Sdf::float3& surface, const Sdf::float3& normal);
+
+		// Cache files hold the version, the key, the resolution and the values.
+		bool Save(const AmbientOcclusionVolume& volume, std::ostream& stream);
+
+		// Fails unless the stream holds a volume of this version and key.
+		bool Load(std::istream& stream, uint64_t key, AmbientOcclusionVolume& volume);
+
+		std::string CacheFileName(uint64_t key);
+
+		// Loads the cached volume for the settings from directory, or generates and caches it.
+		AmbientOcclusionVolume LoadOrGenerate(const std::string& directory, const Settings& settings,
+			WorkStealingPool& pool, bool* fromCache);
+	}
+}
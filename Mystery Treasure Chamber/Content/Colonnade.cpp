@@ -0,0 +1,208 @@
+﻿#include "Colonnade.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	const float Spacing = 3.5f;
+	const float Radius = 0.5f;
+	const float RoomSize = 5.0f;
+
+	// Fraction of the spacing a pillar may move by. With the radius it stays inside its cell.
+	const float JitterFraction = 0.2f;
+
+	const float Far = std::numeric_limits<float>::max();
+
+	// Same integer hash as the shader, so both move the pillars the same way.
+	uint32_t Hash(uint32_t x)
+	{
+		x ^= x >> 16;
+		x *= 0x7feb352du;
+		x ^= x >> 15;
+		x *= 0x846ca68bu;
+		x ^= x >> 16;
+		return x;
+	}
+
+	float Cylinder(const float3& p, const float2& centre, float radius)
+	{
+		return length(float2(p.x - centre.x, p.z - centre.y)) - radius;
+	}
+
+	// Position of a coordinate in cell units, 0 at the centre of the first cell.
+	float CellCoordinate(const ColonnadeLayout& layout, float coordinate)
+	{
+		return coordinate / layout.spacing + 0.5f * (layout.pillarsPerSide - 1);
+	}
+
+	float CellIndex(const ColonnadeLayout& layout, float cells)
+	{
+		return clamp(std::floor(cells + 0.5f), 0.0f, float(layout.pillarsPerSide - 1));
+	}
+
+	// Along one axis: the cell a coordinate is in and its neighbour on the coordinate's side, and how far
+	// the coordinate is from the inner edges of those two cells. The outer cells have nothing beyond them.
+	struct Span
+	{
+		uint32_t	first;
+		uint32_t	last;
+		float		edge;
+	};
+
+	Span BlockSpan(const ColonnadeLayout& layout, float coordinate)
+	{
+		float cells = CellCoordinate(layout, coordinate);
+		float cell = CellIndex(layout, cells);
+		float neighbour = cells >= cell ? cell + 1.0f : cell - 1.0f;
+		float first = cell, last = cell;
+		if (neighbour >= 0.0f && neighbour <= float(layout.pillarsPerSide - 1))
+		{
+			first = std::min(cell, neighbour);
+			last = std::max(cell, neighbour);
+		}
+
+		Span span = { static_cast<uint32_t>(first), static_cast<uint32_t>(last), Far };
+		if (first > 0.0f)
+			span.edge = std::min(span.edge, (cells - (first - 0.5f)) * layout.spacing);
+		if (last < float(layout.pillarsPerSide - 1))
+			span.edge = std::min(span.edge, (last + 0.5f - cells) * layout.spacing);
+		return span;
+	}
+
+	// The pillars of a 2x2 block. A ray takes several steps in one block, so their centres are only
+	// hashed again when it moves to another.
+	struct Block
+	{
+		bool		valid;
+		Span		x;
+		Span		z;
+		float2		centres[2][2];	// [j - z.first][i - x.first]
+	};
+
+	float BlockPillars(const ColonnadeLayout& layout, const float3& p, Block& block)
+	{
+		Span x = BlockSpan(layout, p.x);
+		Span z = BlockSpan(layout, p.z);
+		if (!block.valid || x.first != block.x.first || x.last != block.x.last || z.first != block.z.first ||
+			z.last != block.z.last)
+		{
+			for (uint32_t j = z.first; j <= z.last; j++)
+				for (uint32_t i = x.first; i <= x.last; i++)
+					block.centres[j - z.first][i - x.first] = Colonnade::PillarCentre(layout, i, j);
+			block.valid = true;
+		}
+		block.x = x;
+		block.z = z;
+
+		float Fun = std::min(x.edge, z.edge);
+		for (uint32_t j = 0; j <= z.last - z.first; j++)
+			for (uint32_t i = 0; i <= x.last - x.first; i++)
+				Fun = std::min(Fun, Cylinder(p, block.centres[j][i], layout.radius));
+
+		return Fun;
+	}
+
+	// Distance along direction to the boundary of the cell a coordinate is in, along one axis.
+	float AxisExit(const ColonnadeLayout& layout, float coordinate, float direction)
+	{
+		float cell = CellIndex(layout, CellCoordinate(layout, coordinate));
+		float centre = (cell - 0.5f * (layout.pillarsPerSide - 1)) * layout.spacing;
+
+		if (direction > 0.0f && cell < float(layout.pillarsPerSide - 1))
+			return std::max(centre + 0.5f * layout.spacing - coordinate, 0.0f) / direction;
+		if (direction < 0.0f && cell > 0.0f)
+			return std::max(coordinate - (centre - 0.5f * layout.spacing), 0.0f) / -direction;
+		return Far;
+	}
+
+	bool IntersectHall(const ColonnadeLayout& layout, const float3& origin, const float3& direction,
+		float& timeIn, float& timeOut)
+	{
+		float3 OMIN = (-layout.hallSize - origin) / direction;
+		float3 OMAX = (layout.hallSize - origin) / direction;
+		float3 MAX = max(OMAX, OMIN);
+		float3 MIN = min(OMAX, OMIN);
+		timeOut = std::min(MAX.x, std::min(MAX.y, MAX.z));
+		timeIn = std::max(std::max(MIN.x, 0.0f), std::max(MIN.y, MIN.z));
+
+		return timeOut > timeIn;
+	}
+
+	FusedRaymarch::Hit SphereTrace(const ColonnadeLayout& layout, const float3& origin, const float3& direction,
+		uint32_t& steps)
+	{
+		FusedRaymarch::Hit hit = { FusedRaymarch::Material::None, -1.0f };
+		steps = 0;
+
+		float start, final;
+		if (!IntersectHall(layout, origin, direction, start, final))
+			return hit;
+
+		Block block = {};
+		float t = start;
+		for (uint32_t i = 0; i < Colonnade::MaxSteps && t < final; i++)
+		{
+			float3 Position = origin + t * direction;
+			float distance = BlockPillars(layout, Position, block);
+			steps++;
+			if (distance < Colonnade::HitEpsilon)
+			{
+				hit.material = FusedRaymarch::Material::Pillar;
+				hit.t = t;
+				return hit;
+			}
+
+			t += std::min(distance, Colonnade::CellExit(layout, Position, direction) + Colonnade::CellEpsilon);
+		}
+
+		// Out of steps or past the pillars: the hall's walls, floor or ceiling.
+		hit.material = FusedRaymarch::Material::Room;
+		hit.t = final;
+		return hit;
+	}
+}
+
+ColonnadeLayout Colonnade::MakeLayout(uint32_t pillarsPerSide)
+{
+	ColonnadeLayout layout;
+	layout.pillarsPerSide = std::max(pillarsPerSide, 1u);
+	layout.spacing = Spacing;
+	layout.radius = Radius;
+	layout.jitter = JitterFraction * Spacing;
+
+	float half = std::max(0.5f * layout.pillarsPerSide * Spacing, RoomSize);
+	layout.hallSize = float3(half, RoomSize, half);
+	return layout;
+}
+
+float2 Colonnade::PillarCentre(const ColonnadeLayout& layout, uint32_t i, uint32_t j)
+{
+	uint32_t h = Hash(Hash(i) + j);
+	float offsetX = (float(h & 0xffffu) / 65535.0f * 2.0f - 1.0f) * layout.jitter;
+	float offsetZ = (float(h >> 16) / 65535.0f * 2.0f - 1.0f) * layout.jitter;
+
+	float half = 0.5f * (layout.pillarsPerSide - 1);
+	return float2((i - half) * layout.spacing + offsetX, (j - half) * layout.spacing + offsetZ);
+}
+
+float Colonnade::Pillars(const ColonnadeLayout& layout, const float3& p)
+{
+	Block block = {};
+	return BlockPillars(layout, p, block);
+}
+
+float Colonnade::CellExit(const ColonnadeLayout& layout, const float3& p, const float3& direction)
+{
+	return std::min(AxisExit(layout, p.x, direction.x), AxisExit(layout, p.z, direction.z));
+}
+
+FusedRaymarch::Hit Colonnade::March(const ColonnadeLayout& layout, const float3& origin,
+	const float3& direction, uint32_t& steps)
+{
+	return SphereTrace(layout, origin, direction, steps);
+}
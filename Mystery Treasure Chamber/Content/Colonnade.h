@@ -0,0 +1,58 @@
+﻿#pragma once
+
+#include <cstdint>
+
+#include "FusedRaymarch.h"
+
+namespace Mystery_Treasure_Chamber
+{
+	// A square grid of pillars in a hall sized to fit it.
+	struct ColonnadeLayout
+	{
+		uint32_t		pillarsPerSide;
+		float			spacing;	// Between neighbouring pillars.
+		float			radius;
+		float			jitter;		// Largest offset of a pillar from the centre of its cell, along x and z.
+		Sdf::float3		hallSize;	// Half extents of the hall, centred on the origin like the room.
+	};
+
+	// CPU reference of ColonnadePixelShader.hlsl. The pillars are one cylinder repeated over grid
+	// cells, so the field costs the same for any number of them: only the cell a point is in and its
+	// neighbours on the point's side are evaluated. The hall is intersected as a box, and the pillars
+	// are sphere traced with each step clamped to the boundary of the current cell.
+	//
+	// A pixel only costs the same once the grid fills the view, beyond a few hundred pillars. A
+	// smaller hall has rays crossing fewer cells, and outside the grid checking fewer pillars.
+	namespace Colonnade
+	{
+		// Sphere tracing stops after this many steps, counting the ray as reaching the hall.
+		const uint32_t MaxSteps = 128;
+
+		// Distance below which a step counts as a hit.
+		const float HitEpsilon = 0.001f;
+
+		// Added to a step cut at a cell boundary, so the next step starts in the next cell.
+		const float CellEpsilon = 0.001f;
+
+		// Same spacing and radius as the four pillars of the room. The hall is at least as big as the
+		// room and leaves half a spacing beyond the outer pillars.
+		ColonnadeLayout MakeLayout(uint32_t pillarsPerSide);
+
+		// Where the pillar of cell (i, j) stands. Pillars are moved off their cell centres by a hash
+		// of the cell, but always stay inside the cell.
+		Sdf::float2 PillarCentre(const ColonnadeLayout& layout, uint32_t i, uint32_t j);
+
+		// Distance to the nearest pillar. A moved pillar can be nearer than the one of the cell p is
+		// in, so the pillars of the neighbour cells on p's side are checked too. Every other pillar is
+		// further than the edge of that 2x2 block, so the distance is clamped to the edge and never
+		// overestimates.
+		float Pillars(const ColonnadeLayout& layout, const Sdf::float3& p);
+
+		// Distance along direction to where p leaves its cell. The outer cells reach the walls.
+		float CellExit(const ColonnadeLayout& layout, const Sdf::float3& p, const Sdf::float3& direction);
+
+		// What the ray hits, the pillars or the hall, and how far away. steps counts field evaluations.
+		FusedRaymarch::Hit March(const ColonnadeLayout& layout, const Sdf::float3& origin,
+			const Sdf::float3& direction, uint32_t& steps);
+	}
+}
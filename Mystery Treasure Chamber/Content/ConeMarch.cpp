@@ -0,0 +1,117 @@
+﻿#include "ConeMarch.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	const int Intervals = 200;
+}
+
+uint32_t ConeMarch::TileCount(uint32_t pixels)
+{
+	return (pixels + TileSize - 1) / TileSize;
+}
+
+float3 ConeMarch::TileAxis(const RaymarchCamera& camera, uint32_t tileX, uint32_t tileY)
+{
+	return camera.Ray((tileX + 0.5f) * TileSize, (tileY + 0.5f) * TileSize);
+}
+
+float ConeMarch::TileSpread(const RaymarchCamera& camera, uint32_t tileX, uint32_t tileY)
+{
+	// The rays a tile covers meet the canvas in a rectangle, so the widest one goes through a corner.
+	float3 axis = TileAxis(camera, tileX, tileY);
+	float spread = 0.0f;
+	for (uint32_t corner = 0; corner < 4; corner++)
+	{
+		float x = static_cast<float>((tileX + (corner & 1)) * TileSize);
+		float y = static_cast<float>((tileY + (corner >> 1)) * TileSize);
+		spread = std::max(spread, length(camera.Ray(x, y) - axis));
+	}
+	return spread;
+}
+
+float ConeMarch::MarchCone(FusedRaymarch::Field field, const float3& origin, const float3& axis,
+	float spread, float start, float final)
+{
+	float t = std::max(start, MinimumStart);
+	for (uint32_t i = 0; i < MaxSteps && t < final; i++)
+	{
+		float clear = field(origin + t * axis) - t * spread;
+		if (clear <= 0.0f)
+			break;
+
+		t += clear / (1.0f + spread);
+	}
+
+	return std::max(start, std::min(t, final) - Margin);
+}
+
+void ConeMarch::BuildTileBounds(const RaymarchCamera& camera, std::vector<float>& bounds)
+{
+	uint32_t tilesX = TileCount(static_cast<uint32_t>(camera.width));
+	uint32_t tilesY = TileCount(static_cast<uint32_t>(camera.height));
+	bounds.assign(tilesX * tilesY, 0.0f);
+
+	for (uint32_t tileY = 0; tileY < tilesY; tileY++)
+	{
+		for (uint32_t tileX = 0; tileX < tilesX; tileX++)
+		{
+			float3 axis = TileAxis(camera, tileX, tileY);
+			float start, final;
+			if (!FusedRaymarch::IntersectBox(camera.eye, axis, start, final))
+				continue;
+
+			bounds[tileY * tilesX + tileX] = MarchCone(FusedRaymarch::Scene, camera.eye, axis,
+				TileSpread(camera, tileX, tileY), start, final);
+		}
+	}
+}
+
+int ConeMarch::FirstInterval(float start, float final, float bound)
+{
+	float step = (final - start) / float(Intervals);
+	float first = std::floor((bound - start) / step);
+	return static_cast<int>(std::min(std::max(first, 0.0f), float(Intervals)));
+}
+
+bool ConeMarch::MarchFrom(FusedRaymarch::Field field, const float3& origin, const float3& direction,
+	float bound, float& t, uint32_t& steps)
+{
+	steps = 0;
+	float start, final;
+	if (!FusedRaymarch::IntersectBox(origin, direction, start, final))
+		return false;
+
+	float step = (final - start) / float(Intervals);
+
+	// Each sample is placed from start directly rather than by adding up steps, so it lands on
+	// exactly the same point whether the march began at start or at the bound. That matters for
+	// rays that only graze a surface.
+	int first = FirstInterval(start, final, bound);
+	float time = start + first * step;
+	float3 Position = origin + time * direction;
+
+	float right, left = field(Position);
+	steps++;
+
+	for (int i = first; i < Intervals; i++)
+	{
+		time = start + (i + 1) * step;
+		Position = origin + time * direction;
+		right = field(Position);
+		steps++;
+		if (left * right < 0.0f)
+		{
+			t = time + right * step / (left - right);
+			return true;
+		}
+		left = right;
+	}
+
+	return false;
+}
@@ -0,0 +1,54 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "FusedRaymarch.h"
+#include "TemporalReprojection.h"
+
+namespace Mystery_Treasure_Chamber
+{
+	// CPU reference of ConeMarchComputeShader.hlsl. One cone per tile of pixels, wide enough to hold
+	// every pixel ray of the tile, is marched through the scene at low resolution. The distance it
+	// gets to before touching a surface is clear for all of those rays, so the room and pillar passes
+	// start their fixed step march there instead of at the box entry.
+	namespace ConeMarch
+	{
+		// Pixels per side of a tile, and threads per side of a compute shader group.
+		const uint32_t TileSize = 8;
+
+		// Cone steps before giving up and keeping the distance reached so far.
+		const uint32_t MaxSteps = 48;
+
+		// Where the cones start. The field is 0 at the eye, which sits on the room's wall, so a cone
+		// starting there could never take a step. Nothing is ever this close to the eye.
+		const float MinimumStart = 0.01f;
+
+		// Taken off every bound to cover rounding in the march.
+		const float Margin = 0.01f;
+
+		uint32_t TileCount(uint32_t pixels);
+
+		// Direction through the centre of tile (tileX, tileY), and the largest chord between it and a
+		// ray through the tile's corners, 2 sin(half angle) of the cone.
+		Sdf::float3 TileAxis(const RaymarchCamera& camera, uint32_t tileX, uint32_t tileY);
+		float TileSpread(const RaymarchCamera& camera, uint32_t tileX, uint32_t tileY);
+
+		// Distance along axis up to which the cone holds no surface of field, at least start. A point
+		// t + dt along any ray of the cone is within t * spread + dt of the axis point at t, so the
+		// cone is clear up to t + (d - t * spread) / (1 + spread) where the field is d.
+		float MarchCone(FusedRaymarch::Field field, const Sdf::float3& origin, const Sdf::float3& axis,
+			float spread, float start, float final);
+
+		// One bound per tile, row by row, for the whole scene so both passes can use it.
+		void BuildTileBounds(const RaymarchCamera& camera, std::vector<float>& bounds);
+
+		// The interval RayMarchingInsideCube resumes at for a bound. It stays on the grid of the full
+		// march, so the hit is the same one.
+		int FirstInterval(float start, float final, float bound);
+
+		// RayMarchingInsideCube evaluating the field from bound on. steps counts field evaluations.
+		bool MarchFrom(FusedRaymarch::Field field, const Sdf::float3& origin, const Sdf::float3& direction,
+			float bound, float& t, uint32_t& steps);
+	}
+}
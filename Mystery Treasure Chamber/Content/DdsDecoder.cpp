@@ -0,0 +1,362 @@
+﻿#include "DdsDecoder.h"
+
+#include <cmath>
+#include <cstring>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	const uint32_t Magic = 0x20534444;	// "DDS "
+	const uint32_t HeaderSize = 124;
+	const uint32_t Dx10HeaderSize = 20;
+
+	// Pixel format flags of the legacy header.
+	const uint32_t FourCcFlag = 0x4;
+	const uint32_t RgbFlag = 0x40;
+	const uint32_t LuminanceFlag = 0x20000;
+
+	// The header's other flags that matter.
+	const uint32_t VolumeFlag = 0x800000;
+	const uint32_t CubemapCaps = 0x200;
+
+	uint32_t FourCc(char a, char b, char c, char d)
+	{
+		return uint32_t(uint8_t(a)) | (uint32_t(uint8_t(b)) << 8) | (uint32_t(uint8_t(c)) << 16) | (uint32_t(uint8_t(d)) << 24);
+	}
+
+	// The DXGI formats that can be decoded.
+	enum Format
+	{
+		Unknown = 0,
+		R16G16Unorm = 35,
+		R32Float = 41,
+		R8G8Unorm = 49,
+		R16Unorm = 56,
+		R8Unorm = 61,
+		R8G8B8A8Unorm = 28,
+		R8G8B8A8UnormSrgb = 29,
+		Bc1Unorm = 71,
+		Bc1UnormSrgb = 72,
+		Bc3Unorm = 77,
+		Bc3UnormSrgb = 78,
+		Bc4Unorm = 80,
+		Bc5Unorm = 83,
+		B8G8R8A8Unorm = 87,
+		B8G8R8X8Unorm = 88,
+		B8G8R8A8UnormSrgb = 91,
+	};
+
+	uint32_t Read32(const uint8_t* p)
+	{
+		return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+	}
+
+	// Same choices as GetDXGIFormat in DDSTextureLoader.
+	Format LegacyFormat(uint32_t flags, uint32_t fourCc, uint32_t bits, uint32_t r, uint32_t g, uint32_t b, uint32_t a)
+	{
+		if (flags & RgbFlag)
+		{
+			if (bits == 32)
+			{
+				if (r == 0x000000ff && g == 0x0000ff00 && b == 0x00ff0000 && a == 0xff000000)
+					return R8G8B8A8Unorm;
+				if (r == 0x00ff0000 && g == 0x0000ff00 && b == 0x000000ff && a == 0xff000000)
+					return B8G8R8A8Unorm;
+				if (r == 0x00ff0000 && g == 0x0000ff00 && b == 0x000000ff && a == 0)
+					return B8G8R8X8Unorm;
+				if (r == 0x0000ffff && g == 0xffff0000 && b == 0 && a == 0)
+					return R16G16Unorm;
+				if (r == 0xffffffff && g == 0 && b == 0 && a == 0)
+					return R32Float;
+			}
+		}
+		else if (flags & LuminanceFlag)
+		{
+			if (bits == 8 && r == 0xff && g == 0 && b == 0 && a == 0)
+				return R8Unorm;
+			if (bits == 16 && r == 0xffff && g == 0 && b == 0 && a == 0)
+				return R16Unorm;
+			if (bits == 16 && r == 0xff && g == 0 && b == 0 && a == 0xff00)
+				return R8G8Unorm;
+		}
+		else if (flags & FourCcFlag)
+		{
+			if (fourCc == FourCc('D', 'X', 'T', '1'))
+				return Bc1Unorm;
+			if (fourCc == FourCc('D', 'X', 'T', '5') || fourCc == FourCc('D', 'X', 'T', '4'))
+				return Bc3Unorm;
+			if (fourCc == FourCc('A', 'T', 'I', '1') || fourCc == FourCc('B', 'C', '4', 'U'))
+				return Bc4Unorm;
+			if (fourCc == FourCc('A', 'T', 'I', '2') || fourCc == FourCc('B', 'C', '5', 'U'))
+				return Bc5Unorm;
+			if (fourCc == 114)	// D3DFMT_R32F
+				return R32Float;
+		}
+		return Unknown;
+	}
+
+	bool IsBlockCompressed(Format format)
+	{
+		return format == Bc1Unorm || format == Bc1UnormSrgb || format == Bc3Unorm || format == Bc3UnormSrgb ||
+			format == Bc4Unorm || format == Bc5Unorm;
+	}
+
+	uint32_t BlockBytes(Format format)
+	{
+		return format == Bc1Unorm || format == Bc1UnormSrgb || format == Bc4Unorm ? 8 : 16;
+	}
+
+	uint32_t TexelBytes(Format format)
+	{
+		switch (format)
+		{
+		case R8Unorm:		return 1;
+		case R8G8Unorm:
+		case R16Unorm:		return 2;
+		default:			return 4;
+		}
+	}
+
+	bool IsSrgb(Format format)
+	{
+		return format == R8G8B8A8UnormSrgb || format == B8G8R8A8UnormSrgb || format == Bc1UnormSrgb || format == Bc3UnormSrgb;
+	}
+
+	float Linearize(float value)
+	{
+		return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+	}
+
+	float4 DecodeTexel(Format format, const uint8_t* p)
+	{
+		switch (format)
+		{
+		case R8Unorm:
+			return float4(p[0] / 255.0f, 0.0f, 0.0f, 1.0f);
+		case R8G8Unorm:
+			return float4(p[0] / 255.0f, p[1] / 255.0f, 0.0f, 1.0f);
+		case R16Unorm:
+			return float4((p[0] | (p[1] << 8)) / 65535.0f, 0.0f, 0.0f, 1.0f);
+		case R16G16Unorm:
+			return float4((p[0] | (p[1] << 8)) / 65535.0f, (p[2] | (p[3] << 8)) / 65535.0f, 0.0f, 1.0f);
+		case R32Float:
+		{
+			float value;
+			std::memcpy(&value, p, sizeof(value));
+			return float4(value, 0.0f, 0.0f, 1.0f);
+		}
+		case B8G8R8A8Unorm:
+		case B8G8R8A8UnormSrgb:
+			return float4(p[2] / 255.0f, p[1] / 255.0f, p[0] / 255.0f, p[3] / 255.0f);
+		case B8G8R8X8Unorm:
+			return float4(p[2] / 255.0f, p[1] / 255.0f, p[0] / 255.0f, 1.0f);
+		default:
+			return float4(p[0] / 255.0f, p[1] / 255.0f, p[2] / 255.0f, p[3] / 255.0f);
+		}
+	}
+
+	// The 16 values of a BC4 block, which is also the alpha of BC3 and each channel of BC5.
+	void DecodeBc4(const uint8_t* block, float values[16])
+	{
+		float palette[8];
+		float e0 = block[0] / 255.0f, e1 = block[1] / 255.0f;
+		palette[0] = e0;
+		palette[1] = e1;
+		if (block[0] > block[1])
+		{
+			for (int i = 1; i < 7; i++)
+			{
+				palette[i + 1] = ((7 - i) * e0 + i * e1) / 7.0f;
+			}
+		}
+		else
+		{
+			for (int i = 1; i < 5; i++)
+			{
+				palette[i + 1] = ((5 - i) * e0 + i * e1) / 5.0f;
+			}
+			palette[6] = 0.0f;
+			palette[7] = 1.0f;
+		}
+
+		uint64_t indices = 0;
+		for (int i = 0; i < 6; i++)
+		{
+			indices |= uint64_t(block[2 + i]) << (8 * i);
+		}
+		for (int i = 0; i < 16; i++)
+		{
+			values[i] = palette[(indices >> (3 * i)) & 7];
+		}
+	}
+
+	float3 Rgb565(uint32_t color)
+	{
+		return float3(((color >> 11) & 31) / 31.0f, ((color >> 5) & 63) / 63.0f, (color & 31) / 31.0f);
+	}
+
+	// The 16 texels of a BC1 colour block. BC3 always uses the four colour mode.
+	void DecodeBc1(const uint8_t* block, bool fourColorsOnly, float4 texels[16])
+	{
+		uint32_t c0 = block[0] | (block[1] << 8), c1 = block[2] | (block[3] << 8);
+		float3 e0 = Rgb565(c0), e1 = Rgb565(c1);
+
+		float4 palette[4];
+		palette[0] = float4(e0, 1.0f);
+		palette[1] = float4(e1, 1.0f);
+		if (c0 > c1 || fourColorsOnly)
+		{
+			palette[2] = float4((2.0f * e0 + e1) / 3.0f, 1.0f);
+			palette[3] = float4((e0 + 2.0f * e1) / 3.0f, 1.0f);
+		}
+		else
+		{
+			palette[2] = float4((e0 + e1) * 0.5f, 1.0f);
+			palette[3] = float4(0.0f, 0.0f, 0.0f, 0.0f);
+		}
+
+		uint32_t indices = Read32(block + 4);
+		for (int i = 0; i < 16; i++)
+		{
+			texels[i] = palette[(indices >> (2 * i)) & 3];
+		}
+	}
+
+	void DecodeBlock(Format format, const uint8_t* block, float4 texels[16])
+	{
+		float values[16], greens[16];
+		switch (format)
+		{
+		case Bc1Unorm:
+		case Bc1UnormSrgb:
+			DecodeBc1(block, false, texels);
+			break;
+		case Bc3Unorm:
+		case Bc3UnormSrgb:
+			DecodeBc1(block + 8, true, texels);
+			DecodeBc4(block, values);
+			for (int i = 0; i < 16; i++)
+			{
+				texels[i].w = values[i];
+			}
+			break;
+		case Bc4Unorm:
+			DecodeBc4(block, values);
+			for (int i = 0; i < 16; i++)
+			{
+				texels[i] = float4(values[i], 0.0f, 0.0f, 1.0f);
+			}
+			break;
+		default:
+			DecodeBc4(block, values);
+			DecodeBc4(block + 8, greens);
+			for (int i = 0; i < 16; i++)
+			{
+				texels[i] = float4(values[i], greens[i], 0.0f, 1.0f);
+			}
+			break;
+		}
+	}
+}
+
+bool DdsDecoder::Decode(const uint8_t* data, size_t size, DdsImage& image)
+{
+	if (size < 4 + HeaderSize || Read32(data) != Magic || Read32(data + 4) != HeaderSize)
+		return false;
+
+	const uint8_t* header = data + 4;
+	uint32_t headerFlags = Read32(header + 4);
+	uint32_t height = Read32(header + 8);
+	uint32_t width = Read32(header + 12);
+	uint32_t pixelFlags = Read32(header + 76);
+	uint32_t fourCc = Read32(header + 80);
+	uint32_t caps2 = Read32(header + 108);
+	if (width == 0 || height == 0 || width > 16384 || height > 16384 || (headerFlags & VolumeFlag) || (caps2 & CubemapCaps))
+		return false;
+
+	size_t offset = 4 + HeaderSize;
+	Format format;
+	if ((pixelFlags & FourCcFlag) && fourCc == FourCc('D', 'X', '1', '0'))
+	{
+		if (size < offset + Dx10HeaderSize)
+			return false;
+
+		const uint8_t* dx10 = data + offset;
+		format = static_cast<Format>(Read32(dx10));
+		uint32_t dimension = Read32(dx10 + 4), arraySize = Read32(dx10 + 12);
+		if (dimension != 3 || arraySize > 1 || (Read32(dx10 + 8) & 0x4))
+			return false;
+
+		switch (format)
+		{
+		case R16G16Unorm: case R32Float: case R8G8Unorm: case R16Unorm: case R8Unorm:
+		case R8G8B8A8Unorm: case R8G8B8A8UnormSrgb: case Bc1Unorm: case Bc1UnormSrgb: case Bc3Unorm:
+		case Bc3UnormSrgb: case Bc4Unorm: case Bc5Unorm: case B8G8R8A8Unorm: case B8G8R8X8Unorm: case B8G8R8A8UnormSrgb:
+			break;
+		default:
+			return false;
+		}
+		offset += Dx10HeaderSize;
+	}
+	else
+	{
+		format = LegacyFormat(pixelFlags, fourCc, Read32(header + 84), Read32(header + 88), Read32(header + 92),
+			Read32(header + 96), Read32(header + 100));
+		if (format == Unknown)
+			return false;
+	}
+
+	std::vector<float4> texels(size_t(width) * height);
+	if (IsBlockCompressed(format))
+	{
+		uint32_t blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+		if (size < offset + size_t(blocksX) * blocksY * BlockBytes(format))
+			return false;
+
+		for (uint32_t by = 0; by < blocksY; by++)
+		{
+			for (uint32_t bx = 0; bx < blocksX; bx++)
+			{
+				float4 block[16];
+				DecodeBlock(format, data + offset + (size_t(by) * blocksX + bx) * BlockBytes(format), block);
+
+				// Blocks past the right or bottom edge of a small mip are only partly used.
+				for (uint32_t i = 0; i < 16; i++)
+				{
+					uint32_t x = bx * 4 + (i & 3), y = by * 4 + (i >> 2);
+					if (x < width && y < height)
+						texels[size_t(y) * width + x] = block[i];
+				}
+			}
+		}
+	}
+	else
+	{
+		size_t pitch = size_t(width) * TexelBytes(format);
+		if (size < offset + pitch * height)
+			return false;
+
+		for (uint32_t y = 0; y < height; y++)
+		{
+			for (uint32_t x = 0; x < width; x++)
+			{
+				texels[size_t(y) * width + x] = DecodeTexel(format, data + offset + y * pitch + x * TexelBytes(format));
+			}
+		}
+	}
+
+	if (IsSrgb(format))
+	{
+		for (float4& texel : texels)
+		{
+			texel = float4(Linearize(texel.x), Linearize(texel.y), Linearize(texel.z), texel.w);
+		}
+	}
+
+	image.width = width;
+	image.height = height;
+	image.texels.swap(texels);
+	return true;
+}
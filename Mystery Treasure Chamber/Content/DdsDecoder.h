@@ -0,0 +1,28 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "SdfMath.h"
+
+namespace Mystery_Treasure_Chamber
+{
+	// The top mip of a 2D texture, row after row from the top, with each texel as the shaders read it.
+	struct DdsImage
+	{
+		uint32_t				width;
+		uint32_t				height;
+		std::vector<Sdf::float4>	texels;
+	};
+
+	// Portable reader of the DDS files in Assets/Textures, for the bakers that need the textures on
+	// the CPU. Formats map to DXGI the way DDSTextureLoader maps them, and texels come out the way a
+	// shader samples them: channels a format lacks are 0 and alpha is 1, sRGB is linearized.
+	// Uncompressed 8, 16 and 32 bit formats, BC1, BC3, BC4 and BC5 are read, in the legacy header or
+	// the DX10 one. Arrays, cubes, volumes and other formats are refused.
+	namespace DdsDecoder
+	{
+		bool Decode(const uint8_t* data, size_t size, DdsImage& image);
+	}
+}
@@ -0,0 +1,139 @@
+﻿#include "DeferredShading.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	typedef FusedRaymarch::Material Material;
+
+	uint32_t Quantize(float value, uint32_t maximum)
+	{
+		return static_cast<uint32_t>(std::lround(saturate(value) * maximum));
+	}
+
+	float4 Saturate(const float4& v)
+	{
+		return float4(saturate(v.x), saturate(v.y), saturate(v.z), saturate(v.w));
+	}
+
+	float4 Phong(const float3& n, const float3& l, const float3& v, float shininess, const float4& diffuseColor, const float4& specularColor)
+	{
+		float NdotL = dot(n, l);
+		float diff = saturate(NdotL);
+		float3 r = reflect(l, n);
+		float spec = NdotL > 0.0f ? std::pow(saturate(dot(v, r)), shininess) : 0.0f;
+		return diff * diffuseColor + spec * specularColor;
+	}
+
+	// Same as ClusterAttenuation in LightClusters.hlsli.
+	float Attenuation(const ClusterLight& light, const float3& Position)
+	{
+		float3 d = (light.position - Position) / light.radius;
+		float falloff = saturate(1.0f - dot(d, d));
+		return lerp(1.0f, falloff * falloff, light.falloff);
+	}
+}
+
+DeferredShading::MemoryUsage DeferredShading::Memory(uint32_t width, uint32_t height)
+{
+	uint64_t pixels = static_cast<uint64_t>(width) * height;
+
+	MemoryUsage usage;
+	usage.width = width;
+	usage.height = height;
+	usage.albedoBytes = pixels * AlbedoBytes;
+	usage.normalBytes = pixels * NormalBytes;
+	usage.depthBytes = 2 * pixels * DepthBytes;
+	usage.totalBytes = usage.albedoBytes + usage.normalBytes + usage.depthBytes;
+	usage.extraBytes = usage.albedoBytes + usage.normalBytes;
+	return usage;
+}
+
+uint32_t DeferredShading::PackAlbedo(const float3& albedo, Material material)
+{
+	return Quantize(albedo.x, 255) | Quantize(albedo.y, 255) << 8 | Quantize(albedo.z, 255) << 16 |
+		static_cast<uint32_t>(material) << 24;
+}
+
+uint32_t DeferredShading::PackNormal(const float3& normal)
+{
+	return Quantize(0.5f * normal.x + 0.5f, 1023) | Quantize(0.5f * normal.y + 0.5f, 1023) << 10 |
+		Quantize(0.5f * normal.z + 0.5f, 1023) << 20;
+}
+
+float3 DeferredShading::UnpackAlbedo(uint32_t albedo)
+{
+	return float3(float(albedo & 0xFF), float(albedo >> 8 & 0xFF), float(albedo >> 16 & 0xFF)) / 255.0f;
+}
+
+FusedRaymarch::Material DeferredShading::UnpackMaterial(uint32_t albedo)
+{
+	return static_cast<Material>(albedo >> 24);
+}
+
+float3 DeferredShading::UnpackNormal(uint32_t normal)
+{
+	float3 n = float3(float(normal & 0x3FF), float(normal >> 10 & 0x3FF), float(normal >> 20 & 0x3FF)) * (2.0f / 1023.0f) - float3(1.0f);
+	return normalize(n);
+}
+
+float4 DeferredShading::Shade(const Lighting& lighting, Material material, const float3& albedo, const float3& normal,
+	const float3& Position)
+{
+	// The ray marching shaders skip the lights that are in the lightmap and add it instead, and
+	// take the ray direction for the view where the floor and model shaders take the way to the eye.
+	bool raymarched = material == Material::Room || material == Material::Pillar;
+	float3 viewDir = raymarched ? normalize(Position - lighting.eye) : normalize(lighting.eye - Position);
+
+	// The room tints a green highlight with its texture, everything else has a white one.
+	float4 diffuse(albedo, 1.0f);
+	float4 specular = material == Material::Room ? float4(0.0f, albedo.y, 0.0f, 1.0f) : float4(1.0f, 1.0f, 1.0f, 1.0f);
+
+	float4 output;
+	const ClusterRange& range = (*lighting.ranges)[LightClusters::ClusterOf(*lighting.frustum, Position)];
+	for (uint32_t i = 0; i < std::min(range.count, lighting.lightsPerCluster); i++)
+	{
+		uint32_t index = (*lighting.indices)[range.offset + i];
+		if (raymarched && index < lighting.bakedLights)
+			continue;
+
+		const ClusterLight& light = (*lighting.lights)[index];
+		float3 lightDir = normalize(light.position - Position);
+		output += float4(light.color, 1.0f) * Attenuation(light, Position) * Phong(normal, lightDir, viewDir, 40.0f, diffuse, specular);
+	}
+
+	// The floor's normal map only bends the lighting, its occlusion is looked up above the floor.
+	if (lighting.occlusion)
+	{
+		float3 up = material == Material::Floor ? float3(0.0f, 1.0f, 0.0f) : normal;
+		float voxel = 2.0f * AmbientOcclusion::BoxSize / lighting.occlusion->resolution;
+		output = output * AmbientOcclusion::Sample(*lighting.occlusion, Position + voxel * up);
+	}
+
+	if (raymarched && lighting.bakedLights > 0 && lighting.lightmap)
+	{
+		float4 baked = LightmapBaker::Sample(*lighting.lightmap, Position);
+		output += float4(albedo * float3(baked.x, baked.y, baked.z), 1.0f);
+	}
+
+	float scale = material == Material::Floor ? 0.5f : 1.0f;
+	return Saturate(float4(lighting.lightColor, 1.0f) * output * scale);
+}
+
+void DeferredShading::Resolve(const Lighting& lighting, const std::vector<Texel>& gbuffer, std::vector<float4>& colors)
+{
+	colors.assign(gbuffer.size(), float4());
+	for (size_t i = 0; i < gbuffer.size(); i++)
+	{
+		const Texel& texel = gbuffer[i];
+		Material material = UnpackMaterial(texel.albedo);
+		if (material == Material::None)
+			continue;
+
+		colors[i] = Shade(lighting, material, UnpackAlbedo(texel.albedo), UnpackNormal(texel.normal), texel.position);
+	}
+}
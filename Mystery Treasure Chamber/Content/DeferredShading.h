@@ -0,0 +1,80 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "AmbientOcclusion.h"
+#include "FusedRaymarch.h"
+#include "LightClusters.h"
+#include "LightmapBaker.h"
+#include "SdfMath.h"
+#include "TemporalReprojection.h"
+
+namespace Mystery_Treasure_Chamber
+{
+	// CPU reference of the deferred mode. The floor, the models and the fused ray marching pass
+	// write what they see into a G-buffer instead of lighting it, and DeferredPixelShader.hlsl then
+	// lights every pixel once with what the forward shader of its material would have done.
+	namespace DeferredShading
+	{
+		// Bytes per pixel of the G-buffer targets.
+		const uint32_t AlbedoBytes = 4;		// DXGI_FORMAT_R8G8B8A8_UNORM, the material in alpha.
+		const uint32_t NormalBytes = 4;		// DXGI_FORMAT_R10G10B10A2_UNORM.
+		const uint32_t DepthBytes = 4;		// The depth buffer, and the copy the lighting pass reads.
+
+		// Memory the G-buffer takes up at one resolution. The depth buffer is there in every mode, and
+		// the depth tested mode already has the copy, so only the albedo and the normals are extra.
+		struct MemoryUsage
+		{
+			uint32_t	width;
+			uint32_t	height;
+			uint64_t	albedoBytes;
+			uint64_t	normalBytes;
+			uint64_t	depthBytes;		// Depth buffer and its copy.
+			uint64_t	totalBytes;
+			uint64_t	extraBytes;		// What the deferred mode adds to the depth tested one.
+		};
+
+		MemoryUsage Memory(uint32_t width, uint32_t height);
+
+		// One pixel of the G-buffer as the targets hold it. The shader rebuilds the position from the
+		// depth, the reference keeps it.
+		struct Texel
+		{
+			uint32_t		albedo;
+			uint32_t		normal;
+			Sdf::float3		position;
+		};
+
+		// Same rounding as the UNORM targets, see Deferred.hlsli.
+		uint32_t PackAlbedo(const Sdf::float3& albedo, FusedRaymarch::Material material);
+		uint32_t PackNormal(const Sdf::float3& normal);
+		Sdf::float3 UnpackAlbedo(uint32_t albedo);
+		FusedRaymarch::Material UnpackMaterial(uint32_t albedo);
+		Sdf::float3 UnpackNormal(uint32_t normal);
+
+		// Everything the lighting pass reads besides the G-buffer. lightmap and occlusion may be null,
+		// which is the same as the lightmap being off and the open voxel being bound.
+		struct Lighting
+		{
+			Sdf::float3						eye;
+			Sdf::float3						lightColor;
+			const ClusterFrustum*			frustum;
+			const std::vector<ClusterLight>*	lights;
+			const std::vector<ClusterRange>*	ranges;
+			const std::vector<uint32_t>*		indices;
+			uint32_t						lightsPerCluster;	// NUMLIGHTS of the shader.
+			uint32_t						bakedLights;		// The first lights, which are in the lightmap.
+			const Lightmap*					lightmap;
+			const AmbientOcclusionVolume*	occlusion;
+		};
+
+		// Lit colour of a surface point, the same as Shade in SurfaceShading.hlsli, which both the
+		// forward fused pass and DeferredPixelShader.hlsl light with.
+		Sdf::float4 Shade(const Lighting& lighting, FusedRaymarch::Material material,
+			const Sdf::float3& albedo, const Sdf::float3& normal, const Sdf::float3& Position);
+
+		// Same as DeferredPixelShader.hlsl. Texels without a material stay 0.
+		void Resolve(const Lighting& lighting, const std::vector<Texel>& gbuffer, std::vector<Sdf::float4>& colors);
+	}
+}
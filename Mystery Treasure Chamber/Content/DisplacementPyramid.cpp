@@ -0,0 +1,242 @@
+﻿#include "DisplacementPyramid.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define DISPLACEMENT_PYRAMID_SSE 1
+#include <emmintrin.h>
+#elif defined(_M_ARM) || defined(_M_ARM64) || defined(__ARM_NEON)
+#define DISPLACEMENT_PYRAMID_NEON 1
+#include <arm_neon.h>
+#endif
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	uint32_t Wrap(int64_t i, uint32_t size)
+	{
+		int64_t wrapped = i % int64_t(size);
+		return uint32_t(wrapped < 0 ? wrapped + int64_t(size) : wrapped);
+	}
+
+	// A run of texels first to last along one axis, inside the texture.
+	struct Span
+	{
+		uint32_t	first;
+		uint32_t	last;
+	};
+
+	// The texels along an axis of size that bilinear sampling touches between coordinates low and
+	// high, split where they wrap. Returns how many spans there are.
+	uint32_t FootprintSpans(float low, float high, uint32_t size, Span spans[2])
+	{
+		int64_t first = int64_t(std::floor(low * size - 0.5f));
+		int64_t last = int64_t(std::floor(high * size - 0.5f)) + 1;
+		if (last - first + 1 >= int64_t(size))
+		{
+			spans[0].first = 0;
+			spans[0].last = size - 1;
+			return 1;
+		}
+
+		uint32_t a = Wrap(first, size), b = Wrap(last, size);
+		if (a <= b)
+		{
+			spans[0].first = a;
+			spans[0].last = b;
+			return 1;
+		}
+		spans[0].first = a;
+		spans[0].last = size - 1;
+		spans[1].first = 0;
+		spans[1].last = b;
+		return 2;
+	}
+
+	DisplacementPyramidLevel BaseLevel(const DdsImage& image)
+	{
+		DisplacementPyramidLevel level;
+		level.width = image.width;
+		level.height = image.height;
+		level.low.resize(image.texels.size());
+		for (size_t i = 0; i < image.texels.size(); i++)
+		{
+			level.low[i] = image.texels[i].y;
+		}
+		level.high = level.low;
+		return level;
+	}
+
+	// Reduces columns x0 and x0 + 1 of rows a and b into column x0 / 2 of the next level, for
+	// every pair from x0 on. The last column of an odd row pairs with itself.
+	void ReduceRowScalar(const float* a, const float* b, uint32_t width, uint32_t x0, float* output, bool maximum)
+	{
+		for (uint32_t x = x0; x < width; x += 2)
+		{
+			uint32_t x1 = std::min(x + 1, width - 1);
+			output[x / 2] = maximum ?
+				std::max(std::max(a[x], a[x1]), std::max(b[x], b[x1])) :
+				std::min(std::min(a[x], a[x1]), std::min(b[x], b[x1]));
+		}
+	}
+
+	// Eight columns of two rows at a time: the rows are reduced first, then the even and odd
+	// columns are separated and reduced into four texels.
+	void ReduceRowSimd(const float* a, const float* b, uint32_t width, float* output, bool maximum)
+	{
+		uint32_t x = 0;
+#if defined(DISPLACEMENT_PYRAMID_SSE)
+		for (; x + 8 <= width; x += 8)
+		{
+			__m128 r0 = maximum ? _mm_max_ps(_mm_loadu_ps(a + x), _mm_loadu_ps(b + x)) : _mm_min_ps(_mm_loadu_ps(a + x), _mm_loadu_ps(b + x));
+			__m128 r1 = maximum ? _mm_max_ps(_mm_loadu_ps(a + x + 4), _mm_loadu_ps(b + x + 4)) : _mm_min_ps(_mm_loadu_ps(a + x + 4), _mm_loadu_ps(b + x + 4));
+			__m128 even = _mm_shuffle_ps(r0, r1, _MM_SHUFFLE(2, 0, 2, 0));
+			__m128 odd = _mm_shuffle_ps(r0, r1, _MM_SHUFFLE(3, 1, 3, 1));
+			_mm_storeu_ps(output + x / 2, maximum ? _mm_max_ps(even, odd) : _mm_min_ps(even, odd));
+		}
+#elif defined(DISPLACEMENT_PYRAMID_NEON)
+		for (; x + 8 <= width; x += 8)
+		{
+			float32x4_t r0 = maximum ? vmaxq_f32(vld1q_f32(a + x), vld1q_f32(b + x)) : vminq_f32(vld1q_f32(a + x), vld1q_f32(b + x));
+			float32x4_t r1 = maximum ? vmaxq_f32(vld1q_f32(a + x + 4), vld1q_f32(b + x + 4)) : vminq_f32(vld1q_f32(a + x + 4), vld1q_f32(b + x + 4));
+			float32x4x2_t columns = vuzpq_f32(r0, r1);
+			vst1q_f32(output + x / 2, maximum ? vmaxq_f32(columns.val[0], columns.val[1]) : vminq_f32(columns.val[0], columns.val[1]));
+		}
+#endif
+		ReduceRowScalar(a, b, width, x, output, maximum);
+	}
+
+	DisplacementPyramidLevel Reduce(const DisplacementPyramidLevel& level, bool simd)
+	{
+		DisplacementPyramidLevel next;
+		next.width = (level.width + 1) / 2;
+		next.height = (level.height + 1) / 2;
+		next.low.resize(size_t(next.width) * next.height);
+		next.high.resize(next.low.size());
+
+		for (uint32_t y = 0; y < next.height; y++)
+		{
+			// The last row of an odd level pairs with itself.
+			size_t row0 = size_t(2 * y) * level.width;
+			size_t row1 = size_t(std::min(2 * y + 1, level.height - 1)) * level.width;
+			float* low = &next.low[size_t(y) * next.width];
+			float* high = &next.high[size_t(y) * next.width];
+			if (simd)
+			{
+				ReduceRowSimd(&level.low[row0], &level.low[row1], level.width, low, false);
+				ReduceRowSimd(&level.high[row0], &level.high[row1], level.width, high, true);
+			}
+			else
+			{
+				ReduceRowScalar(&level.low[row0], &level.low[row1], level.width, 0, low, false);
+				ReduceRowScalar(&level.high[row0], &level.high[row1], level.width, 0, high, true);
+			}
+		}
+		return next;
+	}
+
+	// Adds levels to a pyramid holding only the first one, down to a single texel.
+	void ReduceLevels(DisplacementPyramid& pyramid, bool simd)
+	{
+		while (pyramid.levels.back().width > 1 || pyramid.levels.back().height > 1)
+		{
+			// Reduce reads the level it extends, so it cannot be a reference into the vector.
+			DisplacementPyramidLevel next = Reduce(pyramid.levels.back(), simd);
+			pyramid.levels.push_back(std::move(next));
+		}
+	}
+
+	DisplacementPyramid BuildPyramid(const DdsImage& image, bool simd)
+	{
+		DisplacementPyramid pyramid;
+		if (image.width == 0 || image.height == 0)
+			return pyramid;
+
+		pyramid.levels.push_back(BaseLevel(image));
+		ReduceLevels(pyramid, simd);
+		return pyramid;
+	}
+}
+
+const char* DisplacementBounds::GetSimdName()
+{
+#if defined(DISPLACEMENT_PYRAMID_SSE)
+	return "SSE2";
+#elif defined(DISPLACEMENT_PYRAMID_NEON)
+	return "NEON";
+#else
+	return "scalar";
+#endif
+}
+
+DisplacementPyramid DisplacementBounds::Build(const DdsImage& image)
+{
+	return BuildPyramid(image, true);
+}
+
+DisplacementPyramid DisplacementBounds::BuildScalar(const DdsImage& image)
+{
+	return BuildPyramid(image, false);
+}
+
+DisplacementRange DisplacementBounds::Range(const DisplacementPyramid& pyramid, const float2& textureMin, const float2& textureMax)
+{
+	if (pyramid.levels.empty())
+	{
+		DisplacementRange unknown = { 0.0f, 1.0f };
+		return unknown;
+	}
+
+	const DisplacementPyramidLevel& base = pyramid.levels[0];
+	Span xs[2], ys[2];
+	uint32_t xCount = FootprintSpans(textureMin.x, textureMax.x, base.width, xs);
+	uint32_t yCount = FootprintSpans(textureMin.y, textureMax.y, base.height, ys);
+
+	// The finest level where each span covers at most two texels.
+	uint32_t level = 0;
+	for (; level + 1 < pyramid.levels.size(); level++)
+	{
+		bool fits = true;
+		for (uint32_t i = 0; i < xCount; i++)
+		{
+			fits = fits && (xs[i].last >> level) - (xs[i].first >> level) <= 1;
+		}
+		for (uint32_t j = 0; j < yCount; j++)
+		{
+			fits = fits && (ys[j].last >> level) - (ys[j].first >> level) <= 1;
+		}
+		if (fits)
+			break;
+	}
+
+	const DisplacementPyramidLevel& bounds = pyramid.levels[level];
+	DisplacementRange range = { 1e30f, -1e30f };
+	for (uint32_t j = 0; j < yCount; j++)
+	{
+		for (uint32_t y = ys[j].first >> level; y <= ys[j].last >> level; y++)
+		{
+			for (uint32_t i = 0; i < xCount; i++)
+			{
+				for (uint32_t x = xs[i].first >> level; x <= xs[i].last >> level; x++)
+				{
+					size_t texel = size_t(y) * bounds.width + x;
+					range.low = std::min(range.low, bounds.low[texel]);
+					range.high = std::max(range.high, bounds.high[texel]);
+				}
+			}
+		}
+	}
+	return range;
+}
+
+DisplacementRange DisplacementBounds::Whole(const DisplacementPyramid& pyramid)
+{
+	if (pyramid.levels.empty())
+	{
+		DisplacementRange unknown = { 0.0f, 1.0f };
+		return unknown;
+	}
+
+	DisplacementRange range = { pyramid.levels.back().low[0], pyramid.levels.back().high[0] };
+	return range;
+}
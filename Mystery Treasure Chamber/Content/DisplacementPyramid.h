@@ -0,0 +1,58 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "DdsDecoder.h"
+#include "SdfMath.h"
+
+namespace Mystery_Treasure_Chamber
+{
+	// Lowest and highest value of the displacement texture over a region, in texture units.
+	struct DisplacementRange
+	{
+		float	low;
+		float	high;
+	};
+
+	// One level of the pyramid. Texel i covers texels 2i and 2i + 1 of the level below along each
+	// axis, the last one of an odd level covering only one. Row after row from the top.
+	struct DisplacementPyramidLevel
+	{
+		uint32_t			width;
+		uint32_t			height;
+		std::vector<float>	low;
+		std::vector<float>	high;
+	};
+
+	// Min/max mip chain of the displacement texture, finest first. The first level is the texture
+	// itself, with low and high both holding the texel, and the last is a single texel.
+	struct DisplacementPyramid
+	{
+		std::vector<DisplacementPyramidLevel>	levels;
+	};
+
+	// Conservative bounds of the floor's displacement over any region of the texture. The domain
+	// shader and FloorMeshBaker sample the green channel bilinearly with wrapping, so every value
+	// they can produce over a region lies between the lowest and the highest texel its bilinear
+	// footprint touches. The pyramid answers that with at most four texels per axis of one level,
+	// so patches and meshes can be bounded by what the texture holds there instead of by the
+	// whole 0 to 1 range. Levels are reduced with SSE2 on x86 and x64 and NEON on ARM.
+	namespace DisplacementBounds
+	{
+		// The instruction set Build reduces with, "scalar" without one.
+		const char* GetSimdName();
+
+		DisplacementPyramid Build(const DdsImage& image);
+
+		// The same pyramid without SIMD, to check Build against.
+		DisplacementPyramid BuildScalar(const DdsImage& image);
+
+		// Bounds of every value bilinear sampling can return between textureMin and textureMax,
+		// which may lie outside 0 to 1 and wrap.
+		DisplacementRange Range(const DisplacementPyramid& pyramid, const Sdf::float2& textureMin, const Sdf::float2& textureMax);
+
+		// Bounds of the whole texture, the single texel of the last level.
+		DisplacementRange Whole(const DisplacementPyramid& pyramid);
+	}
+}
@@ -0,0 +1,184 @@
+﻿#include "FloorCostModel.h"
+
+#include <algorithm>
+#include <cwchar>
+#include <limits>
+
+using namespace Mystery_Treasure_Chamber;
+
+namespace
+{
+	const FloorMode Modes[FloorCostModel::ModeCount] = { FloorMode::Tessellated, FloorMode::BakedMesh, FloorMode::Parallax };
+	const wchar_t* const ModeNames[FloorCostModel::ModeCount] = { L"tessellated", L"baked mesh", L"parallax" };
+}
+
+FloorCostModel::Settings FloorCostModel::DefaultSettings()
+{
+	Settings settings;
+	settings.calibrationSamples = 8;
+	settings.settleSamples = 4;
+	settings.smoothing = 0.05f;
+	settings.hysteresis = 0.1f;
+	settings.skipFactor = 4.0f;
+	return settings;
+}
+
+double FloorCostModel::GuessMilliseconds(DeviceClass device, FloorMode mode)
+{
+	// WARP runs every stage on the CPU, where tessellating at factor 32 is the worst of all and the
+	// single quad of the parallax floor the best.
+	if (device == DeviceClass::Warp)
+	{
+		return mode == FloorMode::Tessellated ? 40.0 : mode == FloorMode::BakedMesh ? 8.0 : 6.0;
+	}
+	return mode == FloorMode::Tessellated ? 1.0 : mode == FloorMode::BakedMesh ? 0.4 : 0.6;
+}
+
+FloorCostModel::FloorCostModel(DeviceClass device, const Settings& settings) :
+	m_settings(settings)
+{
+	Reset(device);
+}
+
+void FloorCostModel::Reset(DeviceClass device)
+{
+	m_device = device;
+	for (uint32_t i = 0; i < ModeCount; i++)
+	{
+		m_modes[i].available = true;
+		m_modes[i].milliseconds = GuessMilliseconds(device, Modes[i]);
+		m_modes[i].samples = 0;
+	}
+
+	m_current = Modes[0];
+	for (FloorMode mode : Modes)
+	{
+		if (GetMilliseconds(mode) < GetMilliseconds(m_current))
+			m_current = mode;
+	}
+	m_settling = m_settings.settleSamples;
+	m_switches = 0;
+}
+
+void FloorCostModel::SetAvailable(FloorMode mode, bool available)
+{
+	m_modes[Index(mode)].available = available;
+}
+
+void FloorCostModel::Record(FloorMode mode, double milliseconds)
+{
+	if (mode != m_current)
+		return;
+	if (m_settling > 0)
+	{
+		m_settling--;
+		return;
+	}
+
+	// The plain mean of the first few, so one noisy frame does not stick, then a running average.
+	Mode& measured = m_modes[Index(mode)];
+	double weight = std::max<double>(m_settings.smoothing, 1.0 / (measured.samples + 1));
+	measured.milliseconds += weight * (milliseconds - measured.milliseconds);
+	measured.samples++;
+}
+
+FloorMode FloorCostModel::Choose()
+{
+	double cheapestGuess = CheapestGuess();
+	if (cheapestGuess == std::numeric_limits<double>::max())
+		return m_current;
+
+	// Measure every mode worth trying before comparing them, staying on the current one until it
+	// has its measurements.
+	bool calibrating = false;
+	FloorMode untried = m_current;
+	for (FloorMode mode : Modes)
+	{
+		if (!NeedsCalibration(mode, cheapestGuess))
+			continue;
+		if (mode == m_current)
+			return m_current;
+		if (!calibrating || GuessMilliseconds(m_device, mode) < GuessMilliseconds(m_device, untried))
+			untried = mode;
+		calibrating = true;
+	}
+	if (calibrating)
+	{
+		SwitchTo(untried);
+		return m_current;
+	}
+
+	FloorMode cheapest = m_current;
+	for (FloorMode mode : Modes)
+	{
+		if (IsAvailable(mode) && (!IsAvailable(cheapest) || GetMilliseconds(mode) < GetMilliseconds(cheapest)))
+			cheapest = mode;
+	}
+
+	// A mode that went away, like the mesh while it bakes, hands over right away.
+	if (!IsAvailable(m_current) ||
+		(cheapest != m_current && GetMilliseconds(cheapest) < GetMilliseconds(m_current) * (1.0 - m_settings.hysteresis)))
+	{
+		SwitchTo(cheapest);
+	}
+	return m_current;
+}
+
+bool FloorCostModel::IsCalibrating() const
+{
+	double cheapestGuess = CheapestGuess();
+	for (FloorMode mode : Modes)
+	{
+		if (NeedsCalibration(mode, cheapestGuess))
+			return true;
+	}
+	return false;
+}
+
+void FloorCostModel::Use(FloorMode mode)
+{
+	SwitchTo(mode);
+}
+
+double FloorCostModel::CheapestGuess() const
+{
+	double cheapestGuess = std::numeric_limits<double>::max();
+	for (FloorMode mode : Modes)
+	{
+		if (IsAvailable(mode))
+			cheapestGuess = std::min(cheapestGuess, GuessMilliseconds(m_device, mode));
+	}
+	return cheapestGuess;
+}
+
+bool FloorCostModel::NeedsCalibration(FloorMode mode, double cheapestGuess) const
+{
+	const Mode& candidate = m_modes[Index(mode)];
+	return candidate.available && candidate.samples < m_settings.calibrationSamples &&
+		GuessMilliseconds(m_device, mode) <= m_settings.skipFactor * cheapestGuess;
+}
+
+void FloorCostModel::SwitchTo(FloorMode mode)
+{
+	if (mode == m_current)
+		return;
+	m_current = mode;
+	m_settling = m_settings.settleSamples;
+	m_switches++;
+}
+
+std::wstring FloorCostModel::Report() const
+{
+	std::wstring report = m_device == DeviceClass::Warp ? L"Floor on WARP" : L"Floor on the GPU";
+	for (uint32_t i = 0; i < ModeCount; i++)
+	{
+		wchar_t line[64];
+		if (!m_modes[i].available)
+			std::swprintf(line, 64, L"\n%ls -", ModeNames[i]);
+		else
+			std::swprintf(line, 64, L"\n%ls %ls%.2f ms%ls", ModeNames[i], m_modes[i].samples > 0 ? L"" : L"~",
+				m_modes[i].milliseconds, Modes[i] == m_current ? L" <" : L"");
+		report += line;
+	}
+	return report;
+}
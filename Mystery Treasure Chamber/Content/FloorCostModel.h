@@ -0,0 +1,103 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "FloorMesh.h"
+
+namespace Mystery_Treasure_Chamber
+{
+	// What kind of device draws the floor, for the costs FloorCostModel starts from.
+	enum class DeviceClass : uint32_t
+	{
+		Hardware,	// A GPU driver.
+		Warp,		// The WARP software rasterizer DeviceResources falls back to without one.
+	};
+
+	// Chooses how to draw the floor from what each FloorMode costs. Every mode starts from a rough
+	// guess for the device class, and is then tried for a few frames to measure it, cheapest guess
+	// first. Modes guessed to be far more expensive than the cheapest are skipped, which keeps WARP
+	// from tessellating at factor 32 unless everything else turns out to cost more than that guess.
+	// Once every mode worth trying has been measured, the cheapest one is drawn, and only the mode
+	// being drawn keeps being measured, so the model moves to another one when the current one gets
+	// more expensive than the other was measured to be.
+	class FloorCostModel
+	{
+	public:
+		static const uint32_t ModeCount = 3;
+
+		struct Settings
+		{
+			uint32_t	calibrationSamples;	// Measurements of each mode before choosing between them.
+			uint32_t	settleSamples;		// Measurements dropped after every switch, while caches warm up.
+			float		smoothing;			// Weight of a new measurement in a mode's running average.
+			float		hysteresis;			// How much cheaper than the current mode another must be to switch to it.
+			float		skipFactor;			// Modes guessed to cost this many times the cheapest guess are not tried.
+		};
+
+		static Settings DefaultSettings();
+
+		// Guessed milliseconds of a mode for the whole floor. Only their order matters until the
+		// modes are measured.
+		static double GuessMilliseconds(DeviceClass device, FloorMode mode);
+
+		FloorCostModel(DeviceClass device, const Settings& settings = DefaultSettings());
+
+		// Forgets every measurement, for a new device.
+		void Reset(DeviceClass device);
+
+		// Modes the renderer can draw right now, the baked mesh only once it is uploaded. All are
+		// available to begin with.
+		void SetAvailable(FloorMode mode, bool available);
+		bool IsAvailable(FloorMode mode) const			{ return m_modes[Index(mode)].available; }
+
+		// Adds a measurement of the cost of drawing mode. Measurements of a mode other than the
+		// current one arrive late from before a switch, and are dropped.
+		void Record(FloorMode mode, double milliseconds);
+
+		// The mode to draw next.
+		FloorMode Choose();
+
+		// Whether some available mode worth trying still lacks its measurements, while Choose moves
+		// between the modes to take them.
+		bool IsCalibrating() const;
+
+		// Makes mode the current one whatever it costs, for a mode chosen by hand, so its
+		// measurements still count.
+		void Use(FloorMode mode);
+
+		FloorMode GetCurrent() const					{ return m_current; }
+		DeviceClass GetDeviceClass() const				{ return m_device; }
+
+		// Running average of a mode's measurements, or its guess until it has some.
+		double GetMilliseconds(FloorMode mode) const	{ return m_modes[Index(mode)].milliseconds; }
+		uint32_t GetSamples(FloorMode mode) const		{ return m_modes[Index(mode)].samples; }
+		uint32_t GetSwitches() const					{ return m_switches; }
+
+		// A line for the device and one for each mode, for the FPS overlay: the cost, ~ before a
+		// guess, - for a mode that cannot be drawn, and < after the current mode.
+		std::wstring Report() const;
+
+	private:
+		struct Mode
+		{
+			bool		available;
+			double		milliseconds;
+			uint32_t	samples;
+		};
+
+		static uint32_t Index(FloorMode mode)			{ return static_cast<uint32_t>(mode); }
+
+		// Cheapest guess of the available modes, the largest double without one.
+		double CheapestGuess() const;
+		bool NeedsCalibration(FloorMode mode, double cheapestGuess) const;
+		void SwitchTo(FloorMode mode);
+
+		Settings	m_settings;
+		DeviceClass	m_device;
+		Mode		m_modes[ModeCount];
+		FloorMode	m_current;
+		uint32_t	m_settling;
+		uint32_t	m_switches;
+	};
+}
@@ -0,0 +1,227 @@
+﻿#include "FloorMesh.h"
+#include "PassCache.h"
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	const uint32_t Magic = 0x534D4C46;	// "FLMS"
+
+	// Largest segments a cache file may claim, far more than any level needs.
+	const uint32_t MaxSegments = 4096;
+
+	uint32_t Wrap(int32_t i, uint32_t size)
+	{
+		int32_t wrapped = i % int32_t(size);
+		return uint32_t(wrapped < 0 ? wrapped + int32_t(size) : wrapped);
+	}
+
+	// Grid line i of segments along one side of the object space floor, the same way
+	// FloorTessellation computes its patch corners.
+	float GridLine(uint32_t segments, uint32_t i)
+	{
+		return -1.0f + 2.0f * i / segments;
+	}
+
+	// Texture coordinates of an object space point, as FloorTessellation::BuildPatchGrid gives them.
+	float2 FloorTexture(float x, float z)
+	{
+		return float2(0.5f * (x + 1.0f), 0.5f * (1.0f - z));
+	}
+}
+
+FloorMeshBaker::Settings FloorMeshBaker::DefaultSettings()
+{
+	Settings settings;
+	settings.segments = FloorTessellation::DefaultPatches * 32;
+	settings.lods = 4;
+	return settings;
+}
+
+uint64_t FloorMeshBaker::Key(const Settings& settings, const uint8_t* file, size_t size)
+{
+	PassHash hash;
+	hash.Add(Version);
+	hash.Add(FloorTessellation::DisplacementScale);
+	hash.Add(settings);
+	hash.Add(file, size);
+	return hash.GetValue();
+}
+
+float FloorMeshBaker::Displacement(const DdsImage& image, const float2& texture)
+{
+	// Texel centres are at (i + 0.5) / width, as the sampler has them.
+	float x = texture.x * image.width - 0.5f, y = texture.y * image.height - 0.5f;
+	float fx = std::floor(x), fy = std::floor(y);
+	float tx = x - fx, ty = y - fy;
+
+	uint32_t x0 = Wrap(int32_t(fx), image.width), x1 = Wrap(int32_t(fx) + 1, image.width);
+	uint32_t y0 = Wrap(int32_t(fy), image.height), y1 = Wrap(int32_t(fy) + 1, image.height);
+	const float4* row0 = &image.texels[size_t(y0) * image.width];
+	const float4* row1 = &image.texels[size_t(y1) * image.width];
+
+	return lerp(lerp(row0[x0].y, row0[x1].y, tx), lerp(row1[x0].y, row1[x1].y, tx), ty);
+}
+
+FloorMeshLod FloorMeshBaker::BakeLod(const DdsImage& image, uint32_t segments)
+{
+	FloorMeshLod lod;
+	lod.segments = segments;
+	lod.vertices.reserve(size_t(segments + 1) * (segments + 1));
+	for (uint32_t j = 0; j <= segments; j++)
+	{
+		for (uint32_t i = 0; i <= segments; i++)
+		{
+			FloorMeshVertex vertex;
+			float x = GridLine(segments, i), z = GridLine(segments, j);
+			vertex.texture = FloorTexture(x, z);
+			vertex.position = float3(x, -FloorTessellation::DisplacementScale * Displacement(image, vertex.texture), z);
+			lod.vertices.push_back(vertex);
+		}
+	}
+
+	// Clockwise seen from above, the floor's front faces.
+	uint32_t row = segments + 1;
+	lod.indices.reserve(size_t(segments) * segments * 6);
+	for (uint32_t j = 0; j < segments; j++)
+	{
+		for (uint32_t i = 0; i < segments; i++)
+		{
+			uint32_t v = j * row + i;
+			uint32_t quad[6] = { v, v + 1, v + row, v + 1, v + row + 1, v + row };
+			lod.indices.insert(lod.indices.end(), quad, quad + 6);
+		}
+	}
+	return lod;
+}
+
+FloorMesh FloorMeshBaker::Bake(const Settings& settings, const DdsImage& image, uint64_t key)
+{
+	FloorMesh mesh;
+	mesh.key = key;
+
+	uint32_t segments = settings.segments;
+	for (uint32_t lod = 0; lod < settings.lods && segments > 0; lod++)
+	{
+		mesh.lods.push_back(BakeLod(image, segments));
+		if (segments % 2 != 0)
+			break;
+		segments /= 2;
+	}
+	return mesh;
+}
+
+uint32_t FloorMeshBaker::SelectLod(const std::vector<uint32_t>& segments, const FloorTessellation::Settings& settings)
+{
+	if (settings.targetPixels <= 0.0f || segments.empty())
+		return 0;
+
+	// Nearest point of the floor's box, displacement included.
+	const float size = FloorTessellation::FloorScale;
+	float3 nearest(clamp(settings.eye.x, -size, size),
+		clamp(settings.eye.y, FloorTessellation::FloorHeight + settings.displacementLow, FloorTessellation::FloorHeight + settings.displacementHigh),
+		clamp(settings.eye.z, -size, size));
+	float distance = length(nearest - settings.eye);
+
+	uint32_t selected = 0;
+	for (uint32_t lod = 0; lod < segments.size(); lod++)
+	{
+		float segment = 2.0f * size / segments[lod];
+		float pixels = segment * settings.screenScale / std::max(std::max(distance, 0.5f * segment), 1e-4f);
+		if (pixels > settings.targetPixels)
+			break;
+		selected = lod;
+	}
+	return selected;
+}
+
+bool FloorMeshBaker::Save(const FloorMesh& mesh, std::ostream& stream)
+{
+	uint32_t count = static_cast<uint32_t>(mesh.lods.size());
+	stream.write(reinterpret_cast<const char*>(&Magic), sizeof(Magic));
+	stream.write(reinterpret_cast<const char*>(&Version), sizeof(Version));
+	stream.write(reinterpret_cast<const char*>(&mesh.key), sizeof(mesh.key));
+	stream.write(reinterpret_cast<const char*>(&count), sizeof(count));
+	for (const FloorMeshLod& lod : mesh.lods)
+	{
+		stream.write(reinterpret_cast<const char*>(&lod.segments), sizeof(lod.segments));
+		stream.write(reinterpret_cast<const char*>(lod.vertices.data()), lod.vertices.size() * sizeof(FloorMeshVertex));
+		stream.write(reinterpret_cast<const char*>(lod.indices.data()), lod.indices.size() * sizeof(uint32_t));
+	}
+	return static_cast<bool>(stream);
+}
+
+bool FloorMeshBaker::Load(std::istream& stream, uint64_t key, FloorMesh& mesh)
+{
+	uint32_t magic = 0, version = 0, count = 0;
+	uint64_t fileKey = 0;
+	stream.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+	stream.read(reinterpret_cast<char*>(&version), sizeof(version));
+	stream.read(reinterpret_cast<char*>(&fileKey), sizeof(fileKey));
+	stream.read(reinterpret_cast<char*>(&count), sizeof(count));
+	if (!stream || magic != Magic || version != Version || fileKey != key || count == 0 || count > 16)
+		return false;
+
+	// The vertex and index counts follow from the segments.
+	std::vector<FloorMeshLod> lods(count);
+	for (FloorMeshLod& lod : lods)
+	{
+		stream.read(reinterpret_cast<char*>(&lod.segments), sizeof(lod.segments));
+		if (!stream || lod.segments == 0 || lod.segments > MaxSegments)
+			return false;
+
+		lod.vertices.resize(size_t(lod.segments + 1) * (lod.segments + 1));
+		lod.indices.resize(size_t(lod.segments) * lod.segments * 6);
+		stream.read(reinterpret_cast<char*>(lod.vertices.data()), lod.vertices.size() * sizeof(FloorMeshVertex));
+		stream.read(reinterpret_cast<char*>(lod.indices.data()), lod.indices.size() * sizeof(uint32_t));
+		if (!stream)
+			return false;
+	}
+
+	mesh.key = fileKey;
+	mesh.lods.swap(lods);
+	return true;
+}
+
+std::string FloorMeshBaker::CacheFileName(uint64_t key)
+{
+	char name[64];
+	std::snprintf(name, sizeof(name), "FloorMesh_%016llx.bin", static_cast<unsigned long long>(key));
+	return name;
+}
+
+FloorMesh FloorMeshBaker::LoadOrBake(const std::string& directory, const Settings& settings, const uint8_t* file, size_t size,
+	bool* fromCache)
+{
+	uint64_t key = Key(settings, file, size);
+	std::string path = directory.empty() ? CacheFileName(key) : directory + "/" + CacheFileName(key);
+
+	FloorMesh mesh;
+	std::ifstream cached(path, std::ios::binary);
+	bool loaded = cached && Load(cached, key, mesh);
+	if (fromCache)
+		*fromCache = loaded;
+	if (loaded)
+		return mesh;
+
+	// Only a bake pays for decoding the texture.
+	DdsImage image;
+	if (!DdsDecoder::Decode(file, size, image))
+	{
+		mesh.key = key;
+		return mesh;
+	}
+	mesh = Bake(settings, image, key);
+
+	// A cache that cannot be written only costs the next bake.
+	std::ofstream output(path, std::ios::binary);
+	if (output)
+		Save(mesh, output);
+
+	return mesh;
+}
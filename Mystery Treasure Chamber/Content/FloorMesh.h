@@ -0,0 +1,94 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "DdsDecoder.h"
+#include "FloorTessellation.h"
+#include "SdfMath.h"
+
+namespace Mystery_Treasure_Chamber
+{
+	// How the floor's displacement reaches the screen.
+	enum class FloorMode : uint32_t
+	{
+		Tessellated,	// The hull and domain shaders displace the patch grid every frame.
+		BakedMesh,		// A mesh displaced once by FloorMeshBaker, drawn without tessellation.
+		Parallax,		// A flat quad whose pixels march into the displacement, see FloorParallax.
+	};
+
+	// A vertex of the baked floor in object space, what FloorMeshVertexShader.hlsl reads.
+	struct FloorMeshVertex
+	{
+		Sdf::float3	position;
+		Sdf::float2	texture;
+	};
+
+	// One level of detail: a grid of segments by segments quads over the floor, row after row from
+	// z = -1, two triangles each.
+	struct FloorMeshLod
+	{
+		uint32_t						segments;
+		std::vector<FloorMeshVertex>	vertices;
+		std::vector<uint32_t>			indices;
+	};
+
+	struct FloorMesh
+	{
+		uint64_t					key;
+		std::vector<FloorMeshLod>	lods;	// Finest first, each with half the segments of the one before.
+	};
+
+	// Offline CPU baker of the floor DomainShader.hlsl makes every frame. The displacement never
+	// changes, so the surface is sampled once from the decoded displacement texture, with the same
+	// bilinear wrapping sample, at every vertex the tessellator would make of the default patch grid
+	// at the largest factor, and again at coarser levels. Meshes are cached on disk under a key of
+	// the texture file's bytes and the settings.
+	namespace FloorMeshBaker
+	{
+		// Written at the start of a cache file, and part of every key. Change it with the bake code.
+		const uint32_t Version = 1;
+
+		struct Settings
+		{
+			uint32_t	segments;	// Quads along each side of the finest level.
+			uint32_t	lods;		// Levels, stopping early if the segments would no longer halve.
+		};
+
+		// The default patch grid at factor 32, so the finest level is what the tessellator made at most.
+		Settings DefaultSettings();
+
+		// Hash of the displacement texture file and the settings. Equal keys bake the same mesh.
+		uint64_t Key(const Settings& settings, const uint8_t* file, size_t size);
+
+		// Bilinear sample of the green channel at texture coordinates with wrapping, what the domain
+		// shader's txDisplacement.SampleLevel(txSampler, uvTex, 0).xyz * -normal moves the floor by.
+		float Displacement(const DdsImage& image, const Sdf::float2& texture);
+
+		FloorMeshLod BakeLod(const DdsImage& image, uint32_t segments);
+
+		// The key is stored as given.
+		FloorMesh Bake(const Settings& settings, const DdsImage& image, uint64_t key);
+
+		// Coarsest of the levels with these segments, finest first, whose segments still cover at
+		// most targetPixels on screen where the floor is nearest to the eye, with the projection of
+		// FloorTessellation::EdgeFactor. A targetPixels of 0 asks for the finest level.
+		uint32_t SelectLod(const std::vector<uint32_t>& segments, const FloorTessellation::Settings& settings);
+
+		// Cache files hold the version, the key and each level's segments, vertices and indices.
+		bool Save(const FloorMesh& mesh, std::ostream& stream);
+
+		// Fails unless the stream holds a mesh of this version and key.
+		bool Load(std::istream& stream, uint64_t key, FloorMesh& mesh);
+
+		std::string CacheFileName(uint64_t key);
+
+		// Loads the cached mesh for the texture file from directory, or decodes the file, bakes and
+		// caches it. A file that cannot be decoded gives a mesh without levels.
+		FloorMesh LoadOrBake(const std::string& directory, const Settings& settings, const uint8_t* file, size_t size,
+			bool* fromCache);
+	}
+}
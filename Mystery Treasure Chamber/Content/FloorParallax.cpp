@@ -0,0 +1,149 @@
+﻿#include "FloorParallax.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	// How far the displacement reaches below the flat floor, PARALLAX_DEPTH of the shader.
+	const float Depth = FloorTessellation::DisplacementScale * FloorTessellation::FloorScale;
+
+	// Texture coordinates per world unit along x, and against z, PARALLAX_TEXTURE_SCALE.
+	const float TextureScale = 0.5f / FloorTessellation::FloorScale;
+
+	// Smallest steepness of a view ray, so one along the floor stays finite.
+	const float MinDown = 1e-3f;
+
+	// The view ray through a point of the flat floor, and how steeply it goes down.
+	float3 ViewRay(const float3& eye, const float3& worldPosition, float& down)
+	{
+		float3 view = normalize(worldPosition - eye);
+		down = std::max(-view.y, MinDown);
+		return view;
+	}
+
+	// Change of the texture coordinates from the top to the bottom of the displacement.
+	float2 TextureDelta(const float3& view, float down)
+	{
+		return float2(view.x, -view.z) * (TextureScale * Depth / down);
+	}
+
+	FloorParallax::Hit MakeHit(const float3& worldPosition, const float3& view, float down, const float2& texture,
+		float depth, uint32_t layers)
+	{
+		FloorParallax::Hit hit;
+		hit.texture = texture;
+		hit.worldPosition = worldPosition + view * (Depth * depth / down);
+		hit.depth = depth;
+		hit.layers = layers;
+		return hit;
+	}
+}
+
+FloorParallax::Settings FloorParallax::DefaultSettings()
+{
+	Settings settings;
+	settings.minLayers = 8;
+	settings.maxLayers = 32;
+	return settings;
+}
+
+FloorMeshLod FloorParallax::Quad()
+{
+	FloorMeshLod lod;
+	lod.segments = 1;
+	for (uint32_t j = 0; j < 2; j++)
+	{
+		for (uint32_t i = 0; i < 2; i++)
+		{
+			FloorMeshVertex vertex;
+			vertex.position = float3(i ? 1.0f : -1.0f, 0.0f, j ? 1.0f : -1.0f);
+			vertex.texture = float2(0.5f * (vertex.position.x + 1.0f), 0.5f * (1.0f - vertex.position.z));
+			lod.vertices.push_back(vertex);
+		}
+	}
+
+	// Clockwise seen from above, as in FloorMeshBaker::BakeLod.
+	lod.indices = { 0, 1, 2, 1, 3, 2 };
+	return lod;
+}
+
+float2 FloorParallax::FloorTexture(const float3& worldPosition)
+{
+	float x = worldPosition.x / FloorTessellation::FloorScale, z = worldPosition.z / FloorTessellation::FloorScale;
+	return float2(0.5f * (x + 1.0f), 0.5f * (1.0f - z));
+}
+
+FloorParallax::Hit FloorParallax::March(const Settings& settings, const DdsImage& image, const float3& eye, const float3& worldPosition)
+{
+	float down;
+	float3 view = ViewRay(eye, worldPosition, down);
+	float2 start = FloorTexture(worldPosition);
+	float2 delta = TextureDelta(view, down);
+
+	// More layers the flatter the ray, as the lerp in the shader has it.
+	uint32_t layers = static_cast<uint32_t>(lerp(float(settings.maxLayers), float(settings.minLayers), down));
+	float step = 1.0f / layers;
+
+	float2 texture = start;
+	float depth = 0.0f;
+	float surface = FloorMeshBaker::Displacement(image, texture);
+	float previousDepth = 0.0f, previousGap = surface;
+	uint32_t i = 0;
+	for (; i < layers && depth < surface; i++)
+	{
+		previousDepth = depth;
+		previousGap = surface - depth;
+		depth = (i + 1) * step;
+		texture = start + delta * depth;
+		surface = FloorMeshBaker::Displacement(image, texture);
+	}
+
+	// The surface is taken as a straight line between the last two layers.
+	if (i > 0)
+	{
+		float gap = surface - depth;
+		float t = previousGap / std::max(previousGap - gap, 1e-6f);
+		depth = previousDepth + (depth - previousDepth) * t;
+		texture = start + delta * depth;
+	}
+	return MakeHit(worldPosition, view, down, texture, depth, i);
+}
+
+FloorParallax::Hit FloorParallax::Trace(const DdsImage& image, const float3& eye, const float3& worldPosition)
+{
+	const uint32_t steps = 4096, refinements = 24;
+
+	float down;
+	float3 view = ViewRay(eye, worldPosition, down);
+	float2 start = FloorTexture(worldPosition);
+	float2 delta = TextureDelta(view, down);
+
+	float above = 0.0f, below = 0.0f;
+	if (FloorMeshBaker::Displacement(image, start) > 0.0f)
+	{
+		below = 1.0f;
+		for (uint32_t i = 1; i <= steps; i++)
+		{
+			float depth = float(i) / steps;
+			if (depth >= FloorMeshBaker::Displacement(image, start + delta * depth))
+			{
+				above = float(i - 1) / steps;
+				below = depth;
+				break;
+			}
+		}
+		for (uint32_t i = 0; i < refinements; i++)
+		{
+			float middle = 0.5f * (above + below);
+			if (middle >= FloorMeshBaker::Displacement(image, start + delta * middle))
+				below = middle;
+			else
+				above = middle;
+		}
+	}
+	return MakeHit(worldPosition, view, down, start + delta * below, below, steps);
+}
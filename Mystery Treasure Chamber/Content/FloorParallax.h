@@ -0,0 +1,53 @@
+﻿#pragma once
+
+#include <cstdint>
+
+#include "DdsDecoder.h"
+#include "FloorMesh.h"
+#include "SdfMath.h"
+
+namespace Mystery_Treasure_Chamber
+{
+	// Parallax occlusion mapping of the floor, the parallax variant of FloorPixelShader.hlsl. The
+	// floor is drawn as one flat quad at the top of its displacement, and every pixel marches its
+	// view ray down through the displacement texture in layers until the ray is below the surface,
+	// then shades the texture coordinates and the position where it went below. No hull or domain
+	// shader runs and only two triangles are drawn, so the cost is all in the pixels. This is the
+	// same march on the CPU, to check it against the surface the domain shader displaces.
+	namespace FloorParallax
+	{
+		struct Settings
+		{
+			uint32_t	minLayers;	// Layers looking straight down.
+			uint32_t	maxLayers;	// Layers looking along the floor.
+		};
+
+		// PARALLAX_MIN_LAYERS and PARALLAX_MAX_LAYERS of the shader.
+		Settings DefaultSettings();
+
+		// The flat floor the shader is drawn on, one quad at the top of the displacement, wound
+		// like FloorMeshBaker's levels.
+		FloorMeshLod Quad();
+
+		// Texture coordinates of a world space point on the floor, as the floor's vertex shaders
+		// give them.
+		Sdf::float2 FloorTexture(const Sdf::float3& worldPosition);
+
+		// Where a view ray meets the displaced floor. depth goes from 0 at the top of the
+		// displacement to 1 at the bottom.
+		struct Hit
+		{
+			Sdf::float2	texture;
+			Sdf::float3	worldPosition;
+			float		depth;
+			uint32_t	layers;		// Displacement samples taken, not counting the first.
+		};
+
+		// The shader's march for the pixel of the flat floor at worldPosition, seen from eye.
+		Hit March(const Settings& settings, const DdsImage& image, const Sdf::float3& eye, const Sdf::float3& worldPosition);
+
+		// The first point of the same ray below the displaced surface, from small steps refined by
+		// bisection, to measure March against.
+		Hit Trace(const DdsImage& image, const Sdf::float3& eye, const Sdf::float3& worldPosition);
+	}
+}
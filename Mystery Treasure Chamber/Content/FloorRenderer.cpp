@@ -0,0 +1,673 @@
+﻿#include "pch.h"
+#include "FloorRenderer.h"
+
+#include "..\Common\DirectXHelper.h"
+#include "DDSTextureLoader.h"
+#include "FloorParallax.h"
+
+#include <algorithm>
+#include <fstream>
+
+using namespace Mystery_Treasure_Chamber;
+
+using namespace DirectX;
+
+FloorRenderer::FloorRenderer(const std::shared_ptr<DX::DeviceResources>& deviceResources) :
+	m_deviceResources(deviceResources),
+	m_queryPending(false),
+	m_triangles(0),
+	m_patches(FloorTessellation::DefaultPatches),
+	m_patchesCreated(0),
+	m_tessellationTarget(8.0f),
+	m_visibility(),
+	m_mode(FloorMode::BakedMesh),
+	m_displacementLoading(false),
+	m_meshLod(0),
+	m_automaticMode(true),
+	m_timingPending(false),
+	m_timingMode(FloorMode::Tessellated),
+	m_costs(DeviceClass::Hardware),
+	m_calibrationFrames(0)
+{
+}
+
+concurrency::task<void> FloorRenderer::CreateDeviceDependentResources()
+{
+	auto loadPatchVS = DX::ReadDataAsync(L"VertexShader.cso");
+	auto loadHSTask = DX::ReadDataAsync(L"HullShader.cso");
+	auto loadDSTask = DX::ReadDataAsync(L"DomainShader.cso");
+	auto loadGBufferPS = DX::ReadDataAsync(L"FloorPixelShader_GBuffer.cso");
+	auto loadMeshVS = DX::ReadDataAsync(L"FloorMeshVertexShader.cso");
+	auto loadParallaxPS = DX::ReadDataAsync(L"FloorPixelShader_Parallax.cso");
+	auto loadParallaxGBufferPS = DX::ReadDataAsync(L"FloorPixelShader_Parallax_GBuffer.cso");
+
+	// The cost model starts over from the guesses for the new device.
+	m_costs.Reset(m_deviceResources->GetDriverType() == D3D_DRIVER_TYPE_WARP ? DeviceClass::Warp : DeviceClass::Hardware);
+
+	CD3D11_BUFFER_DESC tessellationBufferDesc(sizeof(TessellationConstantBuffer), D3D11_BIND_CONSTANT_BUFFER);
+	DX::ThrowIfFailed(
+		m_deviceResources->GetD3DDevice()->CreateBuffer(&tessellationBufferDesc, nullptr, &m_tessellationConstantBuffer)
+	);
+
+	CD3D11_QUERY_DESC queryDesc(D3D11_QUERY_PIPELINE_STATISTICS);
+	DX::ThrowIfFailed(
+		m_deviceResources->GetD3DDevice()->CreateQuery(&queryDesc, &m_statisticsQuery)
+	);
+
+	CD3D11_QUERY_DESC disjointDesc(D3D11_QUERY_TIMESTAMP_DISJOINT);
+	DX::ThrowIfFailed(
+		m_deviceResources->GetD3DDevice()->CreateQuery(&disjointDesc, &m_timingDisjointQuery)
+	);
+
+	CD3D11_QUERY_DESC timestampDesc(D3D11_QUERY_TIMESTAMP);
+	DX::ThrowIfFailed(
+		m_deviceResources->GetD3DDevice()->CreateQuery(&timestampDesc, &m_timingStartQuery)
+	);
+	DX::ThrowIfFailed(
+		m_deviceResources->GetD3DDevice()->CreateQuery(&timestampDesc, &m_timingEndQuery)
+	);
+
+	auto createPatchVSTask = loadPatchVS.then([this](const std::vector<byte>& fileData) {
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateVertexShader(
+				&fileData[0],
+				fileData.size(),
+				nullptr,
+				&m_patchVertexShader
+			)
+		);
+
+		// VertexPositionTextureNTB, like the models.
+		static const D3D11_INPUT_ELEMENT_DESC vertexDesc[] =
+		{
+			{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			{ "TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			{ "BINORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		};
+
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateInputLayout(
+				vertexDesc,
+				ARRAYSIZE(vertexDesc),
+				&fileData[0],
+				fileData.size(),
+				&m_patchInputLayout
+			)
+		);
+
+		// Draw recreates the patches whenever their count changes.
+		CreatePatches();
+	});
+
+	auto createHSTask = loadHSTask.then([this](const std::vector<byte>& fileData) {
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateHullShader(
+				&fileData[0],
+				fileData.size(),
+				nullptr,
+				&m_hullShader
+			)
+		);
+	});
+
+	auto createDSTask = loadDSTask.then([this](const std::vector<byte>& fileData) {
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateDomainShader(
+				&fileData[0],
+				fileData.size(),
+				nullptr,
+				&m_domainShader
+			)
+		);
+	});
+
+	auto createGBufferPSTask = loadGBufferPS.then([this](const std::vector<byte>& fileData) {
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreatePixelShader(
+				&fileData[0],
+				fileData.size(),
+				nullptr,
+				&m_gbufferPixelShader
+			)
+		);
+	});
+
+	auto createMeshVSTask = loadMeshVS.then([this](const std::vector<byte>& fileData) {
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateVertexShader(
+				&fileData[0],
+				fileData.size(),
+				nullptr,
+				&m_meshVertexShader
+			)
+		);
+
+		// FloorMeshVertex, already displaced.
+		static const D3D11_INPUT_ELEMENT_DESC vertexDesc[] =
+		{
+			{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		};
+
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateInputLayout(
+				vertexDesc,
+				ARRAYSIZE(vertexDesc),
+				&fileData[0],
+				fileData.size(),
+				&m_meshInputLayout
+			)
+		);
+
+		// The flat quad the parallax floor is drawn on, with the same vertices.
+		FloorMeshLod quad = FloorParallax::Quad();
+
+		D3D11_SUBRESOURCE_DATA vertexBufferData = { 0 };
+		vertexBufferData.pSysMem = quad.vertices.data();
+		CD3D11_BUFFER_DESC vertexBufferDesc(static_cast<UINT>(quad.vertices.size() * sizeof(FloorMeshVertex)), D3D11_BIND_VERTEX_BUFFER, D3D11_USAGE_IMMUTABLE);
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateBuffer(&vertexBufferDesc, &vertexBufferData, &m_quadVertexBuffer)
+		);
+
+		D3D11_SUBRESOURCE_DATA indexBufferData = { 0 };
+		indexBufferData.pSysMem = quad.indices.data();
+		CD3D11_BUFFER_DESC indexBufferDesc(static_cast<UINT>(quad.indices.size() * sizeof(uint32_t)), D3D11_BIND_INDEX_BUFFER, D3D11_USAGE_IMMUTABLE);
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateBuffer(&indexBufferDesc, &indexBufferData, &m_quadIndexBuffer)
+		);
+	});
+
+	auto createParallaxPSTask = loadParallaxPS.then([this](const std::vector<byte>& fileData) {
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreatePixelShader(
+				&fileData[0],
+				fileData.size(),
+				nullptr,
+				&m_parallaxPixelShader
+			)
+		);
+	});
+
+	auto createParallaxGBufferPSTask = loadParallaxGBufferPS.then([this](const std::vector<byte>& fileData) {
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreatePixelShader(
+				&fileData[0],
+				fileData.size(),
+				nullptr,
+				&m_parallaxGBufferPixelShader
+			)
+		);
+	});
+
+	auto createTextureTask = concurrency::create_task([this]() {
+		DX::ThrowIfFailed(
+			CreateDDSTextureFromFile(m_deviceResources->GetD3DDevice(), L"Assets\\Textures\\Stone_Wall_002_COLOR.DDS", nullptr, &m_texture)
+		);
+
+		DX::ThrowIfFailed(
+			CreateDDSTextureFromFile(m_deviceResources->GetD3DDevice(), L"Assets\\Textures\\Stone_Wall_002_DISP.DDS", nullptr, &m_displacementTexture)
+		);
+
+		DX::ThrowIfFailed(
+			CreateDDSTextureFromFile(m_deviceResources->GetD3DDevice(), L"Assets\\Textures\\Stone_Wall_002_NRM.DDS", nullptr, &m_normalTexture)
+		);
+	});
+
+	// The floor can be drawn tessellated from here, the mesh and the bounds follow.
+	return (createPatchVSTask && createHSTask && createDSTask && createGBufferPSTask && createMeshVSTask &&
+		createParallaxPSTask && createParallaxGBufferPSTask && createTextureTask).then([this]() {
+		if (m_meshLevels.empty() && !m_displacementLoading)
+		{
+			LoadDisplacement();
+		}
+	});
+}
+
+void FloorRenderer::ReleaseDeviceDependentResources()
+{
+	m_patchVertexShader.Reset();
+	m_patchInputLayout.Reset();
+	m_hullShader.Reset();
+	m_domainShader.Reset();
+	m_patchVertexBuffer.Reset();
+	m_patchesCreated = 0;
+	m_patchDisplacementBuffer.Reset();
+	m_patchDisplacementResourceView.Reset();
+	m_patchDisplacements.clear();
+	m_tessellationConstantBuffer.Reset();
+	m_texture.Reset();
+	m_displacementTexture.Reset();
+	m_normalTexture.Reset();
+	m_gbufferPixelShader.Reset();
+	m_meshVertexShader.Reset();
+	m_meshInputLayout.Reset();
+	m_meshVertexBuffer.Reset();
+	m_meshIndexBuffer.Reset();
+	m_meshLevels.clear();
+	m_meshLod = 0;
+	m_parallaxPixelShader.Reset();
+	m_parallaxGBufferPixelShader.Reset();
+	m_quadVertexBuffer.Reset();
+	m_quadIndexBuffer.Reset();
+	m_statisticsQuery.Reset();
+	m_queryPending = false;
+	m_timingDisjointQuery.Reset();
+	m_timingStartQuery.Reset();
+	m_timingEndQuery.Reset();
+	m_timingPending = false;
+}
+
+void FloorRenderer::SetCamera(const Sdf::float3& eye, const Sdf::float4x4& viewProjection, float fovAngleY, float outputHeight)
+{
+	m_tessellation = FloorTessellation::DefaultSettings(eye, viewProjection, fovAngleY, outputHeight);
+	m_tessellation.targetPixels = m_tessellationTarget;
+	m_tessellation.maxSlope = FloorTessellation::TessellatedSlope(m_tessellation, m_patches);
+	if (!m_pyramid.levels.empty())
+	{
+		FloorTessellation::UseDisplacement(m_tessellation, m_pyramid, m_patches);
+	}
+}
+
+void FloorRenderer::AddPassInputs(RoomPassInputs& inputs) const
+{
+	inputs.modes.push_back(PassBytes::Of(m_tessellation));
+	inputs.modes.push_back(PassBytes::Of(m_patches));
+
+	// The levels change from none to all of them when the mesh is uploaded.
+	inputs.modes.push_back(PassBytes{ m_meshLevels.data(), m_meshLevels.size() * sizeof(MeshLevel) });
+
+	inputs.modes.push_back(PassBytes::Of(m_calibrationFrames));
+
+	inputs.floorMode = m_mode;
+	inputs.resources.push_back(m_texture.Get());
+	inputs.resources.push_back(m_normalTexture.Get());
+	inputs.resources.push_back(m_displacementTexture.Get());
+}
+
+// Reads what the GPU has finished measuring of the floor's earlier draws and chooses the mode to
+// draw it in, every frame, whether or not the room pass is drawn again.
+void FloorRenderer::UpdateCosts()
+{
+	auto context = m_deviceResources->GetD3DDeviceContext();
+
+	// Pick up an earlier count if the GPU has finished it, without waiting for it.
+	D3D11_QUERY_DATA_PIPELINE_STATISTICS statistics;
+	if (m_queryPending &&
+		context->GetData(m_statisticsQuery.Get(), &statistics, sizeof(statistics), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK)
+	{
+		m_triangles = statistics.CInvocations;
+		m_queryPending = false;
+	}
+
+	// The time of an earlier draw goes to the cost model the same way. A disjoint interval, where
+	// the GPU changed its clock, has no usable time.
+	D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+	if (m_timingPending &&
+		context->GetData(m_timingDisjointQuery.Get(), &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK)
+	{
+		UINT64 start, end;
+		if (!disjoint.Disjoint &&
+			context->GetData(m_timingStartQuery.Get(), &start, sizeof(start), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK &&
+			context->GetData(m_timingEndQuery.Get(), &end, sizeof(end), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK)
+		{
+			m_costs.Record(m_timingMode, 1000.0 * (end - start) / disjoint.Frequency);
+		}
+		m_timingPending = false;
+	}
+
+	bool parallaxReady = m_parallaxPixelShader && m_parallaxGBufferPixelShader && m_quadVertexBuffer;
+	if (m_automaticMode)
+	{
+		m_costs.SetAvailable(FloorMode::BakedMesh, !m_meshLevels.empty());
+		m_costs.SetAvailable(FloorMode::Parallax, parallaxReady);
+		m_mode = m_costs.Choose();
+	}
+	else
+	{
+		m_costs.Use(m_mode);
+	}
+
+	// The room pass is drawn again every frame until every mode is measured, since only the floor
+	// it draws is timed.
+	m_calibrationFrames = m_automaticMode && m_costs.IsCalibrating() ? m_calibrationFrames + 1 : 0;
+}
+
+void FloorRenderer::Draw(const SharedResources& shared, bool gbuffer)
+{
+	auto context = m_deviceResources->GetD3DDeviceContext();
+
+	//Clear depth buffer
+	context->ClearDepthStencilView(m_deviceResources->GetDepthStencilView(), D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+
+	bool parallaxReady = m_parallaxPixelShader && m_parallaxGBufferPixelShader && m_quadVertexBuffer;
+
+	// The mesh and the parallax floor are drawn tessellated until they are ready.
+	FloorMode mode = m_mode;
+	if ((mode == FloorMode::BakedMesh && m_meshLevels.empty()) || (mode == FloorMode::Parallax && !parallaxReady))
+	{
+		mode = FloorMode::Tessellated;
+	}
+
+	// Every mode draws the unit floor scaled to the room.
+	XMMATRIX model = XMMatrixIdentity() * XMMatrixScaling(5, 5, 5) * XMMatrixTranslation(0.0f, -2.5f, 0.0f);
+	XMStoreFloat4x4(&shared.constants->model, XMMatrixTranspose(model));
+	context->UpdateSubresource1(shared.constantBuffer, 0, NULL, shared.constants, 0, 0, 0);
+
+	// Time the draw while no earlier time is in flight.
+	bool timeDraw = !m_timingPending;
+	if (timeDraw)
+	{
+		context->Begin(m_timingDisjointQuery.Get());
+		context->End(m_timingStartQuery.Get());
+	}
+
+	switch (mode)
+	{
+	case FloorMode::BakedMesh:
+		DrawMesh(shared, gbuffer);
+		break;
+	case FloorMode::Parallax:
+		DrawParallax(shared, gbuffer);
+		break;
+	default:
+		DrawTessellated(shared, gbuffer);
+		break;
+	}
+
+	if (timeDraw)
+	{
+		context->End(m_timingEndQuery.Get());
+		context->End(m_timingDisjointQuery.Get());
+		m_timingPending = true;
+		m_timingMode = mode;
+	}
+}
+
+// Draws the floor's patch grid, tessellated and displaced by the hull and domain shaders.
+void FloorRenderer::DrawTessellated(const SharedResources& shared, bool gbuffer)
+{
+	auto context = m_deviceResources->GetD3DDeviceContext();
+
+	if (m_patchesCreated != m_patches)
+	{
+		CreatePatches();
+	}
+
+	UINT stride = sizeof(VertexPositionTextureNTB);
+	UINT offset = 0;
+	context->IASetVertexBuffers(0, 1, m_patchVertexBuffer.GetAddressOf(), &stride, &offset);
+	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST);
+	context->IASetInputLayout(m_patchInputLayout.Get());
+
+	context->VSSetShader(m_patchVertexShader.Get(), nullptr, 0);
+	context->HSSetShader(m_hullShader.Get(), nullptr, 0);
+
+	// The hull shader measures the edges in world space on screen.
+	m_tessellationConstantBufferData.eye = XMFLOAT3(m_tessellation.eye.x, m_tessellation.eye.y, m_tessellation.eye.z);
+	m_tessellationConstantBufferData.screenScale = m_tessellation.screenScale;
+	m_tessellationConstantBufferData.targetPixels = m_tessellation.targetPixels;
+	m_tessellationConstantBufferData.maxFactor = m_tessellation.maxFactor;
+	m_tessellationConstantBufferData.displacementLow = m_tessellation.displacementLow;
+	m_tessellationConstantBufferData.displacementHigh = m_tessellation.displacementHigh;
+	m_tessellationConstantBufferData.maxSlope = m_tessellation.maxSlope;
+	m_tessellationConstantBufferData.patchRanges = m_patchDisplacementResourceView ? 1 : 0;
+	m_tessellationConstantBufferData.padding = XMFLOAT2();
+	context->UpdateSubresource1(m_tessellationConstantBuffer.Get(), 0, NULL, &m_tessellationConstantBufferData, 0, 0, 0);
+	ID3D11Buffer *const hullConstantBuffers[2] = { shared.constantBuffer, m_tessellationConstantBuffer.Get() };
+	context->HSSetConstantBuffers1(0, 2, hullConstantBuffers, nullptr, nullptr);
+	context->HSSetShaderResources(0, 1, m_patchDisplacementResourceView.GetAddressOf());
+
+	context->DSSetConstantBuffers1(0, 1, &shared.constantBuffer, nullptr, nullptr);
+	context->DSSetShaderResources(0, 1, m_displacementTexture.GetAddressOf());
+	context->DSSetSamplers(0, 1, &shared.sampler);
+	context->DSSetShader(m_domainShader.Get(), nullptr, 0);
+
+	context->PSSetShader(gbuffer ? m_gbufferPixelShader.Get() : shared.pixelShader, nullptr, 0);
+	context->PSSetShaderResources(0, 1, m_texture.GetAddressOf());
+	context->PSSetShaderResources(1, 1, m_normalTexture.GetAddressOf());
+	context->PSSetSamplers(0, 1, &shared.sampler);
+
+	//Draw the patches, counting their triangles while no earlier count is in flight
+	bool countTriangles = !m_queryPending;
+	if (countTriangles)
+	{
+		context->Begin(m_statisticsQuery.Get());
+	}
+
+	context->Draw(4 * m_patches * m_patches, 0);
+	m_visibility = FloorTessellation::MeasureVisibility(m_tessellation, m_patches, m_patchDisplacements);
+
+	if (countTriangles)
+	{
+		context->End(m_statisticsQuery.Get());
+		m_queryPending = true;
+	}
+
+	context->RSSetState(nullptr);
+	context->HSSetShader(nullptr, nullptr, 0);
+	context->DSSetShader(nullptr, nullptr, 0);
+}
+
+// Draws the baked floor mesh at the level the camera needs, with the floor's pixel shaders and
+// without tessellation.
+void FloorRenderer::DrawMesh(const SharedResources& shared, bool gbuffer)
+{
+	auto context = m_deviceResources->GetD3DDeviceContext();
+
+	std::vector<uint32_t> segments;
+	for (const MeshLevel& level : m_meshLevels)
+	{
+		segments.push_back(level.segments);
+	}
+	m_meshLod = FloorMeshBaker::SelectLod(segments, m_tessellation);
+	const MeshLevel& level = m_meshLevels[m_meshLod];
+
+	UINT stride = sizeof(FloorMeshVertex);
+	UINT offset = 0;
+	context->IASetVertexBuffers(0, 1, m_meshVertexBuffer.GetAddressOf(), &stride, &offset);
+	context->IASetIndexBuffer(m_meshIndexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	context->IASetInputLayout(m_meshInputLayout.Get());
+
+	context->VSSetShader(m_meshVertexShader.Get(), nullptr, 0);
+	context->VSSetConstantBuffers1(0, 1, &shared.constantBuffer, nullptr, nullptr);
+
+	context->PSSetShader(gbuffer ? m_gbufferPixelShader.Get() : shared.pixelShader, nullptr, 0);
+	context->PSSetShaderResources(0, 1, m_texture.GetAddressOf());
+	context->PSSetShaderResources(1, 1, m_normalTexture.GetAddressOf());
+	context->PSSetSamplers(0, 1, &shared.sampler);
+
+	bool countTriangles = !m_queryPending;
+	if (countTriangles)
+	{
+		context->Begin(m_statisticsQuery.Get());
+	}
+
+	context->DrawIndexed(level.indexCount, level.startIndex, level.baseVertex);
+
+	if (countTriangles)
+	{
+		context->End(m_statisticsQuery.Get());
+		m_queryPending = true;
+	}
+}
+
+// Draws the floor as one flat quad at the top of its displacement, which the parallax variants of
+// the floor's pixel shader march into.
+void FloorRenderer::DrawParallax(const SharedResources& shared, bool gbuffer)
+{
+	auto context = m_deviceResources->GetD3DDeviceContext();
+
+	UINT stride = sizeof(FloorMeshVertex);
+	UINT offset = 0;
+	context->IASetVertexBuffers(0, 1, m_quadVertexBuffer.GetAddressOf(), &stride, &offset);
+	context->IASetIndexBuffer(m_quadIndexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	context->IASetInputLayout(m_meshInputLayout.Get());
+
+	context->VSSetShader(m_meshVertexShader.Get(), nullptr, 0);
+	context->VSSetConstantBuffers1(0, 1, &shared.constantBuffer, nullptr, nullptr);
+
+	context->PSSetShader(gbuffer ? m_parallaxGBufferPixelShader.Get() : m_parallaxPixelShader.Get(), nullptr, 0);
+	context->PSSetShaderResources(0, 1, m_texture.GetAddressOf());
+	context->PSSetShaderResources(1, 1, m_normalTexture.GetAddressOf());
+	context->PSSetShaderResources(2, 1, m_displacementTexture.GetAddressOf());
+	context->PSSetSamplers(0, 1, &shared.sampler);
+
+	bool countTriangles = !m_queryPending;
+	if (countTriangles)
+	{
+		context->Begin(m_statisticsQuery.Get());
+	}
+
+	context->DrawIndexed(6, 0, 0);
+
+	if (countTriangles)
+	{
+		context->End(m_statisticsQuery.Get());
+		m_queryPending = true;
+	}
+}
+
+void FloorRenderer::SetPatches(uint32 count)
+{
+	m_patches = std::max<uint32>(count, 1);
+	m_tessellation.maxSlope = FloorTessellation::TessellatedSlope(m_tessellation, m_patches);
+}
+
+// Fills the floor's vertex buffer with four control points for each of its patches, and once the
+// displacement texture is decoded, the hull shader's buffer with the range of each.
+void FloorRenderer::CreatePatches()
+{
+	std::vector<FloorControlPoint> points;
+	FloorTessellation::BuildPatchGrid(m_patches, points);
+
+	// The domain shader displaces along the normal of the first control point.
+	std::vector<VertexPositionTextureNTB> vertices;
+	for (const FloorControlPoint& point : points)
+	{
+		VertexPositionTextureNTB vertex = {
+			XMFLOAT3(point.position.x, point.position.y, point.position.z),
+			XMFLOAT2(point.texture.x, point.texture.y),
+			XMFLOAT3(0.0f, 1.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 1.0f), XMFLOAT3(1.0f, 0.0f, 0.0f)
+		};
+		vertices.push_back(vertex);
+	}
+
+	D3D11_SUBRESOURCE_DATA vertexBufferData = { 0 };
+	vertexBufferData.pSysMem = vertices.data();
+	CD3D11_BUFFER_DESC vertexBufferDesc(static_cast<UINT>(vertices.size() * sizeof(VertexPositionTextureNTB)), D3D11_BIND_VERTEX_BUFFER);
+	DX::ThrowIfFailed(
+		m_deviceResources->GetD3DDevice()->CreateBuffer(&vertexBufferDesc, &vertexBufferData, m_patchVertexBuffer.ReleaseAndGetAddressOf())
+	);
+
+	m_patchDisplacements.clear();
+	m_patchDisplacementBuffer.Reset();
+	m_patchDisplacementResourceView.Reset();
+	if (!m_pyramid.levels.empty())
+	{
+		FloorTessellation::PatchDisplacements(m_pyramid, m_patches, m_patchDisplacements);
+
+		UINT count = static_cast<UINT>(m_patchDisplacements.size());
+		D3D11_SUBRESOURCE_DATA rangeData = { 0 };
+		rangeData.pSysMem = m_patchDisplacements.data();
+		CD3D11_BUFFER_DESC rangeBufferDesc(count * sizeof(Sdf::float2), D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_IMMUTABLE,
+			0, D3D11_RESOURCE_MISC_BUFFER_STRUCTURED, sizeof(Sdf::float2));
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateBuffer(&rangeBufferDesc, &rangeData, &m_patchDisplacementBuffer)
+		);
+
+		CD3D11_SHADER_RESOURCE_VIEW_DESC rangeViewDesc(m_patchDisplacementBuffer.Get(), DXGI_FORMAT_UNKNOWN, 0, count);
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateShaderResourceView(m_patchDisplacementBuffer.Get(), &rangeViewDesc, &m_patchDisplacementResourceView)
+		);
+	}
+
+	m_patchesCreated = m_patches;
+}
+
+// Decodes the displacement texture in the background and builds its min/max pyramid, which
+// bounds the floor's patches and its baked mesh. The floor mesh comes from the local folder, or
+// is baked there, and every level is uploaded into one vertex and one index buffer.
+void FloorRenderer::LoadDisplacement()
+{
+	m_displacementLoading = true;
+
+	std::wstring folder(Windows::Storage::ApplicationData::Current->LocalFolder->Path->Data());
+
+	// The read would hand the file back on the UI thread, so the bake asks for the thread pool.
+	DX::ReadDataAsync(L"Assets\\Textures\\Stone_Wall_002_DISP.DDS").then([folder](const std::vector<byte>& fileData) {
+		std::pair<DisplacementPyramid, FloorMesh> result;
+
+		// A texture in a format the decoder does not read leaves the floor tessellated, with the
+		// worst case bounds.
+		DdsImage image;
+		if (!DdsDecoder::Decode(fileData.data(), fileData.size(), image))
+		{
+			return result;
+		}
+		result.first = DisplacementBounds::Build(image);
+
+		FloorMeshBaker::Settings settings = FloorMeshBaker::DefaultSettings();
+		uint64_t key = FloorMeshBaker::Key(settings, fileData.data(), fileData.size());
+		std::string name = FloorMeshBaker::CacheFileName(key);
+		std::wstring path = folder + L"\\" + std::wstring(name.begin(), name.end());
+
+		std::ifstream cached(path, std::ios::binary);
+		if (cached && FloorMeshBaker::Load(cached, key, result.second))
+		{
+			return result;
+		}
+
+		result.second = FloorMeshBaker::Bake(settings, image, key);
+
+		std::ofstream file(path, std::ios::binary);
+		if (file)
+		{
+			FloorMeshBaker::Save(result.second, file);
+		}
+		return result;
+	}, concurrency::task_continuation_context::use_arbitrary()).then([this](const std::pair<DisplacementPyramid, FloorMesh>& result) {
+		// The patches pick up their ranges the next time the floor is drawn.
+		m_pyramid = result.first;
+		if (!m_pyramid.levels.empty())
+		{
+			FloorTessellation::UseDisplacement(m_tessellation, m_pyramid, m_patches);
+			m_patchesCreated = 0;
+		}
+
+		const FloorMesh& mesh = result.second;
+		std::vector<FloorMeshVertex> vertices;
+		std::vector<uint32_t> indices;
+		std::vector<MeshLevel> levels;
+		for (const FloorMeshLod& lod : mesh.lods)
+		{
+			MeshLevel level = { lod.segments, static_cast<UINT>(indices.size()), static_cast<UINT>(lod.indices.size()), static_cast<INT>(vertices.size()) };
+			levels.push_back(level);
+			vertices.insert(vertices.end(), lod.vertices.begin(), lod.vertices.end());
+			indices.insert(indices.end(), lod.indices.begin(), lod.indices.end());
+		}
+
+		if (!levels.empty())
+		{
+			D3D11_SUBRESOURCE_DATA vertexBufferData = { 0 };
+			vertexBufferData.pSysMem = vertices.data();
+			CD3D11_BUFFER_DESC vertexBufferDesc(static_cast<UINT>(vertices.size() * sizeof(FloorMeshVertex)), D3D11_BIND_VERTEX_BUFFER, D3D11_USAGE_IMMUTABLE);
+			DX::ThrowIfFailed(
+				m_deviceResources->GetD3DDevice()->CreateBuffer(&vertexBufferDesc, &vertexBufferData, &m_meshVertexBuffer)
+			);
+
+			D3D11_SUBRESOURCE_DATA indexBufferData = { 0 };
+			indexBufferData.pSysMem = indices.data();
+			CD3D11_BUFFER_DESC indexBufferDesc(static_cast<UINT>(indices.size() * sizeof(uint32_t)), D3D11_BIND_INDEX_BUFFER, D3D11_USAGE_IMMUTABLE);
+			DX::ThrowIfFailed(
+				m_deviceResources->GetD3DDevice()->CreateBuffer(&indexBufferDesc, &indexBufferData, &m_meshIndexBuffer)
+			);
+		}
+
+		m_meshLevels = levels;
+		m_displacementLoading = false;
+	}, concurrency::task_continuation_context::use_current());
+}
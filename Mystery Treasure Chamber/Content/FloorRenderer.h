@@ -0,0 +1,167 @@
+﻿#pragma once
+
+#include "..\Common\DeviceResources.h"
+#include "ShaderStructures.h"
+#include "PassCache.h"
+#include "FloorTessellation.h"
+#include "FloorMesh.h"
+#include "FloorCostModel.h"
+
+#include <ppltasks.h>
+#include <vector>
+
+namespace Mystery_Treasure_Chamber
+{
+	// Draws the floor of the room in one of the FloorModes: tessellated and displaced on the GPU,
+	// as a mesh displaced once on the CPU, or as one flat quad the pixel shader displaces. Owns the
+	// floor's shaders, textures and buffers, and times its draws for FloorCostModel.
+	class FloorRenderer
+	{
+	public:
+		// What the floor draws with that the scene renderer owns. The floor writes its model matrix
+		// into constants and uploads them to constantBuffer, and binds its own vertex and index
+		// buffers, so the next draw has to set its own.
+		// The lit pixel shader is the renderer's, which switches it between the variants of the
+		// quality tiers.
+		struct SharedResources
+		{
+			ModelViewProjectionConstantBuffer*	constants;
+			ID3D11Buffer*						constantBuffer;
+			ID3D11SamplerState*					sampler;
+			ID3D11PixelShader*					pixelShader;
+		};
+
+		FloorRenderer(const std::shared_ptr<DX::DeviceResources>& deviceResources);
+
+		// Loads the floor's shaders and textures, done when the floor can be drawn. The baked mesh
+		// and the displacement bounds follow in the background.
+		concurrency::task<void> CreateDeviceDependentResources();
+		void ReleaseDeviceDependentResources();
+
+		// The camera the floor's edges are measured in pixels of, and its patches culled against.
+		void SetCamera(const Sdf::float3& eye, const Sdf::float4x4& viewProjection, float fovAngleY, float outputHeight);
+
+		// Feeds the cost model the floor's latest timings and chooses its mode. Called at the start
+		// of every frame, before the room pass is hashed.
+		void UpdateCosts();
+
+		// Draws the floor into the bound render target, on a cleared depth buffer, in the mode the
+		// cost model chooses or the one set. With gbuffer it goes into the bound G-buffer instead
+		// of being lit.
+		void Draw(const SharedResources& shared, bool gbuffer);
+
+		// What the room pass reads of the floor, for its hash. The modes point into the floor.
+		void AddPassInputs(RoomPassInputs& inputs) const;
+
+		// Splits each edge of the floor so its triangles cover about pixels on screen, up to the
+		// old fixed factor of 32, see FloorTessellation. 0 tessellates everything at 32.
+		void SetTessellationTarget(float pixels)		{ m_tessellationTarget = m_tessellation.targetPixels = pixels; }
+		float GetTessellationTarget() const				{ return m_tessellationTarget; }
+
+		// Splits the floor into count by count patches, which the hull shader culls one by one
+		// against the view frustum and for facing away.
+		void SetPatches(uint32 count);
+		uint32 GetPatches() const						{ return m_patches; }
+
+		// Triangles the floor was drawn with the last time, tessellated or baked, as of the latest
+		// query result.
+		uint64 GetTriangles() const						{ return m_triangles; }
+
+		// How many of the floor's patches the hull shader keeps for the current camera, from the
+		// CPU model of its culling.
+		const FloorTessellation::Visibility& GetVisibility() const	{ return m_visibility; }
+
+		// Draws the floor as a mesh displaced once on the CPU from the displacement texture, instead
+		// of tessellating and displacing it every frame. The mesh is baked in the background the
+		// first time and cached in the local folder under the hash of the texture file, see
+		// FloorMeshBaker, and the floor stays tessellated until it is ready. Its level of detail
+		// follows the tessellation target. FloorMode::Parallax draws one flat quad instead, which the
+		// pixel shader displaces with parallax occlusion mapping, see FloorParallax. Setting a mode
+		// turns the automatic choice off.
+		void SetMode(FloorMode mode)					{ m_mode = mode; m_automaticMode = false; }
+		FloorMode GetMode() const						{ return m_mode; }
+
+		// Level of the baked mesh drawn last, 0 for the finest.
+		uint32 GetMeshLod() const						{ return m_meshLod; }
+
+		// Lets FloorCostModel choose the floor mode from what each costs on the GPU, starting from
+		// guesses for a hardware or a WARP device. On until a mode is set by hand.
+		void SetAutomaticMode(bool enabled)				{ m_automaticMode = enabled; }
+		bool GetAutomaticMode() const					{ return m_automaticMode; }
+
+		// What each floor mode costs, timed with timestamp queries around the floor's draw.
+		const FloorCostModel& GetCosts() const			{ return m_costs; }
+
+	private:
+		// Where one level of the baked floor mesh is in its shared vertex and index buffers.
+		struct MeshLevel
+		{
+			uint32	segments;
+			UINT	startIndex;
+			UINT	indexCount;
+			INT		baseVertex;
+		};
+
+		void DrawTessellated(const SharedResources& shared, bool gbuffer);
+		void DrawMesh(const SharedResources& shared, bool gbuffer);
+		void DrawParallax(const SharedResources& shared, bool gbuffer);
+		void CreatePatches();
+		void LoadDisplacement();
+
+	private:
+		// Cached pointer to device resources.
+		std::shared_ptr<DX::DeviceResources> m_deviceResources;
+
+		// Tessellated patches.
+		Microsoft::WRL::ComPtr<ID3D11VertexShader>		m_patchVertexShader;
+		Microsoft::WRL::ComPtr<ID3D11InputLayout>		m_patchInputLayout;
+		Microsoft::WRL::ComPtr<ID3D11HullShader>		m_hullShader;
+		Microsoft::WRL::ComPtr<ID3D11DomainShader>		m_domainShader;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>			m_patchVertexBuffer;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>			m_patchDisplacementBuffer;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	m_patchDisplacementResourceView;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>			m_tessellationConstantBuffer;
+
+		// Textures, and the pixel shader that writes the G-buffer.
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_texture;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_displacementTexture;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_normalTexture;
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>		m_gbufferPixelShader;
+
+		// Baked mesh, with the flat quad of the parallax floor that shares its vertices.
+		Microsoft::WRL::ComPtr<ID3D11VertexShader>		m_meshVertexShader;
+		Microsoft::WRL::ComPtr<ID3D11InputLayout>		m_meshInputLayout;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>			m_meshVertexBuffer;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>			m_meshIndexBuffer;
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>		m_parallaxPixelShader;
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>		m_parallaxGBufferPixelShader;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>			m_quadVertexBuffer;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>			m_quadIndexBuffer;
+
+		// Triangle count and timing of the draws.
+		Microsoft::WRL::ComPtr<ID3D11Query>				m_statisticsQuery;
+		Microsoft::WRL::ComPtr<ID3D11Query>				m_timingDisjointQuery;
+		Microsoft::WRL::ComPtr<ID3D11Query>				m_timingStartQuery;
+		Microsoft::WRL::ComPtr<ID3D11Query>				m_timingEndQuery;
+
+		TessellationConstantBuffer		m_tessellationConstantBufferData;
+		bool	m_queryPending;
+		uint64	m_triangles;
+		uint32	m_patches;
+		uint32	m_patchesCreated;		// Patches in the vertex buffer, 0 before it is created.
+		float	m_tessellationTarget;
+		FloorTessellation::Settings		m_tessellation;
+		FloorTessellation::Visibility	m_visibility;
+		FloorMode	m_mode;
+		bool		m_displacementLoading;
+		uint32		m_meshLod;
+		std::vector<MeshLevel>		m_meshLevels;			// Empty until the mesh is baked and uploaded.
+		DisplacementPyramid			m_pyramid;				// Empty until the displacement texture is decoded.
+		std::vector<Sdf::float2>	m_patchDisplacements;	// Range of each patch in m_patchDisplacementBuffer.
+		bool			m_automaticMode;
+		bool			m_timingPending;
+		FloorMode		m_timingMode;		// What was drawn between the pending timestamps.
+		FloorCostModel	m_costs;
+		uint32			m_calibrationFrames;	// Frames the cost model has been calibrating, 0 once it is done.
+	};
+}
@@ -0,0 +1,263 @@
+﻿#include "FloorTessellation.h"
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	// Grid line i of patches along one side of the object space floor, which goes from -1 to 1.
+	float GridLine(uint32_t patches, uint32_t i)
+	{
+		return -1.0f + 2.0f * i / patches;
+	}
+
+	void WorldCorners(uint32_t patches, uint32_t x, uint32_t z, float3 corners[4])
+	{
+		FloorTessellation::PatchCorners(patches, x, z, corners);
+		for (int i = 0; i < 4; i++)
+		{
+			corners[i] = FloorTessellation::ToWorld(corners[i]);
+		}
+	}
+}
+
+FloorTessellation::Settings FloorTessellation::DefaultSettings(const float3& eye, const float4x4& viewProjection, float fovAngleY, float height)
+{
+	Settings settings;
+	settings.eye = eye;
+	settings.screenScale = ScreenScale(fovAngleY, height);
+	settings.targetPixels = 8.0f;
+	settings.maxFactor = 32.0f;
+	settings.viewProjection = viewProjection;
+	settings.displacementLow = -DisplacementScale * FloorScale;
+	settings.displacementHigh = 0.0f;
+	settings.maxSlope = TessellatedSlope(settings, DefaultPatches);
+	return settings;
+}
+
+float FloorTessellation::ScreenScale(float fovAngleY, float height)
+{
+	return 0.5f * height / std::tan(0.5f * fovAngleY);
+}
+
+float FloorTessellation::TessellatedSlope(const Settings& settings, uint32_t patches)
+{
+	float shortestEdge = 2.0f * FloorScale / patches / std::ceil(settings.maxFactor);
+	return (settings.displacementHigh - settings.displacementLow) / shortestEdge;
+}
+
+float2 FloorTessellation::WorldDisplacement(const DisplacementRange& range)
+{
+	// A higher texel moves the floor further down.
+	return float2(-DisplacementScale * FloorScale * range.high, -DisplacementScale * FloorScale * range.low);
+}
+
+void FloorTessellation::UseDisplacement(Settings& settings, const DisplacementPyramid& pyramid, uint32_t patches)
+{
+	float2 displacement = WorldDisplacement(DisplacementBounds::Whole(pyramid));
+	settings.displacementLow = displacement.x;
+	settings.displacementHigh = displacement.y;
+	settings.maxSlope = TessellatedSlope(settings, patches);
+}
+
+void FloorTessellation::PatchDisplacements(const DisplacementPyramid& pyramid, uint32_t patches, std::vector<float2>& ranges)
+{
+	ranges.clear();
+	ranges.reserve(size_t(patches) * patches);
+	for (uint32_t z = 0; z < patches; z++)
+	{
+		for (uint32_t x = 0; x < patches; x++)
+		{
+			// Texture coordinates as BuildPatchGrid gives them, v runs the other way from z.
+			float3 corners[4];
+			PatchCorners(patches, x, z, corners);
+			float2 textureMin(0.5f * (corners[0].x + 1.0f), 0.5f * (1.0f - corners[0].z));
+			float2 textureMax(0.5f * (corners[3].x + 1.0f), 0.5f * (1.0f - corners[3].z));
+			ranges.push_back(WorldDisplacement(DisplacementBounds::Range(pyramid, textureMin, textureMax)));
+		}
+	}
+}
+
+void FloorTessellation::PatchCorners(uint32_t patches, uint32_t x, uint32_t z, float3 corners[4])
+{
+	float x0 = GridLine(patches, x), x1 = GridLine(patches, x + 1);
+	float z0 = GridLine(patches, z), z1 = GridLine(patches, z + 1);
+	corners[0] = float3(x0, 0.0f, z1);
+	corners[1] = float3(x0, 0.0f, z0);
+	corners[2] = float3(x1, 0.0f, z1);
+	corners[3] = float3(x1, 0.0f, z0);
+}
+
+float3 FloorTessellation::ToWorld(const float3& Position)
+{
+	return float3(Position.x * FloorScale, Position.y * FloorScale + FloorHeight, Position.z * FloorScale);
+}
+
+void FloorTessellation::BuildPatchGrid(uint32_t patches, std::vector<FloorControlPoint>& points)
+{
+	points.clear();
+	points.reserve(size_t(patches) * patches * 4);
+	for (uint32_t z = 0; z < patches; z++)
+	{
+		for (uint32_t x = 0; x < patches; x++)
+		{
+			float3 corners[4];
+			PatchCorners(patches, x, z, corners);
+			for (const float3& corner : corners)
+			{
+				FloorControlPoint point;
+				point.position = corner;
+				point.texture = float2(0.5f * (corner.x + 1.0f), 0.5f * (1.0f - corner.z));
+				points.push_back(point);
+			}
+		}
+	}
+}
+
+PatchBounds FloorTessellation::Bounds(const Settings& settings, const float3 corners[4])
+{
+	return Bounds(settings, corners, float2(settings.displacementLow, settings.displacementHigh));
+}
+
+PatchBounds FloorTessellation::Bounds(const Settings&, const float3 corners[4], const float2& displacement)
+{
+	PatchBounds bounds = { corners[0], corners[0] };
+	for (int i = 1; i < 4; i++)
+	{
+		bounds.minimum = min(bounds.minimum, corners[i]);
+		bounds.maximum = max(bounds.maximum, corners[i]);
+	}
+	bounds.minimum.y += displacement.x;
+	bounds.maximum.y += displacement.y;
+	return bounds;
+}
+
+bool FloorTessellation::InFrustum(const Settings& settings, const PatchBounds& bounds)
+{
+	// Counts the corners outside each plane: left, right, bottom, top, near and far.
+	int outside[6] = {};
+	for (int i = 0; i < 8; i++)
+	{
+		float3 corner((i & 1) ? bounds.maximum.x : bounds.minimum.x,
+			(i & 2) ? bounds.maximum.y : bounds.minimum.y,
+			(i & 4) ? bounds.maximum.z : bounds.minimum.z);
+		float4 clip = mul(float4(corner, 1.0f), settings.viewProjection);
+
+		outside[0] += clip.x < -clip.w;
+		outside[1] += clip.x > clip.w;
+		outside[2] += clip.y < -clip.w;
+		outside[3] += clip.y > clip.w;
+		outside[4] += clip.z < 0.0f;
+		outside[5] += clip.z > clip.w;
+	}
+
+	for (int plane = 0; plane < 6; plane++)
+	{
+		if (outside[plane] == 8)
+			return false;
+	}
+	return true;
+}
+
+bool FloorTessellation::FacesAway(const Settings& settings, const PatchBounds& bounds)
+{
+	float dx = std::max(std::fabs(settings.eye.x - bounds.minimum.x), std::fabs(settings.eye.x - bounds.maximum.x));
+	float dz = std::max(std::fabs(settings.eye.z - bounds.minimum.z), std::fabs(settings.eye.z - bounds.maximum.z));
+	return settings.eye.y - bounds.minimum.y + settings.maxSlope * (dx + dz) < 0.0f;
+}
+
+float FloorTessellation::EdgeFactor(const Settings& settings, const float3& a, const float3& b)
+{
+	if (settings.targetPixels <= 0.0f)
+		return settings.maxFactor;
+
+	// Both sums and the length are the same either way round.
+	float3 centre = (a + b) * 0.5f;
+	float diameter = length(a - b);
+	float distance = std::max(length(centre - settings.eye), 0.5f * diameter);
+	float pixels = diameter * settings.screenScale / std::max(distance, 1e-4f);
+
+	return clamp(pixels / settings.targetPixels, 1.0f, settings.maxFactor);
+}
+
+PatchFactors FloorTessellation::Factors(const Settings& settings, const float3 corners[4])
+{
+	return Factors(settings, corners, float2(settings.displacementLow, settings.displacementHigh));
+}
+
+PatchFactors FloorTessellation::Factors(const Settings& settings, const float3 corners[4], const float2& displacement)
+{
+	PatchFactors factors = {};
+
+	PatchBounds bounds = Bounds(settings, corners, displacement);
+	if (!InFrustum(settings, bounds) || FacesAway(settings, bounds))
+		return factors;
+
+	factors.edges[0] = EdgeFactor(settings, corners[0], corners[1]);
+	factors.edges[1] = EdgeFactor(settings, corners[0], corners[2]);
+	factors.edges[2] = EdgeFactor(settings, corners[2], corners[3]);
+	factors.edges[3] = EdgeFactor(settings, corners[1], corners[3]);
+	factors.inside[0] = std::max(factors.edges[1], factors.edges[3]);
+	factors.inside[1] = std::max(factors.edges[0], factors.edges[2]);
+	return factors;
+}
+
+uint32_t FloorTessellation::RoundFactor(float factor)
+{
+	return static_cast<uint32_t>(std::ceil(clamp(factor, 1.0f, HardwareMaxFactor)));
+}
+
+uint32_t FloorTessellation::TriangleCount(const PatchFactors& factors)
+{
+	// The tessellator drops a patch with any edge at 0.
+	for (float edge : factors.edges)
+	{
+		if (!(edge > 0.0f))
+			return 0;
+	}
+
+	int u = static_cast<int>(RoundFactor(factors.inside[0]));
+	int v = static_cast<int>(RoundFactor(factors.inside[1]));
+
+	// The inner grid loses a row of quads on each side to the rings, and each ring has a triangle
+	// per segment of its edge and per segment of the grid's edge next to it.
+	int count = 2 * (u - 2) * (v - 2);
+	count += static_cast<int>(RoundFactor(factors.edges[0]) + RoundFactor(factors.edges[2])) + 2 * (v - 2);
+	count += static_cast<int>(RoundFactor(factors.edges[1]) + RoundFactor(factors.edges[3])) + 2 * (u - 2);
+	return static_cast<uint32_t>(std::max(count, 2));
+}
+
+FloorTessellation::Visibility FloorTessellation::MeasureVisibility(const Settings& settings, uint32_t patches,
+	const std::vector<float2>& displacements)
+{
+	bool patchDisplacements = displacements.size() == size_t(patches) * patches;
+
+	Visibility visibility = {};
+	for (uint32_t z = 0; z < patches; z++)
+	{
+		for (uint32_t x = 0; x < patches; x++)
+		{
+			float3 corners[4];
+			WorldCorners(patches, x, z, corners);
+
+			float2 displacement = patchDisplacements ? displacements[z * patches + x] :
+				float2(settings.displacementLow, settings.displacementHigh);
+			PatchBounds bounds = Bounds(settings, corners, displacement);
+			visibility.patches++;
+			if (!InFrustum(settings, bounds))
+			{
+				visibility.outsideFrustum++;
+				continue;
+			}
+			if (FacesAway(settings, bounds))
+			{
+				visibility.facingAway++;
+				continue;
+			}
+
+			visibility.visiblePatches++;
+			visibility.triangles += TriangleCount(Factors(settings, corners, displacement));
+		}
+	}
+	return visibility;
+}
@@ -0,0 +1,143 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "DisplacementPyramid.h"
+#include "SdfMath.h"
+
+namespace Mystery_Treasure_Chamber
+{
+	// Tessellation factors of one quad patch in the order of HullShader.hlsl. The patch's control
+	// points p0 to p3 are blended by DomainShader.hlsl as lerp(lerp(p0, p1, v), lerp(p2, p3, v), u),
+	// so the edges are u = 0 (p0 p1), v = 0 (p0 p2), u = 1 (p2 p3) and v = 1 (p1 p3). A patch that
+	// is culled has every factor 0.
+	struct PatchFactors
+	{
+		float	edges[4];
+		float	inside[2];	// Along u, then along v.
+	};
+
+	// A control point of the floor's patches in object space, what the renderer's vertex buffer holds.
+	struct FloorControlPoint
+	{
+		Sdf::float3	position;
+		Sdf::float2	texture;
+	};
+
+	// World space box around everything the domain shader can make of a patch.
+	struct PatchBounds
+	{
+		Sdf::float3	minimum;
+		Sdf::float3	maximum;
+	};
+
+	// CPU reference of CalcHSPatchConstants in HullShader.hlsl. The floor is a grid of patches, and
+	// each edge is split so that its segments cover about targetPixels on screen, measured as the
+	// projected diameter of the sphere around the edge. The factor only depends on the edge's two
+	// end points, never on the patch, so the two patches on either side of an edge always agree and
+	// the floor has no cracks. Patches whose bounds, displacement included, are outside the view
+	// frustum or can only show their back faces get factor 0, and the tessellator drops them. With
+	// the displacement texture's pyramid, each patch is bounded by what the texture holds under it.
+	namespace FloorTessellation
+	{
+		// Largest factor Direct3D 11 tessellates to.
+		const float HardwareMaxFactor = 64.0f;
+
+		// The floor's model matrix in DrawFloor, a scale and a drop to the bottom of the room.
+		const float FloorScale = 5.0f;
+		const float FloorHeight = -2.5f;
+
+		// The domain shader moves the floor down by this times the displacement texture, in object space.
+		const float DisplacementScale = 0.03f;
+
+		// Patches along each side of the floor.
+		const uint32_t DefaultPatches = 8;
+
+		struct Settings
+		{
+			Sdf::float3		eye;
+			float			screenScale;		// Pixels covered by one unit at distance one, see ScreenScale.
+			float			targetPixels;		// Edge of a triangle on screen, 0 for the fixed maxFactor everywhere.
+			float			maxFactor;
+			Sdf::float4x4	viewProjection;		// The raster camera, row vectors as in DirectXMath.
+			float			displacementLow;	// Most the surface can move along y in world space, down and up.
+			float			displacementHigh;
+			float			maxSlope;			// Steepest the tessellated surface can be, see TessellatedSlope.
+		};
+
+		// Settings of the renderer's camera for an output height in pixels, with the displacement
+		// texture assumed to go all the way from 0 to 1 and the default patches.
+		Settings DefaultSettings(const Sdf::float3& eye, const Sdf::float4x4& viewProjection, float fovAngleY, float height);
+
+		// Half the height in pixels over tan(fovAngleY / 2).
+		float ScreenScale(float fovAngleY, float height);
+
+		// Steepest a triangle of the tessellated floor can be: the displacement range over the
+		// shortest edge a patch can be split into.
+		float TessellatedSlope(const Settings& settings, uint32_t patches);
+
+		// How far the domain shader moves the floor along y in world space for texture values in
+		// range, down in x and up in y.
+		Sdf::float2 WorldDisplacement(const DisplacementRange& range);
+
+		// Narrows the settings' displacement range and slope to what the texture actually holds.
+		void UseDisplacement(Settings& settings, const DisplacementPyramid& pyramid, uint32_t patches);
+
+		// World space displacement range of each patch, row after row like BuildPatchGrid.
+		void PatchDisplacements(const DisplacementPyramid& pyramid, uint32_t patches, std::vector<Sdf::float2>& ranges);
+
+		// Corners of patch (x, z) of the grid in object space, in control point order. Neighbours
+		// compute their shared corners the same way, so they match to the bit.
+		void PatchCorners(uint32_t patches, uint32_t x, uint32_t z, Sdf::float3 corners[4]);
+
+		// Object space to world space, the same as the floor's model matrix.
+		Sdf::float3 ToWorld(const Sdf::float3& Position);
+
+		// Four control points per patch, row after row. The texture coordinates run over the whole
+		// floor the way the domain location did over the single patch it used to be.
+		void BuildPatchGrid(uint32_t patches, std::vector<FloorControlPoint>& points);
+
+		// The patch with world space corners, moved by the whole displacement range, or by the
+		// patch's own down in x and up in y.
+		PatchBounds Bounds(const Settings& settings, const Sdf::float3 corners[4]);
+		PatchBounds Bounds(const Settings& settings, const Sdf::float3 corners[4], const Sdf::float2& displacement);
+
+		// False when every point of the box is on the outside of one of the clip planes.
+		bool InFrustum(const Settings& settings, const PatchBounds& bounds);
+
+		// True when no triangle in the box can face the eye. The triangles' normals lean at most
+		// maxSlope away from up, so n . (eye - p) is at most (eye - p).y + maxSlope (|dx| + |dz|).
+		bool FacesAway(const Settings& settings, const PatchBounds& bounds);
+
+		// Factor of the edge from a to b in world space, before the tessellator rounds it. Swapping
+		// a and b gives exactly the same factor.
+		float EdgeFactor(const Settings& settings, const Sdf::float3& a, const Sdf::float3& b);
+
+		// Factors of the patch with control points corners in world space. Each inside factor is
+		// the larger of the two edges along it, and culled patches get 0 everywhere.
+		PatchFactors Factors(const Settings& settings, const Sdf::float3 corners[4]);
+		PatchFactors Factors(const Settings& settings, const Sdf::float3 corners[4], const Sdf::float2& displacement);
+
+		// What integer partitioning makes of a factor.
+		uint32_t RoundFactor(float factor);
+
+		// Triangles the tessellator makes of a patch: the inner grid and the ring stitched between it
+		// and each edge. Exact when both inside factors round to more than 1, or everything to 1.
+		uint32_t TriangleCount(const PatchFactors& factors);
+
+		// What the hull shader keeps of the floor's patches for one camera.
+		struct Visibility
+		{
+			uint32_t	patches;
+			uint32_t	visiblePatches;
+			uint32_t	outsideFrustum;
+			uint32_t	facingAway;			// Inside the frustum, but only showing back faces.
+			uint32_t	triangles;
+		};
+
+		// Each patch is bounded by its range in displacements, or by the settings' without them.
+		Visibility MeasureVisibility(const Settings& settings, uint32_t patches,
+			const std::vector<Sdf::float2>& displacements = std::vector<Sdf::float2>());
+	}
+}
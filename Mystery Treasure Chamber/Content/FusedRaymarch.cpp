@@ -0,0 +1,170 @@
+﻿#include "FusedRaymarch.h"
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	const float BoxSize = 5.0f;
+	const int Intervals = 200;
+
+	// The floor quad: scaled by 5 and moved down by 2.5 in Render().
+	const float FloorHeight = -2.5f;
+	const float FloorSize = 5.0f;
+
+	// Bytes per pixel of the targets involved.
+	const uint64_t RoomTargetBytes = 16;	// DXGI_FORMAT_R32G32B32A32_FLOAT
+	const uint64_t BackBufferBytes = 4;		// DXGI_FORMAT_B8G8R8A8_UNORM
+	const uint64_t DepthBytes = 4;			// DXGI_FORMAT_D24_UNORM_S8_UINT
+
+	float sdBox(const float3& p, const float3& b)
+	{
+		float3 d = abs(p) - b;
+		return std::min(std::max(d.x, std::max(d.y, d.z)), 0.0f) + length(max(d, 0.0f));
+	}
+
+	float sdCylinder(const float3& p, const float3& c)
+	{
+		return length(float2(p.x - c.x, p.z - c.y)) - c.z;
+	}
+}
+
+bool FusedRaymarch::IntersectBox(const float3& origin, const float3& direction, float& timeIn, float& timeOut)
+{
+	float3 OMIN = (float3(-BoxSize) - origin) / direction;
+	float3 OMAX = (float3(BoxSize) - origin) / direction;
+	float3 MAX = max(OMAX, OMIN);
+	float3 MIN = min(OMAX, OMIN);
+	timeOut = std::min(MAX.x, std::min(MAX.y, MAX.z));
+	timeIn = std::max(std::max(MIN.x, 0.0f), std::max(MIN.y, MIN.z));
+
+	return timeOut > timeIn;
+}
+
+float FusedRaymarch::Room(const float3& Position)
+{
+	return -sdBox(Position, float3(5, 5, 5));
+}
+
+float FusedRaymarch::Pillars(const float3& Position)
+{
+	float Fun = sdCylinder(Position + float3(3.5f, 0, 3.5f), float3(0, 0, 0.5f));
+	Fun = std::min(Fun, sdCylinder(Position + float3(-3.5f, 0, 3.5f), float3(0, 0, 0.5f)));
+	Fun = std::min(Fun, sdCylinder(Position + float3(-3.5f, 0, 0), float3(0, 0, 0.5f)));
+	Fun = std::min(Fun, sdCylinder(Position + float3(3.5f, 0, 0), float3(0, 0, 0.5f)));
+
+	return Fun;
+}
+
+float FusedRaymarch::Scene(const float3& Position)
+{
+	return std::min(Room(Position), Pillars(Position));
+}
+
+bool FusedRaymarch::March(Field field, const float3& origin, const float3& direction, float& t)
+{
+	float start, final;
+	if (!IntersectBox(origin, direction, start, final))
+		return false;
+
+	float step = (final - start) / float(Intervals);
+	float time = start;
+	float3 Position = origin + time * direction;
+	float right, left = field(Position);
+
+	for (int i = 0; i < Intervals; i++)
+	{
+		time += step;
+		Position += step * direction;
+		right = field(Position);
+		if (left * right < 0.0f)
+		{
+			t = time + right * step / (left - right);
+			return true;
+		}
+		left = right;
+	}
+
+	return false;
+}
+
+bool FusedRaymarch::HitsFloor(const float3& origin, const float3& direction, float& t)
+{
+	if (direction.y == 0.0f)
+		return false;
+
+	t = (FloorHeight - origin.y) / direction.y;
+	if (t <= 0.0f)
+		return false;
+
+	float3 Position = origin + t * direction;
+	return std::fabs(Position.x) <= FloorSize && std::fabs(Position.z) <= FloorSize;
+}
+
+FusedRaymarch::Hit FusedRaymarch::TwoPass(const float3& origin, const float3& direction)
+{
+	Hit hit = { Material::None, -1.0f };
+	float t;
+
+	// The pillar pass draws over everything, where it misses it shows the room target.
+	if (March(Pillars, origin, direction, t))
+	{
+		hit.material = Material::Pillar;
+		hit.t = t;
+	}
+	else if (HitsFloor(origin, direction, t))
+	{
+		hit.material = Material::Floor;
+		hit.t = t;
+	}
+	else if (March(Room, origin, direction, t))
+	{
+		hit.material = Material::Room;
+		hit.t = t;
+	}
+
+	return hit;
+}
+
+FusedRaymarch::Hit FusedRaymarch::Fused(const float3& origin, const float3& direction)
+{
+	Hit hit = { Material::None, -1.0f };
+	float t, floorT;
+
+	if (!March(Scene, origin, direction, t))
+		return hit;
+
+	// Whichever surface the hit is closer to is the one the ray crossed.
+	float3 Position = origin + t * direction;
+	hit.material = std::fabs(Pillars(Position)) < std::fabs(Room(Position)) ? Material::Pillar : Material::Room;
+	hit.t = t;
+
+	// Pillars write the nearest depth and always pass, the room writes the farthest and loses to the floor.
+	if (hit.material == Material::Room && HitsFloor(origin, direction, floorT))
+	{
+		hit.material = Material::Floor;
+		hit.t = floorT;
+	}
+
+	return hit;
+}
+
+FusedRaymarch::TrafficEstimate FusedRaymarch::EstimateTraffic(uint32_t width, uint32_t height, uint32_t floorPixels)
+{
+	uint64_t pixels = static_cast<uint64_t>(width) * height;
+	uint64_t floor = floorPixels;
+
+	TrafficEstimate estimate;
+
+	// Room written, floor tested and written over it, room read back by every pillar pixel, back buffer written.
+	estimate.twoPassBytes = pixels * RoomTargetBytes +
+		floor * (2 * DepthBytes + RoomTargetBytes) +
+		pixels * (RoomTargetBytes + BackBufferBytes);
+
+	// Floor written straight to the back buffer, then one pass depth tested against it.
+	estimate.fusedBytes = floor * (2 * DepthBytes + BackBufferBytes) +
+		pixels * (DepthBytes + BackBufferBytes);
+
+	estimate.intermediateBytes = pixels * RoomTargetBytes;
+	return estimate;
+}
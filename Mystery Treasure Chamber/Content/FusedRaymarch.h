@@ -0,0 +1,63 @@
+﻿#pragma once
+
+#include <cstdint>
+
+#include "SdfMath.h"
+
+namespace Mystery_Treasure_Chamber
+{
+	// CPU reference of FusedPixelShader.hlsl, which marches the room and the pillars in one pass
+	// instead of marching the room into an intermediate target and the pillars over it.
+	namespace FusedRaymarch
+	{
+		// Values match the MATERIAL_* defines in the shader.
+		enum class Material : uint32_t
+		{
+			None = 0,
+			Room = 1,
+			Pillar = 2,
+			Floor = 3,		// Rasterized, only used to compare the composited images.
+			Model = 4,		// Rasterized snakes, only written to the G-buffer of the deferred mode.
+		};
+
+		struct Hit
+		{
+			Material	material;
+			float		t;
+		};
+
+		typedef float (*Field)(const Sdf::float3& Position);
+
+		// Distance functions of the shaders, positive in free space.
+		float Room(const Sdf::float3& Position);
+		float Pillars(const Sdf::float3& Position);
+		float Scene(const Sdf::float3& Position);
+
+		// Same as IntersectBox in the shaders: where the ray enters and leaves the room's box.
+		bool IntersectBox(const Sdf::float3& origin, const Sdf::float3& direction, float& timeIn, float& timeOut);
+
+		// Same as IntersectBox and RayMarchingInsideCube in the shaders: a fixed number of steps
+		// across the room, stopping at the first sign change.
+		bool March(Field field, const Sdf::float3& origin, const Sdf::float3& direction, float& t);
+
+		// Whether the rasterized floor covers the pixel the ray goes through.
+		bool HitsFloor(const Sdf::float3& origin, const Sdf::float3& direction, float& t);
+
+		// What the pixel shows with the room pass, the floor drawn over it and the pillar pass on top.
+		Hit TwoPass(const Sdf::float3& origin, const Sdf::float3& direction);
+
+		// What the pixel shows with the floor drawn first and the fused pass depth tested against it.
+		Hit Fused(const Sdf::float3& origin, const Sdf::float3& direction);
+
+		// Bytes of render target traffic per frame, ignoring caches and material texture reads.
+		// floorPixels is how many pixels the floor covers.
+		struct TrafficEstimate
+		{
+			uint64_t	twoPassBytes;
+			uint64_t	fusedBytes;
+			uint64_t	intermediateBytes;	// Memory the room target takes up.
+		};
+
+		TrafficEstimate EstimateTraffic(uint32_t width, uint32_t height, uint32_t floorPixels);
+	}
+}
@@ -0,0 +1,341 @@
+﻿#include "IrradianceProbes.h"
+#include "FusedRaymarch.h"
+#include "PassCache.h"
+#include "SdfScene.h"
+
+#include <cstdio>
+#include <fstream>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	const uint32_t Magic = 0x424F5250;	// "PROB"
+
+	const float Pi = 3.14159265f;
+	const float GoldenAngle = 2.39996323f;
+
+	// Convolution of each band with the clamped cosine.
+	const float CosineBand[3] = { Pi, 2.0f * Pi / 3.0f, Pi / 4.0f };
+
+	float3 Normal(const float3& Position)
+	{
+		const float h = 0.001f;
+		return normalize(float3(
+			FusedRaymarch::Scene(Position + float3(h, 0, 0)) - FusedRaymarch::Scene(Position - float3(h, 0, 0)),
+			FusedRaymarch::Scene(Position + float3(0, h, 0)) - FusedRaymarch::Scene(Position - float3(0, h, 0)),
+			FusedRaymarch::Scene(Position + float3(0, 0, h)) - FusedRaymarch::Scene(Position - float3(0, 0, h))));
+	}
+
+	// Direction i of count spread evenly over the whole sphere.
+	float3 SphereDirection(uint32_t i, uint32_t count)
+	{
+		float y = 1.0f - 2.0f * (i + 0.5f) / count;
+		float r = std::sqrt(std::max(0.0f, 1.0f - y * y));
+		float phi = i * GoldenAngle;
+		return float3(r * std::cos(phi), y, r * std::sin(phi));
+	}
+
+	// Same as SoftShadow in LightmapBaker, from a point in free space.
+	float SoftShadow(const IrradianceProbes::Settings& settings, const float3& origin, const float3& light)
+	{
+		float3 direction = normalize(light - origin);
+
+		float timeIn, timeOut;
+		if (!FusedRaymarch::IntersectBox(origin, direction, timeIn, timeOut))
+			return 1.0f;
+		timeOut = std::min(timeOut, length(light - origin));
+
+		float shadow = 1.0f;
+		float t = 0.02f;
+		for (uint32_t i = 0; i < settings.shadowSteps && t < timeOut; i++)
+		{
+			float h = FusedRaymarch::Pillars(origin + t * direction);
+			if (h < 0.001f)
+				return 0.0f;
+			shadow = std::min(shadow, settings.penumbra * h / t);
+			t += clamp(h, 0.01f, 0.5f);
+		}
+		return shadow;
+	}
+
+	// Whether a ray gets reach away without hitting the scene.
+	bool Open(const float3& origin, const float3& direction, float reach)
+	{
+		float t = 0.01f;
+		for (uint32_t i = 0; i < 128 && t < reach; i++)
+		{
+			float d = FusedRaymarch::Scene(origin + t * direction);
+			if (d < 0.001f)
+				return false;
+			t += d;
+		}
+		return true;
+	}
+
+	float CellSize(uint32_t resolution)
+	{
+		return 2.0f * IrradianceProbes::BoxSize / resolution;
+	}
+
+	float3 CellCentre(uint32_t resolution, uint32_t x, uint32_t y, uint32_t z)
+	{
+		return float3(-IrradianceProbes::BoxSize) + CellSize(resolution) * float3(x + 0.5f, y + 0.5f, z + 0.5f);
+	}
+
+	// Probes this close to a surface are moved away from it, so they do not see half of it from inside.
+	float Clearance(uint32_t resolution)
+	{
+		return 0.25f * CellSize(resolution);
+	}
+}
+
+IrradianceProbes::Settings IrradianceProbes::DefaultSettings()
+{
+	Settings settings;
+	settings.resolution = 8;
+	settings.directions = 256;
+	settings.reach = 2.0f;
+	settings.shadowSteps = 64;
+	settings.penumbra = 8.0f;
+	settings.ambient = 0.15f;
+	return settings;
+}
+
+uint64_t IrradianceProbes::Key(const Settings& settings, const std::vector<LightmapLight>& lights)
+{
+	PassHash hash;
+	hash.Add(Version);
+	hash.Add(BoxSize);
+	hash.Add(SdfScene::PillarRadius);
+	hash.Add(SdfScene::PillarOffsets);
+	hash.Add(settings);
+	for (const LightmapLight& light : lights)
+	{
+		hash.Add(light.position);
+		hash.Add(light.color);
+	}
+	return hash.GetValue();
+}
+
+void IrradianceProbes::Basis(const float3& direction, float basis[9])
+{
+	float x = direction.x, y = direction.y, z = direction.z;
+	basis[0] = 0.282095f;
+	basis[1] = 0.488603f * y;
+	basis[2] = 0.488603f * z;
+	basis[3] = 0.488603f * x;
+	basis[4] = 1.092548f * x * y;
+	basis[5] = 1.092548f * y * z;
+	basis[6] = 0.315392f * (3.0f * z * z - 1.0f);
+	basis[7] = 1.092548f * x * z;
+	basis[8] = 0.546274f * (x * x - y * y);
+}
+
+ShL2 IrradianceProbes::Project(const std::function<float3(const float3&)>& radiance, uint32_t directions)
+{
+	ShL2 sh = {};
+	if (directions == 0)
+		return sh;
+
+	float weight = 4.0f * Pi / directions;
+	for (uint32_t i = 0; i < directions; i++)
+	{
+		float3 direction = SphereDirection(i, directions);
+		float3 value = radiance(direction) * weight;
+
+		float basis[9];
+		Basis(direction, basis);
+		for (int j = 0; j < 9; j++)
+		{
+			sh.c[j] += basis[j] * value;
+		}
+	}
+	return sh;
+}
+
+ShL2 IrradianceProbes::ProjectDirectional(const float3& direction, const float3& color)
+{
+	float basis[9];
+	Basis(direction, basis);
+
+	ShL2 sh;
+	for (int j = 0; j < 9; j++)
+	{
+		sh.c[j] = basis[j] * color;
+	}
+	return sh;
+}
+
+ShL2 IrradianceProbes::ConvolveCosine(const ShL2& radiance)
+{
+	ShL2 irradiance;
+	for (int j = 0; j < 9; j++)
+	{
+		int band = j == 0 ? 0 : j < 4 ? 1 : 2;
+		irradiance.c[j] = CosineBand[band] * radiance.c[j];
+	}
+	return irradiance;
+}
+
+float3 IrradianceProbes::Evaluate(const ShL2& sh, const float3& direction)
+{
+	float basis[9];
+	Basis(direction, basis);
+
+	float3 result;
+	for (int j = 0; j < 9; j++)
+	{
+		result += basis[j] * sh.c[j];
+	}
+	return result;
+}
+
+ShL2 IrradianceProbes::EvaluateProbe(const Settings& settings, const std::vector<LightmapLight>& lights, const float3& Position)
+{
+	// The ambient light is ambient / pi from every open direction, so that a fully open surface
+	// gets settings.ambient.
+	float3 sky = float3(settings.ambient / Pi);
+	ShL2 radiance = Project([&](const float3& direction) {
+		return Open(Position, direction, settings.reach) ? sky : float3();
+	}, settings.directions);
+
+	for (const LightmapLight& light : lights)
+	{
+		float shadow = SoftShadow(settings, Position, light.position);
+		if (shadow <= 0.0f)
+			continue;
+
+		ShL2 direct = ProjectDirectional(normalize(light.position - Position), shadow * light.color);
+		for (int j = 0; j < 9; j++)
+		{
+			radiance.c[j] += direct.c[j];
+		}
+	}
+
+	return ConvolveCosine(radiance);
+}
+
+IrradianceProbeGrid IrradianceProbes::Bake(const Settings& settings, const std::vector<LightmapLight>& lights, WorkStealingPool& pool)
+{
+	uint32_t resolution = settings.resolution;
+
+	IrradianceProbeGrid grid;
+	grid.key = Key(settings, lights);
+	grid.resolution = resolution;
+	grid.probes.assign(size_t(resolution) * resolution * resolution, ShL2());
+
+	float clearance = Clearance(resolution);
+	pool.Run(resolution, [&](uint32_t z, uint32_t) {
+		ShL2* slice = &grid.probes[size_t(z) * resolution * resolution];
+		for (uint32_t y = 0; y < resolution; y++)
+		{
+			for (uint32_t x = 0; x < resolution; x++)
+			{
+				float3 centre = CellCentre(resolution, x, y, z);
+				float distance = FusedRaymarch::Scene(centre);
+				if (distance < clearance)
+					centre += (clearance - distance) * Normal(centre);
+
+				slice[y * resolution + x] = EvaluateProbe(settings, lights, centre);
+			}
+		}
+	});
+
+	return grid;
+}
+
+ShL2 IrradianceProbes::Interpolate(const IrradianceProbeGrid& grid, const float3& Position)
+{
+	int resolution = static_cast<int>(grid.resolution);
+	float3 cell = (Position + float3(BoxSize)) * (resolution / (2.0f * BoxSize)) - float3(0.5f);
+
+	int corner[3];
+	float weight[3];
+	for (int i = 0; i < 3; i++)
+	{
+		float t = clamp(cell[i], 0.0f, float(resolution - 1));
+		corner[i] = std::min(static_cast<int>(t), resolution - 2);
+		weight[i] = t - corner[i];
+	}
+
+	ShL2 result = {};
+	for (int i = 0; i < 8; i++)
+	{
+		int x = corner[0] + (i & 1), y = corner[1] + ((i >> 1) & 1), z = corner[2] + ((i >> 2) & 1);
+		float w = ((i & 1) ? weight[0] : 1.0f - weight[0]) *
+			((i & 2) ? weight[1] : 1.0f - weight[1]) *
+			((i & 4) ? weight[2] : 1.0f - weight[2]);
+
+		const ShL2& probe = grid.probes[(size_t(z) * resolution + y) * resolution + x];
+		for (int j = 0; j < 9; j++)
+		{
+			result.c[j] += w * probe.c[j];
+		}
+	}
+	return result;
+}
+
+bool IrradianceProbes::Save(const IrradianceProbeGrid& grid, std::ostream& stream)
+{
+	stream.write(reinterpret_cast<const char*>(&Magic), sizeof(Magic));
+	stream.write(reinterpret_cast<const char*>(&Version), sizeof(Version));
+	stream.write(reinterpret_cast<const char*>(&grid.key), sizeof(grid.key));
+	stream.write(reinterpret_cast<const char*>(&grid.resolution), sizeof(grid.resolution));
+	stream.write(reinterpret_cast<const char*>(grid.probes.data()), grid.probes.size() * sizeof(ShL2));
+	return static_cast<bool>(stream);
+}
+
+bool IrradianceProbes::Load(std::istream& stream, uint64_t key, IrradianceProbeGrid& grid)
+{
+	uint32_t magic = 0, version = 0, resolution = 0;
+	uint64_t fileKey = 0;
+	stream.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+	stream.read(reinterpret_cast<char*>(&version), sizeof(version));
+	stream.read(reinterpret_cast<char*>(&fileKey), sizeof(fileKey));
+	stream.read(reinterpret_cast<char*>(&resolution), sizeof(resolution));
+	if (!stream || magic != Magic || version != Version || fileKey != key || resolution < 2 || resolution > 256)
+		return false;
+
+	std::vector<ShL2> probes(size_t(resolution) * resolution * resolution);
+	stream.read(reinterpret_cast<char*>(probes.data()), probes.size() * sizeof(ShL2));
+	if (!stream)
+		return false;
+
+	grid.key = fileKey;
+	grid.resolution = resolution;
+	grid.probes.swap(probes);
+	return true;
+}
+
+std::string IrradianceProbes::CacheFileName(uint64_t key)
+{
+	char name[64];
+	std::snprintf(name, sizeof(name), "Probes_%016llx.bin", static_cast<unsigned long long>(key));
+	return name;
+}
+
+IrradianceProbeGrid IrradianceProbes::LoadOrBake(const std::string& directory, const Settings& settings,
+	const std::vector<LightmapLight>& lights, WorkStealingPool& pool, bool* fromCache)
+{
+	uint64_t key = Key(settings, lights);
+	std::string path = directory.empty() ? CacheFileName(key) : directory + "/" + CacheFileName(key);
+
+	IrradianceProbeGrid grid;
+	std::ifstream cached(path, std::ios::binary);
+	bool loaded = cached && Load(cached, key, grid);
+	if (fromCache)
+		*fromCache = loaded;
+	if (loaded)
+		return grid;
+
+	grid = Bake(settings, lights, pool);
+
+	// A cache that cannot be written only costs the next bake.
+	std::ofstream file(path, std::ios::binary);
+	if (file)
+		Save(grid, file);
+
+	return grid;
+}
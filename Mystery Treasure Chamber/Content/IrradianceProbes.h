@@ -0,0 +1,97 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "LightmapBaker.h"
+#include "SdfMath.h"
+#include "WorkStealingPool.h"
+
+namespace Mystery_Treasure_Chamber
+{
+	// Real spherical harmonics up to L2: nine coefficients, each with r, g and b.
+	struct ShL2
+	{
+		Sdf::float3	c[9];
+	};
+
+	// Irradiance probes over the room's box, one at the centre of each cell. Each probe holds the
+	// light arriving from every direction, already convolved with the cosine lobe, so evaluating it
+	// for a normal gives the irradiance of a surface facing that way. x is fastest, then y, then z.
+	struct IrradianceProbeGrid
+	{
+		uint64_t			key;
+		uint32_t			resolution;
+		std::vector<ShL2>	probes;
+	};
+
+	// Offline CPU baker of the probes ProbeLighting.hlsli evaluates for the snakes. The static lights
+	// are shadowed by the pillars the way LightmapBaker shadows them, and the ambient light only
+	// comes in through the directions the scene leaves open, so a probe next to a pillar or the
+	// floor is darker on that side. Probes are baked a slice at a time on a WorkStealingPool, and
+	// bakes are cached on disk under their key.
+	namespace IrradianceProbes
+	{
+		// Half size of the room's box, which the grid covers.
+		const float BoxSize = 5.0f;
+
+		// Written at the start of a cache file, and part of every key. Change it with the bake code.
+		const uint32_t Version = 1;
+
+		struct Settings
+		{
+			uint32_t	resolution;		// Probes along each side of the room.
+			uint32_t	directions;		// Rays that look for open sky around each probe.
+			float		reach;			// How far a ray has to get to count as open.
+			uint32_t	shadowSteps;	// Most steps of a shadow ray.
+			float		penumbra;		// Sharpness of the shadows, higher is harder.
+			float		ambient;		// Irradiance of a fully open surface from everywhere, as in LightmapBaker.
+		};
+
+		Settings DefaultSettings();
+
+		// Hash of the scene, the lights and the settings. Equal keys bake the same grid.
+		uint64_t Key(const Settings& settings, const std::vector<LightmapLight>& lights);
+
+		// The nine basis functions at a unit direction, the same constants as ProbeLighting.hlsli.
+		void Basis(const Sdf::float3& direction, float basis[9]);
+
+		// Coefficients of radiance, integrated over directions spread evenly over the sphere.
+		ShL2 Project(const std::function<Sdf::float3(const Sdf::float3&)>& radiance, uint32_t directions);
+
+		// Coefficients of light arriving from a single direction.
+		ShL2 ProjectDirectional(const Sdf::float3& direction, const Sdf::float3& color);
+
+		// Radiance coefficients to irradiance ones, the convolution with the clamped cosine.
+		ShL2 ConvolveCosine(const ShL2& radiance);
+
+		// Value of the coefficients in direction. For irradiance coefficients and a normal, the
+		// irradiance of the surface, the same as ProbeIrradiance in ProbeLighting.hlsli.
+		Sdf::float3 Evaluate(const ShL2& sh, const Sdf::float3& direction);
+
+		// Irradiance coefficients of a probe at Position, which should be in free space.
+		ShL2 EvaluateProbe(const Settings& settings, const std::vector<LightmapLight>& lights, const Sdf::float3& Position);
+
+		// Probes in or next to the walls and the pillars are moved out to free space first. The
+		// result does not depend on the pool's thread count.
+		IrradianceProbeGrid Bake(const Settings& settings, const std::vector<LightmapLight>& lights, WorkStealingPool& pool);
+
+		// Trilinear blend of the probes around Position, what one object is lit with.
+		ShL2 Interpolate(const IrradianceProbeGrid& grid, const Sdf::float3& Position);
+
+		// Cache files hold the version, the key, the resolution and the probes.
+		bool Save(const IrradianceProbeGrid& grid, std::ostream& stream);
+
+		// Fails unless the stream holds a grid of this version and key.
+		bool Load(std::istream& stream, uint64_t key, IrradianceProbeGrid& grid);
+
+		std::string CacheFileName(uint64_t key);
+
+		// Loads the cached bake for the settings and lights from directory, or bakes and caches it.
+		IrradianceProbeGrid LoadOrBake(const std::string& directory, const Settings& settings,
+			const std::vector<LightmapLight>& lights, WorkStealingPool& pool, bool* fromCache);
+	}
+}
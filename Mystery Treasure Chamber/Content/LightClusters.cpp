@@ -0,0 +1,353 @@
+﻿#include "LightClusters.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define LIGHT_CLUSTERS_SSE 1
+#include <emmintrin.h>
+#else
+#define LIGHT_CLUSTERS_SSE 0
+#endif
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	// Bit i is set for every column, row or slice i the light's sphere touches.
+	struct LightBits
+	{
+		uint32_t	columns;
+		uint32_t	rows;
+		uint32_t	slices;
+	};
+
+	// Signed distance from a plane through the eye, positive towards higher columns or rows.
+	float PlaneDistance(const float3& normal, const float3& d)
+	{
+		return normal.x * d.x + normal.y * d.y + normal.z * d.z;
+	}
+
+	// Whether a sphere at distance f from the planes at both edges of a column or row reaches
+	// into it. The outer ones have no plane on their outside.
+	bool Touches(const std::vector<float3>& planes, uint32_t i, uint32_t count, const float3& d, float radius)
+	{
+		bool afterStart = i == 0 || PlaneDistance(planes[i], d) >= -radius;
+		bool beforeEnd = i + 1 == count || PlaneDistance(planes[i + 1], d) <= radius;
+		return afterStart && beforeEnd;
+	}
+
+	bool TouchesSlice(const ClusterFrustum& frustum, uint32_t slice, float depth, float radius)
+	{
+		bool afterStart = slice == 0 || depth + radius >= frustum.sliceDepths[slice];
+		bool beforeEnd = slice + 1 == LightClusters::Slices || depth - radius <= frustum.sliceDepths[slice + 1];
+		return afterStart && beforeEnd;
+	}
+
+	void TestLightsScalar(const ClusterFrustum& frustum, const ClusterLight* lights, uint32_t count, LightBits* bits)
+	{
+		for (uint32_t l = 0; l < count; l++)
+		{
+			float3 d = lights[l].position - frustum.eye;
+			float radius = lights[l].radius;
+			float depth = frustum.axis * d.z;
+
+			LightBits b = { 0, 0, 0 };
+			for (uint32_t i = 0; i < LightClusters::TilesX; i++)
+				b.columns |= Touches(frustum.columnPlanes, i, LightClusters::TilesX, d, radius) ? 1u << i : 0u;
+			for (uint32_t i = 0; i < LightClusters::TilesY; i++)
+				b.rows |= Touches(frustum.rowPlanes, i, LightClusters::TilesY, d, radius) ? 1u << i : 0u;
+			for (uint32_t i = 0; i < LightClusters::Slices; i++)
+				b.slices |= TouchesSlice(frustum, i, depth, radius) ? 1u << i : 0u;
+			bits[l] = b;
+		}
+	}
+
+#if LIGHT_CLUSTERS_SSE
+	// Spreads the four lane bits of a movemask into bit i of four words.
+	void Scatter(int mask, uint32_t i, uint32_t* words, uint32_t stride)
+	{
+		for (uint32_t lane = 0; lane < 4; lane++)
+			words[lane * stride] |= static_cast<uint32_t>((mask >> lane) & 1) << i;
+	}
+
+	// Same tests as TestLightsScalar for four lights at once. The plane distances are computed in
+	// the same order, so both give exactly the same bits.
+	void TestPlanes(const std::vector<float3>& planes, uint32_t count, __m128 dx, __m128 dy, __m128 dz,
+		__m128 radius, __m128 negativeRadius, uint32_t* words, uint32_t stride)
+	{
+		__m128 all = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		__m128 afterStart = all;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			__m128 beforeEnd = all;
+			if (i + 1 < count)
+			{
+				const float3& n = planes[i + 1];
+				__m128 f = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(n.x), dx), _mm_mul_ps(_mm_set1_ps(n.y), dy)),
+					_mm_mul_ps(_mm_set1_ps(n.z), dz));
+				beforeEnd = _mm_cmple_ps(f, radius);
+				Scatter(_mm_movemask_ps(_mm_and_ps(afterStart, beforeEnd)), i, words, stride);
+				afterStart = _mm_cmpge_ps(f, negativeRadius);
+			}
+			else
+			{
+				Scatter(_mm_movemask_ps(afterStart), i, words, stride);
+			}
+		}
+	}
+
+	void TestLightsSse(const ClusterFrustum& frustum, const ClusterLight* lights, uint32_t count, LightBits* bits)
+	{
+		const uint32_t stride = sizeof(LightBits) / sizeof(uint32_t);
+		uint32_t l = 0;
+		for (; l + 4 <= count; l += 4)
+		{
+			const ClusterLight* group = lights + l;
+			__m128 dx = _mm_sub_ps(_mm_setr_ps(group[0].position.x, group[1].position.x, group[2].position.x, group[3].position.x), _mm_set1_ps(frustum.eye.x));
+			__m128 dy = _mm_sub_ps(_mm_setr_ps(group[0].position.y, group[1].position.y, group[2].position.y, group[3].position.y), _mm_set1_ps(frustum.eye.y));
+			__m128 dz = _mm_sub_ps(_mm_setr_ps(group[0].position.z, group[1].position.z, group[2].position.z, group[3].position.z), _mm_set1_ps(frustum.eye.z));
+			__m128 radius = _mm_setr_ps(group[0].radius, group[1].radius, group[2].radius, group[3].radius);
+			__m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), radius);
+
+			LightBits* b = bits + l;
+			for (uint32_t lane = 0; lane < 4; lane++)
+				b[lane].columns = b[lane].rows = b[lane].slices = 0;
+
+			TestPlanes(frustum.columnPlanes, LightClusters::TilesX, dx, dy, dz, radius, negativeRadius, &b->columns, stride);
+			TestPlanes(frustum.rowPlanes, LightClusters::TilesY, dx, dy, dz, radius, negativeRadius, &b->rows, stride);
+
+			__m128 depth = _mm_mul_ps(_mm_set1_ps(frustum.axis), dz);
+			__m128 nearEdge = _mm_add_ps(depth, radius);
+			__m128 farEdge = _mm_sub_ps(depth, radius);
+			__m128 afterStart = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (uint32_t i = 0; i < LightClusters::Slices; i++)
+			{
+				if (i + 1 < LightClusters::Slices)
+				{
+					__m128 boundary = _mm_set1_ps(frustum.sliceDepths[i + 1]);
+					Scatter(_mm_movemask_ps(_mm_and_ps(afterStart, _mm_cmple_ps(farEdge, boundary))), i, &b->slices, stride);
+					afterStart = _mm_cmpge_ps(nearEdge, boundary);
+				}
+				else
+				{
+					Scatter(_mm_movemask_ps(afterStart), i, &b->slices, stride);
+				}
+			}
+		}
+
+		TestLightsScalar(frustum, lights + l, count - l, bits + l);
+	}
+#endif
+
+	template <class Visit>
+	void ForEachCluster(const LightBits& bits, Visit visit)
+	{
+		for (uint32_t s = 0; s < LightClusters::Slices; s++)
+		{
+			if (!(bits.slices & (1u << s)))
+				continue;
+			for (uint32_t r = 0; r < LightClusters::TilesY; r++)
+			{
+				if (!(bits.rows & (1u << r)))
+					continue;
+				uint32_t base = (s * LightClusters::TilesY + r) * LightClusters::TilesX;
+				for (uint32_t c = 0; c < LightClusters::TilesX; c++)
+				{
+					if (bits.columns & (1u << c))
+						visit(base + c);
+				}
+			}
+		}
+	}
+
+	// Deterministic lights, so a failing case can be found again.
+	struct Random
+	{
+		uint32_t	state;
+
+		float Next()
+		{
+			state = state * 1664525u + 1013904223u;
+			return static_cast<float>(state >> 8) / 16777216.0f;
+		}
+
+		float Range(float low, float high)		{ return low + (high - low) * Next(); }
+	};
+
+	const float BoxSize = 5.0f;
+}
+
+ClusterFrustum LightClusters::MakeFrustum(const RaymarchCamera& camera)
+{
+	ClusterFrustum frustum;
+	frustum.eye = camera.eye;
+	frustum.nearPlane = camera.nearPlane;
+	frustum.canvasWidth = camera.zoom * camera.width;
+	frustum.canvasHeight = camera.zoom * camera.height;
+	frustum.axis = camera.nearPlane > camera.eye.z ? 1.0f : -1.0f;
+
+	// A point is seen at canvas x c when d.x + (eye.x - c) * d.z / (nearPlane - eye.z) = 0, with d
+	// its offset from the eye, the plane through the eye with that normal.
+	float toCanvas = 1.0f / (camera.nearPlane - camera.eye.z);
+	for (uint32_t i = 0; i < TilesX; i++)
+	{
+		float c = (2.0f * i / TilesX - 1.0f) * frustum.canvasWidth;
+		frustum.columnPlanes.push_back(normalize(float3(1.0f, 0.0f, (camera.eye.x - c) * toCanvas)));
+	}
+	for (uint32_t i = 0; i < TilesY; i++)
+	{
+		float c = (2.0f * i / TilesY - 1.0f) * frustum.canvasHeight;
+		frustum.rowPlanes.push_back(normalize(float3(0.0f, 1.0f, (camera.eye.y - c) * toCanvas)));
+	}
+
+	frustum.sliceDepths.push_back(0.0f);
+	for (uint32_t i = 1; i < Slices; i++)
+		frustum.sliceDepths.push_back(NearDepth * std::pow(FarDepth / NearDepth, float(i - 1) / float(Slices - 2)));
+
+	return frustum;
+}
+
+uint32_t LightClusters::ClusterOf(const ClusterFrustum& frustum, const float3& Position)
+{
+	float3 d = Position - frustum.eye;
+	float w = std::max(d.z / (frustum.nearPlane - frustum.eye.z), 1e-6f);
+	float canvasX = (frustum.eye.x * w + d.x) / (w * frustum.canvasWidth);
+	float canvasY = (frustum.eye.y * w + d.y) / (w * frustum.canvasHeight);
+
+	float column = std::floor((canvasX * 0.5f + 0.5f) * TilesX);
+	float row = std::floor((canvasY * 0.5f + 0.5f) * TilesY);
+	uint32_t x = static_cast<uint32_t>(std::min(std::max(column, 0.0f), float(TilesX - 1)));
+	uint32_t y = static_cast<uint32_t>(std::min(std::max(row, 0.0f), float(TilesY - 1)));
+
+	float depth = frustum.axis * d.z;
+	uint32_t slice = 0;
+	if (depth >= NearDepth)
+	{
+		float k = std::log(depth / NearDepth) / std::log(FarDepth / NearDepth) * (Slices - 2);
+		slice = std::min(1 + static_cast<uint32_t>(k), Slices - 1);
+	}
+
+	return (slice * TilesY + y) * TilesX + x;
+}
+
+void LightClusters::Build(const ClusterFrustum& frustum, const std::vector<ClusterLight>& lights,
+	std::vector<ClusterRange>& ranges, std::vector<uint32_t>& indices)
+{
+	uint32_t count = static_cast<uint32_t>(lights.size());
+	std::vector<LightBits> bits(count);
+#if LIGHT_CLUSTERS_SSE
+	TestLightsSse(frustum, lights.data(), count, bits.data());
+#else
+	TestLightsScalar(frustum, lights.data(), count, bits.data());
+#endif
+
+	// Count, then turn the counts into offsets and fill the lists in light order.
+	ranges.assign(ClusterCount, ClusterRange());
+	for (const LightBits& b : bits)
+		ForEachCluster(b, [&](uint32_t cluster) { ranges[cluster].count++; });
+
+	uint32_t offset = 0;
+	for (ClusterRange& range : ranges)
+	{
+		range.offset = offset;
+		offset += range.count;
+		range.count = 0;
+	}
+
+	indices.resize(offset);
+	for (uint32_t l = 0; l < count; l++)
+	{
+		ForEachCluster(bits[l], [&](uint32_t cluster) {
+			ClusterRange& range = ranges[cluster];
+			indices[range.offset + range.count++] = l;
+		});
+	}
+}
+
+void LightClusters::BuildReference(const ClusterFrustum& frustum, const std::vector<ClusterLight>& lights,
+	std::vector<ClusterRange>& ranges, std::vector<uint32_t>& indices)
+{
+	ranges.assign(ClusterCount, ClusterRange());
+	indices.clear();
+	for (uint32_t s = 0; s < Slices; s++)
+	{
+		for (uint32_t r = 0; r < TilesY; r++)
+		{
+			for (uint32_t c = 0; c < TilesX; c++)
+			{
+				ClusterRange& range = ranges[(s * TilesY + r) * TilesX + c];
+				range.offset = static_cast<uint32_t>(indices.size());
+				for (uint32_t l = 0; l < lights.size(); l++)
+				{
+					float3 d = lights[l].position - frustum.eye;
+					float radius = lights[l].radius;
+					if (Touches(frustum.columnPlanes, c, TilesX, d, radius) &&
+						Touches(frustum.rowPlanes, r, TilesY, d, radius) &&
+						TouchesSlice(frustum, s, frustum.axis * d.z, radius))
+					{
+						indices.push_back(l);
+					}
+				}
+				range.count = static_cast<uint32_t>(indices.size()) - range.offset;
+			}
+		}
+	}
+}
+
+ClusterLight LightClusters::SceneLight(const float3& position, const float3& color)
+{
+	// The farthest corner of the room is the one across each axis from the light.
+	float3 corner(BoxSize + std::fabs(position.x), BoxSize + std::fabs(position.y), BoxSize + std::fabs(position.z));
+
+	ClusterLight light;
+	light.position = position;
+	light.radius = length(corner);
+	light.color = color;
+	light.falloff = 0.0f;
+	return light;
+}
+
+std::vector<ClusterLight> LightClusters::WallTorches(uint32_t count)
+{
+	// Evenly spaced along the walls, 0.2 in from them.
+	const float inset = BoxSize - 0.2f;
+	const float perimeter = 8.0f * inset;
+
+	std::vector<ClusterLight> torches;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		float s = (i + 0.5f) / count * perimeter;
+		uint32_t wall = std::min(static_cast<uint32_t>(s / (2.0f * inset)), 3u);
+		float along = s - wall * 2.0f * inset - inset;
+
+		ClusterLight torch;
+		torch.position =
+			wall == 0 ? float3(along, 1.0f, -inset) :
+			wall == 1 ? float3(inset, 1.0f, along) :
+			wall == 2 ? float3(-along, 1.0f, inset) :
+			float3(-inset, 1.0f, -along);
+		torch.radius = 3.0f;
+		torch.color = float3(1.0f, 0.55f, 0.25f);
+		torch.falloff = 1.0f;
+		torches.push_back(torch);
+	}
+	return torches;
+}
+
+std::vector<ClusterLight> LightClusters::RandomLights(uint32_t count, uint32_t seed)
+{
+	Random random = { seed };
+	std::vector<ClusterLight> lights;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		ClusterLight light;
+		light.position = float3(random.Range(-BoxSize, BoxSize), random.Range(-BoxSize, BoxSize), random.Range(-BoxSize, BoxSize));
+		light.radius = random.Range(0.5f, 2.0f);
+		light.color = float3(1.0f, random.Range(0.4f, 0.7f), 0.25f);
+		light.falloff = 1.0f;
+		lights.push_back(light);
+	}
+	return lights;
+}
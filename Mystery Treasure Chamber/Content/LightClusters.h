@@ -0,0 +1,86 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "SdfMath.h"
+#include "TemporalReprojection.h"
+
+namespace Mystery_Treasure_Chamber
+{
+	// A point light as the shaders read it from their StructuredBuffer. Light falls off to nothing
+	// at radius, unless falloff is 0, which is a distant light that reaches radius unattenuated.
+	struct ClusterLight
+	{
+		Sdf::float3	position;
+		float		radius;
+		Sdf::float3	color;
+		float		falloff;	// 1 fades out at radius, 0 does not fade.
+	};
+
+	// Where the lights of one cluster start in the index list, and how many there are.
+	struct ClusterRange
+	{
+		uint32_t	offset;
+		uint32_t	count;
+	};
+
+	// The planes between the clusters of a canvas camera. Columns and rows are bounded by planes
+	// through the eye along the edges of screen tiles, slices by depths along the view axis. The
+	// outer columns, rows and slices reach to infinity, so every point belongs to a cluster even
+	// where the raster camera sees more than the canvas camera does.
+	struct ClusterFrustum
+	{
+		Sdf::float3			eye;
+		float				nearPlane;
+		float				canvasWidth;		// Half extents of the canvas in world units, zoom * width and zoom * height.
+		float				canvasHeight;
+		float				axis;				// Sign of the view axis along z.
+		std::vector<Sdf::float3>	columnPlanes;	// Unit normals of the planes at the left edge of each column.
+		std::vector<Sdf::float3>	rowPlanes;		// Same at the bottom edge of each row.
+		std::vector<float>			sliceDepths;	// Depth where each slice starts.
+	};
+
+	// Per frame assignment of point lights to the froxels of the canvas camera. Each light's sphere
+	// is tested against the column, row and slice planes, four lights at a time with SSE where the
+	// build has it, and the clusters it touches get its index. The lists are compacted into one
+	// index array with an offset and count per cluster, which LightClusters.hlsli looks up.
+	namespace LightClusters
+	{
+		const uint32_t TilesX = 16;
+		const uint32_t TilesY = 8;
+		const uint32_t Slices = 16;
+		const uint32_t ClusterCount = TilesX * TilesY * Slices;
+
+		// The first slice ends and the last one starts at these depths, the ones in between are
+		// spaced exponentially. The room is 10 deep from the eye.
+		const float NearDepth = 0.5f;
+		const float FarDepth = 10.0f;
+
+		// Lights in the StructuredBuffer, scene lights and torches together.
+		const uint32_t MaxLights = 4096;
+
+		ClusterFrustum MakeFrustum(const RaymarchCamera& camera);
+
+		// Cluster Position is in, the same as ClusterIndex in LightClusters.hlsli.
+		uint32_t ClusterOf(const ClusterFrustum& frustum, const Sdf::float3& Position);
+
+		// Replaces ranges and indices with the lights touching each cluster, in light order.
+		void Build(const ClusterFrustum& frustum, const std::vector<ClusterLight>& lights,
+			std::vector<ClusterRange>& ranges, std::vector<uint32_t>& indices);
+
+		// Build one cluster and one light at a time, what the fast path must match exactly.
+		void BuildReference(const ClusterFrustum& frustum, const std::vector<ClusterLight>& lights,
+			std::vector<ClusterRange>& ranges, std::vector<uint32_t>& indices);
+
+		// A distant scene light, unattenuated, whose sphere just covers the room so that it is in
+		// every cluster the room is seen in and in none beyond.
+		ClusterLight SceneLight(const Sdf::float3& position, const Sdf::float3& color);
+
+		// count torches along the walls of the room, a little below the eye.
+		std::vector<ClusterLight> WallTorches(uint32_t count);
+
+		// count torch sized lights anywhere in the room, the same ones for the same seed.
+		std::vector<ClusterLight> RandomLights(uint32_t count, uint32_t seed);
+	}
+}
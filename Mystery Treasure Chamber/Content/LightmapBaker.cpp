@@ -0,0 +1,256 @@
+﻿#include "LightmapBaker.h"
+#include "FusedRaymarch.h"
+#include "PassCache.h"
+#include "SdfScene.h"
+
+#include <cstdio>
+#include <fstream>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	const uint32_t Magic = 0x50414D4C;	// "LMAP"
+
+	// Pushes the shadow rays off the surface they start on.
+	const float SurfaceOffset = 0.01f;
+
+	float3 Normal(const float3& Position)
+	{
+		const float h = 0.001f;
+		return normalize(float3(
+			FusedRaymarch::Scene(Position + float3(h, 0, 0)) - FusedRaymarch::Scene(Position - float3(h, 0, 0)),
+			FusedRaymarch::Scene(Position + float3(0, h, 0)) - FusedRaymarch::Scene(Position - float3(0, h, 0)),
+			FusedRaymarch::Scene(Position + float3(0, 0, h)) - FusedRaymarch::Scene(Position - float3(0, 0, h))));
+	}
+
+	// 1 where the light is seen, 0 behind a pillar, in between where the ray passes close to one.
+	// The lights are outside the room, so the ray only has to cross it.
+	float SoftShadow(const LightmapBaker::Settings& settings, const float3& surface, const float3& normal, const float3& light)
+	{
+		float3 origin = surface + SurfaceOffset * normal;
+		float3 direction = normalize(light - origin);
+
+		float timeIn, timeOut;
+		if (!FusedRaymarch::IntersectBox(origin, direction, timeIn, timeOut))
+			return 1.0f;
+		timeOut = std::min(timeOut, length(light - origin));
+
+		float shadow = 1.0f;
+		float t = 2.0f * SurfaceOffset;
+		for (uint32_t i = 0; i < settings.shadowSteps && t < timeOut; i++)
+		{
+			float h = FusedRaymarch::Pillars(origin + t * direction);
+			if (h < 0.001f)
+				return 0.0f;
+			shadow = std::min(shadow, settings.penumbra * h / t);
+			t += clamp(h, 0.01f, 0.5f);
+		}
+		return shadow;
+	}
+
+	// How much of the space along the normal the scene leaves open, weighting the near samples most.
+	float Occlusion(const LightmapBaker::Settings& settings, const float3& surface, const float3& normal)
+	{
+		float closed = 0.0f, total = 0.0f, weight = 1.0f;
+		for (uint32_t i = 1; i <= settings.occlusionSteps; i++)
+		{
+			float h = i * settings.occlusionStep;
+			closed += weight * std::max(h - FusedRaymarch::Scene(surface + h * normal), 0.0f);
+			total += weight * h;
+			weight *= 0.5f;
+		}
+		return total > 0.0f ? saturate(1.0f - closed / total) : 1.0f;
+	}
+
+	float3 TexelCentre(uint32_t resolution, uint32_t x, uint32_t y, uint32_t z)
+	{
+		float size = 2.0f * LightmapBaker::BoxSize / resolution;
+		return float3(-LightmapBaker::BoxSize) + size * float3(x + 0.5f, y + 0.5f, z + 0.5f);
+	}
+
+	// Texels further than this from every surface are never part of a surface sample.
+	float SurfaceReach(uint32_t resolution)
+	{
+		return 1.75f * 2.0f * LightmapBaker::BoxSize / resolution;
+	}
+}
+
+LightmapBaker::Settings LightmapBaker::DefaultSettings()
+{
+	Settings settings;
+	settings.resolution = 64;
+	settings.shadowSteps = 64;
+	settings.penumbra = 8.0f;
+	settings.occlusionSteps = 5;
+	settings.occlusionStep = 0.15f;
+	settings.ambient = 0.15f;
+	return settings;
+}
+
+uint64_t LightmapBaker::Key(const Settings& settings, const std::vector<LightmapLight>& lights)
+{
+	PassHash hash;
+	hash.Add(Version);
+	hash.Add(BoxSize);
+	hash.Add(SdfScene::PillarRadius);
+	hash.Add(SdfScene::PillarOffsets);
+	hash.Add(settings);
+	for (const LightmapLight& light : lights)
+	{
+		hash.Add(light.position);
+		hash.Add(light.color);
+	}
+	return hash.GetValue();
+}
+
+float4 LightmapBaker::Evaluate(const Settings& settings, const std::vector<LightmapLight>& lights,
+	const float3& surface, const float3& normal)
+{
+	float occlusion = Occlusion(settings, surface, normal);
+	float3 light = float3(settings.ambient * occlusion);
+
+	for (const LightmapLight& source : lights)
+	{
+		float diffuse = saturate(dot(normal, normalize(source.position - surface)));
+		if (diffuse > 0.0f)
+			light += (diffuse * SoftShadow(settings, surface, normal, source.position)) * source.color;
+	}
+
+	return float4(light, occlusion);
+}
+
+Lightmap LightmapBaker::Bake(const Settings& settings, const std::vector<LightmapLight>& lights, WorkStealingPool& pool)
+{
+	uint32_t resolution = settings.resolution;
+
+	Lightmap lightmap;
+	lightmap.key = Key(settings, lights);
+	lightmap.resolution = resolution;
+	lightmap.texels.assign(size_t(resolution) * resolution * resolution, float4());
+
+	float reach = SurfaceReach(resolution);
+	pool.Run(resolution, [&](uint32_t z, uint32_t) {
+		float4* slice = &lightmap.texels[size_t(z) * resolution * resolution];
+		for (uint32_t y = 0; y < resolution; y++)
+		{
+			for (uint32_t x = 0; x < resolution; x++)
+			{
+				float3 centre = TexelCentre(resolution, x, y, z);
+				float distance = FusedRaymarch::Scene(centre);
+				if (std::fabs(distance) > reach)
+					continue;
+
+				// Along the gradient to the surface, out of a pillar as well as onto a wall.
+				float3 normal = Normal(centre);
+				slice[y * resolution + x] = Evaluate(settings, lights, centre - distance * normal, normal);
+			}
+		}
+	});
+
+	return lightmap;
+}
+
+float4 LightmapBaker::Sample(const Lightmap& lightmap, const float3& Position)
+{
+	int resolution = static_cast<int>(lightmap.resolution);
+	float3 texel = (Position + float3(BoxSize)) * (resolution / (2.0f * BoxSize)) - float3(0.5f);
+
+	int corner[3];
+	float weight[3];
+	for (int i = 0; i < 3; i++)
+	{
+		float t = clamp(texel[i], 0.0f, float(resolution - 1));
+		corner[i] = std::min(static_cast<int>(t), resolution - 2);
+		weight[i] = t - corner[i];
+	}
+
+	float4 result;
+	for (int i = 0; i < 8; i++)
+	{
+		int x = corner[0] + (i & 1), y = corner[1] + ((i >> 1) & 1), z = corner[2] + ((i >> 2) & 1);
+		float w = ((i & 1) ? weight[0] : 1.0f - weight[0]) *
+			((i & 2) ? weight[1] : 1.0f - weight[1]) *
+			((i & 4) ? weight[2] : 1.0f - weight[2]);
+		result += w * lightmap.texels[(size_t(z) * resolution + y) * resolution + x];
+	}
+	return result;
+}
+
+bool LightmapBaker::Save(const Lightmap& lightmap, std::ostream& stream)
+{
+	stream.write(reinterpret_cast<const char*>(&Magic), sizeof(Magic));
+	stream.write(reinterpret_cast<const char*>(&Version), sizeof(Version));
+	stream.write(reinterpret_cast<const char*>(&lightmap.key), sizeof(lightmap.key));
+	stream.write(reinterpret_cast<const char*>(&lightmap.resolution), sizeof(lightmap.resolution));
+	stream.write(reinterpret_cast<const char*>(lightmap.texels.data()), lightmap.texels.size() * sizeof(float4));
+	return static_cast<bool>(stream);
+}
+
+bool LightmapBaker::Load(std::istream& stream, uint64_t key, Lightmap& lightmap)
+{
+	uint32_t magic = 0, version = 0, resolution = 0;
+	uint64_t fileKey = 0;
+	stream.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+	stream.read(reinterpret_cast<char*>(&version), sizeof(version));
+	stream.read(reinterpret_cast<char*>(&fileKey), sizeof(fileKey));
+	stream.read(reinterpret_cast<char*>(&resolution), sizeof(resolution));
+	if (!stream || magic != Magic || version != Version || fileKey != key || resolution < 2 || resolution > 1024)
+		return false;
+
+	std::vector<float4> texels(size_t(resolution) * resolution * resolution);
+	stream.read(reinterpret_cast<char*>(texels.data()), texels.size() * sizeof(float4));
+	if (!stream)
+		return false;
+
+	lightmap.key = fileKey;
+	lightmap.resolution = resolution;
+	lightmap.texels.swap(texels);
+	return true;
+}
+
+std::string LightmapBaker::CacheFileName(uint64_t key)
+{
+	char name[64];
+	std::snprintf(name, sizeof(name), "Lightmap_%016llx.bin", static_cast<unsigned long long>(key));
+	return name;
+}
+
+Lightmap LightmapBaker::LoadOrBake(const std::string& directory, const Settings& settings,
+	const std::vector<LightmapLight>& lights, WorkStealingPool& pool, bool* fromCache)
+{
+	uint64_t key = Key(settings, lights);
+	std::string path = directory.empty() ? CacheFileName(key) : directory + "/" + CacheFileName(key);
+
+	Lightmap lightmap;
+	std::ifstream cached(path, std::ios::binary);
+	bool loaded = cached && Load(cached, key, lightmap);
+	if (fromCache)
+		*fromCache = loaded;
+	if (loaded)
+		return lightmap;
+
+	lightmap = Bake(settings, lights, pool);
+
+	// A cache that cannot be written only costs the next bake.
+	std::ofstream file(path, std::ios::binary);
+	if (file)
+		Save(lightmap, file);
+
+	return lightmap;
+}
+
+std::vector<LightmapLight> LightmapBaker::SceneLights()
+{
+	std::vector<LightmapLight> lights;
+	LightmapLight light;
+	light.color = float3(1.0f);
+	light.position = float3(-10.0f, 10.0f, -50.0f);
+	lights.push_back(light);
+	light.position = float3(10.0f, 10.0f, 50.0f);
+	lights.push_back(light);
+	light.position = float3(0.0f, 60.0f, 5.0f);
+	lights.push_back(light);
+	return lights;
+}
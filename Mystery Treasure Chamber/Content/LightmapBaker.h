@@ -0,0 +1,87 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "SdfMath.h"
+#include "WorkStealingPool.h"
+
+namespace Mystery_Treasure_Chamber
+{
+	// A light that never moves, lit into the lightmap instead of shaded every frame.
+	struct LightmapLight
+	{
+		Sdf::float3	position;
+		Sdf::float3	color;
+	};
+
+	// Diffuse light of the static lights over the room's box, one texel per voxel. Each texel holds
+	// the light at the surface point nearest its centre, so sampling it trilinearly anywhere on the
+	// walls or the pillars gives the light there: rgb is the direct light with soft shadows plus the
+	// occluded ambient, a is the ambient occlusion alone. x is fastest, then y, then z.
+	struct Lightmap
+	{
+		uint64_t				key;
+		uint32_t				resolution;
+		std::vector<Sdf::float4>	texels;
+	};
+
+	// Offline CPU baker of the lightmap Lightmap.hlsli samples. Shadows are marched through the
+	// pillars, the only thing that can stand between the walls and the lights outside the room, with
+	// the penumbra estimated from how close the ray passes to them. Occlusion is sampled along the
+	// normal through the whole scene. Texels are baked a slice at a time on a WorkStealingPool, and
+	// bakes are cached on disk under their key.
+	namespace LightmapBaker
+	{
+		// Corners of the baked volume, the room's box.
+		const float BoxSize = 5.0f;
+
+		// Written at the start of a cache file, and part of every key. Change it with the bake code.
+		const uint32_t Version = 1;
+
+		struct Settings
+		{
+			uint32_t	resolution;		// Texels along each side of the room.
+			uint32_t	shadowSteps;	// Most steps of a shadow ray.
+			float		penumbra;		// Sharpness of the shadows, higher is harder.
+			uint32_t	occlusionSteps;	// Samples along the normal.
+			float		occlusionStep;	// Distance between them.
+			float		ambient;		// Light reaching a fully open surface from everywhere.
+		};
+
+		Settings DefaultSettings();
+
+		// Hash of the scene, the lights and the settings. Equal keys bake the same lightmap.
+		uint64_t Key(const Settings& settings, const std::vector<LightmapLight>& lights);
+
+		// Light at a surface point with its outward normal, what the texels are baked from.
+		Sdf::float4 Evaluate(const Settings& settings, const std::vector<LightmapLight>& lights,
+			const Sdf::float3& surface, const Sdf::float3& normal);
+
+		// Bakes every texel near a surface, the rest stay 0 since no surface samples them. The
+		// result does not depend on the pool's thread count.
+		Lightmap Bake(const Settings& settings, const std::vector<LightmapLight>& lights, WorkStealingPool& pool);
+
+		// Trilinear sample at Position, the same as BakedLight in Lightmap.hlsli.
+		Sdf::float4 Sample(const Lightmap& lightmap, const Sdf::float3& Position);
+
+		// Cache files hold the version, the key, the resolution and the texels.
+		bool Save(const Lightmap& lightmap, std::ostream& stream);
+
+		// Fails unless the stream holds a lightmap of this version and key.
+		bool Load(std::istream& stream, uint64_t key, Lightmap& lightmap);
+
+		// Name of the cache file for key, the same on every platform.
+		std::string CacheFileName(uint64_t key);
+
+		// Loads the cached bake for the settings and lights from directory, or bakes and caches it.
+		// fromCache, if set, tells which happened.
+		Lightmap LoadOrBake(const std::string& directory, const Settings& settings,
+			const std::vector<LightmapLight>& lights, WorkStealingPool& pool, bool* fromCache);
+
+		// The three lights of PixelShaderConstantBuffer.
+		std::vector<LightmapLight> SceneLights();
+	}
+}
@@ -0,0 +1,88 @@
+﻿#pragma once
+
+#include <cstdint>
+
+#include "SdfExpression.h"
+
+namespace Mystery_Treasure_Chamber
+{
+	// Sphere tracing of SDF expressions whose fields are not all true distances. The step can be
+	// the plain distance, the distance divided by the Lipschitz bound of the whole scene, or the
+	// expression's Bound, which only shrinks the steps near the nodes that need it.
+	namespace LipschitzMarch
+	{
+		// Steps before a ray counts as a miss.
+		const uint32_t MaxSteps = 1024;
+
+		// Distance below which a step counts as a hit.
+		const float HitEpsilon = 0.0005f;
+
+		enum class Scaling
+		{
+			None,		// Evaluate, which can step through surfaces.
+			Global,		// Evaluate divided by Lipschitz of the scene.
+			PerNode,	// Bound.
+		};
+
+		struct Trace
+		{
+			bool		hit;
+			bool		exhausted;	// Ran out of steps before reaching a surface or tMax.
+			float		t;
+			uint32_t	steps;
+		};
+
+		// lipschitz is only used with Scaling::Global, see SdfExpression::Lipschitz.
+		template <class E>
+		Trace March(const SdfExpression::Expression<E>& e, Scaling scaling, float lipschitz,
+			const Sdf::float3& origin, const Sdf::float3& direction, float tMax)
+		{
+			const E& expression = e.Self();
+			float inverse = scaling == Scaling::Global ? 1.0f / lipschitz : 1.0f;
+
+			Trace trace = { false, false, 0.0f, 0 };
+			while (trace.t < tMax)
+			{
+				if (trace.steps == MaxSteps)
+				{
+					trace.exhausted = true;
+					return trace;
+				}
+
+				Sdf::float3 p = origin + trace.t * direction;
+				SdfExpression::Point<float> point = SdfExpression::MakePoint(p.x, p.y, p.z);
+				float d = scaling == Scaling::PerNode ? expression.Bound(point) : expression.Evaluate(point) * inverse;
+				trace.steps++;
+
+				if (d < HitEpsilon)
+				{
+					trace.hit = true;
+					return trace;
+				}
+				trace.t += d;
+			}
+
+			return trace;
+		}
+
+		// The first sign change of the field along the ray, found with steps of spacing. The
+		// reference the traces are checked against.
+		template <class E>
+		bool FirstCrossing(const SdfExpression::Expression<E>& e, const Sdf::float3& origin,
+			const Sdf::float3& direction, float tMax, float spacing, float& t)
+		{
+			float left = SdfExpression::Evaluate(e, origin);
+			for (float time = spacing; time <= tMax; time += spacing)
+			{
+				float right = SdfExpression::Evaluate(e, origin + time * direction);
+				if (left > 0.0f && right <= 0.0f)
+				{
+					t = time - spacing;
+					return true;
+				}
+				left = right;
+			}
+			return false;
+		}
+	}
+}
@@ -0,0 +1,236 @@
+﻿#include "PacketRaymarchKernel.h"
+
+#include <cstdio>
+
+#if PACKET_RAYMARCH_X86 && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	// A struct rather than bool so the kernel finds the functions below by argument dependent lookup.
+	struct ScalarMask
+	{
+		bool v;
+
+		explicit ScalarMask(bool m) : v(m) {}
+	};
+
+	// One ray per packet, the fallback for CPUs without a wider path.
+	struct ScalarFloat
+	{
+		typedef ScalarMask Mask;
+		static const uint32_t Width = 1;
+
+		float v;
+
+		ScalarFloat() : v(0.0f) {}
+		explicit ScalarFloat(float s) : v(s) {}
+
+		static ScalarFloat Load(const float* p)	{ return ScalarFloat(*p); }
+		void Store(float* p) const				{ *p = v; }
+	};
+
+	inline ScalarFloat operator+(ScalarFloat a, ScalarFloat b)	{ return ScalarFloat(a.v + b.v); }
+	inline ScalarFloat operator-(ScalarFloat a, ScalarFloat b)	{ return ScalarFloat(a.v - b.v); }
+	inline ScalarFloat operator*(ScalarFloat a, ScalarFloat b)	{ return ScalarFloat(a.v * b.v); }
+	inline ScalarFloat operator/(ScalarFloat a, ScalarFloat b)	{ return ScalarFloat(a.v / b.v); }
+	inline ScalarFloat Min(ScalarFloat a, ScalarFloat b)		{ return ScalarFloat(std::min(a.v, b.v)); }
+	inline ScalarFloat Max(ScalarFloat a, ScalarFloat b)		{ return ScalarFloat(std::max(a.v, b.v)); }
+	inline ScalarFloat Abs(ScalarFloat a)						{ return ScalarFloat(std::fabs(a.v)); }
+	inline ScalarFloat Sqrt(ScalarFloat a)						{ return ScalarFloat(std::sqrt(a.v)); }
+	inline ScalarMask Less(ScalarFloat a, ScalarFloat b)		{ return ScalarMask(a.v < b.v); }
+	inline ScalarFloat Select(ScalarMask m, ScalarFloat a, ScalarFloat b)	{ return m.v ? a : b; }
+	inline ScalarMask And(ScalarMask a, ScalarMask b)			{ return ScalarMask(a.v && b.v); }
+	inline ScalarMask Or(ScalarMask a, ScalarMask b)			{ return ScalarMask(a.v || b.v); }
+	inline ScalarMask AndNot(ScalarMask a, ScalarMask b)		{ return ScalarMask(a.v && !b.v); }
+	inline bool Any(ScalarMask m)								{ return m.v; }
+
+#if PACKET_RAYMARCH_X86
+	// Whether the CPU has the instructions and the OS saves the registers they use.
+	bool HasAvx(bool avx512)
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx)
+			return false;
+
+		// YMM state, and for AVX-512 the opmask and ZMM state too.
+		unsigned long long xcr0 = _xgetbv(0);
+		unsigned long long required = avx512 ? 0xE6 : 0x06;
+		if ((xcr0 & required) != required)
+			return false;
+
+		__cpuidex(info, 7, 0);
+		return avx512 ? (info[1] & (1 << 16)) != 0 : (info[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		return avx512 ? __builtin_cpu_supports("avx512f") != 0 : __builtin_cpu_supports("avx2") != 0;
+#endif
+	}
+#endif
+}
+
+void PacketRaymarch::Detail::RenderTileScalar(const RaymarchCamera& camera, const RaymarchLighting& lighting, uint32_t x, uint32_t y, uint32_t tileWidth, uint32_t tileHeight, uint32_t blockSize, RaymarchSample* image)
+{
+	RenderTile<ScalarFloat>(camera, lighting, x, y, tileWidth, tileHeight, blockSize, image);
+}
+
+RaymarchLighting RaymarchLighting::Default()
+{
+	RaymarchLighting lighting;
+	lighting.lightPos[0] = float3(-10.0f, 10.0f, -50.0f);
+	lighting.lightPos[1] = float3(10.0f, 10.0f, 50.0f);
+	lighting.lightPos[2] = float3(0.0f, 60.0f, 5.0f);
+	lighting.lightColor = float4(1.0f, 1.0f, 1.0f, 1.0f);
+	lighting.roomAlbedo = float3(0.5f);
+	lighting.pillarAlbedo = float3(0.5f);
+	return lighting;
+}
+
+bool PacketRaymarch::IsSupported(SimdLevel level)
+{
+	switch (level)
+	{
+	case SimdLevel::Scalar:
+		return true;
+#if PACKET_RAYMARCH_X86
+	case SimdLevel::Avx2:
+	{
+		static const bool supported = HasAvx(false);
+		return supported;
+	}
+	case SimdLevel::Avx512:
+	{
+		static const bool supported = HasAvx(true);
+		return supported;
+	}
+#endif
+	default:
+		return false;
+	}
+}
+
+PacketRaymarch::SimdLevel PacketRaymarch::GetBestLevel()
+{
+	if (IsSupported(SimdLevel::Avx512))
+		return SimdLevel::Avx512;
+
+	if (IsSupported(SimdLevel::Avx2))
+		return SimdLevel::Avx2;
+
+	return SimdLevel::Scalar;
+}
+
+const char* PacketRaymarch::GetLevelName(SimdLevel level)
+{
+	switch (level)
+	{
+	case SimdLevel::Avx2:
+		return "AVX2";
+	case SimdLevel::Avx512:
+		return "AVX-512";
+	default:
+		return "Scalar";
+	}
+}
+
+void PacketRaymarch::Render(SimdLevel level, const RaymarchCamera& camera, const RaymarchLighting& lighting, std::vector<RaymarchSample>& image)
+{
+	uint32_t width = static_cast<uint32_t>(camera.width);
+	uint32_t height = static_cast<uint32_t>(camera.height);
+
+	image.resize(width * height);
+	RenderTile(level, camera, lighting, 0, 0, width, height, 1, image.data());
+}
+
+void PacketRaymarch::RenderTile(SimdLevel level,
+	const RaymarchCamera& camera,
+	const RaymarchLighting& lighting,
+	uint32_t x,
+	uint32_t y,
+	uint32_t tileWidth,
+	uint32_t tileHeight,
+	uint32_t blockSize,
+	RaymarchSample* image)
+{
+	// Falls back to the scalar path rather than running instructions the CPU does not have.
+	if (!IsSupported(level))
+		level = SimdLevel::Scalar;
+
+	switch (level)
+	{
+#if PACKET_RAYMARCH_X86
+	case SimdLevel::Avx2:
+		Detail::RenderTileAvx2(camera, lighting, x, y, tileWidth, tileHeight, blockSize, image);
+		break;
+	case SimdLevel::Avx512:
+		Detail::RenderTileAvx512(camera, lighting, x, y, tileWidth, tileHeight, blockSize, image);
+		break;
+#endif
+	default:
+		Detail::RenderTileScalar(camera, lighting, x, y, tileWidth, tileHeight, blockSize, image);
+		break;
+	}
+}
+
+uint32_t PacketRaymarch::CountMismatches(const std::vector<RaymarchSample>& a, const std::vector<RaymarchSample>& b, float tolerance)
+{
+	if (a.size() != b.size())
+		return static_cast<uint32_t>(std::max(a.size(), b.size()));
+
+	uint32_t count = 0;
+	for (size_t i = 0; i < a.size(); i++)
+	{
+		const float4& ca = a[i].color;
+		const float4& cb = b[i].color;
+
+		bool differ = (a[i].depth < 0.0f) != (b[i].depth < 0.0f) ||
+			std::fabs(ca.x - cb.x) > tolerance ||
+			std::fabs(ca.y - cb.y) > tolerance ||
+			std::fabs(ca.z - cb.z) > tolerance ||
+			std::fabs(ca.w - cb.w) > tolerance;
+
+		if (differ)
+			count++;
+	}
+
+	return count;
+}
+
+bool PacketRaymarch::WriteImage(const char* path, uint32_t width, uint32_t height, const std::vector<RaymarchSample>& image)
+{
+	if (image.size() < static_cast<size_t>(width) * height)
+		return false;
+
+	FILE* file = std::fopen(path, "wb");
+	if (file == nullptr)
+		return false;
+
+	std::fprintf(file, "P6\n%u %u\n255\n", width, height);
+
+	std::vector<unsigned char> row(width * 3);
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			const float4& color = image[y * width + x].color;
+			row[x * 3 + 0] = static_cast<unsigned char>(saturate(color.x) * 255.0f + 0.5f);
+			row[x * 3 + 1] = static_cast<unsigned char>(saturate(color.y) * 255.0f + 0.5f);
+			row[x * 3 + 2] = static_cast<unsigned char>(saturate(color.z) * 255.0f + 0.5f);
+		}
+		std::fwrite(row.data(), 1, row.size(), file);
+	}
+
+	return std::fclose(file) == 0;
+}
@@ -0,0 +1,74 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "SdfMath.h"
+#include "RaymarchReconstruction.h"
+#include "TemporalReprojection.h"
+
+namespace Mystery_Treasure_Chamber
+{
+	// The lights of PixelShaderConstantBuffer and what stands in for the material textures,
+	// which the CPU does not sample.
+	struct RaymarchLighting
+	{
+		Sdf::float3	lightPos[3];
+		Sdf::float4	lightColor;
+		Sdf::float3	roomAlbedo;
+		Sdf::float3	pillarAlbedo;
+
+		// The values Sample3DSceneRenderer uses, with mid grey for both materials.
+		static RaymarchLighting Default();
+	};
+
+	// CPU version of FusedPixelShader.hlsl with the canvas camera: the room and the pillars are
+	// marched as one field, shaded with the three Phong lights, and several rays are traced per
+	// instruction. Meant for golden images and performance baselines on machines without a GPU.
+	// Textures are replaced by the albedos of RaymarchLighting and the pillars are lit with their
+	// geometric normal instead of the normal map.
+	namespace PacketRaymarch
+	{
+		// Instruction sets the marcher has a path for. Values are the rays per packet.
+		enum class SimdLevel : uint32_t
+		{
+			Scalar = 1,
+			Avx2 = 8,
+			Avx512 = 16,
+		};
+
+		// Whether both this build and the CPU it runs on can use level.
+		bool IsSupported(SimdLevel level);
+
+		// The widest supported level.
+		SimdLevel GetBestLevel();
+
+		const char* GetLevelName(SimdLevel level);
+
+		// Traces every pixel of camera. Misses get a zero colour and a negative depth, hits the
+		// distance along the ray in depth.
+		void Render(SimdLevel level,
+			const RaymarchCamera& camera,
+			const RaymarchLighting& lighting,
+			std::vector<RaymarchSample>& image);
+
+		// Traces the pixels of one rectangle into image, which holds the whole frame row by row.
+		// With a blockSize above 1 only the centre of each blockSize x blockSize block is traced
+		// and copied to the rest of the block, for quick low resolution previews.
+		void RenderTile(SimdLevel level,
+			const RaymarchCamera& camera,
+			const RaymarchLighting& lighting,
+			uint32_t x,
+			uint32_t y,
+			uint32_t tileWidth,
+			uint32_t tileHeight,
+			uint32_t blockSize,
+			RaymarchSample* image);
+
+		// How many pixels differ by more than tolerance in any colour channel, or disagree on hit or miss.
+		uint32_t CountMismatches(const std::vector<RaymarchSample>& a, const std::vector<RaymarchSample>& b, float tolerance);
+
+		// Writes the colours as a binary PPM, the simplest format image diff tools read.
+		bool WriteImage(const char* path, uint32_t width, uint32_t height, const std::vector<RaymarchSample>& image);
+	}
+}
@@ -0,0 +1,61 @@
+﻿#include "PacketRaymarch.h"
+
+// Everything after this point may use AVX2. The shared headers above are compiled for the base
+// instruction set, so their inline functions are safe to share with the other paths.
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#pragma GCC target("avx2")
+#endif
+
+#include "PacketRaymarchKernel.h"
+
+#if PACKET_RAYMARCH_X86
+
+using namespace Mystery_Treasure_Chamber;
+
+namespace
+{
+	struct Avx2Mask
+	{
+		__m256 v;
+
+		explicit Avx2Mask(__m256 m) : v(m) {}
+	};
+
+	// Eight rays per packet.
+	struct Avx2Float
+	{
+		typedef Avx2Mask Mask;
+		static const uint32_t Width = 8;
+
+		__m256 v;
+
+		Avx2Float() : v(_mm256_setzero_ps()) {}
+		explicit Avx2Float(float s) : v(_mm256_set1_ps(s)) {}
+		explicit Avx2Float(__m256 x) : v(x) {}
+
+		static Avx2Float Load(const float* p)	{ return Avx2Float(_mm256_loadu_ps(p)); }
+		void Store(float* p) const				{ _mm256_storeu_ps(p, v); }
+	};
+
+	inline Avx2Float operator+(Avx2Float a, Avx2Float b)	{ return Avx2Float(_mm256_add_ps(a.v, b.v)); }
+	inline Avx2Float operator-(Avx2Float a, Avx2Float b)	{ return Avx2Float(_mm256_sub_ps(a.v, b.v)); }
+	inline Avx2Float operator*(Avx2Float a, Avx2Float b)	{ return Avx2Float(_mm256_mul_ps(a.v, b.v)); }
+	inline Avx2Float operator/(Avx2Float a, Avx2Float b)	{ return Avx2Float(_mm256_div_ps(a.v, b.v)); }
+	inline Avx2Float Min(Avx2Float a, Avx2Float b)			{ return Avx2Float(_mm256_min_ps(a.v, b.v)); }
+	inline Avx2Float Max(Avx2Float a, Avx2Float b)			{ return Avx2Float(_mm256_max_ps(a.v, b.v)); }
+	inline Avx2Float Abs(Avx2Float a)						{ return Avx2Float(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v)); }
+	inline Avx2Float Sqrt(Avx2Float a)						{ return Avx2Float(_mm256_sqrt_ps(a.v)); }
+	inline Avx2Mask Less(Avx2Float a, Avx2Float b)			{ return Avx2Mask(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)); }
+	inline Avx2Float Select(Avx2Mask m, Avx2Float a, Avx2Float b)	{ return Avx2Float(_mm256_blendv_ps(b.v, a.v, m.v)); }
+	inline Avx2Mask And(Avx2Mask a, Avx2Mask b)				{ return Avx2Mask(_mm256_and_ps(a.v, b.v)); }
+	inline Avx2Mask Or(Avx2Mask a, Avx2Mask b)				{ return Avx2Mask(_mm256_or_ps(a.v, b.v)); }
+	inline Avx2Mask AndNot(Avx2Mask a, Avx2Mask b)			{ return Avx2Mask(_mm256_andnot_ps(b.v, a.v)); }
+	inline bool Any(Avx2Mask m)								{ return _mm256_movemask_ps(m.v) != 0; }
+}
+
+void PacketRaymarch::Detail::RenderTileAvx2(const RaymarchCamera& camera, const RaymarchLighting& lighting, uint32_t x, uint32_t y, uint32_t tileWidth, uint32_t tileHeight, uint32_t blockSize, RaymarchSample* image)
+{
+	RenderTile<Avx2Float>(camera, lighting, x, y, tileWidth, tileHeight, blockSize, image);
+}
+
+#endif
@@ -0,0 +1,67 @@
+﻿#include "PacketRaymarch.h"
+
+// Everything after this point may use AVX-512. The shared headers above are compiled for the base
+// instruction set, so their inline functions are safe to share with the other paths.
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#pragma GCC target("avx512f")
+#endif
+
+#include "PacketRaymarchKernel.h"
+
+#if PACKET_RAYMARCH_X86
+
+using namespace Mystery_Treasure_Chamber;
+
+namespace
+{
+	struct Avx512Mask
+	{
+		__mmask16 v;
+
+		explicit Avx512Mask(__mmask16 m) : v(m) {}
+	};
+
+	// Sixteen rays per packet, with the lane masks in mask registers.
+	struct Avx512Float
+	{
+		typedef Avx512Mask Mask;
+		static const uint32_t Width = 16;
+
+		__m512 v;
+
+		Avx512Float() : v(_mm512_setzero_ps()) {}
+		explicit Avx512Float(float s) : v(_mm512_set1_ps(s)) {}
+		explicit Avx512Float(__m512 x) : v(x) {}
+
+		static Avx512Float Load(const float* p)	{ return Avx512Float(_mm512_loadu_ps(p)); }
+		void Store(float* p) const				{ _mm512_storeu_ps(p, v); }
+	};
+
+	inline Avx512Float operator+(Avx512Float a, Avx512Float b)	{ return Avx512Float(_mm512_add_ps(a.v, b.v)); }
+	inline Avx512Float operator-(Avx512Float a, Avx512Float b)	{ return Avx512Float(_mm512_sub_ps(a.v, b.v)); }
+	inline Avx512Float operator*(Avx512Float a, Avx512Float b)	{ return Avx512Float(_mm512_mul_ps(a.v, b.v)); }
+	inline Avx512Float operator/(Avx512Float a, Avx512Float b)	{ return Avx512Float(_mm512_div_ps(a.v, b.v)); }
+	inline Avx512Float Abs(Avx512Float a)						{ return Avx512Float(_mm512_abs_ps(a.v)); }
+
+	// GCC's unmasked min, max and square root pass _mm512_undefined_ps() to their masked builtins,
+	// which -Wall reports as used uninitialized once they are inlined. Masked with every lane set
+	// they compile to the same instructions, with an operand for the lanes nothing is written to.
+	const __mmask16 AllLanes = 0xFFFF;
+
+	inline Avx512Float Min(Avx512Float a, Avx512Float b)		{ return Avx512Float(_mm512_mask_min_ps(a.v, AllLanes, a.v, b.v)); }
+	inline Avx512Float Max(Avx512Float a, Avx512Float b)		{ return Avx512Float(_mm512_mask_max_ps(a.v, AllLanes, a.v, b.v)); }
+	inline Avx512Float Sqrt(Avx512Float a)						{ return Avx512Float(_mm512_mask_sqrt_ps(a.v, AllLanes, a.v)); }
+	inline Avx512Mask Less(Avx512Float a, Avx512Float b)		{ return Avx512Mask(_mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ)); }
+	inline Avx512Float Select(Avx512Mask m, Avx512Float a, Avx512Float b)	{ return Avx512Float(_mm512_mask_blend_ps(m.v, b.v, a.v)); }
+	inline Avx512Mask And(Avx512Mask a, Avx512Mask b)			{ return Avx512Mask(static_cast<__mmask16>(a.v & b.v)); }
+	inline Avx512Mask Or(Avx512Mask a, Avx512Mask b)			{ return Avx512Mask(static_cast<__mmask16>(a.v | b.v)); }
+	inline Avx512Mask AndNot(Avx512Mask a, Avx512Mask b)		{ return Avx512Mask(static_cast<__mmask16>(a.v & ~b.v)); }
+	inline bool Any(Avx512Mask m)								{ return m.v != 0; }
+}
+
+void PacketRaymarch::Detail::RenderTileAvx512(const RaymarchCamera& camera, const RaymarchLighting& lighting, uint32_t x, uint32_t y, uint32_t tileWidth, uint32_t tileHeight, uint32_t blockSize, RaymarchSample* image)
+{
+	RenderTile<Avx512Float>(camera, lighting, x, y, tileWidth, tileHeight, blockSize, image);
+}
+
+#endif
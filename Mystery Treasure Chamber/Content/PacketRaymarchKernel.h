@@ -0,0 +1,305 @@
+﻿#pragma once
+
+#include "PacketRaymarch.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define PACKET_RAYMARCH_X86 1
+#include <immintrin.h>
+#else
+#define PACKET_RAYMARCH_X86 0
+#endif
+
+// The marcher written once for any packet width. F is a lane type with Width floats, arithmetic
+// operators, Min, Max, Abs, Sqrt, Less, Select, Load, Store and a mask type M with And, Or,
+// AndNot and Any. Each instruction set has its own translation unit that defines its lane type
+// and instantiates RenderTile with it, so it can be compiled for that instruction set alone.
+namespace Mystery_Treasure_Chamber
+{
+	namespace PacketRaymarch
+	{
+		namespace Detail
+		{
+			void RenderTileScalar(const RaymarchCamera& camera, const RaymarchLighting& lighting, uint32_t x, uint32_t y, uint32_t tileWidth, uint32_t tileHeight, uint32_t blockSize, RaymarchSample* image);
+#if PACKET_RAYMARCH_X86
+			void RenderTileAvx2(const RaymarchCamera& camera, const RaymarchLighting& lighting, uint32_t x, uint32_t y, uint32_t tileWidth, uint32_t tileHeight, uint32_t blockSize, RaymarchSample* image);
+			void RenderTileAvx512(const RaymarchCamera& camera, const RaymarchLighting& lighting, uint32_t x, uint32_t y, uint32_t tileWidth, uint32_t tileHeight, uint32_t blockSize, RaymarchSample* image);
+#endif
+
+			// Same constants as FusedPixelShader.hlsl.
+			const float BoxSize = 5.0f;
+			const int Intervals = 200;
+			const float NormalStep = 0.01f;
+			const float PillarRadius = 0.5f;
+			const float PillarOffset = 3.5f;
+
+			template <class F>
+			struct Vec
+			{
+				F x, y, z;
+			};
+
+			template <class F>
+			Vec<F> MakeVec(const F& x, const F& y, const F& z)
+			{
+				Vec<F> v = { x, y, z };
+				return v;
+			}
+
+			template <class F>
+			Vec<F> Broadcast(const Sdf::float3& v)
+			{
+				return MakeVec(F(v.x), F(v.y), F(v.z));
+			}
+
+			template <class F>
+			F Dot(const Vec<F>& a, const Vec<F>& b)
+			{
+				return a.x * b.x + a.y * b.y + a.z * b.z;
+			}
+
+			template <class F>
+			Vec<F> Normalize(const Vec<F>& a)
+			{
+				F length = Sqrt(Dot(a, a));
+				return MakeVec(a.x / length, a.y / length, a.z / length);
+			}
+
+			template <class F>
+			F Saturate(const F& x)
+			{
+				return Min(Max(x, F(0.0f)), F(1.0f));
+			}
+
+			// pow(x, 40) for x in [0, 1], the Phong shininess of both materials.
+			template <class F>
+			F Pow40(const F& x)
+			{
+				F x2 = x * x;
+				F x4 = x2 * x2;
+				F x8 = x4 * x4;
+				F x16 = x8 * x8;
+				F x32 = x16 * x16;
+				return x32 * x8;
+			}
+
+			// -sdBox(Position, 5)
+			template <class F>
+			F Room(const Vec<F>& p)
+			{
+				F zero(0.0f);
+				F dx = Abs(p.x) - F(BoxSize);
+				F dy = Abs(p.y) - F(BoxSize);
+				F dz = Abs(p.z) - F(BoxSize);
+				F inside = Min(Max(dx, Max(dy, dz)), zero);
+				F ox = Max(dx, zero);
+				F oy = Max(dy, zero);
+				F oz = Max(dz, zero);
+				return zero - (inside + Sqrt(ox * ox + oy * oy + oz * oz));
+			}
+
+			template <class F>
+			F Cylinder(const Vec<F>& p, float offsetX, float offsetZ)
+			{
+				F a = p.x + F(offsetX);
+				F b = p.z + F(offsetZ);
+				return Sqrt(a * a + b * b) - F(PillarRadius);
+			}
+
+			template <class F>
+			F Pillars(const Vec<F>& p)
+			{
+				F Fun = Cylinder(p, PillarOffset, PillarOffset);
+				Fun = Min(Fun, Cylinder(p, -PillarOffset, PillarOffset));
+				Fun = Min(Fun, Cylinder(p, -PillarOffset, 0.0f));
+				Fun = Min(Fun, Cylinder(p, PillarOffset, 0.0f));
+				return Fun;
+			}
+
+			template <class F>
+			F Scene(const Vec<F>& p)
+			{
+				return Min(Room(p), Pillars(p));
+			}
+
+			template <class F>
+			Vec<F> Offset(const Vec<F>& p, int axis, float d)
+			{
+				Vec<F> q = p;
+				F& c = axis == 0 ? q.x : axis == 1 ? q.y : q.z;
+				c = c + F(d);
+				return q;
+			}
+
+			// CalcNormal of the shader for one of the two fields.
+			template <class F, F (*Field)(const Vec<F>&)>
+			Vec<F> Gradient(const Vec<F>& p)
+			{
+				return Normalize(MakeVec(
+					Field(Offset(p, 0, NormalStep)) - Field(Offset(p, 0, -NormalStep)),
+					Field(Offset(p, 1, NormalStep)) - Field(Offset(p, 1, -NormalStep)),
+					Field(Offset(p, 2, NormalStep)) - Field(Offset(p, 2, -NormalStep))));
+			}
+
+			template <class F>
+			Vec<F> Select(const typename F::Mask& mask, const Vec<F>& a, const Vec<F>& b)
+			{
+				return MakeVec(Select(mask, a.x, b.x), Select(mask, a.y, b.y), Select(mask, a.z, b.z));
+			}
+
+			template <class F>
+			struct Packet
+			{
+				F r, g, b, a;
+				Vec<F> normal;
+				F depth;
+			};
+
+			// IntersectBox, RayMarchingInsideCube, CalcNormal and the shading of the fused shader
+			// for F::Width rays at once. Lanes that are done are masked out of the results but keep
+			// stepping until every lane in the packet is done.
+			template <class F>
+			Packet<F> TracePacket(const Vec<F>& o, const Vec<F>& d, const RaymarchLighting& lighting)
+			{
+				typedef typename F::Mask M;
+
+				F zero(0.0f);
+				Packet<F> result = { zero, zero, zero, zero, MakeVec(zero, zero, zero), F(-1.0f) };
+
+				// IntersectBox
+				F minX = (F(-BoxSize) - o.x) / d.x, maxX = (F(BoxSize) - o.x) / d.x;
+				F minY = (F(-BoxSize) - o.y) / d.y, maxY = (F(BoxSize) - o.y) / d.y;
+				F minZ = (F(-BoxSize) - o.z) / d.z, maxZ = (F(BoxSize) - o.z) / d.z;
+				F timeOut = Min(Max(minX, maxX), Min(Max(minY, maxY), Max(minZ, maxZ)));
+				F timeIn = Max(Max(Min(minX, maxX), zero), Max(Min(minY, maxY), Min(minZ, maxZ)));
+
+				M active = Less(timeIn, timeOut);
+				if (!Any(active))
+					return result;
+
+				// RayMarchingInsideCube
+				F step = (timeOut - timeIn) / F(float(Intervals));
+				F time = timeIn;
+				Vec<F> Position = MakeVec(o.x + time * d.x, o.y + time * d.y, o.z + time * d.z);
+				F left = Scene(Position);
+				F t = zero;
+				M found = Less(zero, zero);
+
+				for (int i = 0; i < Intervals && Any(active); i++)
+				{
+					time = time + step;
+					Position = MakeVec(Position.x + step * d.x, Position.y + step * d.y, Position.z + step * d.z);
+					F right = Scene(Position);
+
+					M crossed = And(active, Less(left * right, zero));
+					t = Select(crossed, time + right * step / (left - right), t);
+					found = Or(found, crossed);
+					active = AndNot(active, crossed);
+					left = right;
+				}
+
+				if (!Any(found))
+					return result;
+
+				Position = MakeVec(o.x + d.x * t, o.y + d.y * t, o.z + d.z * t);
+
+				// Whichever surface the hit is closer to is the one the ray crossed.
+				M pillar = Less(Abs(Pillars(Position)), Abs(Room(Position)));
+				M room = AndNot(found, pillar);
+				pillar = And(found, pillar);
+
+				Vec<F> normal = MakeVec(zero, zero, zero);
+				if (Any(pillar))
+					normal = Gradient<F, Pillars<F> >(Position);
+				if (Any(room))
+					normal = Select(room, Gradient<F, Room<F> >(Position), normal);
+
+				// Three Phong lights. The room's specular colour is green, the pillar's white.
+				F diffuse = zero, specular = zero;
+				for (int i = 0; i < 3; i++)
+				{
+					Vec<F> toLight = Broadcast<F>(lighting.lightPos[i]);
+					Vec<F> l = Normalize(MakeVec(toLight.x - Position.x, toLight.y - Position.y, toLight.z - Position.z));
+					F NdotL = Dot(normal, l);
+					F twoNdotL = NdotL + NdotL;
+					Vec<F> r = MakeVec(l.x - twoNdotL * normal.x, l.y - twoNdotL * normal.y, l.z - twoNdotL * normal.z);
+					diffuse = diffuse + Saturate(NdotL);
+					specular = specular + Select(Less(zero, NdotL), Pow40(Saturate(Dot(d, r))), zero);
+				}
+
+				const Sdf::float3& ra = lighting.roomAlbedo;
+				const Sdf::float3& pa = lighting.pillarAlbedo;
+				const Sdf::float4& lc = lighting.lightColor;
+				F alpha = diffuse + specular;
+
+				result.r = Select(found, Saturate(F(lc.x) * Select(pillar, diffuse * F(pa.x) + specular, F(ra.x) * diffuse)), zero);
+				result.g = Select(found, Saturate(F(lc.y) * Select(pillar, diffuse * F(pa.y) + specular, F(ra.y) * alpha)), zero);
+				result.b = Select(found, Saturate(F(lc.z) * Select(pillar, diffuse * F(pa.z) + specular, F(ra.z) * diffuse)), zero);
+				result.a = Select(found, Saturate(F(lc.w) * alpha), zero);
+				result.normal = normal;
+				result.depth = Select(found, t, result.depth);
+				return result;
+			}
+
+			template <class F>
+			void RenderTile(const RaymarchCamera& camera, const RaymarchLighting& lighting, uint32_t x, uint32_t y, uint32_t tileWidth, uint32_t tileHeight, uint32_t blockSize, RaymarchSample* image)
+			{
+				const uint32_t Width = F::Width;
+				uint32_t width = static_cast<uint32_t>(camera.width);
+				uint32_t right = x + tileWidth;
+				uint32_t bottom = y + tileHeight;
+				float centre = 0.5f * blockSize;
+
+				float lanes[8][Width];
+				Vec<F> origin = Broadcast<F>(camera.eye);
+
+				for (uint32_t row = y; row < bottom; row += blockSize)
+				{
+					for (uint32_t column = x; column < right; column += Width * blockSize)
+					{
+						uint32_t blocks = (right - column + blockSize - 1) / blockSize;
+						uint32_t count = blocks < Width ? blocks : Width;
+
+						// Unused lanes repeat the last ray, so they finish with the others.
+						for (uint32_t lane = 0; lane < Width; lane++)
+						{
+							uint32_t pixel = column + (lane < count ? lane : count - 1) * blockSize;
+							Sdf::float3 direction = camera.Ray(pixel + centre, row + centre);
+							lanes[0][lane] = direction.x;
+							lanes[1][lane] = direction.y;
+							lanes[2][lane] = direction.z;
+						}
+
+						Packet<F> packet = TracePacket(origin, MakeVec(F::Load(lanes[0]), F::Load(lanes[1]), F::Load(lanes[2])), lighting);
+
+						packet.r.Store(lanes[0]);
+						packet.g.Store(lanes[1]);
+						packet.b.Store(lanes[2]);
+						packet.a.Store(lanes[3]);
+						packet.normal.x.Store(lanes[4]);
+						packet.normal.y.Store(lanes[5]);
+						packet.normal.z.Store(lanes[6]);
+						packet.depth.Store(lanes[7]);
+
+						for (uint32_t lane = 0; lane < count; lane++)
+						{
+							RaymarchSample sample;
+							sample.color = Sdf::float4(lanes[0][lane], lanes[1][lane], lanes[2][lane], lanes[3][lane]);
+							sample.normal = Sdf::float3(lanes[4][lane], lanes[5][lane], lanes[6][lane]);
+							sample.depth = lanes[7][lane];
+
+							// The whole block shows its centre ray, clipped to the tile.
+							uint32_t blockX = column + lane * blockSize;
+							for (uint32_t py = row; py < row + blockSize && py < bottom; py++)
+							{
+								for (uint32_t px = blockX; px < blockX + blockSize && px < right; px++)
+								{
+									image[py * width + px] = sample;
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,73 @@
+﻿#include "PassCache.h"
+
+using namespace Mystery_Treasure_Chamber;
+
+namespace
+{
+	const uint64_t OffsetBasis = 14695981039346656037ULL;
+	const uint64_t Prime = 1099511628211ULL;
+}
+
+PassHash::PassHash() :
+	m_value(OffsetBasis)
+{
+}
+
+void PassHash::Add(const void* data, size_t size)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+	for (size_t i = 0; i < size; i++)
+	{
+		m_value ^= bytes[i];
+		m_value *= Prime;
+	}
+}
+
+void PassHash::AddRoomPass(const RoomPassInputs& inputs)
+{
+	// Counts go in ahead of the lists so that moving a value from one list to the next changes the hash.
+	for (const std::vector<PassBytes>* list : { &inputs.constants, &inputs.modes })
+	{
+		Add(list->size());
+		for (const PassBytes& bytes : *list)
+		{
+			Add(bytes.data, bytes.size);
+		}
+	}
+
+	Add(inputs.lightCount);
+	Add(inputs.lights, inputs.lightCount * sizeof(ClusterLight));
+	Add(inputs.viewport);
+	Add(inputs.floorMode);
+	Add(inputs.bakedLights);
+	Add(inputs.occlusion);
+
+	Add(inputs.resources.size());
+	for (const void* resource : inputs.resources)
+	{
+		Add(resource);
+	}
+}
+
+PassCache::PassCache() :
+	m_hash(0),
+	m_valid(false),
+	m_hits(0),
+	m_misses(0)
+{
+}
+
+bool PassCache::Reuse(uint64_t hash)
+{
+	if (m_valid && hash == m_hash)
+	{
+		m_hits++;
+		return true;
+	}
+
+	m_hash = hash;
+	m_valid = true;
+	m_misses++;
+	return false;
+}
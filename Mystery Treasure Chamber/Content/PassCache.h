@@ -0,0 +1,92 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "FloorMesh.h"
+#include "LightClusters.h"
+
+namespace Mystery_Treasure_Chamber
+{
+	// A value to hash byte for byte, see PassBytes::Of.
+	struct PassBytes
+	{
+		const void*	data;
+		size_t		size;
+
+		template <typename T>
+		static PassBytes Of(const T& value)		{ return PassBytes{ &value, sizeof(value) }; }
+	};
+
+	// D3D11_VIEWPORT's fields, in its order.
+	struct PassViewport
+	{
+		float	x;
+		float	y;
+		float	width;
+		float	height;
+		float	minDepth;
+		float	maxDepth;
+	};
+
+	// Everything the room pass reads. Constant buffers, mode switches and lights are hashed by value,
+	// the target and textures by identity since recreating them is the only way their contents change.
+	struct RoomPassInputs
+	{
+		std::vector<PassBytes>		constants;		// As uploaded: camera, lights, canvas size.
+		std::vector<PassBytes>		modes;			// Render settings that pick shaders or passes.
+		const ClusterLight*			lights;			// Scene lights and torches, as the clusters hold them.
+		size_t						lightCount;
+		PassViewport				viewport;
+		FloorMode					floorMode;
+		uint32_t					bakedLights;	// Lights that come from the lightmap, 0 without it.
+		bool						occlusion;		// The occlusion volume is bound.
+		std::vector<const void*>	resources;		// Target and textures.
+	};
+
+	// FNV-1a hash of everything a render pass reads: constant buffer contents, the identity of the
+	// bound views and the viewport. Values are hashed byte for byte, so structs must not contain
+	// uninitialised padding.
+	class PassHash
+	{
+	public:
+		PassHash();
+
+		void Add(const void* data, size_t size);
+
+		template <typename T>
+		void Add(const T& value)		{ Add(&value, sizeof(value)); }
+
+		void AddRoomPass(const RoomPassInputs& inputs);
+
+		uint64_t GetValue() const		{ return m_value; }
+
+	private:
+		uint64_t	m_value;
+	};
+
+	// Decides whether a pass can keep the output it rendered last time. The output stays valid until
+	// the inputs hash differently or the target is recreated.
+	class PassCache
+	{
+	public:
+		PassCache();
+
+		// Returns true if the output rendered for the same hash is still there. Otherwise the caller
+		// renders the pass, and hash is remembered for next time.
+		bool Reuse(uint64_t hash);
+
+		// Forgets the output, for when the target it lives in is recreated.
+		void Invalidate()				{ m_valid = false; }
+
+		uint64_t GetHits() const		{ return m_hits; }
+		uint64_t GetMisses() const		{ return m_misses; }
+
+	private:
+		uint64_t	m_hash;
+		bool		m_valid;
+		uint64_t	m_hits;
+		uint64_t	m_misses;
+	};
+}
@@ -0,0 +1,122 @@
+﻿#include "RaymarchDepth.h"
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	float4 Unproject(const float4x4& inverseViewProjection, const float2& ndc, float depth)
+	{
+		float4 Position = mul(float4(ndc.x, ndc.y, depth, 1.0f), inverseViewProjection);
+		return Position * (1.0f / Position.w);
+	}
+}
+
+float4x4 RaymarchDepth::LookAtRH(const float3& eye, const float3& at, const float3& up)
+{
+	// The camera looks down -z, so z points from the target to the eye.
+	float3 z = normalize(eye - at);
+	float3 x = normalize(cross(up, z));
+	float3 y = cross(z, x);
+
+	float4x4 view = { {
+		{ x.x, y.x, z.x, 0.0f },
+		{ x.y, y.y, z.y, 0.0f },
+		{ x.z, y.z, z.z, 0.0f },
+		{ -dot(x, eye), -dot(y, eye), -dot(z, eye), 1.0f },
+	} };
+	return view;
+}
+
+float4x4 RaymarchDepth::PerspectiveFovRH(float fovAngleY, float aspectRatio, float nearZ, float farZ)
+{
+	float height = 1.0f / std::tan(0.5f * fovAngleY);
+	float width = height / aspectRatio;
+	float range = farZ / (nearZ - farZ);
+
+	float4x4 projection = { {
+		{ width, 0.0f, 0.0f, 0.0f },
+		{ 0.0f, height, 0.0f, 0.0f },
+		{ 0.0f, 0.0f, range, -1.0f },
+		{ 0.0f, 0.0f, range * nearZ, 0.0f },
+	} };
+	return projection;
+}
+
+float4x4 RaymarchDepth::Inverse(const float4x4& matrix)
+{
+	// Gauss-Jordan elimination with partial pivoting.
+	float a[4][8];
+	for (int i = 0; i < 4; i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			a[i][j] = matrix.m[i][j];
+			a[i][j + 4] = i == j ? 1.0f : 0.0f;
+		}
+	}
+
+	for (int column = 0; column < 4; column++)
+	{
+		int pivot = column;
+		for (int row = column + 1; row < 4; row++)
+		{
+			if (std::fabs(a[row][column]) > std::fabs(a[pivot][column]))
+				pivot = row;
+		}
+
+		for (int j = 0; j < 8; j++)
+			std::swap(a[column][j], a[pivot][j]);
+
+		float scale = 1.0f / a[column][column];
+		for (int j = 0; j < 8; j++)
+			a[column][j] *= scale;
+
+		for (int row = 0; row < 4; row++)
+		{
+			if (row == column)
+				continue;
+
+			float factor = a[row][column];
+			for (int j = 0; j < 8; j++)
+				a[row][j] -= factor * a[column][j];
+		}
+	}
+
+	float4x4 inverse;
+	for (int i = 0; i < 4; i++)
+	{
+		for (int j = 0; j < 4; j++)
+			inverse.m[i][j] = a[i][j + 4];
+	}
+	return inverse;
+}
+
+float2 RaymarchDepth::PixelToNdc(float x, float y, float width, float height)
+{
+	return float2(2.0f * (x + 0.5f) / width - 1.0f, 1.0f - 2.0f * (y + 0.5f) / height);
+}
+
+float RaymarchDepth::ProjectDepth(const float4x4& viewProjection, const float3& Position)
+{
+	float4 clip = mul(float4(Position, 1.0f), viewProjection);
+	return clip.z / clip.w;
+}
+
+float3 RaymarchDepth::PixelRay(const float4x4& inverseViewProjection, const float3& eye, const float2& ndc)
+{
+	float4 farPoint = Unproject(inverseViewProjection, ndc, 1.0f);
+	return normalize(float3(farPoint.x, farPoint.y, farPoint.z) - eye);
+}
+
+float RaymarchDepth::RayDistance(const float4x4& inverseViewProjection, const float3& eye, const float3& direction, const float2& ndc, float depth)
+{
+	float4 Position = Unproject(inverseViewProjection, ndc, depth);
+	return dot(float3(Position.x, Position.y, Position.z) - eye, direction);
+}
+
+float RaymarchDepth::QuantizeDepth(float depth)
+{
+	const float Levels = 16777215.0f;
+	return std::floor(saturate(depth) * Levels + 0.5f) / Levels;
+}
@@ -0,0 +1,34 @@
+﻿#pragma once
+
+#include "SdfMath.h"
+
+namespace Mystery_Treasure_Chamber
+{
+	// CPU reference of the depth conversions in FusedPixelShader.hlsl. In depth tested mode the
+	// marcher shoots its rays through the raster camera, writes the depth the rasterizer would have
+	// written for the hit and stops marching where the rasterized geometry is.
+	namespace RaymarchDepth
+	{
+		// Same matrices as XMMatrixLookAtRH and XMMatrixPerspectiveFovRH.
+		Sdf::float4x4 LookAtRH(const Sdf::float3& eye, const Sdf::float3& at, const Sdf::float3& up);
+		Sdf::float4x4 PerspectiveFovRH(float fovAngleY, float aspectRatio, float nearZ, float farZ);
+
+		// General 4x4 inverse. The matrix must not be singular.
+		Sdf::float4x4 Inverse(const Sdf::float4x4& matrix);
+
+		// Normalized device coordinates of the centre of pixel (x, y), measured from the top left corner.
+		Sdf::float2 PixelToNdc(float x, float y, float width, float height);
+
+		// Depth buffer value of Position, z / w after the view projection.
+		float ProjectDepth(const Sdf::float4x4& viewProjection, const Sdf::float3& Position);
+
+		// Direction of the ray from the eye through ndc.
+		Sdf::float3 PixelRay(const Sdf::float4x4& inverseViewProjection, const Sdf::float3& eye, const Sdf::float2& ndc);
+
+		// Distance along the ray through ndc to the point with the given depth buffer value.
+		float RayDistance(const Sdf::float4x4& inverseViewProjection, const Sdf::float3& eye, const Sdf::float3& direction, const Sdf::float2& ndc, float depth);
+
+		// The value a DXGI_FORMAT_D24_UNORM_S8_UINT buffer stores for depth.
+		float QuantizeDepth(float depth);
+	}
+}
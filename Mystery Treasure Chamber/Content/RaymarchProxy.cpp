@@ -0,0 +1,117 @@
+﻿#include "RaymarchProxy.h"
+#include "ConeMarch.h"
+#include "SdfScene.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	const float BoxSize = 5.0f;
+	const int Intervals = 200;
+
+	// Corner i of a box has maximum.x if bit 0 is set, maximum.y for bit 1 and maximum.z for bit 2.
+	float3 Corner(const RaymarchProxy& proxy, uint32_t i)
+	{
+		return float3(
+			(i & 1) ? proxy.maximum.x : proxy.minimum.x,
+			(i & 2) ? proxy.maximum.y : proxy.minimum.y,
+			(i & 4) ? proxy.maximum.z : proxy.minimum.z);
+	}
+
+	// Two triangles per face, clockwise seen from outside.
+	const uint16_t BoxIndices[RaymarchProxies::TrianglesPerProxy * 3] =
+	{
+		0, 3, 2,	0, 1, 3,	// -z
+		4, 7, 5,	4, 6, 7,	// +z
+		0, 6, 4,	0, 2, 6,	// -x
+		1, 7, 3,	1, 5, 7,	// +x
+		0, 5, 1,	0, 4, 5,	// -y
+		2, 7, 6,	2, 3, 7,	// +y
+	};
+}
+
+std::vector<RaymarchProxy> RaymarchProxies::PillarProxies()
+{
+	std::vector<RaymarchProxy> proxies;
+	float half = SdfScene::PillarRadius + Margin;
+	for (uint32_t i = 0; i < SdfScene::PillarCount; i++)
+	{
+		float3 centre = -SdfScene::PillarOffsets[i];
+
+		// The pillars are infinite, the march only sees them inside the room.
+		RaymarchProxy proxy;
+		proxy.minimum = max(float3(centre.x - half, -BoxSize, centre.z - half), -BoxSize);
+		proxy.maximum = min(float3(centre.x + half, BoxSize, centre.z + half), float3(BoxSize));
+		proxies.push_back(proxy);
+	}
+	return proxies;
+}
+
+void RaymarchProxies::BuildMesh(const std::vector<RaymarchProxy>& proxies, std::vector<float3>& vertices,
+	std::vector<uint16_t>& indices)
+{
+	vertices.clear();
+	indices.clear();
+	for (const RaymarchProxy& proxy : proxies)
+	{
+		uint16_t base = static_cast<uint16_t>(vertices.size());
+		for (uint32_t i = 0; i < VerticesPerProxy; i++)
+			vertices.push_back(Corner(proxy, i));
+		for (uint16_t index : BoxIndices)
+			indices.push_back(base + index);
+	}
+}
+
+float4 RaymarchProxies::ProjectToCanvas(const RaymarchCamera& camera, const float3& Position)
+{
+	// The canvas ray of a pixel meets the canvas plane z = nearPlane at zoom * canvasXY, so a point
+	// is seen at eye + (Position - eye) / w there, with w its distance from the eye in units of the
+	// eye's distance to the canvas.
+	float3 d = Position - camera.eye;
+	float w = d.z / (camera.nearPlane - camera.eye.z);
+	return float4(
+		(camera.eye.x * w + d.x) / (camera.zoom * camera.width),
+		(camera.eye.y * w + d.y) / (camera.zoom * camera.height),
+		0.5f * w,
+		w);
+}
+
+bool RaymarchProxies::MarchRange(FusedRaymarch::Field field, const float3& origin, const float3& direction,
+	float timeIn, float timeOut, float& t, uint32_t& steps)
+{
+	steps = 0;
+	float start, final;
+	if (!FusedRaymarch::IntersectBox(origin, direction, start, final))
+		return false;
+
+	float step = (final - start) / float(Intervals);
+	int first = ConeMarch::FirstInterval(start, final, timeIn);
+	float time = start + first * step;
+	float3 Position = origin + time * direction;
+
+	float right, left = field(Position);
+	steps++;
+
+	for (int i = first; i < Intervals; i++)
+	{
+		if (time > timeOut)
+			return false;
+
+		time = start + (i + 1) * step;
+		Position = origin + time * direction;
+		right = field(Position);
+		steps++;
+		if (left * right < 0.0f)
+		{
+			t = time + right * step / (left - right);
+			return true;
+		}
+		left = right;
+	}
+
+	return false;
+}
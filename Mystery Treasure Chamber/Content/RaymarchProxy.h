@@ -0,0 +1,51 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "FusedRaymarch.h"
+#include "TemporalReprojection.h"
+
+namespace Mystery_Treasure_Chamber
+{
+	// An axis aligned box around one SDF object, clipped to the room.
+	struct RaymarchProxy
+	{
+		Sdf::float3	minimum;
+		Sdf::float3	maximum;
+	};
+
+	// CPU reference of the proxy pillar pass. Instead of marching every pixel of the screen, each
+	// pillar's box is rasterized through the canvas camera and only the pixels it covers march, from
+	// where the ray enters the box to where it leaves it. The back faces are drawn, so a box the eye
+	// is inside still covers its pixels, and the entry is the front face the ray crosses.
+	namespace RaymarchProxies
+	{
+		// Boxes in ProxyConstantBuffer.
+		const uint32_t MaxProxies = 16;
+
+		const uint32_t VerticesPerProxy = 8;
+		const uint32_t TrianglesPerProxy = 12;
+
+		// Added around each pillar in x and z. The march finds a hit between two samples, and the one
+		// before the hit must still be inside the box.
+		const float Margin = 0.05f;
+
+		// One box per pillar of SdfScene::Pillars, full room height.
+		std::vector<RaymarchProxy> PillarProxies();
+
+		// Corners and triangles of the boxes, proxy after proxy. Triangles are clockwise seen from
+		// outside the box, the front faces of Direct3D's default rasterizer state.
+		void BuildMesh(const std::vector<RaymarchProxy>& proxies, std::vector<Sdf::float3>& vertices,
+			std::vector<uint16_t>& indices);
+
+		// Clip space position the proxy vertex shader gives Position, so that the rasterized pixel's
+		// canvas ray goes through it. w is the distance along the view axis in units of nearPlane.
+		Sdf::float4 ProjectToCanvas(const RaymarchCamera& camera, const Sdf::float3& Position);
+
+		// Same as RayMarchingInsideCube in PillarPixelShader.hlsl for a proxy: the fixed steps of the
+		// room's march, evaluating the field only from the interval holding timeIn to timeOut.
+		bool MarchRange(FusedRaymarch::Field field, const Sdf::float3& origin, const Sdf::float3& direction,
+			float timeIn, float timeOut, float& t, uint32_t& steps);
+	}
+}
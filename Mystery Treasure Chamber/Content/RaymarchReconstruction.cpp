@@ -0,0 +1,202 @@
+﻿#include "RaymarchReconstruction.h"
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	// Relative hit distance difference at which two samples stop counting as the same surface.
+	const float DepthTolerance = 0.05f;
+
+	// Sharpness of the normal test.
+	const float NormalPower = 8.0f;
+
+	float4 Average(const RaymarchSample& a, const RaymarchSample& b)
+	{
+		return (a.color + b.color) * 0.5f;
+	}
+
+	int Mirror(int i, int size)
+	{
+		// Stepping off the edge picks the pixel on the other side, which has the same checkerboard parity.
+		if (i < 0)
+			return 1;
+		if (i >= size)
+			return size - 2;
+		return i;
+	}
+
+	float4 ReconstructCheckerboard(const std::vector<RaymarchSample>& marched, int width, int height, int x, int y, const std::vector<float4>* background)
+	{
+		const RaymarchSample& left = marched[y * width + Mirror(x - 1, width)];
+		const RaymarchSample& right = marched[y * width + Mirror(x + 1, width)];
+		const RaymarchSample& up = marched[Mirror(y - 1, height) * width + x];
+		const RaymarchSample& down = marched[Mirror(y + 1, height) * width + x];
+
+		// Interpolate along the direction that does not cross an edge.
+		float horizontal = RaymarchReconstruction::Discontinuity(left, right);
+		float vertical = RaymarchReconstruction::Discontinuity(up, down);
+
+		const RaymarchSample* a = &left;
+		const RaymarchSample* b = &right;
+		if (vertical < horizontal)
+		{
+			a = &up;
+			b = &down;
+		}
+
+		if (a->depth < 0.0f && b->depth < 0.0f && background)
+		{
+			return (*background)[y * width + x];
+		}
+
+		if (std::fabs(horizontal - vertical) < DepthTolerance)
+		{
+			return (Average(left, right) + Average(up, down)) * 0.5f;
+		}
+
+		return Average(*a, *b);
+	}
+
+	float4 UpsampleHalf(const std::vector<RaymarchSample>& marched, int marchedWidth, int marchedHeight, int x, int y, int width, const std::vector<float4>* background)
+	{
+		// Position of the pixel centre in the half resolution image.
+		float qx = (x + 0.5f) * 0.5f - 0.5f;
+		float qy = (y + 0.5f) * 0.5f - 0.5f;
+		float fx0 = std::floor(qx);
+		float fy0 = std::floor(qy);
+		float fx = qx - fx0;
+		float fy = qy - fy0;
+
+		int x0 = std::max(static_cast<int>(fx0), 0);
+		int y0 = std::max(static_cast<int>(fy0), 0);
+		int x1 = std::min(static_cast<int>(fx0) + 1, marchedWidth - 1);
+		int y1 = std::min(static_cast<int>(fy0) + 1, marchedHeight - 1);
+
+		const RaymarchSample* taps[4] = {
+			&marched[y0 * marchedWidth + x0],
+			&marched[y0 * marchedWidth + x1],
+			&marched[y1 * marchedWidth + x0],
+			&marched[y1 * marchedWidth + x1],
+		};
+		float weights[4] = {
+			(1.0f - fx) * (1.0f - fy),
+			fx * (1.0f - fy),
+			(1.0f - fx) * fy,
+			fx * fy,
+		};
+
+		// The nearest tap decides which surface the pixel belongs to, the others only contribute if they agree.
+		int nearest = 0;
+		for (int i = 1; i < 4; i++)
+		{
+			if (weights[i] > weights[nearest])
+				nearest = i;
+		}
+
+		const RaymarchSample& reference = *taps[nearest];
+		if (reference.depth < 0.0f && background)
+		{
+			return (*background)[y * width + x];
+		}
+
+		float4 color;
+		float total = 0.0f;
+		for (int i = 0; i < 4; i++)
+		{
+			float w = weights[i] * RaymarchReconstruction::Similarity(*taps[i], reference);
+			color += taps[i]->color * w;
+			total += w;
+		}
+
+		return total > 1e-4f ? color * (1.0f / total) : reference.color;
+	}
+}
+
+bool RaymarchReconstruction::IsMarched(RaymarchResolution resolution, uint32_t x, uint32_t y)
+{
+	switch (resolution)
+	{
+	case RaymarchResolution::Checkerboard:
+		return ((x + y) & 1) == 0;
+	case RaymarchResolution::Half:
+		return (x & 1) == 0 && (y & 1) == 0;
+	default:
+		return true;
+	}
+}
+
+void RaymarchReconstruction::MarchedSize(RaymarchResolution resolution, uint32_t width, uint32_t height, uint32_t& marchedWidth, uint32_t& marchedHeight)
+{
+	if (resolution == RaymarchResolution::Half)
+	{
+		marchedWidth = (width + 1) / 2;
+		marchedHeight = (height + 1) / 2;
+	}
+	else
+	{
+		marchedWidth = width;
+		marchedHeight = height;
+	}
+}
+
+float RaymarchReconstruction::Discontinuity(const RaymarchSample& a, const RaymarchSample& b)
+{
+	bool missA = a.depth < 0.0f;
+	bool missB = b.depth < 0.0f;
+
+	if (missA && missB)
+		return 0.0f;
+	if (missA != missB)
+		return 1000.0f;
+
+	float depth = std::fabs(a.depth - b.depth) / std::max(std::min(a.depth, b.depth), 1e-4f);
+	return depth + (1.0f - dot(a.normal, b.normal));
+}
+
+float RaymarchReconstruction::Similarity(const RaymarchSample& sample, const RaymarchSample& reference)
+{
+	bool missSample = sample.depth < 0.0f;
+	bool missReference = reference.depth < 0.0f;
+
+	if (missSample || missReference)
+		return missSample == missReference ? 1.0f : 0.0f;
+
+	float depth = std::fabs(sample.depth - reference.depth) / std::max(reference.depth, 1e-4f);
+	float normal = std::pow(saturate(dot(sample.normal, reference.normal)), NormalPower);
+	return std::exp(-depth / DepthTolerance) * normal;
+}
+
+void RaymarchReconstruction::Reconstruct(RaymarchResolution resolution,
+	const std::vector<RaymarchSample>& marched,
+	uint32_t width,
+	uint32_t height,
+	const std::vector<float4>* background,
+	std::vector<float4>& output)
+{
+	uint32_t marchedWidth, marchedHeight;
+	MarchedSize(resolution, width, height, marchedWidth, marchedHeight);
+
+	output.resize(width * height);
+
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			float4& pixel = output[y * width + x];
+
+			if (resolution == RaymarchResolution::Half)
+			{
+				pixel = UpsampleHalf(marched, marchedWidth, marchedHeight, x, y, width, background);
+			}
+			else if (IsMarched(resolution, x, y))
+			{
+				pixel = marched[y * width + x].color;
+			}
+			else
+			{
+				pixel = ReconstructCheckerboard(marched, width, height, x, y, background);
+			}
+		}
+	}
+}
@@ -0,0 +1,50 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "SdfMath.h"
+
+namespace Mystery_Treasure_Chamber
+{
+	// How many pixels the ray marching passes march. Values match the RAYMARCH_* defines in the shaders.
+	enum class RaymarchResolution : uint32_t
+	{
+		Full = 0,			// Every pixel.
+		Checkerboard = 1,	// Pixels where x + y is even, the others are reconstructed.
+		Half = 2,			// One pixel per 2x2 block, upsampled afterwards.
+	};
+
+	// What a ray marching pass knows about a pixel. A negative depth marks a ray that hit nothing.
+	struct RaymarchSample
+	{
+		Sdf::float4	color;
+		Sdf::float3	normal;
+		float		depth;
+	};
+
+	// CPU reference of ReconstructPixelShader.hlsl, used to check the shader against known images.
+	namespace RaymarchReconstruction
+	{
+		// Whether the pass marches pixel (x, y) of the full resolution image.
+		bool IsMarched(RaymarchResolution resolution, uint32_t x, uint32_t y);
+
+		// Size of the image the pass actually renders into for a given output size.
+		void MarchedSize(RaymarchResolution resolution, uint32_t width, uint32_t height, uint32_t& marchedWidth, uint32_t& marchedHeight);
+
+		// How different two samples are in hit distance and orientation. 0 means the same surface.
+		float Discontinuity(const RaymarchSample& a, const RaymarchSample& b);
+
+		// Weight of sample when it is blended with reference, from 0 (other surface) to 1.
+		float Similarity(const RaymarchSample& sample, const RaymarchSample& reference);
+
+		// Fills in the pixels that were not marched. marched holds marchedWidth * marchedHeight samples
+		// laid out as MarchedSize describes. background, if not null, is the full resolution image misses fall back to.
+		void Reconstruct(RaymarchResolution resolution,
+			const std::vector<RaymarchSample>& marched,
+			uint32_t width,
+			uint32_t height,
+			const std::vector<Sdf::float4>* background,
+			std::vector<Sdf::float4>& output);
+	}
+}
@@ -1,22 +1,30 @@
 //This is for the room raymarching or the first raymarching pass
 
 Texture2D txTexture : register(t0);
+Texture2D<float> txConeBound : register(t1);	//distance the scene is empty for along the rays of each tile
 SamplerState txSampler : register(s0);
 
-#define NUMLIGHTS 3
+#ifndef NUMLIGHTS	//set by the variant wrappers in the Permutations folder
+#define NUMLIGHTS 4096	//most lights of a cluster shaded per pixel, LightClusters::MaxLights so none is dropped
+#endif
 
 #define MIN_XYZ -5.0
 #define MAX_XYZ 5.0
 static const float3 BoxMinimum = (float3)MIN_XYZ;
 static const float3 BoxMaximum = (float3)MAX_XYZ;
-#define INTERVALS 200
+#ifndef INTERVALS	//set by the variant wrappers in the Permutations folder
+#define INTERVALS 200	//fixed steps of the march
+#endif
+#define TILE_SIZE 8	//pixels per side of the tiles of txConeBound
 
 static const float3 Zero = float3 (0.0, 0.0, 0.0);
 static const float3 Unit = float3 (1.0, 1.0, 1.0);
 static const float3 AxisX = float3 (1.0, 0.0, 0.0);
 static const float3 AxisY = float3 (0.0, 1.0, 0.0);
 static const float3 AxisZ = float3 (0.0, 0.0, 1.0);
-#define STEP 0.01
+//Finite difference step of the normals, about a pixel wide at the hit: SdfScene::PixelAngle of the default camera
+#define PIXEL_ANGLE 0.0015
+#define MIN_EPSILON 0.001
 
 cbuffer PixelShaderConstantBuffer : register(b0)
 {
@@ -29,6 +37,25 @@ float farPlane;
 float2 padding;
 };
 
+#define RAYMARCH_FULL 0
+#define RAYMARCH_CHECKERBOARD 1
+#define RAYMARCH_HALF 2
+
+cbuffer RaymarchConstantBuffer : register(b1)
+{
+	uint raymarchMode;
+	uint hasBackground;
+	uint coneBounded;	//txConeBound holds this frame's cone march prepass
+	uint proxyPass;
+	uint bakedLights;	//the first bakedLights lights are in txLightmap
+};
+
+struct PS_OUTPUT
+{
+	float4 color : SV_TARGET0;
+	float4 geometry : SV_TARGET1;	//normal and hit distance, negative distance on a miss
+};
+
 struct Ray
 {
 	float3 o;	//origin
@@ -44,11 +71,10 @@ struct VS_Canvas
 
 //------------------------------------------------------------------------------------------------------------------
 
-float sdBox(float3 p, float3 b)
-{
-	float3 d = abs(p) - b;
-	return min(max(d.x, max(d.y, d.z)), 0.0) + length(max(d, 0.0));
-}
+#include "../SdfScene.hlsli"
+#include "../LightClusters.hlsli"
+#include "../Lightmap.hlsli"
+#include "../AmbientOcclusion.hlsli"
 
 float sdPlane(float3 p, float4 n)
 {
@@ -56,11 +82,6 @@ float sdPlane(float3 p, float4 n)
 	return dot(p, n.xyz) + n.w;
 }
 
-float room(float3 Position)
-{
-	return  -sdBox(Position, float3(5, 5, 5));
-}
-
 //-------------------------------------------------------------------------------------------------------------------
 
 float Function(float3 Position)
@@ -82,18 +103,22 @@ bool IntersectBox(in Ray ray, in float3 minimum, in float3 maximum, out float ti
 	return timeOut > timeIn;
 }
 
-bool RayMarchingInsideCube(in Ray ray, in float start, in float final, out float val)
+bool RayMarchingInsideCube(in Ray ray, in float start, in float final, in float bound, out float val)
 {
 	val = 0.0;
 	float step = (final - start) / float(INTERVALS);
-	float time = start;
+
+	//Nothing is closer than bound, so the march starts at the interval holding it. Every sample is placed from start directly, so it lands on the same point whichever interval the march starts from.
+	int first = clamp((int)floor((bound - start) / step), 0, INTERVALS);
+	float time = start + first * step;
 	float3 Position = ray.o + time * ray.d;
+
 	float right, left = Function(Position);
 	
-	for (int i = 0; i < INTERVALS; i++)
+	for (int i = first; i < INTERVALS; i++)
 	{
-		time += step;
-		Position += step * ray.d;
+		time = start + (i + 1) * step;
+		Position = ray.o + time * ray.d;
 		right = Function(Position);
 		if (left * right < 0.0)
 		{
@@ -106,14 +131,9 @@ bool RayMarchingInsideCube(in Ray ray, in float start, in float final, out float
 	return false;
 }
 
-float3 CalcNormal(float3 Position) {
-	float A = Function(Position + AxisX * STEP)
-		- Function(Position - AxisX * STEP);
-	float B = Function(Position + AxisY * STEP)
-		- Function(Position - AxisY * STEP);
-	float C = Function(Position + AxisZ * STEP)
-		- Function(Position - AxisZ * STEP);
-	return normalize(float3 (A, B, C));
+//Analytic gradient of the room, t is the hit distance along the ray
+float3 CalcNormal(float3 Position, float t) {
+	return normalize(roomGradient(Position, max(MIN_EPSILON, t * PIXEL_ANGLE)));
 }
 
 float4 Phong(float3 n, float3 l, float3 v, float shininess, float4 diffuseColor, float4 specularColor)
@@ -133,12 +153,26 @@ float4 Shade(float3 Position, float3 normal, float3 viewDir, float3 color)
 	float4 output = (float4)0;
 	float3 lightDir;
 
-	for (int i = 0; i < NUMLIGHTS; i++)
+	//The scene lights come first in every cluster, the torches near Position after them
+	uint2 range = clusterRanges[ClusterIndex(Position)];
+	for (uint i = 0; i < min(range.y, NUMLIGHTS); i++)
 	{
-		lightDir = normalize(LightPos[i] - Position);
-		output += float4(color, 1.0) * Phong(normal, lightDir, viewDir, 40, diff, spec);
+		uint index = clusterLightIndices[range.x + i];
+		if (index < bakedLights)
+			continue;
+
+		ClusterLight light = clusterLights[index];
+		lightDir = normalize(light.position - Position);
+		output += float4(color * light.color, 1.0) * ClusterAttenuation(light, Position) * Phong(normal, lightDir, viewDir, 40, diff, spec);
 	}
 
+	//The baked lights carry their own occlusion
+	output *= SurfaceOcclusion(txSampler, Position, normal);
+
+	//The baked lights are diffuse only, their highlights depend on the view
+	if (bakedLights > 0)
+		output += float4(color * BakedLight(txSampler, Position), 1.0);
+
 	return saturate(LightColor * output);
 }
 
@@ -152,29 +186,35 @@ float2 CalcUV(float3 Position, float3 normal)
 
 }
 
-float4 RayMarching(Ray ray)
+float4 RayMarching(Ray ray, float bound, out float4 geometry)
 {
 	float4 result = (float4)0;
 	float start, final;
 	float t;
+	geometry = float4(0, 0, 0, -1);
 	if (IntersectBox(ray, BoxMinimum, BoxMaximum, start, final))
 	{
-		if (RayMarchingInsideCube(ray, start, final, t))
+		if (RayMarchingInsideCube(ray, start, final, bound, t))
 		{
 			float3 Position = ray.o + ray.d * t;
-			float3 normal = CalcNormal(Position);
+			float3 normal = CalcNormal(Position, t);
 
 			float3 color = txTexture.Sample(txSampler, CalcUV(Position, normal));
 
 			result = Shade(Position, normal, ray.d, color);
+			geometry = float4(normal, t);
 		}
 	}
 	return result;
 
 }
 
-float4 main(VS_Canvas input) : SV_TARGET
+PS_OUTPUT main(VS_Canvas input)
 {
+	//Only every other pixel is marched in checkerboard mode, the rest is reconstructed afterwards
+	if (raymarchMode == RAYMARCH_CHECKERBOARD && (((uint)input.Position.x + (uint)input.Position.y) & 1))
+		discard;
+
 	float zoom = 0.004;
 	float2 xy = zoom * input.canvasXY;
 	float distEye2Canvas = nearPlane;
@@ -184,5 +224,9 @@ float4 main(VS_Canvas input) : SV_TARGET
 	eyeRay.o = Eye.xyz;
 	eyeRay.d = normalize(PixelPos - Eye.xyz);	//view direction
 	
-	return RayMarching(eyeRay);
+	float bound = coneBounded ? txConeBound.Load(int3(input.Position.xy / TILE_SIZE, 0)) : 0.0;
+
+	PS_OUTPUT output;
+	output.color = RayMarching(eyeRay, bound, output.geometry);
+	return output;
 }
@@ -3,8 +3,12 @@
 
 #include "..\Common\DirectXHelper.h"
 #include "DDSTextureLoader.h"
+#include "ConeMarch.h"
+#include "Colonnade.h"
+#include "RaymarchProxy.h"
 //#include "..\Common\BasicShapes.h"
 
+#include <algorithm>
 #include <fstream>
 
 using namespace Mystery_Treasure_Chamber;
@@ -17,6 +21,22 @@ Sample3DSceneRenderer::Sample3DSceneRenderer(const std::shared_ptr<DX::DeviceRes
 	m_loadingComplete(false),
 	m_degreesPerSecond(45),
 	m_indexCount(0),
+	m_proxyIndexCount(0),
+	m_raymarchResolution(RaymarchResolution::Full),
+	m_temporalReprojection(false),
+	m_fusedRaymarch(false),
+	m_depthTestedRaymarch(false),
+	m_coneMarchPrepass(false),
+	m_colonnadePillarsPerSide(0),
+	m_raymarchProxies(false),
+	m_qualityTier(UINT_MAX),
+	m_torchCount(0),
+	m_deferredShading(false),
+	m_floor(deviceResources),
+	m_bakers(deviceResources),
+	m_clusterIndexCapacity(0),
+	m_shaderVariantGeneration(0),
+	m_frameIndex(0),
 	m_deviceResources(deviceResources)
 {
 	CreateDeviceDependentResources();
@@ -68,7 +88,59 @@ void Sample3DSceneRenderer::CreateWindowSizeDependentResources()
 	static const XMVECTORF32 at = { 0.0f, -0.1f, 0.0f, 0.0f };
 	static const XMVECTORF32 up = { 0.0f, 1.0f, 0.0f, 0.0f };
 
-	XMStoreFloat4x4(&m_constantBufferData.view, XMMatrixTranspose(XMMatrixLookAtRH(eye, at, up)));
+	XMMATRIX viewMatrix = XMMatrixLookAtRH(eye, at, up);
+	XMStoreFloat4x4(&m_constantBufferData.view, XMMatrixTranspose(viewMatrix));
+
+	// Lets the depth tested ray marching shoot its rays through the same camera as the rasterized geometry.
+	XMMATRIX viewProjection = viewMatrix * perspectiveMatrix * orientationMatrix;
+
+	// The floor's edges are measured in pixels of this camera, and its patches culled against it.
+	XMFLOAT4X4 viewProjectionRows;
+	XMStoreFloat4x4(&viewProjectionRows, viewProjection);
+	Sdf::float4x4 floorViewProjection;
+	memcpy(floorViewProjection.m, viewProjectionRows.m, sizeof(floorViewProjection.m));
+	m_floor.SetCamera(Sdf::float3(XMVectorGetX(eye), XMVectorGetY(eye), XMVectorGetZ(eye)), floorViewProjection, fovAngleY, outputSize.Height);
+	XMStoreFloat4x4(&m_depthConstantBufferData.viewProjection, XMMatrixTranspose(viewProjection));
+	XMStoreFloat4x4(&m_depthConstantBufferData.inverseViewProjection, XMMatrixTranspose(XMMatrixInverse(nullptr, viewProjection)));
+	m_depthConstantBufferData.depthTested = 0;
+	m_depthConstantBufferData.padding = XMFLOAT3();
+
+	CreateRenderTarget(DXGI_FORMAT_R32G32B32A32_FLOAT, m_renderTargetTexture, m_renderTargetView, m_shaderResourceView);
+
+	// Half resolution marching only uses the top left quarter of these.
+	CreateRenderTarget(DXGI_FORMAT_R32G32B32A32_FLOAT, m_sparseColorTexture, m_sparseColorTargetView, m_sparseColorResourceView);
+	CreateRenderTarget(DXGI_FORMAT_R16G16B16A16_FLOAT, m_sparseGeometryTexture, m_sparseGeometryTargetView, m_sparseGeometryResourceView);
+
+	// The pillars are marched straight into the back buffer, so their history has its format.
+	D3D11_RENDER_TARGET_VIEW_DESC1 backBufferDesc;
+	m_deviceResources->GetBackBufferRenderTargetView()->GetDesc1(&backBufferDesc);
+
+	CreateRaymarchHistory(m_roomHistory, DXGI_FORMAT_R32G32B32A32_FLOAT);
+	CreateRaymarchHistory(m_pillarHistory, backBufferDesc.Format);
+
+	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> pillarCacheTargetView;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> pillarCacheResourceView;
+	CreateRenderTarget(backBufferDesc.Format, m_pillarCacheTexture, pillarCacheTargetView, pillarCacheResourceView);
+
+	CreateDepthCopy();
+	CreateConeBounds();
+
+	// Made whether the deferred mode is on or not, see DeferredShading::Memory for what they cost.
+	CreateRenderTarget(DXGI_FORMAT_R8G8B8A8_UNORM, m_gbufferAlbedoTexture, m_gbufferAlbedoTargetView, m_gbufferAlbedoResourceView);
+	CreateRenderTarget(DXGI_FORMAT_R10G10B10A2_UNORM, m_gbufferNormalTexture, m_gbufferNormalTargetView, m_gbufferNormalResourceView);
+
+	// The cached results were in the old targets.
+	m_roomPassCache.Invalidate();
+	m_pillarPassCache.Invalidate();
+}
+
+// Creates a screen sized texture that can be rendered to and then sampled by a later pass.
+void Sample3DSceneRenderer::CreateRenderTarget(DXGI_FORMAT format,
+	Microsoft::WRL::ComPtr<ID3D11Texture2D>& texture,
+	Microsoft::WRL::ComPtr<ID3D11RenderTargetView>& renderTargetView,
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& shaderResourceView)
+{
+	Size outputSize = m_deviceResources->GetOutputSize();
 
 	D3D11_TEXTURE2D_DESC textureDesc;
 	D3D11_RENDER_TARGET_VIEW_DESC renderTargetViewDesc;
@@ -82,7 +154,7 @@ void Sample3DSceneRenderer::CreateWindowSizeDependentResources()
 	textureDesc.Height = outputSize.Height;
 	textureDesc.MipLevels = 1;
 	textureDesc.ArraySize = 1;
-	textureDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	textureDesc.Format = format;
 	textureDesc.SampleDesc.Count = 1;
 	textureDesc.Usage = D3D11_USAGE_DEFAULT;
 	textureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
@@ -91,7 +163,7 @@ void Sample3DSceneRenderer::CreateWindowSizeDependentResources()
 
 	// Create the render target texture.
 	DX::ThrowIfFailed(
-		m_deviceResources->GetD3DDevice()->CreateTexture2D(&textureDesc, NULL, &m_renderTargetTexture)
+		m_deviceResources->GetD3DDevice()->CreateTexture2D(&textureDesc, NULL, texture.ReleaseAndGetAddressOf())
 	);
 
 	// Setup the description of the render target view.
@@ -101,7 +173,7 @@ void Sample3DSceneRenderer::CreateWindowSizeDependentResources()
 
 	// Create the render target view.
 	DX::ThrowIfFailed(
-		m_deviceResources->GetD3DDevice()->CreateRenderTargetView(m_renderTargetTexture.Get(), &renderTargetViewDesc, m_renderTargetView.GetAddressOf())
+		m_deviceResources->GetD3DDevice()->CreateRenderTargetView(texture.Get(), &renderTargetViewDesc, renderTargetView.ReleaseAndGetAddressOf())
 	);
 
 	// Setup the description of the shader resource view.
@@ -112,15 +184,205 @@ void Sample3DSceneRenderer::CreateWindowSizeDependentResources()
 
 	// Create the shader resource view.
 	DX::ThrowIfFailed(
-		m_deviceResources->GetD3DDevice()->CreateShaderResourceView(m_renderTargetTexture.Get(), &shaderResourceViewDesc, &m_shaderResourceView)
+		m_deviceResources->GetD3DDevice()->CreateShaderResourceView(texture.Get(), &shaderResourceViewDesc, shaderResourceView.ReleaseAndGetAddressOf())
 	);
 }
 
+// Creates the texture the rasterized depth is copied into, so the ray marching can read it while the
+// depth buffer stays bound.
+void Sample3DSceneRenderer::CreateDepthCopy()
+{
+	Microsoft::WRL::ComPtr<ID3D11Resource> depthBuffer;
+	m_deviceResources->GetDepthStencilView()->GetResource(&depthBuffer);
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> depthTexture;
+	DX::ThrowIfFailed(depthBuffer.As(&depthTexture));
+
+	D3D11_TEXTURE2D_DESC textureDesc;
+	depthTexture->GetDesc(&textureDesc);
+
+	// Same typeless group as DXGI_FORMAT_D24_UNORM_S8_UINT, so CopyResource works.
+	textureDesc.Format = DXGI_FORMAT_R24G8_TYPELESS;
+	textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	DX::ThrowIfFailed(
+		m_deviceResources->GetD3DDevice()->CreateTexture2D(&textureDesc, NULL, m_rasterDepthTexture.ReleaseAndGetAddressOf())
+	);
+
+	CD3D11_SHADER_RESOURCE_VIEW_DESC shaderResourceViewDesc(D3D11_SRV_DIMENSION_TEXTURE2D, DXGI_FORMAT_R24_UNORM_X8_TYPELESS);
+	DX::ThrowIfFailed(
+		m_deviceResources->GetD3DDevice()->CreateShaderResourceView(m_rasterDepthTexture.Get(), &shaderResourceViewDesc, m_rasterDepthResourceView.ReleaseAndGetAddressOf())
+	);
+}
+
+// Creates the texture the cone march prepass writes one distance per tile of the screen into.
+void Sample3DSceneRenderer::CreateConeBounds()
+{
+	Size outputSize = m_deviceResources->GetOutputSize();
+
+	CD3D11_TEXTURE2D_DESC textureDesc(
+		DXGI_FORMAT_R32_FLOAT,
+		ConeMarch::TileCount(static_cast<uint32>(outputSize.Width)),
+		ConeMarch::TileCount(static_cast<uint32>(outputSize.Height)),
+		1,
+		1,
+		D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS
+	);
+
+	DX::ThrowIfFailed(
+		m_deviceResources->GetD3DDevice()->CreateTexture2D(&textureDesc, NULL, m_coneBoundTexture.ReleaseAndGetAddressOf())
+	);
+
+	DX::ThrowIfFailed(
+		m_deviceResources->GetD3DDevice()->CreateShaderResourceView(m_coneBoundTexture.Get(), nullptr, m_coneBoundResourceView.ReleaseAndGetAddressOf())
+	);
+
+	DX::ThrowIfFailed(
+		m_deviceResources->GetD3DDevice()->CreateUnorderedAccessView(m_coneBoundTexture.Get(), nullptr, m_coneBoundAccessView.ReleaseAndGetAddressOf())
+	);
+}
+
+// Creates what one ray marching pass keeps of its last frame. The colour is copied from the
+// pass's output, so it has the output's format.
+void Sample3DSceneRenderer::CreateRaymarchHistory(RaymarchHistory& history, DXGI_FORMAT colorFormat)
+{
+	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> colorTargetView;
+	CreateRenderTarget(colorFormat, history.colorTexture, colorTargetView, history.colorResourceView);
+
+	for (int i = 0; i < 2; i++)
+	{
+		CreateRenderTarget(DXGI_FORMAT_R16G16B16A16_FLOAT, history.geometryTexture[i], history.geometryTargetView[i], history.geometryResourceView[i]);
+	}
+
+	CD3D11_QUERY_DESC queryDesc(D3D11_QUERY_OCCLUSION);
+	DX::ThrowIfFailed(
+		m_deviceResources->GetD3DDevice()->CreateQuery(&queryDesc, history.remarchQuery.ReleaseAndGetAddressOf())
+	);
+
+	history.eye = XMFLOAT4();
+	history.nearPlane = 0.0f;
+	history.current = 0;
+	history.valid = false;
+	history.queryBegun = false;
+	history.queryPending = false;
+	history.remarchedPixels = 0;
+}
+
+void Sample3DSceneRenderer::ReleaseRaymarchHistory(RaymarchHistory& history)
+{
+	history.colorTexture.Reset();
+	history.colorResourceView.Reset();
+
+	for (int i = 0; i < 2; i++)
+	{
+		history.geometryTexture[i].Reset();
+		history.geometryTargetView[i].Reset();
+		history.geometryResourceView[i].Reset();
+	}
+
+	history.remarchQuery.Reset();
+	history.valid = false;
+	history.queryBegun = false;
+	history.queryPending = false;
+}
+
+// Copies into target whatever last frame's result still covers and leaves the stencil set on the
+// rest, so the ray marching draw that follows only runs there. Called before the pass binds its
+// own pixel shader and resources.
+void Sample3DSceneRenderer::ReprojectRaymarchHistory(RaymarchHistory& history, ID3D11RenderTargetView* target)
+{
+	auto context = m_deviceResources->GetD3DDeviceContext();
+
+	// Pick up an earlier count if the GPU has finished it, without waiting for it.
+	UINT64 samples;
+	if (history.queryPending &&
+		context->GetData(history.remarchQuery.Get(), &samples, sizeof(samples), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK)
+	{
+		history.remarchedPixels = samples;
+		history.queryPending = false;
+	}
+
+	ID3D11RenderTargetView *const historyTargets[2] = { target, history.geometryTargetView[history.current].Get() };
+	context->OMSetRenderTargets(2, historyTargets, m_deviceResources->GetDepthStencilView());
+	context->ClearDepthStencilView(m_deviceResources->GetDepthStencilView(), D3D11_CLEAR_STENCIL, 1.0f, 1);
+
+	if (history.valid)
+	{
+		m_temporalConstantBufferData.previousEye = history.eye;
+		m_temporalConstantBufferData.previousNearPlane = history.nearPlane;
+		m_temporalConstantBufferData.frameIndex = m_frameIndex;
+		m_temporalConstantBufferData.cameraChanged =
+			history.eye.x != m_psConstantBufferData.eye.x ||
+			history.eye.y != m_psConstantBufferData.eye.y ||
+			history.eye.z != m_psConstantBufferData.eye.z ||
+			history.nearPlane != m_psConstantBufferData.nearPlane;
+		context->UpdateSubresource1(m_temporalConstantBuffer.Get(), 0, NULL, &m_temporalConstantBufferData, 0, 0, 0);
+
+		context->PSSetConstantBuffers1(2, 1, m_temporalConstantBuffer.GetAddressOf(), nullptr, nullptr);
+
+		ID3D11ShaderResourceView *const resources[2] = { history.colorResourceView.Get(), history.geometryResourceView[1 - history.current].Get() };
+		context->PSSetShaderResources(0, 2, resources);
+
+		context->PSSetShader(
+			m_reprojectPixelShader.Get(),
+			nullptr,
+			0
+		);
+
+		// Accepted pixels clear their stencil, rejected ones discard and keep it.
+		context->OMSetDepthStencilState(m_historyAcceptState.Get(), 0);
+
+		context->DrawIndexed(
+			m_indexCount,
+			0,
+			0
+		);
+
+		ID3D11ShaderResourceView *const nullResources[2] = { nullptr, nullptr };
+		context->PSSetShaderResources(0, 2, nullResources);
+	}
+
+	context->OMSetDepthStencilState(m_historyMarchState.Get(), 1);
+
+	// Only one count is in flight at a time.
+	history.queryBegun = !history.queryPending;
+	if (history.queryBegun)
+	{
+		context->Begin(history.remarchQuery.Get());
+	}
+}
+
+// Keeps target, which the ray marching draw has just completed, as next frame's history.
+void Sample3DSceneRenderer::UpdateRaymarchHistory(RaymarchHistory& history, ID3D11RenderTargetView* target)
+{
+	auto context = m_deviceResources->GetD3DDeviceContext();
+
+	if (history.queryBegun)
+	{
+		context->End(history.remarchQuery.Get());
+		history.queryBegun = false;
+		history.queryPending = true;
+	}
+
+	context->OMSetDepthStencilState(nullptr, 0);
+
+	Microsoft::WRL::ComPtr<ID3D11Resource> output;
+	target->GetResource(&output);
+	context->CopyResource(history.colorTexture.Get(), output.Get());
+
+	history.eye = m_psConstantBufferData.eye;
+	history.nearPlane = m_psConstantBufferData.nearPlane;
+	history.current = 1 - history.current;
+	history.valid = true;
+}
+
 // Called once per frame, rotates the cube and calculates the model and view matrices.
 void Sample3DSceneRenderer::Update(DX::StepTimer const& timer)
 {
 	m_timeBufferData.time = timer.GetTotalSeconds();
 	m_timeBufferData.deltaTime = timer.GetElapsedSeconds();
+
+	m_frameIndex++;
 }
 
 // Rotate the 3D cube model a set amount of radians.
@@ -130,50 +392,184 @@ void Sample3DSceneRenderer::Rotate(float radians)
 	XMStoreFloat4x4(&m_constantBufferData.model, XMMatrixTranspose(XMMatrixRotationY(radians)));
 }
 
-// Renders one frame using the vertex and pixel shaders.
-void Sample3DSceneRenderer::Render()
+// Points the bound ray marching shader at the sparse targets. Called right before its draw.
+void Sample3DSceneRenderer::BeginSparseRaymarch(bool hasBackground)
 {
-	// Loading is asynchronous. Only draw geometry after it's loaded.
-	if (!m_loadingComplete)
+	auto context = m_deviceResources->GetD3DDeviceContext();
+
+	m_raymarchConstantBufferData.mode = static_cast<uint32>(m_raymarchResolution);
+	m_raymarchConstantBufferData.hasBackground = hasBackground;
+	context->UpdateSubresource1(m_raymarchConstantBuffer.Get(), 0, NULL, &m_raymarchConstantBufferData, 0, 0, 0);
+
+	// Colour goes to the first target, normal and hit distance to the second for the reconstruction.
+	ID3D11RenderTargetView *const sparseTargets[2] = { m_sparseColorTargetView.Get(), m_sparseGeometryTargetView.Get() };
+	context->OMSetRenderTargets(2, sparseTargets, nullptr);
+
+	if (m_raymarchResolution == RaymarchResolution::Half)
 	{
-		return;
+		uint32 width, height;
+		Size outputSize = m_deviceResources->GetOutputSize();
+		RaymarchReconstruction::MarchedSize(m_raymarchResolution, static_cast<uint32>(outputSize.Width), static_cast<uint32>(outputSize.Height), width, height);
+
+		CD3D11_VIEWPORT viewport(0.0f, 0.0f, static_cast<float>(width), static_cast<float>(height));
+		context->RSSetViewports(1, &viewport);
 	}
+}
 
+// Fills in the pixels the last ray marching draw skipped and writes the full image to target.
+// Misses show background when there is one.
+void Sample3DSceneRenderer::ResolveSparseRaymarch(ID3D11RenderTargetView* target, ID3D11ShaderResourceView* background)
+{
 	auto context = m_deviceResources->GetD3DDeviceContext();
 
-//First, draw the room using ray marching
-//----------------------------------------------------------------------------------------------------------------------------------------------
-	// Prepare the constant buffer to send it to the graphics device.
-	context->UpdateSubresource1(
-		m_constantBuffer.Get(),
-		0,
-		NULL,
-		&m_constantBufferData,
-		0,
-		0,
+	auto viewport = m_deviceResources->GetScreenViewport();
+	context->RSSetViewports(1, &viewport);
+
+	context->OMSetRenderTargets(1, &target, nullptr);
+
+	ID3D11ShaderResourceView *const resources[3] = { m_sparseColorResourceView.Get(), m_sparseGeometryResourceView.Get(), background };
+	context->PSSetShaderResources(0, 3, resources);
+
+	context->PSSetShader(
+		m_reconstructPixelShader.Get(),
+		nullptr,
 		0
 	);
 
-	context->UpdateSubresource1(
-		m_changesOnResizeConstantBuffer.Get(),
-		0,
-		NULL,
-		&m_changesOnResizeConstantBufferData,
+	context->DrawIndexed(
+		m_indexCount,
 		0,
+		0
+	);
+
+	// The sparse targets are written again by the next ray marching pass.
+	ID3D11ShaderResourceView *const nullResources[3] = { nullptr, nullptr, nullptr };
+	context->PSSetShaderResources(0, 3, nullResources);
+}
+
+// Draws the floor with the camera, the sampler and the floor pixel shader of the quality tier, and
+// binds the canvas cube's indices again.
+void Sample3DSceneRenderer::DrawFloor(bool gbuffer)
+{
+	FloorRenderer::SharedResources shared = { &m_constantBufferData, m_constantBuffer.Get(), m_samplerState.Get(), m_floorPixelShader.Get() };
+	m_floor.Draw(shared, gbuffer);
+
+	// The mesh and the parallax floor bind their own index buffers, and every pass after the floor
+	// draws the canvas cube.
+	m_deviceResources->GetD3DDeviceContext()->IASetIndexBuffer(
+		m_indexBuffer.Get(),
+		DXGI_FORMAT_R16_UINT,
+		0
+	);
+}
+
+// Draws both snakes into the bound render target, or the bound G-buffer.
+void Sample3DSceneRenderer::DrawSnakes(bool gbuffer)
+{
+	auto context = m_deviceResources->GetD3DDeviceContext();
+
+	UINT stride = sizeof(VertexPositionTextureNTB);
+	UINT offset = 0;
+	context->IASetVertexBuffers(
 		0,
+		1,
+		m_snakeVertexBuffer.GetAddressOf(),
+		&stride,
+		&offset
+	);
+
+	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	context->IASetInputLayout(m_modelInputLayout.Get());
+
+	// Attach our vertex shader.
+	context->VSSetShader(
+		m_modelVertexShader.Get(),
+		nullptr,
 		0
 	);
 
+	m_bakers.BindProbes(Sdf::float3(1.5f, -2.5f, 0.0f));
+
+	XMMATRIX model = XMMatrixScaling(3, 3, 3) * XMMatrixRotationX(-90)* XMMatrixTranslation(1.5f, -2.5f, 0.0f);
+
+	XMStoreFloat4x4(&m_constantBufferData.model, XMMatrixTranspose(model));
+
 	context->UpdateSubresource1(
-		m_timeBuffer.Get(),
+		m_constantBuffer.Get(),
 		0,
 		NULL,
-		&m_timeBufferData,
+		&m_constantBufferData,
 		0,
 		0,
 		0
 	);
 
+	context->PSSetShaderResources(0, 1, m_scalesTexture.GetAddressOf());
+
+	// Attach our pixel shader.
+	context->PSSetShader(
+		gbuffer ? m_modelGBufferPixelShader.Get() : m_modelPixelShader.Get(),
+		nullptr,
+		0
+	);
+
+	context->PSSetSamplers(0, 1, m_samplerState.GetAddressOf());
+
+	// Draw the objects.
+	context->Draw(m_vertexCount, 0);
+
+	m_bakers.BindProbes(Sdf::float3(-1.5f, -2.5f, 0.0f));
+
+	model = XMMatrixScaling(3, 3, 3) * XMMatrixRotationX(-90)* XMMatrixTranslation(-1.5f, -2.5f, 0.0f);
+
+	XMStoreFloat4x4(&m_constantBufferData.model, XMMatrixTranspose(model));
+
+	context->UpdateSubresource1(m_constantBuffer.Get(),	0, NULL, &m_constantBufferData,	0, 0, 0	);
+
+	// Draw the objects.
+	context->Draw(m_vertexCount, 0);
+}
+
+// Marches one cone per tile through the scene and writes how far its rays can skip. Uses the pixel
+// shader constant buffer and the screen size, which must be up to date.
+void Sample3DSceneRenderer::RunConeMarchPrepass()
+{
+	auto context = m_deviceResources->GetD3DDeviceContext();
+
+	// Still bound to the ray marching shaders from last frame, and a texture cannot be read and written at once.
+	ID3D11ShaderResourceView *const nullResources[1] = { nullptr };
+	context->PSSetShaderResources(1, 1, nullResources);
+	context->PSSetShaderResources(3, 1, nullResources);
+
+	context->CSSetShader(m_coneMarchComputeShader.Get(), nullptr, 0);
+
+	ID3D11Buffer *const constantBuffers[2] = { m_psConstantBuffer.Get(), m_changesOnResizeConstantBuffer.Get() };
+	context->CSSetConstantBuffers(0, 2, constantBuffers);
+	context->CSSetUnorderedAccessViews(0, 1, m_coneBoundAccessView.GetAddressOf(), nullptr);
+
+	// One thread per tile.
+	D3D11_TEXTURE2D_DESC textureDesc;
+	m_coneBoundTexture->GetDesc(&textureDesc);
+	context->Dispatch(
+		ConeMarch::TileCount(textureDesc.Width),
+		ConeMarch::TileCount(textureDesc.Height),
+		1
+	);
+
+	ID3D11UnorderedAccessView *const nullAccessViews[1] = { nullptr };
+	context->CSSetUnorderedAccessViews(0, 1, nullAccessViews, nullptr);
+	context->CSSetShader(nullptr, nullptr, 0);
+}
+
+// Draws the room and the pillars in one ray marching pass, over the floor that is already in the
+// bound render target. With depthTested the rays go through the raster camera and stop at the
+// rasterized depth, otherwise the canvas camera is used and the floor simply stays on top of the room.
+// With gbuffer the hits go into the bound G-buffer instead of being lit.
+void Sample3DSceneRenderer::DrawFusedRaymarch(bool depthTested, bool gbuffer)
+{
+	auto context = m_deviceResources->GetD3DDeviceContext();
+
 	// Each vertex is one instance of the VertexPositionColor struct.
 	UINT stride = sizeof(VertexPositionColor);
 	UINT offset = 0;
@@ -185,12 +581,6 @@ void Sample3DSceneRenderer::Render()
 		&offset
 	);
 
-	context->IASetIndexBuffer(
-		m_indexBuffer.Get(),
-		DXGI_FORMAT_R16_UINT, // Each index is one 16-bit unsigned integer (short).
-		0
-	);
-
 	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
 	context->IASetInputLayout(m_inputLayout.Get());
@@ -202,115 +592,287 @@ void Sample3DSceneRenderer::Render()
 		0
 	);
 
-	// Send the constant buffer to the graphics device.
-	context->VSSetConstantBuffers1(
-		0,
-		1,
-		m_constantBuffer.GetAddressOf(),
-		nullptr,
-		nullptr
-	);
+	m_depthConstantBufferData.depthTested = depthTested;
+	context->UpdateSubresource1(m_depthConstantBuffer.Get(), 0, NULL, &m_depthConstantBufferData, 0, 0, 0);
+	// The lighting reads bakedLights, the lightmap and the occlusion volume are bound for the frame.
+	context->PSSetConstantBuffers1(1, 1, m_raymarchConstantBuffer.GetAddressOf(), nullptr, nullptr);
+	context->PSSetConstantBuffers1(3, 1, m_depthConstantBuffer.GetAddressOf(), nullptr, nullptr);
 
-	context->VSSetConstantBuffers1(
-		1,
-		1,
-		m_changesOnResizeConstantBuffer.GetAddressOf(),
+	// The marcher reads the rasterized depth from a copy, the depth buffer itself stays bound for the test.
+	if (depthTested)
+	{
+		Microsoft::WRL::ComPtr<ID3D11Resource> depthBuffer;
+		m_deviceResources->GetDepthStencilView()->GetResource(&depthBuffer);
+		context->CopyResource(m_rasterDepthTexture.Get(), depthBuffer.Get());
+	}
+
+	ID3D11ShaderResourceView *const resources[3] = { m_wallTexture.Get(), m_wallHeightTexture.Get(), depthTested ? m_rasterDepthResourceView.Get() : nullptr };
+	context->PSSetShaderResources(0, 3, resources);
+	context->PSSetSamplers(0, 1, m_samplerState.GetAddressOf());
+
+	// Attach our pixel shader.
+	context->PSSetShader(
+		gbuffer ? m_fusedGBufferPixelShader.Get() : m_fusedPixelShader.Get(),
 		nullptr,
-		nullptr
+		0
 	);
 
-	context->VSSetConstantBuffers1(
-		2,
-		1,
-		m_timeBuffer.GetAddressOf(),
-		nullptr,
-		nullptr
+	// Depth tested, the marcher writes the depth of its hits. Otherwise pillars write depth 0 and
+	// always pass, the room writes 1 and only passes where the floor is not. Either way nothing is
+	// nearer than the canvas quad at depth 0, which the shader declares with SV_DepthGreaterEqual so
+	// the hardware keeps its early and hierarchical depth tests.
+	context->OMSetDepthStencilState(depthTested ? m_raymarchDepthState.Get() : m_fusedDepthState.Get(), 0);
+
+	// Draw the objects.
+	context->DrawIndexed(
+		m_indexCount,
+		0,
+		0
 	);
 
-	// Attach our pixel shader.
+	context->OMSetDepthStencilState(nullptr, 0);
+
+	ID3D11ShaderResourceView *const nullResources[1] = { nullptr };
+	context->PSSetShaderResources(2, 1, nullResources);
+}
+
+// Draws the floor, the snakes and the depth tested ray marching into the G-buffer, then lights every
+// pixel it holds once into the back buffer.
+void Sample3DSceneRenderer::DrawDeferred()
+{
+	auto context = m_deviceResources->GetD3DDeviceContext();
+
+	// Material 0 is nothing, where the lighting pass leaves the back buffer alone.
+	const float clear[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	context->ClearRenderTargetView(m_gbufferAlbedoTargetView.Get(), clear);
+	context->ClearRenderTargetView(m_gbufferNormalTargetView.Get(), clear);
+
+	ID3D11RenderTargetView *const gbufferTargets[2] = { m_gbufferAlbedoTargetView.Get(), m_gbufferNormalTargetView.Get() };
+	context->OMSetRenderTargets(2, gbufferTargets, m_deviceResources->GetDepthStencilView());
+
+	DrawFloor(true);
+	DrawSnakes(true);
+	DrawFusedRaymarch(true, true);
+
+	// Copied again, now with the depth of the ray marched surfaces, to rebuild positions from.
+	Microsoft::WRL::ComPtr<ID3D11Resource> depthBuffer;
+	m_deviceResources->GetDepthStencilView()->GetResource(&depthBuffer);
+	context->CopyResource(m_rasterDepthTexture.Get(), depthBuffer.Get());
+
+	// No depth buffer, so the canvas quad covers every pixel.
+	ID3D11RenderTargetView *const targets[1] = { m_deviceResources->GetBackBufferRenderTargetView() };
+	context->OMSetRenderTargets(1, targets, nullptr);
+
+	// The canvas quad and vertex shader are still bound from the ray marching.
+	ID3D11ShaderResourceView *const resources[3] = { m_gbufferAlbedoResourceView.Get(), m_gbufferNormalResourceView.Get(), m_rasterDepthResourceView.Get() };
+	context->PSSetShaderResources(0, 3, resources);
+	context->PSSetSamplers(0, 1, m_samplerState.GetAddressOf());
+	context->PSSetConstantBuffers1(1, 1, m_raymarchConstantBuffer.GetAddressOf(), nullptr, nullptr);
+	context->PSSetConstantBuffers1(3, 1, m_depthConstantBuffer.GetAddressOf(), nullptr, nullptr);
+
 	context->PSSetShader(
-		m_roomPixelShader.Get(),
+		m_deferredPixelShader.Get(),
 		nullptr,
 		0
 	);
 
-	context->UpdateSubresource1(
-		m_psConstantBuffer.Get(),
-		0,
-		NULL,
-		&m_psConstantBufferData,
-		0,
+	context->DrawIndexed(
+		m_indexCount,
 		0,
 		0
 	);
 
-	context->PSSetConstantBuffers1(
+	// The G-buffer is a render target again next frame.
+	ID3D11ShaderResourceView *const nullResources[3] = { nullptr, nullptr, nullptr };
+	context->PSSetShaderResources(0, 3, nullResources);
+
+	context->OMSetRenderTargets(1, targets, m_deviceResources->GetDepthStencilView());
+}
+
+DeferredShading::MemoryUsage Sample3DSceneRenderer::GetGBufferMemory() const
+{
+	Size outputSize = m_deviceResources->GetOutputSize();
+	return DeferredShading::Memory(static_cast<uint32_t>(outputSize.Width), static_cast<uint32_t>(outputSize.Height));
+}
+
+// Draws the colonnade hall and its pillars into the bound render target in one ray marching pass,
+// through the canvas camera.
+void Sample3DSceneRenderer::DrawColonnade()
+{
+	auto context = m_deviceResources->GetD3DDeviceContext();
+
+	ColonnadeLayout layout = Colonnade::MakeLayout(m_colonnadePillarsPerSide);
+	m_colonnadeConstantBufferData.pillarsPerSide = layout.pillarsPerSide;
+	m_colonnadeConstantBufferData.spacing = layout.spacing;
+	m_colonnadeConstantBufferData.radius = layout.radius;
+	m_colonnadeConstantBufferData.jitter = layout.jitter;
+	m_colonnadeConstantBufferData.hallSize = XMFLOAT4(layout.hallSize.x, layout.hallSize.y, layout.hallSize.z, 0.0f);
+	context->UpdateSubresource1(m_colonnadeConstantBuffer.Get(), 0, NULL, &m_colonnadeConstantBufferData, 0, 0, 0);
+	context->PSSetConstantBuffers1(4, 1, m_colonnadeConstantBuffer.GetAddressOf(), nullptr, nullptr);
+
+	// Each vertex is one instance of the VertexPositionColor struct.
+	UINT stride = sizeof(VertexPositionColor);
+	UINT offset = 0;
+	context->IASetVertexBuffers(
 		0,
 		1,
-		m_psConstantBuffer.GetAddressOf(),
+		m_cubeVertexBuffer.GetAddressOf(),
+		&stride,
+		&offset
+	);
+
+	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	context->IASetInputLayout(m_inputLayout.Get());
+
+	// Attach our vertex shader.
+	context->VSSetShader(
+		m_canvasVertexShader.Get(),
 		nullptr,
-		nullptr
+		0
 	);
 
-	context->PSSetShaderResources(0, 1, m_wallTexture.GetAddressOf());
+	ID3D11ShaderResourceView *const resources[2] = { m_wallTexture.Get(), m_wallHeightTexture.Get() };
+	context->PSSetShaderResources(0, 2, resources);
 	context->PSSetSamplers(0, 1, m_samplerState.GetAddressOf());
 
-	context->OMSetRenderTargets(1, m_renderTargetView.GetAddressOf(), m_deviceResources->GetDepthStencilView());
+	// Attach our pixel shader.
+	context->PSSetShader(
+		m_colonnadePixelShader.Get(),
+		nullptr,
+		0
+	);
+
 	// Draw the objects.
 	context->DrawIndexed(
 		m_indexCount,
 		0,
 		0
 	);
+}
 
-//Second, draw the tessellated floor after the room walls.
-//----------------------------------------------------------------------------------------------------------------------------------------------
-	//Clear depth buffer
-	context->ClearDepthStencilView(m_deviceResources->GetDepthStencilView(), D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+// Draws the pillars over the room with the pillar pixel shader already bound. The canvas quad only
+// copies the room, then the back faces of the proxy boxes march the pixels they cover, so a box
+// the eye is inside still draws. Overlapping boxes both march and the depth of the hits decides.
+void Sample3DSceneRenderer::DrawRaymarchProxies()
+{
+	auto context = m_deviceResources->GetD3DDeviceContext();
 
-	stride = sizeof(VertexPositionTextureNTB);
-	offset = 0;
+	m_raymarchConstantBufferData.proxyPass = static_cast<uint32>(ProxyPass::Background);
+	context->UpdateSubresource1(m_raymarchConstantBuffer.Get(), 0, NULL, &m_raymarchConstantBufferData, 0, 0, 0);
+
+	context->DrawIndexed(
+		m_indexCount,
+		0,
+		0
+	);
 
+	// The models clear it again before they are drawn.
+	context->ClearDepthStencilView(m_deviceResources->GetDepthStencilView(), D3D11_CLEAR_DEPTH, 1.0f, 0);
+
+	m_raymarchConstantBufferData.proxyPass = static_cast<uint32>(ProxyPass::March);
+	context->UpdateSubresource1(m_raymarchConstantBuffer.Get(), 0, NULL, &m_raymarchConstantBufferData, 0, 0, 0);
+	context->PSSetConstantBuffers1(2, 1, m_proxyConstantBuffer.GetAddressOf(), nullptr, nullptr);
+	context->VSSetConstantBuffers1(3, 1, m_psConstantBuffer.GetAddressOf(), nullptr, nullptr);
+
+	UINT stride = sizeof(VertexPositionColor);
+	UINT offset = 0;
 	context->IASetVertexBuffers(
 		0,
 		1,
-		m_quadVertexBuffer.GetAddressOf(),
+		m_proxyVertexBuffer.GetAddressOf(),
 		&stride,
 		&offset
 	);
 
-	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST);
-
-	context->IASetInputLayout(m_modelInputLayout.Get());
+	context->IASetIndexBuffer(
+		m_proxyIndexBuffer.Get(),
+		DXGI_FORMAT_R16_UINT,
+		0
+	);
 
-	// Attach our vertex shader.
 	context->VSSetShader(
-		m_groundVertexShader.Get(),
+		m_proxyVertexShader.Get(),
 		nullptr,
 		0
 	);
 
-	context->HSSetShader(
-		m_hullShader.Get(),
-		nullptr,
+	context->RSSetState(m_cullFrontState.Get());
+	context->OMSetDepthStencilState(nullptr, 0);
+
+	context->DrawIndexed(
+		m_proxyIndexCount,
+		0,
 		0
 	);
 
-	XMMATRIX model = XMMatrixIdentity() * XMMatrixScaling(5, 5, 5) * XMMatrixTranslation(0.0f, -2.5f, 0.0f);
+	context->RSSetState(nullptr);
 
-	XMStoreFloat4x4(&m_constantBufferData.model, XMMatrixTranspose(model));
+	context->IASetIndexBuffer(
+		m_indexBuffer.Get(),
+		DXGI_FORMAT_R16_UINT,
+		0
+	);
+
+	m_raymarchConstantBufferData.proxyPass = static_cast<uint32>(ProxyPass::None);
+	context->UpdateSubresource1(m_raymarchConstantBuffer.Get(), 0, NULL, &m_raymarchConstantBufferData, 0, 0, 0);
+}
+
+// Renders one frame using the vertex and pixel shaders.
+void Sample3DSceneRenderer::Render()
+{
+	// Loading is asynchronous. Only draw geometry after it's loaded.
+	if (!m_loadingComplete)
+	{
+		return;
+	}
+
+	ApplyPendingShaderVariants();
+	m_floor.UpdateCosts();
+
+	auto context = m_deviceResources->GetD3DDeviceContext();
 
+//First, draw the room using ray marching
+//----------------------------------------------------------------------------------------------------------------------------------------------
+	// Prepare the constant buffer to send it to the graphics device.
 	context->UpdateSubresource1(
 		m_constantBuffer.Get(),
 		0,
 		NULL,
-		&m_constantBufferData,
+		&m_constantBufferData,
+		0,
+		0,
+		0
+	);
+
+	context->UpdateSubresource1(
+		m_changesOnResizeConstantBuffer.Get(),
+		0,
+		NULL,
+		&m_changesOnResizeConstantBufferData,
+		0,
+		0,
+		0
+	);
+
+	context->UpdateSubresource1(
+		m_timeBuffer.Get(),
+		0,
+		NULL,
+		&m_timeBufferData,
 		0,
 		0,
 		0
 	);
 
-	context->DSSetConstantBuffers1(
+	context->IASetIndexBuffer(
+		m_indexBuffer.Get(),
+		DXGI_FORMAT_R16_UINT, // Each index is one 16-bit unsigned integer (short).
+		0
+	);
+
+	// Send the constant buffer to the graphics device.
+	context->VSSetConstantBuffers1(
 		0,
 		1,
 		m_constantBuffer.GetAddressOf(),
@@ -318,158 +880,330 @@ void Sample3DSceneRenderer::Render()
 		nullptr
 	);
 
-	context->DSSetConstantBuffers1(
-		0,
+	context->VSSetConstantBuffers1(
 		1,
-		m_constantBuffer.GetAddressOf(),
+		1,
+		m_changesOnResizeConstantBuffer.GetAddressOf(),
 		nullptr,
 		nullptr
 	);
 
-	context->DSSetShaderResources(0, 1, m_floorDisplacementTexture.GetAddressOf());
-	context->DSSetSamplers(0, 1, m_samplerState.GetAddressOf());
-
-	context->DSSetShader(
-		m_domainShader.Get(),
+	context->VSSetConstantBuffers1(
+		2,
+		1,
+		m_timeBuffer.GetAddressOf(),
 		nullptr,
+		nullptr
+	);
+
+	context->UpdateSubresource1(
+		m_psConstantBuffer.Get(),
+		0,
+		NULL,
+		&m_psConstantBufferData,
+		0,
+		0,
 		0
 	);
 
-	// Attach our pixel shader.
-	context->PSSetShader(
-		m_floorPixelShader.Get(),
+	context->PSSetConstantBuffers1(
+		0,
+		1,
+		m_psConstantBuffer.GetAddressOf(),
 		nullptr,
-		0
+		nullptr
 	);
 
-	context->PSSetShaderResources(0, 1, m_floorTexture.GetAddressOf());
-	context->PSSetShaderResources(1, 1, m_floorNormalTexture.GetAddressOf());
-	context->PSSetSamplers(0, 1, m_samplerState.GetAddressOf());
+	UpdateLightClusters();
+
+	ID3D11ShaderResourceView* lightmap = m_bakers.GetLightmap();
+	uint32 bakedLights = m_bakers.GetBakedLighting() && lightmap ? 3 : 0;
+	context->PSSetShaderResources(4, 1, &lightmap);
+
+	bool occlusion = m_bakers.BindOcclusionVolume();
+
+	bool sparseRaymarch = m_raymarchResolution != RaymarchResolution::Full;
+	bool colonnade = m_colonnadePillarsPerSide > 0 && !sparseRaymarch;
+	bool deferredShading = m_deferredShading && !sparseRaymarch && !colonnade;
+	bool depthRaymarch = (m_depthTestedRaymarch || deferredShading) && !sparseRaymarch && !colonnade;
+	bool fusedRaymarch = (m_fusedRaymarch || depthRaymarch) && !sparseRaymarch && !colonnade;
+	bool temporalRaymarch = m_temporalReprojection && !sparseRaymarch && !fusedRaymarch && !colonnade;
+	bool proxyRaymarch = m_raymarchProxies && !sparseRaymarch && !fusedRaymarch && !colonnade && !temporalRaymarch;
+
+	// The room, floor and pillars only change when something they read does. If their inputs hash
+	// the same as last time, the targets still hold the result and the passes are skipped.
+	D3D11_VIEWPORT viewport = m_deviceResources->GetScreenViewport();
+
+	RoomPassInputs roomInputs;
+	roomInputs.constants = {
+		PassBytes::Of(m_psConstantBufferData),
+		PassBytes::Of(m_changesOnResizeConstantBufferData),
+		PassBytes::Of(m_constantBufferData.view),
+		PassBytes::Of(m_constantBufferData.projection),
+	};
+	roomInputs.modes = {
+		PassBytes::Of(m_raymarchResolution),
+		PassBytes::Of(m_temporalReprojection),
+		PassBytes::Of(m_fusedRaymarch),
+		PassBytes::Of(m_depthTestedRaymarch),
+		PassBytes::Of(m_deferredShading),
+		PassBytes::Of(m_coneMarchPrepass),
+		PassBytes::Of(m_colonnadePillarsPerSide),
+		PassBytes::Of(m_raymarchProxies),
+		PassBytes::Of(m_shaderVariantGeneration),
+	};
+	roomInputs.lights = m_clusterLights.data();
+	roomInputs.lightCount = m_clusterLights.size();
+	roomInputs.viewport = { viewport.TopLeftX, viewport.TopLeftY, viewport.Width, viewport.Height, viewport.MinDepth, viewport.MaxDepth };
+	roomInputs.bakedLights = bakedLights;
+	roomInputs.occlusion = occlusion;
+	roomInputs.resources = {
+		m_renderTargetView.Get(),
+		m_wallTexture.Get(),
+	};
+	m_floor.AddPassInputs(roomInputs);
+
+	PassHash roomHash;
+	roomHash.AddRoomPass(roomInputs);
+
+	// The pillars show the room where they miss, so they depend on everything it does.
+	PassHash pillarHash;
+	pillarHash.Add(roomHash.GetValue());
+	pillarHash.Add(m_wallHeightTexture.Get());
+	pillarHash.Add(m_pillarCacheTexture.Get());
+
+	// The models are part of the back buffer in depth tested mode, which the cache does not cover.
+	bool roomCached = !depthRaymarch && m_roomPassCache.Reuse(roomHash.GetValue());
+	bool pillarCached = !depthRaymarch && m_pillarPassCache.Reuse(pillarHash.GetValue());
+
+	// The separate passes start their rays where the cones found the scene begins.
+	bool coneBounded = m_coneMarchPrepass && !sparseRaymarch && !fusedRaymarch && !colonnade && (!roomCached || !pillarCached);
+	if (coneBounded)
+	{
+		RunConeMarchPrepass();
+	}
 
-	//context->RSSetState(m_cullFrontState.Get());
+	m_raymarchConstantBufferData.coneBounded = coneBounded;
+	m_raymarchConstantBufferData.bakedLights = bakedLights;
+	context->UpdateSubresource1(m_raymarchConstantBuffer.Get(), 0, NULL, &m_raymarchConstantBufferData, 0, 0, 0);
 
-	//Draw the quad
-	context->Draw(4, 0);
+	// Each vertex is one instance of the VertexPositionColor struct.
+	UINT stride = sizeof(VertexPositionColor);
+	UINT offset = 0;
+	// The fused and colonnade passes do the work of the room and the floor themselves.
+	if (!roomCached && !fusedRaymarch && !colonnade)
+	{
+		context->IASetVertexBuffers(
+			0,
+			1,
+			m_cubeVertexBuffer.GetAddressOf(),
+			&stride,
+			&offset
+		);
 
-	context->RSSetState(nullptr);
+		context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-	context->HSSetShader(nullptr,
-		nullptr, 0);
+		context->IASetInputLayout(m_inputLayout.Get());
 
-	context->DSSetShader(nullptr,
-		nullptr,
-		0);
+		// Attach our vertex shader.
+		context->VSSetShader(
+			m_canvasVertexShader.Get(),
+			nullptr,
+			0
+		);
 
-	// Reset render targets to the screen.
-	ID3D11RenderTargetView *const targets[1] = { m_deviceResources->GetBackBufferRenderTargetView() };
-	context->OMSetRenderTargets(1, targets, m_deviceResources->GetDepthStencilView());
+		// Also binds the targets, with the stencil limiting the draw to the pixels that need marching.
+		if (temporalRaymarch)
+		{
+			ReprojectRaymarchHistory(m_roomHistory, m_renderTargetView.Get());
+		}
 
-//Third, draw the pillars on top of the floor using ray marching
-//----------------------------------------------------------------------------------------------------------------------------------------------
+		// Attach our pixel shader.
+		context->PSSetShader(
+			m_roomPixelShader.Get(),
+			nullptr,
+			0
+		);
 
-	// Each vertex is one instance of the VertexPositionColor struct.
-	stride = sizeof(VertexPositionColor);
-	offset = 0;
-	context->IASetVertexBuffers(
-		0,
-		1,
-		m_cubeVertexBuffer.GetAddressOf(),
-		&stride,
-		&offset
-	);
+		context->PSSetShaderResources(0, 1, m_wallTexture.GetAddressOf());
+		context->PSSetShaderResources(1, 1, m_coneBoundResourceView.GetAddressOf());
+		context->PSSetSamplers(0, 1, m_samplerState.GetAddressOf());
 
-	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		if (sparseRaymarch)
+		{
+			BeginSparseRaymarch(false);
+		}
+		else
+		{
+			m_raymarchConstantBufferData.mode = static_cast<uint32>(RaymarchResolution::Full);
+			context->UpdateSubresource1(m_raymarchConstantBuffer.Get(), 0, NULL, &m_raymarchConstantBufferData, 0, 0, 0);
 
-	context->IASetInputLayout(m_inputLayout.Get());
+			if (!temporalRaymarch)
+			{
+				context->OMSetRenderTargets(1, m_renderTargetView.GetAddressOf(), m_deviceResources->GetDepthStencilView());
+			}
+		}
 
-	// Attach our vertex shader.
-	context->VSSetShader(
-		m_canvasVertexShader.Get(),
-		nullptr,
-		0
-	);
+		context->PSSetConstantBuffers1(
+			1,
+			1,
+			m_raymarchConstantBuffer.GetAddressOf(),
+			nullptr,
+			nullptr
+		);
 
-	context->PSSetShaderResources(0, 1, m_shaderResourceView.GetAddressOf());
-	context->PSSetShaderResources(1, 1, m_wallTexture.GetAddressOf());
-	context->PSSetShaderResources(2, 1, m_wallHeightTexture.GetAddressOf());
-	context->PSSetSamplers(0, 1, m_samplerState.GetAddressOf());
+		// Draw the objects.
+		context->DrawIndexed(
+			m_indexCount,
+			0,
+			0
+		);
 
-	// Attach our pixel shader.
-	context->PSSetShader(
-		m_pillarPixelShader.Get(),
-		nullptr,
-		0
-	);
+		if (sparseRaymarch)
+		{
+			ResolveSparseRaymarch(m_renderTargetView.Get(), nullptr);
+			context->OMSetRenderTargets(1, m_renderTargetView.GetAddressOf(), m_deviceResources->GetDepthStencilView());
+		}
 
-	// Draw the objects.
-	context->DrawIndexed(
-		m_indexCount,
-		0,
-		0
-	);
+		// Copied before the floor is drawn over it.
+		if (temporalRaymarch)
+		{
+			UpdateRaymarchHistory(m_roomHistory, m_renderTargetView.Get());
+			context->OMSetRenderTargets(1, m_renderTargetView.GetAddressOf(), m_deviceResources->GetDepthStencilView());
+		}
 
-//Draw explicit models from vertex buffers
+//Second, draw the tessellated floor after the room walls.
 //----------------------------------------------------------------------------------------------------------------------------------------------
+		DrawFloor(false);
+	}
 
-	context->ClearDepthStencilView(m_deviceResources->GetDepthStencilView(), D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+	// Reset render targets to the screen.
+	ID3D11RenderTargetView *const targets[1] = { m_deviceResources->GetBackBufferRenderTargetView() };
+	context->OMSetRenderTargets(1, targets, m_deviceResources->GetDepthStencilView());
 
-	stride = sizeof(VertexPositionTextureNTB);
-	offset = 0;
-	context->IASetVertexBuffers(
-		0,
-		1,
-		m_snakeVertexBuffer.GetAddressOf(),
-		&stride,
-		&offset
-	);
+//Third, draw the pillars on top of the floor using ray marching
+//----------------------------------------------------------------------------------------------------------------------------------------------
 
-	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	Microsoft::WRL::ComPtr<ID3D11Resource> backBuffer;
+	m_deviceResources->GetBackBufferRenderTargetView()->GetResource(&backBuffer);
 
-	context->IASetInputLayout(m_modelInputLayout.Get());
+	// The back buffer is flipped away every frame, so a cached result is copied back in.
+	if (pillarCached)
+	{
+		context->CopyResource(backBuffer.Get(), m_pillarCacheTexture.Get());
+	}
+	else if (colonnade)
+	{
+		DrawColonnade();
+	}
+	else if (deferredShading)
+	{
+		DrawDeferred();
+	}
+	else if (fusedRaymarch)
+	{
+		// Opaque rasterized geometry first, so the ray marching can stop where it is hidden.
+		DrawFloor(false);
 
-	// Attach our vertex shader.
-	context->VSSetShader(
-		m_modelVertexShader.Get(),
-		nullptr,
-		0
-	);
+		if (depthRaymarch)
+		{
+			DrawSnakes(false);
+		}
 
-	model = XMMatrixScaling(3, 3, 3) * XMMatrixRotationX(-90)* XMMatrixTranslation(1.5f, -2.5f, 0.0f);
+		DrawFusedRaymarch(depthRaymarch, false);
+	}
+	else
+	{
+		// Each vertex is one instance of the VertexPositionColor struct.
+		stride = sizeof(VertexPositionColor);
+		offset = 0;
+		context->IASetVertexBuffers(
+			0,
+			1,
+			m_cubeVertexBuffer.GetAddressOf(),
+			&stride,
+			&offset
+		);
 
-	XMStoreFloat4x4(&m_constantBufferData.model, XMMatrixTranspose(model));
+		context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-	context->UpdateSubresource1(
-		m_constantBuffer.Get(),
-		0,
-		NULL,
-		&m_constantBufferData,
-		0,
-		0,
-		0
-	);
+		context->IASetInputLayout(m_inputLayout.Get());
 
-	context->PSSetShaderResources(0, 1, m_scalesTexture.GetAddressOf());
+		// Attach our vertex shader.
+		context->VSSetShader(
+			m_canvasVertexShader.Get(),
+			nullptr,
+			0
+		);
 
-	// Attach our pixel shader.
-	context->PSSetShader(
-		m_modelPixelShader.Get(),
-		nullptr,
-		0
-	);
+		if (temporalRaymarch)
+		{
+			ReprojectRaymarchHistory(m_pillarHistory, m_deviceResources->GetBackBufferRenderTargetView());
+		}
 
-	context->PSSetSamplers(0, 1, m_samplerState.GetAddressOf());
+		context->PSSetShaderResources(0, 1, m_shaderResourceView.GetAddressOf());
+		context->PSSetShaderResources(1, 1, m_wallTexture.GetAddressOf());
+		context->PSSetShaderResources(2, 1, m_wallHeightTexture.GetAddressOf());
+		context->PSSetShaderResources(3, 1, m_coneBoundResourceView.GetAddressOf());
+		context->PSSetSamplers(0, 1, m_samplerState.GetAddressOf());
+
+		// Attach our pixel shader.
+		context->PSSetShader(
+			m_pillarPixelShader.Get(),
+			nullptr,
+			0
+		);
 
-	// Draw the objects.
-	context->Draw(m_vertexCount, 0);
+		// Bound again in case the room pass was skipped.
+		context->PSSetConstantBuffers1(1, 1, m_raymarchConstantBuffer.GetAddressOf(), nullptr, nullptr);
 
-	model = XMMatrixScaling(3, 3, 3) * XMMatrixRotationX(-90)* XMMatrixTranslation(-1.5f, -2.5f, 0.0f);
+		if (sparseRaymarch)
+		{
+			BeginSparseRaymarch(true);
+		}
 
-	XMStoreFloat4x4(&m_constantBufferData.model, XMMatrixTranspose(model));
+		if (proxyRaymarch)
+		{
+			DrawRaymarchProxies();
+		}
+		else
+		{
+			// Draw the objects.
+			context->DrawIndexed(
+				m_indexCount,
+				0,
+				0
+			);
+		}
 
-	context->UpdateSubresource1(m_constantBuffer.Get(),	0, NULL, &m_constantBufferData,	0, 0, 0	);
+		if (sparseRaymarch)
+		{
+			ResolveSparseRaymarch(m_deviceResources->GetBackBufferRenderTargetView(), m_shaderResourceView.Get());
+			context->OMSetRenderTargets(1, targets, m_deviceResources->GetDepthStencilView());
+		}
 
-	// Draw the objects.
-	context->Draw(m_vertexCount, 0);
+		if (temporalRaymarch)
+		{
+			UpdateRaymarchHistory(m_pillarHistory, m_deviceResources->GetBackBufferRenderTargetView());
+			context->OMSetRenderTargets(1, targets, m_deviceResources->GetDepthStencilView());
+		}
+	}
+
+	if (!pillarCached && !depthRaymarch)
+	{
+		context->CopyResource(m_pillarCacheTexture.Get(), backBuffer.Get());
+	}
+
+//Draw explicit models from vertex buffers
+//----------------------------------------------------------------------------------------------------------------------------------------------
+
+	// In depth tested mode the models were drawn before the ray marching.
+	if (!depthRaymarch)
+	{
+		context->ClearDepthStencilView(m_deviceResources->GetDepthStencilView(), D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+
+		DrawSnakes(false);
+	}
 
 	//Draw the particles using geometry shader
 	//----------------------------------------------------------------------------------------------------------------------------------------------
@@ -527,7 +1261,7 @@ void Sample3DSceneRenderer::Render()
 		0
 	);
 
-	model = XMMatrixIdentity() * XMMatrixScaling(3, 3, 3);
+	XMMATRIX model = XMMatrixIdentity() * XMMatrixScaling(3, 3, 3);
 
 	XMStoreFloat4x4(&m_constantBufferData.model, XMMatrixTranspose(model));
 
@@ -583,34 +1317,262 @@ void Sample3DSceneRenderer::Render()
 		0
 	);
 
-	//Enable blending
-	context->OMSetBlendState(m_additiveBlend.Get(), nullptr, 0xFFFFFF);
+	//Enable blending
+	context->OMSetBlendState(m_additiveBlend.Get(), nullptr, 0xFFFFFF);
+
+	//Disable depth buffer writes
+	//context->OMSetDepthStencilState(m_noWriteDepthState.Get(), 1);
+
+	//context->RSSetState(m_DisableCullState.Get());
+
+	// Draw the objects.
+	context->DrawAuto();
+
+	//disable blending
+	context->OMSetBlendState(nullptr, nullptr, 0xFFFFFF);
+
+	//Reset depth stencil state
+	//context->OMSetDepthStencilState(nullptr, 0);
+
+	//context->RSSetState(nullptr);
+	//Unset geometry shaders
+	context->GSSetShader(
+		nullptr,
+		nullptr,
+		0
+	);
+}
+
+void Sample3DSceneRenderer::SetQualityTier(uint32 tier)
+{
+	m_qualityTier = tier;
+
+	// Otherwise the variants are loaded with everything else.
+	if (m_loadingComplete)
+	{
+		LoadShaderVariants();
+	}
+}
+
+// Switches each permuted pixel shader to the variant the quality tier selects. The plain shaders
+// created with the device resources are the variants of the highest tier and start the cache.
+// Variants that are not cached yet load on a worker thread and are switched to by Render.
+void Sample3DSceneRenderer::LoadShaderVariants()
+{
+	static const std::pair<const char*, PixelShaderMember> permuted[] =
+	{
+		{ "RoomPixelShader", &Sample3DSceneRenderer::m_roomPixelShader },
+		{ "PillarPixelShader", &Sample3DSceneRenderer::m_pillarPixelShader },
+		{ "FusedPixelShader", &Sample3DSceneRenderer::m_fusedPixelShader },
+		{ "FloorPixelShader", &Sample3DSceneRenderer::m_floorPixelShader },
+		{ "ModelPixelShader", &Sample3DSceneRenderer::m_modelPixelShader },
+		{ "ColonnadePixelShader", &Sample3DSceneRenderer::m_colonnadePixelShader },
+	};
+
+	for (const auto& entry : permuted)
+	{
+		std::string name = entry.first;
+		std::wstring plain = std::wstring(name.begin(), name.end()) + L".cso";
+		if (m_pixelShaderVariants.find(plain) == m_pixelShaderVariants.end())
+		{
+			m_pixelShaderVariants[plain] = this->*entry.second;
+		}
+
+		const ShaderVariant* variant = m_shaderPermutations.Select(name, m_qualityTier);
+		if (!variant)
+		{
+			continue;
+		}
+
+		auto cached = m_pixelShaderVariants.find(variant->file);
+		if (cached != m_pixelShaderVariants.end())
+		{
+			if (this->*entry.second != cached->second)
+			{
+				this->*entry.second = cached->second;
+				m_shaderVariantGeneration++;
+			}
+			continue;
+		}
+
+		uint32 tier = m_qualityTier;
+		std::wstring file = variant->file;
+		PixelShaderMember member = entry.second;
+		Microsoft::WRL::ComPtr<ID3D11Device> device = m_deviceResources->GetD3DDevice();
+		DX::ReadDataAsync(file).then([this, device, tier, file, member](const std::vector<byte>& fileData) {
+			PendingShaderVariant pending = { device, file, tier, member };
+			DX::ThrowIfFailed(
+				device->CreatePixelShader(
+					&fileData[0],
+					fileData.size(),
+					nullptr,
+					&pending.shader
+				)
+			);
+
+			std::lock_guard<std::mutex> lock(m_pendingShaderVariantsMutex);
+			m_pendingShaderVariants.push_back(pending);
+		});
+	}
+}
+
+// Takes the variants that finished loading into the cache, and switches to those the current
+// quality tier still wants. Runs on the render thread, so the shaders never change mid-frame.
+void Sample3DSceneRenderer::ApplyPendingShaderVariants()
+{
+	std::vector<PendingShaderVariant> loaded;
+	{
+		std::lock_guard<std::mutex> lock(m_pendingShaderVariantsMutex);
+		loaded.swap(m_pendingShaderVariants);
+	}
+
+	for (const PendingShaderVariant& pending : loaded)
+	{
+		// Loaded for a device that has been lost since.
+		if (pending.device.Get() != m_deviceResources->GetD3DDevice())
+		{
+			continue;
+		}
+
+		m_pixelShaderVariants[pending.file] = pending.shader;
+
+		// Another tier may have been chosen while this one loaded.
+		if (m_qualityTier == pending.tier && this->*pending.member != pending.shader)
+		{
+			this->*pending.member = pending.shader;
+			m_shaderVariantGeneration++;
+		}
+	}
+}
+
+void Sample3DSceneRenderer::SetTorchLights(uint32 count)
+{
+	m_torchCount = std::min<uint32>(count, LightClusters::MaxLights - 3);
+}
+
+// Creates a structured buffer the CPU rewrites every frame, and its view.
+void Sample3DSceneRenderer::CreateClusterBuffer(UINT stride, UINT count,
+	Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer,
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& shaderResourceView)
+{
+	CD3D11_BUFFER_DESC bufferDesc(stride * count, D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_DYNAMIC,
+		D3D11_CPU_ACCESS_WRITE, D3D11_RESOURCE_MISC_BUFFER_STRUCTURED, stride);
+	DX::ThrowIfFailed(
+		m_deviceResources->GetD3DDevice()->CreateBuffer(&bufferDesc, nullptr, buffer.ReleaseAndGetAddressOf())
+	);
+
+	CD3D11_SHADER_RESOURCE_VIEW_DESC shaderResourceViewDesc(buffer.Get(), DXGI_FORMAT_UNKNOWN, 0, count);
+	DX::ThrowIfFailed(
+		m_deviceResources->GetD3DDevice()->CreateShaderResourceView(buffer.Get(), &shaderResourceViewDesc, shaderResourceView.ReleaseAndGetAddressOf())
+	);
+}
 
-	//Disable depth buffer writes
-	//context->OMSetDepthStencilState(m_noWriteDepthState.Get(), 1);
+// Sorts the scene lights and the torches into the clusters of the canvas camera and binds the
+// lists for the pixel shaders that include LightClusters.hlsli.
+void Sample3DSceneRenderer::UpdateLightClusters()
+{
+	auto context = m_deviceResources->GetD3DDeviceContext();
 
-	//context->RSSetState(m_DisableCullState.Get());
+	// The scene lights reach the whole room, so they are first in every cluster it is seen in and
+	// the tiers that shade fewer lights keep them.
+	m_clusterLights.clear();
+	for (const XMFLOAT4& position : m_psConstantBufferData.lightPos)
+	{
+		m_clusterLights.push_back(LightClusters::SceneLight(Sdf::float3(position.x, position.y, position.z), Sdf::float3(1.0f, 1.0f, 1.0f)));
+	}
+	std::vector<ClusterLight> torches = LightClusters::WallTorches(m_torchCount);
+	m_clusterLights.insert(m_clusterLights.end(), torches.begin(), torches.end());
+
+	RaymarchCamera camera = {
+		Sdf::float3(m_psConstantBufferData.eye.x, m_psConstantBufferData.eye.y, m_psConstantBufferData.eye.z),
+		m_psConstantBufferData.nearPlane,
+		0.004f,
+		m_changesOnResizeConstantBufferData.width,
+		m_changesOnResizeConstantBufferData.height
+	};
+	ClusterFrustum frustum = LightClusters::MakeFrustum(camera);
+	LightClusters::Build(frustum, m_clusterLights, m_clusterRanges, m_clusterIndices);
+
+	if (!m_clusterConstantBuffer)
+	{
+		CD3D11_BUFFER_DESC clusterBufferDesc(sizeof(ClusterConstantBuffer), D3D11_BIND_CONSTANT_BUFFER);
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateBuffer(&clusterBufferDesc, nullptr, &m_clusterConstantBuffer)
+		);
+		CreateClusterBuffer(sizeof(ClusterLight), LightClusters::MaxLights, m_clusterLightBuffer, m_clusterLightResourceView);
+		CreateClusterBuffer(sizeof(ClusterRange), LightClusters::ClusterCount, m_clusterRangeBuffer, m_clusterRangeResourceView);
+		m_clusterIndexCapacity = 0;
+	}
 
-	// Draw the objects.
-	context->DrawAuto();
+	if (m_clusterIndices.size() > m_clusterIndexCapacity)
+	{
+		m_clusterIndexCapacity = std::max<uint32>(static_cast<uint32>(m_clusterIndices.size()), 2 * m_clusterIndexCapacity);
+		CreateClusterBuffer(sizeof(uint32_t), m_clusterIndexCapacity, m_clusterIndexBuffer, m_clusterIndexResourceView);
+	}
 
-	//disable blending
-	context->OMSetBlendState(nullptr, nullptr, 0xFFFFFF);
+	const std::pair<ID3D11Buffer*, std::pair<const void*, size_t>> uploads[] =
+	{
+		{ m_clusterLightBuffer.Get(), { m_clusterLights.data(), m_clusterLights.size() * sizeof(ClusterLight) } },
+		{ m_clusterRangeBuffer.Get(), { m_clusterRanges.data(), m_clusterRanges.size() * sizeof(ClusterRange) } },
+		{ m_clusterIndexBuffer.Get(), { m_clusterIndices.data(), m_clusterIndices.size() * sizeof(uint32_t) } },
+	};
+	for (const auto& upload : uploads)
+	{
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		DX::ThrowIfFailed(context->Map(upload.first, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped));
+		memcpy(mapped.pData, upload.second.first, upload.second.second);
+		context->Unmap(upload.first, 0);
+	}
 
-	//Reset depth stencil state
-	//context->OMSetDepthStencilState(nullptr, 0);
+	m_clusterConstantBufferData.eye = XMFLOAT4(frustum.eye.x, frustum.eye.y, frustum.eye.z, frustum.nearPlane);
+	m_clusterConstantBufferData.canvas = XMFLOAT4(frustum.canvasWidth, frustum.canvasHeight,
+		(LightClusters::Slices - 2) / std::log(LightClusters::FarDepth / LightClusters::NearDepth), LightClusters::NearDepth);
+	m_clusterConstantBufferData.tilesX = LightClusters::TilesX;
+	m_clusterConstantBufferData.tilesY = LightClusters::TilesY;
+	m_clusterConstantBufferData.slices = LightClusters::Slices;
+	m_clusterConstantBufferData.axis = frustum.axis;
+	context->UpdateSubresource1(m_clusterConstantBuffer.Get(), 0, NULL, &m_clusterConstantBufferData, 0, 0, 0);
+	context->PSSetConstantBuffers1(5, 1, m_clusterConstantBuffer.GetAddressOf(), nullptr, nullptr);
+
+	ID3D11ShaderResourceView* resources[] = { m_clusterLightResourceView.Get(), m_clusterRangeResourceView.Get(), m_clusterIndexResourceView.Get() };
+	context->PSSetShaderResources(8, 3, resources);
+}
 
-	//context->RSSetState(nullptr);
-	//Unset geometry shaders
-	context->GSSetShader(
-		nullptr,
-		nullptr,
-		0
-	);
+void Sample3DSceneRenderer::SetBakedLighting(bool enabled)
+{
+	m_bakers.SetBakedLighting(enabled, StaticLights());
+}
+
+void Sample3DSceneRenderer::SetProbeLighting(bool enabled)
+{
+	m_bakers.SetProbeLighting(enabled, StaticLights());
+}
+
+// The three scene lights, which the lightmap and the probes bake.
+std::vector<LightmapLight> Sample3DSceneRenderer::StaticLights() const
+{
+	std::vector<LightmapLight> lights;
+	for (const XMFLOAT4& position : m_psConstantBufferData.lightPos)
+	{
+		LightmapLight light;
+		light.position = Sdf::float3(position.x, position.y, position.z);
+		light.color = Sdf::float3(m_psConstantBufferData.lightColor.x, m_psConstantBufferData.lightColor.y, m_psConstantBufferData.lightColor.z);
+		lights.push_back(light);
+	}
+	return lights;
 }
 
 void Sample3DSceneRenderer::CreateDeviceDependentResources()
 {
+	// Tiers go from the lowest quality up, and the plain shaders loaded below are the highest, which
+	// is also where an unset or unknown tier ends up.
+	std::ifstream permutations("Assets/Shaders/Permutations.txt");
+	m_shaderPermutations.Load(permutations);
+	if (m_qualityTier >= m_shaderPermutations.GetTierCount())
+	{
+		m_qualityTier = m_shaderPermutations.GetTierCount() > 0 ? m_shaderPermutations.GetTierCount() - 1 : 0;
+	}
+
 	// Load shaders asynchronously.
 	auto loadVSTask = DX::ReadDataAsync(L"SampleVertexShader.cso");
 	auto loadPSTask = DX::ReadDataAsync(L"RoomPixelShader.cso");
@@ -622,10 +1584,19 @@ void Sample3DSceneRenderer::CreateDeviceDependentResources()
 	auto loadParticleVS = DX::ReadDataAsync(L"ParticleVertexShader.cso");
 	auto loadParticlePS = DX::ReadDataAsync(L"ParticlePixelShader.cso");
 	auto loadGSTask = DX::ReadDataAsync(L"GeometryShader.cso");
-	auto loadGroundVS = DX::ReadDataAsync(L"VertexShader.cso");
-	auto loadHSTask = DX::ReadDataAsync(L"HullShader.cso");
-	auto loadDSTask = DX::ReadDataAsync(L"DomainShader.cso");
 	auto loadGSSOTask = DX::ReadDataAsync(L"GeometryShaderSO.cso");
+	auto loadReconstructPS = DX::ReadDataAsync(L"ReconstructPixelShader.cso");
+	auto loadReprojectPS = DX::ReadDataAsync(L"ReprojectPixelShader.cso");
+	auto loadFusedPS = DX::ReadDataAsync(L"FusedPixelShader.cso");
+	auto loadConeMarchCS = DX::ReadDataAsync(L"ConeMarchComputeShader.cso");
+	auto loadColonnadePS = DX::ReadDataAsync(L"ColonnadePixelShader.cso");
+	auto loadProxyVS = DX::ReadDataAsync(L"ProxyVertexShader.cso");
+	auto loadModelGBufferPS = DX::ReadDataAsync(L"ModelPixelShader_GBuffer.cso");
+	auto loadFusedGBufferPS = DX::ReadDataAsync(L"FusedPixelShader_GBuffer.cso");
+	auto loadDeferredPS = DX::ReadDataAsync(L"DeferredPixelShader.cso");
+
+	// The floor loads the rest of its shaders and its textures itself.
+	auto createFloorTask = m_floor.CreateDeviceDependentResources();
 
 	// After the vertex shader file is loaded, create the shader and input layout.
 	auto createVSTask = loadVSTask.then([this](const std::vector<byte>& fileData) {
@@ -717,6 +1688,245 @@ void Sample3DSceneRenderer::CreateDeviceDependentResources()
 				&m_timeBuffer
 			)
 		);
+
+		CD3D11_BUFFER_DESC raymarchBufferDesc(sizeof(RaymarchConstantBuffer), D3D11_BIND_CONSTANT_BUFFER);
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateBuffer(
+				&raymarchBufferDesc,
+				nullptr,
+				&m_raymarchConstantBuffer
+			)
+		);
+
+		CD3D11_BUFFER_DESC temporalBufferDesc(sizeof(TemporalConstantBuffer), D3D11_BIND_CONSTANT_BUFFER);
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateBuffer(
+				&temporalBufferDesc,
+				nullptr,
+				&m_temporalConstantBuffer
+			)
+		);
+
+		//Reprojected pixels clear the stencil, the ray marching draw then only runs where it is still set
+		D3D11_DEPTH_STENCIL_DESC historyDesc = CD3D11_DEPTH_STENCIL_DESC(D3D11_DEFAULT);
+		historyDesc.DepthEnable = FALSE;
+		historyDesc.StencilEnable = TRUE;
+		historyDesc.FrontFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
+		historyDesc.FrontFace.StencilPassOp = D3D11_STENCIL_OP_REPLACE;
+		historyDesc.BackFace = historyDesc.FrontFace;
+
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateDepthStencilState(
+				&historyDesc,
+				&m_historyAcceptState
+			)
+		);
+
+		historyDesc.FrontFace.StencilFunc = D3D11_COMPARISON_EQUAL;
+		historyDesc.FrontFace.StencilPassOp = D3D11_STENCIL_OP_KEEP;
+		historyDesc.BackFace = historyDesc.FrontFace;
+
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateDepthStencilState(
+				&historyDesc,
+				&m_historyMarchState
+			)
+		);
+	});
+
+	auto createReconstructPSTask = loadReconstructPS.then([this](const std::vector<byte>& fileData) {
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreatePixelShader(
+				&fileData[0],
+				fileData.size(),
+				nullptr,
+				&m_reconstructPixelShader
+			)
+		);
+	});
+
+	auto createReprojectPSTask = loadReprojectPS.then([this](const std::vector<byte>& fileData) {
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreatePixelShader(
+				&fileData[0],
+				fileData.size(),
+				nullptr,
+				&m_reprojectPixelShader
+			)
+		);
+	});
+
+	auto createFusedPSTask = loadFusedPS.then([this](const std::vector<byte>& fileData) {
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreatePixelShader(
+				&fileData[0],
+				fileData.size(),
+				nullptr,
+				&m_fusedPixelShader
+			)
+		);
+
+		//The fused pass writes its own depth and is only tested against the floor
+		D3D11_DEPTH_STENCIL_DESC fusedDesc = CD3D11_DEPTH_STENCIL_DESC(D3D11_DEFAULT);
+		fusedDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+		fusedDesc.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
+
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateDepthStencilState(
+				&fusedDesc,
+				&m_fusedDepthState
+			)
+		);
+
+		//Depth tested, the ray marched surfaces also go into the depth buffer for the particles
+		fusedDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateDepthStencilState(
+				&fusedDesc,
+				&m_raymarchDepthState
+			)
+		);
+
+		CD3D11_BUFFER_DESC depthBufferDesc(sizeof(DepthConstantBuffer), D3D11_BIND_CONSTANT_BUFFER);
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateBuffer(
+				&depthBufferDesc,
+				nullptr,
+				&m_depthConstantBuffer
+			)
+		);
+	});
+
+	auto createConeMarchCSTask = loadConeMarchCS.then([this](const std::vector<byte>& fileData) {
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateComputeShader(
+				&fileData[0],
+				fileData.size(),
+				nullptr,
+				&m_coneMarchComputeShader
+			)
+		);
+	});
+
+	auto createColonnadePSTask = loadColonnadePS.then([this](const std::vector<byte>& fileData) {
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreatePixelShader(
+				&fileData[0],
+				fileData.size(),
+				nullptr,
+				&m_colonnadePixelShader
+			)
+		);
+
+		CD3D11_BUFFER_DESC colonnadeBufferDesc(sizeof(ColonnadeConstantBuffer), D3D11_BIND_CONSTANT_BUFFER);
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateBuffer(
+				&colonnadeBufferDesc,
+				nullptr,
+				&m_colonnadeConstantBuffer
+			)
+		);
+	});
+
+	auto createModelGBufferPSTask = loadModelGBufferPS.then([this](const std::vector<byte>& fileData) {
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreatePixelShader(
+				&fileData[0],
+				fileData.size(),
+				nullptr,
+				&m_modelGBufferPixelShader
+			)
+		);
+	});
+
+	auto createFusedGBufferPSTask = loadFusedGBufferPS.then([this](const std::vector<byte>& fileData) {
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreatePixelShader(
+				&fileData[0],
+				fileData.size(),
+				nullptr,
+				&m_fusedGBufferPixelShader
+			)
+		);
+	});
+
+	auto createDeferredPSTask = loadDeferredPS.then([this](const std::vector<byte>& fileData) {
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreatePixelShader(
+				&fileData[0],
+				fileData.size(),
+				nullptr,
+				&m_deferredPixelShader
+			)
+		);
+	});
+
+	auto createProxyVSTask = loadProxyVS.then([this](const std::vector<byte>& fileData) {
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateVertexShader(
+				&fileData[0],
+				fileData.size(),
+				nullptr,
+				&m_proxyVertexShader
+			)
+		);
+
+		std::vector<RaymarchProxy> proxies = RaymarchProxies::PillarProxies();
+		std::vector<Sdf::float3> corners;
+		std::vector<uint16_t> proxyIndices;
+		RaymarchProxies::BuildMesh(proxies, corners, proxyIndices);
+
+		// Drawn with the canvas input layout, the color is not read.
+		std::vector<VertexPositionColor> proxyVertices;
+		for (const Sdf::float3& corner : corners)
+		{
+			VertexPositionColor vertex = { XMFLOAT3(corner.x, corner.y, corner.z), XMFLOAT3(0.0f, 0.0f, 0.0f) };
+			proxyVertices.push_back(vertex);
+		}
+
+		D3D11_SUBRESOURCE_DATA vertexBufferData = { 0 };
+		vertexBufferData.pSysMem = proxyVertices.data();
+		CD3D11_BUFFER_DESC vertexBufferDesc(static_cast<UINT>(proxyVertices.size() * sizeof(VertexPositionColor)), D3D11_BIND_VERTEX_BUFFER);
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateBuffer(
+				&vertexBufferDesc,
+				&vertexBufferData,
+				&m_proxyVertexBuffer
+			)
+		);
+
+		m_proxyIndexCount = static_cast<uint32>(proxyIndices.size());
+
+		D3D11_SUBRESOURCE_DATA indexBufferData = { 0 };
+		indexBufferData.pSysMem = proxyIndices.data();
+		CD3D11_BUFFER_DESC indexBufferDesc(static_cast<UINT>(proxyIndices.size() * sizeof(uint16_t)), D3D11_BIND_INDEX_BUFFER);
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateBuffer(
+				&indexBufferDesc,
+				&indexBufferData,
+				&m_proxyIndexBuffer
+			)
+		);
+
+		// The boxes never change, so the pixel shader gets them once.
+		ProxyConstantBuffer proxyData = {};
+		for (size_t i = 0; i < proxies.size() && i < RaymarchProxies::MaxProxies; i++)
+		{
+			proxyData.minimum[i] = XMFLOAT4(proxies[i].minimum.x, proxies[i].minimum.y, proxies[i].minimum.z, 0.0f);
+			proxyData.maximum[i] = XMFLOAT4(proxies[i].maximum.x, proxies[i].maximum.y, proxies[i].maximum.z, 0.0f);
+		}
+
+		D3D11_SUBRESOURCE_DATA proxyBufferData = { 0 };
+		proxyBufferData.pSysMem = &proxyData;
+		CD3D11_BUFFER_DESC proxyBufferDesc(sizeof(ProxyConstantBuffer), D3D11_BIND_CONSTANT_BUFFER);
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateBuffer(
+				&proxyBufferDesc,
+				&proxyBufferData,
+				&m_proxyConstantBuffer
+			)
+		);
 	});
 
 	auto createPSTask2 = loadPSTask2.then([this](const std::vector<byte>& fileData) {
@@ -740,6 +1950,15 @@ void Sample3DSceneRenderer::CreateDeviceDependentResources()
 	m_psConstantBufferData.backgroundColor = XMFLOAT4(0.1f, 0.2f, 0.3f, 1.0f);
 	m_psConstantBufferData.padding = XMFLOAT2();
 
+	m_raymarchConstantBufferData.mode = static_cast<uint32>(RaymarchResolution::Full);
+	m_raymarchConstantBufferData.hasBackground = 0;
+	m_raymarchConstantBufferData.coneBounded = 0;
+	m_raymarchConstantBufferData.proxyPass = static_cast<uint32>(ProxyPass::None);
+	m_raymarchConstantBufferData.bakedLights = 0;
+	m_raymarchConstantBufferData.padding = XMFLOAT3();
+
+	ZeroMemory(&m_temporalConstantBufferData, sizeof(m_temporalConstantBufferData));
+
 	auto createModelVS = loadModelVS.then([this](const std::vector<byte>& fileData) {
 		DX::ThrowIfFailed(
 			m_deviceResources->GetD3DDevice()->CreateVertexShader(
@@ -926,55 +2145,10 @@ void Sample3DSceneRenderer::CreateDeviceDependentResources()
 		);
 	});
 
-	auto createGroundVSTask = loadGroundVS.then([this](const std::vector<byte>& fileData) {
-		DX::ThrowIfFailed(
-			m_deviceResources->GetD3DDevice()->CreateVertexShader(
-				&fileData[0],
-				fileData.size(),
-				nullptr,
-				&m_groundVertexShader
-			)
-		);
-	});
-
-	auto createHSTask = loadHSTask.then([this](const std::vector<byte>& fileData) {
-		DX::ThrowIfFailed(
-			m_deviceResources->GetD3DDevice()->CreateHullShader(
-				&fileData[0],
-				fileData.size(),
-				nullptr,
-				&m_hullShader
-			)
-		);
-	});
-
-	auto createDSTask = loadDSTask.then([this](const std::vector<byte>& fileData) {
-		DX::ThrowIfFailed(
-			m_deviceResources->GetD3DDevice()->CreateDomainShader(
-				&fileData[0],
-				fileData.size(),
-				nullptr,
-				&m_domainShader
-			)
-		);
-	});
-
 	auto createTextureTask = (createModelVS && createModelPS).then([this]() {
 		DX::ThrowIfFailed(
 			CreateDDSTextureFromFile(m_deviceResources->GetD3DDevice(), L"Assets\\Textures\\Scales2.DDS", nullptr, &m_scalesTexture)
 		);
-		DX::ThrowIfFailed(
-			CreateDDSTextureFromFile(m_deviceResources->GetD3DDevice(), L"Assets\\Textures\\Stone_Wall_002_COLOR.DDS", nullptr, &m_floorTexture)
-		);
-
-		DX::ThrowIfFailed(
-			CreateDDSTextureFromFile(m_deviceResources->GetD3DDevice(), L"Assets\\Textures\\Stone_Wall_002_DISP.DDS", nullptr, &m_floorDisplacementTexture)
-		);
-
-		DX::ThrowIfFailed(
-			CreateDDSTextureFromFile(m_deviceResources->GetD3DDevice(), L"Assets\\Textures\\Stone_Wall_002_NRM.DDS", nullptr, &m_floorNormalTexture)
-		);
-
 		DX::ThrowIfFailed(
 			CreateDDSTextureFromFile(m_deviceResources->GetD3DDevice(), L"Assets\\Textures\\StoneWall_1024_albedo.DDS", nullptr, &m_wallTexture)
 		);
@@ -1063,29 +2237,7 @@ void Sample3DSceneRenderer::CreateDeviceDependentResources()
 		);
 	});
 
-	auto createQuadTask = (createPSTask && createGroundVSTask).then([this]() {
-		// Load mesh vertices. Each vertex has a position and a color.
-		static const VertexPositionTextureNTB quadVertices[] =
-		{
-			{ XMFLOAT3(-1.0f, 0.0f, 1.0f), XMFLOAT2(0, 1), XMFLOAT3(0.0f, 1.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 1.0f), XMFLOAT3(1.0f, 0.0f, 0.0f) },
-			{ XMFLOAT3(-1.0f, 0.0f,  -1.0f), XMFLOAT2(0, 0), XMFLOAT3(0.0f, 1.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 1.0f), XMFLOAT3(1.0f, 0.0f, 0.0f) },
-			{ XMFLOAT3(1.0f, 0.0f, 1.0f), XMFLOAT2(1, 1), XMFLOAT3(0.0f, 1.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 1.0f), XMFLOAT3(1.0f, 0.0f, 0.0f) },
-			{ XMFLOAT3(1.0f, 0.0f,  -1.0f), XMFLOAT2(1, 0), XMFLOAT3(0.0f, 1.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 1.0f), XMFLOAT3(1.0f, 0.0f, 0.0f) },
-		};
-
-		D3D11_SUBRESOURCE_DATA vertexBufferData = { 0 };
-		vertexBufferData.pSysMem = quadVertices;
-		vertexBufferData.SysMemPitch = 0;
-		vertexBufferData.SysMemSlicePitch = 0;
-		CD3D11_BUFFER_DESC vertexBufferDesc(sizeof(quadVertices), D3D11_BIND_VERTEX_BUFFER);
-		DX::ThrowIfFailed(
-			m_deviceResources->GetD3DDevice()->CreateBuffer(
-				&vertexBufferDesc,
-				&vertexBufferData,
-				&m_quadVertexBuffer
-			)
-		);
-
+	auto createRasterizerStatesTask = createPSTask.then([this]() {
 		D3D11_RASTERIZER_DESC rasterizerDesc = CD3D11_RASTERIZER_DESC(D3D11_DEFAULT);
 		rasterizerDesc.FillMode = D3D11_FILL_WIREFRAME;
 		rasterizerDesc.CullMode = D3D11_CULL_NONE;
@@ -1224,7 +2376,9 @@ void Sample3DSceneRenderer::CreateDeviceDependentResources()
 	});
 
 	// Once everything is loaded, the object is ready to be rendered.
-	(createCubeTask && createParticlesTask && createSnakeTask && createQuadTask && createTextureTask).then([this]() {
+	(createCubeTask && createParticlesTask && createSnakeTask && createRasterizerStatesTask && createTextureTask && createReconstructPSTask && createReprojectPSTask && createFusedPSTask && createConeMarchCSTask && createColonnadePSTask && createProxyVSTask &&
+		createModelGBufferPSTask && createFusedGBufferPSTask && createDeferredPSTask && createFloorTask).then([this]() {
+		LoadShaderVariants();
 		m_loadingComplete = true;
 	});
 }
@@ -1248,29 +2402,79 @@ void Sample3DSceneRenderer::ReleaseDeviceDependentResources()
 	m_psConstantBuffer.Reset();
 	m_changesOnResizeConstantBuffer.Reset();
 	m_cubeVertexBuffer.Reset();
-	m_quadVertexBuffer.Reset();
 	m_snakeVertexBuffer.Reset();
 	m_particleVertexBuffer.Reset();
 	m_indexBuffer.Reset();
 	m_additiveBlend.Reset();
 	m_noWriteDepthState.Reset();
-	m_groundVertexShader.Reset();
-	m_hullShader.Reset();
-	m_domainShader.Reset();
 	m_wireframeState.Reset();
 	m_renderTargetTexture.Reset();
 	m_renderTargetView.Reset();
 	m_shaderResourceView.Reset();
 	m_samplerState.Reset();
 	m_scalesTexture.Reset();
-	m_floorTexture.Reset();
 	m_cullFrontState.Reset();
-	m_floorDisplacementTexture.Reset();
-	m_floorNormalTexture.Reset();
 	m_floorPixelShader.Reset();
 	m_wallHeightTexture.Reset();
 	m_wallTexture.Reset();
 	m_fireTexture.Reset();
 	m_noiseTexture.Reset();
 	m_particleVertexBufferSO.Reset();
+	m_sparseColorTexture.Reset();
+	m_sparseColorTargetView.Reset();
+	m_sparseColorResourceView.Reset();
+	m_sparseGeometryTexture.Reset();
+	m_sparseGeometryTargetView.Reset();
+	m_sparseGeometryResourceView.Reset();
+	m_reconstructPixelShader.Reset();
+	m_raymarchConstantBuffer.Reset();
+	m_reprojectPixelShader.Reset();
+	m_temporalConstantBuffer.Reset();
+	m_historyAcceptState.Reset();
+	m_historyMarchState.Reset();
+	ReleaseRaymarchHistory(m_roomHistory);
+	ReleaseRaymarchHistory(m_pillarHistory);
+	m_pillarCacheTexture.Reset();
+	m_fusedPixelShader.Reset();
+	m_fusedDepthState.Reset();
+	m_raymarchDepthState.Reset();
+	m_depthConstantBuffer.Reset();
+	m_rasterDepthTexture.Reset();
+	m_rasterDepthResourceView.Reset();
+	m_gbufferAlbedoTexture.Reset();
+	m_gbufferAlbedoTargetView.Reset();
+	m_gbufferAlbedoResourceView.Reset();
+	m_gbufferNormalTexture.Reset();
+	m_gbufferNormalTargetView.Reset();
+	m_gbufferNormalResourceView.Reset();
+	m_modelGBufferPixelShader.Reset();
+	m_fusedGBufferPixelShader.Reset();
+	m_deferredPixelShader.Reset();
+	m_coneMarchComputeShader.Reset();
+	m_coneBoundTexture.Reset();
+	m_coneBoundResourceView.Reset();
+	m_coneBoundAccessView.Reset();
+	m_colonnadePixelShader.Reset();
+	m_colonnadeConstantBuffer.Reset();
+	m_proxyVertexShader.Reset();
+	m_proxyVertexBuffer.Reset();
+	m_proxyIndexBuffer.Reset();
+	m_proxyConstantBuffer.Reset();
+	m_clusterConstantBuffer.Reset();
+	m_clusterLightBuffer.Reset();
+	m_clusterLightResourceView.Reset();
+	m_clusterRangeBuffer.Reset();
+	m_clusterRangeResourceView.Reset();
+	m_clusterIndexBuffer.Reset();
+	m_clusterIndexResourceView.Reset();
+	m_clusterIndexCapacity = 0;
+	m_floor.ReleaseDeviceDependentResources();
+	m_bakers.ReleaseDeviceDependentResources();
+	m_pixelShaderVariants.clear();
+	{
+		std::lock_guard<std::mutex> lock(m_pendingShaderVariantsMutex);
+		m_pendingShaderVariants.clear();
+	}
+	m_roomPassCache.Invalidate();
+	m_pillarPassCache.Invalidate();
 }
\ No newline at end of file
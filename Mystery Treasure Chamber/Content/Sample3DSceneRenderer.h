@@ -2,8 +2,19 @@
 
 #include "..\Common\DeviceResources.h"
 #include "ShaderStructures.h"
+#include "RaymarchReconstruction.h"
+#include "PassCache.h"
+#include "ShaderPermutations.h"
+#include "LightClusters.h"
+#include "DeferredShading.h"
+#include "FloorRenderer.h"
+#include "SceneBakers.h"
 #include "..\Common\StepTimer.h"
 
+#include <map>
+#include <mutex>
+#include <vector>
+
 namespace Mystery_Treasure_Chamber
 {
 	// This sample renderer instantiates a basic rendering pipeline.
@@ -17,9 +28,165 @@ namespace Mystery_Treasure_Chamber
 		void Update(DX::StepTimer const& timer);
 		void Render();
 
+		// Marching fewer pixels trades image quality for speed, the skipped ones are reconstructed.
+		void SetRaymarchResolution(RaymarchResolution resolution)	{ m_raymarchResolution = resolution; }
+		RaymarchResolution GetRaymarchResolution() const			{ return m_raymarchResolution; }
+
+		// Reuses last frame's ray marching result where the camera motion allows it. Only applies
+		// when every pixel is marched.
+		void SetTemporalReprojection(bool enabled)		{ m_temporalReprojection = enabled; }
+		bool GetTemporalReprojection() const			{ return m_temporalReprojection; }
+
+		// Pixels the room and pillar passes had to march again, as of the latest query result.
+		uint64 GetRoomRemarchedPixels() const			{ return m_roomHistory.remarchedPixels; }
+		uint64 GetPillarRemarchedPixels() const			{ return m_pillarHistory.remarchedPixels; }
+
+		// The floor, drawn in the FloorMode its cost model chooses unless one is set, see
+		// FloorRenderer.
+		void SetTessellationTarget(float pixels)		{ m_floor.SetTessellationTarget(pixels); }
+		float GetTessellationTarget() const				{ return m_floor.GetTessellationTarget(); }
+		void SetFloorPatches(uint32 count)				{ m_floor.SetPatches(count); }
+		uint32 GetFloorPatches() const					{ return m_floor.GetPatches(); }
+		uint64 GetFloorTriangles() const				{ return m_floor.GetTriangles(); }
+		const FloorTessellation::Visibility& GetFloorVisibility() const	{ return m_floor.GetVisibility(); }
+		void SetFloorMode(FloorMode mode)				{ m_floor.SetMode(mode); }
+		FloorMode GetFloorMode() const					{ return m_floor.GetMode(); }
+		uint32 GetFloorMeshLod() const					{ return m_floor.GetMeshLod(); }
+		void SetAutomaticFloorMode(bool enabled)		{ m_floor.SetAutomaticMode(enabled); }
+		bool GetAutomaticFloorMode() const				{ return m_floor.GetAutomaticMode(); }
+		const FloorCostModel& GetFloorCosts() const		{ return m_floor.GetCosts(); }
+
+		// Marches the room and the pillars in one pass after the floor, instead of marching the room
+		// into an intermediate target first. Only applies when every pixel is marched.
+		void SetFusedRaymarch(bool enabled)				{ m_fusedRaymarch = enabled; }
+		bool GetFusedRaymarch() const					{ return m_fusedRaymarch; }
+
+		// Draws the floor and the models first and then marches the room and the pillars through the
+		// raster camera, writing their depth and stopping where the rasterized geometry is. Only
+		// applies when every pixel is marched. The raster camera shares the canvas camera's eye but
+		// looks down at the floor with its own field of view, so the room and the pillars are seen
+		// from that camera in this mode, which the deferred mode uses as well. Their depth has to be
+		// in the space of the depth buffer the floor and the models wrote.
+		void SetDepthTestedRaymarch(bool enabled)		{ m_depthTestedRaymarch = enabled; }
+		bool GetDepthTestedRaymarch() const				{ return m_depthTestedRaymarch; }
+
+		// Marches one cone per 8x8 tile first, so the room and pillar passes can start their rays
+		// where the cone found the scene begins. Only applies when every pixel is marched and the
+		// passes are separate.
+		void SetConeMarchPrepass(bool enabled)			{ m_coneMarchPrepass = enabled; }
+		bool GetConeMarchPrepass() const				{ return m_coneMarchPrepass; }
+
+		// Replaces the room, its floor and its four pillars with a hall holding a square grid of
+		// pillarsPerSide by pillarsPerSide pillars, marched in one pass. 0 keeps the room. Only
+		// applies when every pixel is marched, and takes over from the fused and depth tested modes.
+		void SetColonnade(uint32 pillarsPerSide)		{ m_colonnadePillarsPerSide = pillarsPerSide; }
+		uint32 GetColonnade() const						{ return m_colonnadePillarsPerSide; }
+
+		// Draws a box around each pillar instead of the canvas quad in the pillar pass, so only
+		// the pixels the boxes cover march, and only between where their rays enter and leave the
+		// box. Only applies when every pixel is marched without temporal reprojection and the
+		// passes are separate.
+		void SetRaymarchProxies(bool enabled)			{ m_raymarchProxies = enabled; }
+		bool GetRaymarchProxies() const					{ return m_raymarchProxies; }
+
+		// Switches the room, pillar, fused, floor, model and colonnade pixel shaders to the
+		// cheapest compiled variants that do what the tier asks for, see
+		// Assets\Shaders\Permutations.txt. Tiers go from the lowest quality up and start at the
+		// highest. Variants load in the background and stay cached, so switching back is immediate.
+		void SetQualityTier(uint32 tier);
+		uint32 GetQualityTier() const					{ return m_qualityTier; }
+		uint32 GetQualityTierCount() const				{ return m_shaderPermutations.GetTierCount(); }
+
+		// Adds count torches along the walls of the room to the three scene lights. The lights are
+		// sorted into froxel clusters every frame, so the room, pillar, floor and model shaders
+		// only shade the ones near each pixel.
+		void SetTorchLights(uint32 count);
+		uint32 GetTorchLights() const					{ return m_torchCount; }
+
+		// Lighting of the three scene lights and ambient occlusion, baked on the CPU in the
+		// background the first time each is turned on, see SceneBakers. The lightmap shades the
+		// walls and the pillars, the probes the models, and the deferred mode still lights the
+		// models from the clusters.
+		void SetBakedLighting(bool enabled);
+		bool GetBakedLighting() const					{ return m_bakers.GetBakedLighting(); }
+		void SetAmbientOcclusion(bool enabled)			{ m_bakers.SetAmbientOcclusion(enabled); }
+		bool GetAmbientOcclusion() const				{ return m_bakers.GetAmbientOcclusion(); }
+		void SetProbeLighting(bool enabled);
+		bool GetProbeLighting() const					{ return m_bakers.GetProbeLighting(); }
+
+		// Draws the floor, the models and the room and pillars marched through the raster camera
+		// into a G-buffer of albedo, material, normal and depth, and then lights each pixel once in
+		// a full screen pass, instead of lighting in every pass and painting over it. Only applies
+		// when every pixel is marched, and takes over from the fused and depth tested modes.
+		void SetDeferredShading(bool enabled)			{ m_deferredShading = enabled; }
+		bool GetDeferredShading() const					{ return m_deferredShading; }
+
+		// What the G-buffer takes up at the current output size.
+		DeferredShading::MemoryUsage GetGBufferMemory() const;
+
+		// How often the room and pillar passes were skipped because none of their inputs changed.
+		const PassCache& GetRoomPassCache() const		{ return m_roomPassCache; }
+		const PassCache& GetPillarPassCache() const		{ return m_pillarPassCache; }
 
 	private:
+		typedef Microsoft::WRL::ComPtr<ID3D11PixelShader> Sample3DSceneRenderer::* PixelShaderMember;
+
+		// A shader variant that finished loading on a worker thread, for Render to switch to.
+		struct PendingShaderVariant
+		{
+			Microsoft::WRL::ComPtr<ID3D11Device>		device;		// What created it, which may since have been lost.
+			std::wstring								file;
+			uint32										tier;		// The quality tier it was loaded for.
+			PixelShaderMember							member;
+			Microsoft::WRL::ComPtr<ID3D11PixelShader>	shader;
+		};
+
+		// Last frame's output of one ray marching pass. Geometry is double buffered because the
+		// reprojection reads the old one while writing the new one.
+		struct RaymarchHistory
+		{
+			Microsoft::WRL::ComPtr<ID3D11Texture2D>				colorTexture;
+			Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	colorResourceView;
+			Microsoft::WRL::ComPtr<ID3D11Texture2D>				geometryTexture[2];
+			Microsoft::WRL::ComPtr<ID3D11RenderTargetView>		geometryTargetView[2];
+			Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	geometryResourceView[2];
+			Microsoft::WRL::ComPtr<ID3D11Query>					remarchQuery;
+			DirectX::XMFLOAT4	eye;
+			float				nearPlane;
+			uint32				current;
+			bool				valid;
+			bool				queryBegun;
+			bool				queryPending;
+			uint64				remarchedPixels;
+		};
+
 		void Rotate(float radians);
+		void CreateRenderTarget(DXGI_FORMAT format,
+			Microsoft::WRL::ComPtr<ID3D11Texture2D>& texture,
+			Microsoft::WRL::ComPtr<ID3D11RenderTargetView>& renderTargetView,
+			Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& shaderResourceView);
+		void BeginSparseRaymarch(bool hasBackground);
+		void CreateDepthCopy();
+		void CreateConeBounds();
+		void RunConeMarchPrepass();
+		void DrawFloor(bool gbuffer);
+		void DrawSnakes(bool gbuffer);
+		void DrawFusedRaymarch(bool depthTested, bool gbuffer);
+		void DrawDeferred();
+		void DrawColonnade();
+		void DrawRaymarchProxies();
+		void LoadShaderVariants();
+		void ApplyPendingShaderVariants();
+		void CreateClusterBuffer(UINT stride, UINT count,
+			Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer,
+			Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& shaderResourceView);
+		void UpdateLightClusters();
+		std::vector<LightmapLight> StaticLights() const;
+		void ResolveSparseRaymarch(ID3D11RenderTargetView* target, ID3D11ShaderResourceView* background);
+		void CreateRaymarchHistory(RaymarchHistory& history, DXGI_FORMAT colorFormat);
+		void ReleaseRaymarchHistory(RaymarchHistory& history);
+		void ReprojectRaymarchHistory(RaymarchHistory& history, ID3D11RenderTargetView* target);
+		void UpdateRaymarchHistory(RaymarchHistory& history, ID3D11RenderTargetView* target);
 
 	private:
 		// Cached pointer to device resources.
@@ -30,7 +197,6 @@ namespace Mystery_Treasure_Chamber
 		Microsoft::WRL::ComPtr<ID3D11InputLayout>		m_modelInputLayout;
 		Microsoft::WRL::ComPtr<ID3D11InputLayout>		m_particleInputLayout;
 		Microsoft::WRL::ComPtr<ID3D11Buffer>			m_cubeVertexBuffer;
-		Microsoft::WRL::ComPtr<ID3D11Buffer>			m_quadVertexBuffer;
 		Microsoft::WRL::ComPtr<ID3D11Buffer>			m_snakeVertexBuffer;
 		Microsoft::WRL::ComPtr<ID3D11Buffer>			m_particleVertexBuffer;
 		Microsoft::WRL::ComPtr<ID3D11Buffer>			m_particleVertexBufferSO;
@@ -53,18 +219,12 @@ namespace Mystery_Treasure_Chamber
 		Microsoft::WRL::ComPtr<ID3D11BlendState>		m_additiveBlend;
 		Microsoft::WRL::ComPtr<ID3D11DepthStencilState>	m_noWriteDepthState;
 		Microsoft::WRL::ComPtr<ID3D11RasterizerState>	m_DisableCullState;
-		Microsoft::WRL::ComPtr<ID3D11VertexShader>		m_groundVertexShader;
-		Microsoft::WRL::ComPtr<ID3D11HullShader>		m_hullShader;
-		Microsoft::WRL::ComPtr<ID3D11DomainShader>		m_domainShader;
 		Microsoft::WRL::ComPtr<ID3D11RasterizerState>	m_wireframeState;
 		Microsoft::WRL::ComPtr<ID3D11Texture2D>			m_renderTargetTexture;
 		Microsoft::WRL::ComPtr<ID3D11RenderTargetView>	m_renderTargetView;
 		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_shaderResourceView;
 		Microsoft::WRL::ComPtr<ID3D11SamplerState>		m_samplerState;
 		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_scalesTexture;
-		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_floorTexture;
-		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_floorDisplacementTexture;
-		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_floorNormalTexture;
 		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_pillarTexture;
 		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_pillarNormalTexture;
 		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_pillarHeightTexture;
@@ -74,18 +234,121 @@ namespace Mystery_Treasure_Chamber
 		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_fireTexture;
 		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_noiseTexture;
 
+		// Targets the ray marching passes write to when they skip pixels, and the pass that fills them in.
+		Microsoft::WRL::ComPtr<ID3D11Texture2D>			m_sparseColorTexture;
+		Microsoft::WRL::ComPtr<ID3D11RenderTargetView>	m_sparseColorTargetView;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_sparseColorResourceView;
+		Microsoft::WRL::ComPtr<ID3D11Texture2D>			m_sparseGeometryTexture;
+		Microsoft::WRL::ComPtr<ID3D11RenderTargetView>	m_sparseGeometryTargetView;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_sparseGeometryResourceView;
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>		m_reconstructPixelShader;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>			m_raymarchConstantBuffer;
+
+		// Temporal reprojection of the ray marching passes.
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>		m_reprojectPixelShader;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>			m_temporalConstantBuffer;
+		Microsoft::WRL::ComPtr<ID3D11DepthStencilState>	m_historyAcceptState;
+		Microsoft::WRL::ComPtr<ID3D11DepthStencilState>	m_historyMarchState;
+		RaymarchHistory									m_roomHistory;
+		RaymarchHistory									m_pillarHistory;
+
+		// Change detection for the ray marching passes. The pillars render into the back buffer, so
+		// their result is kept in a copy.
+		Microsoft::WRL::ComPtr<ID3D11Texture2D>			m_pillarCacheTexture;
+		PassCache										m_roomPassCache;
+		PassCache										m_pillarPassCache;
+
+		// Single pass ray marching of the room and the pillars.
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>		m_fusedPixelShader;
+		Microsoft::WRL::ComPtr<ID3D11DepthStencilState>	m_fusedDepthState;
+
+		// Depth tested ray marching against the rasterized geometry.
+		Microsoft::WRL::ComPtr<ID3D11DepthStencilState>	m_raymarchDepthState;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>			m_depthConstantBuffer;
+		Microsoft::WRL::ComPtr<ID3D11Texture2D>			m_rasterDepthTexture;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	m_rasterDepthResourceView;
+
+		// G-buffer of the deferred mode, the variants that write it and the pass that lights it.
+		Microsoft::WRL::ComPtr<ID3D11Texture2D>			m_gbufferAlbedoTexture;
+		Microsoft::WRL::ComPtr<ID3D11RenderTargetView>	m_gbufferAlbedoTargetView;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	m_gbufferAlbedoResourceView;
+		Microsoft::WRL::ComPtr<ID3D11Texture2D>			m_gbufferNormalTexture;
+		Microsoft::WRL::ComPtr<ID3D11RenderTargetView>	m_gbufferNormalTargetView;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	m_gbufferNormalResourceView;
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>		m_modelGBufferPixelShader;
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>		m_fusedGBufferPixelShader;
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>		m_deferredPixelShader;
+
+		// Cone march prepass, one distance per tile that the room and pillar rays can skip.
+		Microsoft::WRL::ComPtr<ID3D11ComputeShader>		m_coneMarchComputeShader;
+		Microsoft::WRL::ComPtr<ID3D11Texture2D>			m_coneBoundTexture;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	m_coneBoundResourceView;
+		Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView>	m_coneBoundAccessView;
+
+		// Pillar grid marched by domain repetition.
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>		m_colonnadePixelShader;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>			m_colonnadeConstantBuffer;
+
+		// Compiled shader variants by file, and the quality tiers that choose between them.
+		ShaderPermutations		m_shaderPermutations;
+		std::map<std::wstring, Microsoft::WRL::ComPtr<ID3D11PixelShader>>	m_pixelShaderVariants;
+		std::mutex							m_pendingShaderVariantsMutex;
+		std::vector<PendingShaderVariant>	m_pendingShaderVariants;	// Guarded by m_pendingShaderVariantsMutex.
+
+		// Pillar proxy boxes.
+		Microsoft::WRL::ComPtr<ID3D11VertexShader>		m_proxyVertexShader;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>			m_proxyVertexBuffer;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>			m_proxyIndexBuffer;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>			m_proxyConstantBuffer;
+
+		// Froxel light clusters, rebuilt on the CPU every frame. The index buffer grows to the
+		// longest list the lights have needed so far.
+		Microsoft::WRL::ComPtr<ID3D11Buffer>			m_clusterConstantBuffer;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>			m_clusterLightBuffer;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	m_clusterLightResourceView;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>			m_clusterRangeBuffer;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	m_clusterRangeResourceView;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>			m_clusterIndexBuffer;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	m_clusterIndexResourceView;
+		uint32											m_clusterIndexCapacity;
+		std::vector<ClusterLight>						m_clusterLights;
+		std::vector<ClusterRange>						m_clusterRanges;
+		std::vector<uint32_t>							m_clusterIndices;
+
+		// The floor, and the lighting baked for the static scene.
+		FloorRenderer									m_floor;
+		SceneBakers										m_bakers;
+
 		// System resources for cube geometry.
 		ConstantBuffer						m_timeBufferData;
 		ModelViewProjectionConstantBuffer	m_constantBufferData;
 		PixelShaderConstantBuffer			m_psConstantBufferData;
 		ChangesOnResizeConstantBuffer		m_changesOnResizeConstantBufferData;
+		RaymarchConstantBuffer				m_raymarchConstantBufferData;
+		TemporalConstantBuffer				m_temporalConstantBufferData;
+		DepthConstantBuffer					m_depthConstantBufferData;
+		ColonnadeConstantBuffer				m_colonnadeConstantBufferData;
+		ClusterConstantBuffer				m_clusterConstantBufferData;
 		uint32	m_indexCount;
+		uint32	m_proxyIndexCount;
 		uint32	m_vertexCount;
 		uint32 m_maxParticles;
 
 		// Variables used with the rendering loop.
 		bool	m_loadingComplete;
 		float	m_degreesPerSecond;
+		RaymarchResolution	m_raymarchResolution;
+		bool	m_temporalReprojection;
+		bool	m_fusedRaymarch;
+		bool	m_depthTestedRaymarch;
+		bool	m_coneMarchPrepass;
+		uint32	m_colonnadePillarsPerSide;
+		bool	m_raymarchProxies;
+		uint32	m_qualityTier;
+		uint32	m_torchCount;
+		bool	m_deferredShading;
+		uint32	m_shaderVariantGeneration;	// Changes whenever a pixel shader is switched to another variant.
+		uint32	m_frameIndex;
 	};
 }
 
@@ -3,6 +3,8 @@
 
 #include "Common/DirectXHelper.h"
 
+#include <algorithm>
+
 using namespace Mystery_Treasure_Chamber;
 using namespace Microsoft::WRL;
 
@@ -51,6 +53,15 @@ void SampleFpsTextRenderer::Update(DX::StepTimer const& timer)
 
 	m_text = (fps > 0) ? std::to_wstring(fps) + L" FPS" : L" - FPS";
 
+	// Detail lines follow at half the size.
+	uint32 fpsLength = (uint32) m_text.length();
+	uint32 detailLines = 0;
+	if (!m_detail.empty())
+	{
+		m_text += L"\n" + m_detail;
+		detailLines = 1 + (uint32) std::count(m_detail.begin(), m_detail.end(), L'\n');
+	}
+
 	ComPtr<IDWriteTextLayout> textLayout;
 	DX::ThrowIfFailed(
 		m_deviceResources->GetDWriteFactory()->CreateTextLayout(
@@ -58,11 +69,19 @@ void SampleFpsTextRenderer::Update(DX::StepTimer const& timer)
 			(uint32) m_text.length(),
 			m_textFormat.Get(),
 			240.0f, // Max width of the input text.
-			50.0f, // Max height of the input text.
+			50.0f + 25.0f * detailLines, // Max height of the input text.
 			&textLayout
 			)
 		);
 
+	if (detailLines > 0)
+	{
+		DWRITE_TEXT_RANGE detailRange = { fpsLength, (uint32) m_text.length() - fpsLength };
+		DX::ThrowIfFailed(
+			textLayout->SetFontSize(16.0f, detailRange)
+			);
+	}
+
 	DX::ThrowIfFailed(
 		textLayout.As(&m_textLayout)
 		);
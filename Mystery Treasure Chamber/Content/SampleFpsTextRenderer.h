@@ -6,7 +6,8 @@
 
 namespace Mystery_Treasure_Chamber
 {
-	// Renders the current FPS value in the bottom right corner of the screen using Direct2D and DirectWrite.
+	// Renders the current FPS value in the bottom right corner of the screen using Direct2D and DirectWrite,
+	// with any detail lines under it in smaller type.
 	class SampleFpsTextRenderer
 	{
 	public:
@@ -16,12 +17,17 @@ namespace Mystery_Treasure_Chamber
 		void Update(DX::StepTimer const& timer);
 		void Render();
 
+		// Lines shown under the FPS value from the next Update, such as what each way of drawing the
+		// floor costs. Empty shows the FPS value alone.
+		void SetDetail(const std::wstring& detail)	{ m_detail = detail; }
+
 	private:
 		// Cached pointer to device resources.
 		std::shared_ptr<DX::DeviceResources> m_deviceResources;
 
 		// Resources related to text rendering.
 		std::wstring                                    m_text;
+		std::wstring                                    m_detail;
 		DWRITE_TEXT_METRICS	                            m_textMetrics;
 		Microsoft::WRL::ComPtr<ID2D1SolidColorBrush>    m_whiteBrush;
 		Microsoft::WRL::ComPtr<ID2D1DrawingStateBlock1> m_stateBlock;
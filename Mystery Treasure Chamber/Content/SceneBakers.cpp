@@ -0,0 +1,257 @@
+﻿#include "pch.h"
+#include "SceneBakers.h"
+
+#include "..\Common\DirectXHelper.h"
+#include "AmbientOcclusion.h"
+
+#include <fstream>
+
+using namespace Mystery_Treasure_Chamber;
+
+using namespace DirectX;
+
+SceneBakers::SceneBakers(const std::shared_ptr<DX::DeviceResources>& deviceResources) :
+	m_deviceResources(deviceResources),
+	m_probeLights(0),
+	m_bakedLighting(false),
+	m_lightmapBaking(false),
+	m_ambientOcclusion(false),
+	m_occlusionGenerating(false),
+	m_probeLighting(false),
+	m_probeBaking(false)
+{
+}
+
+void SceneBakers::ReleaseDeviceDependentResources()
+{
+	m_lightmapTexture.Reset();
+	m_lightmapResourceView.Reset();
+	m_probeConstantBuffer.Reset();
+	m_occlusionTexture.Reset();
+	m_occlusionResourceView.Reset();
+	m_openOcclusionTexture.Reset();
+	m_openOcclusionResourceView.Reset();
+}
+
+void SceneBakers::SetBakedLighting(bool enabled, const std::vector<LightmapLight>& lights)
+{
+	m_bakedLighting = enabled;
+
+	if (enabled && !m_lightmapResourceView && !m_lightmapBaking)
+	{
+		BakeLightmap(lights);
+	}
+}
+
+// Loads the lightmap of the lights from the local folder, or bakes it on the CPU there. The
+// texture is created back on the calling thread once it is ready.
+void SceneBakers::BakeLightmap(const std::vector<LightmapLight>& lights)
+{
+	m_lightmapBaking = true;
+
+	LightmapBaker::Settings settings = LightmapBaker::DefaultSettings();
+	uint64_t key = LightmapBaker::Key(settings, lights);
+	std::string name = LightmapBaker::CacheFileName(key);
+	std::wstring path = std::wstring(Windows::Storage::ApplicationData::Current->LocalFolder->Path->Data()) + L"\\" +
+		std::wstring(name.begin(), name.end());
+
+	concurrency::create_task([settings, lights, key, path]() {
+		Lightmap lightmap;
+		std::ifstream cached(path, std::ios::binary);
+		if (cached && LightmapBaker::Load(cached, key, lightmap))
+		{
+			return lightmap;
+		}
+
+		WorkStealingPool pool(0);
+		lightmap = LightmapBaker::Bake(settings, lights, pool);
+
+		std::ofstream file(path, std::ios::binary);
+		if (file)
+		{
+			LightmapBaker::Save(lightmap, file);
+		}
+		return lightmap;
+	}).then([this](const Lightmap& lightmap) {
+		UINT resolution = lightmap.resolution;
+
+		D3D11_SUBRESOURCE_DATA textureData = { 0 };
+		textureData.pSysMem = lightmap.texels.data();
+		textureData.SysMemPitch = resolution * sizeof(Sdf::float4);
+		textureData.SysMemSlicePitch = resolution * resolution * sizeof(Sdf::float4);
+
+		CD3D11_TEXTURE3D_DESC textureDesc(DXGI_FORMAT_R32G32B32A32_FLOAT, resolution, resolution, resolution, 1,
+			D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_IMMUTABLE);
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateTexture3D(&textureDesc, &textureData, m_lightmapTexture.ReleaseAndGetAddressOf())
+		);
+
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateShaderResourceView(m_lightmapTexture.Get(), nullptr, m_lightmapResourceView.ReleaseAndGetAddressOf())
+		);
+
+		m_lightmapBaking = false;
+	}, concurrency::task_continuation_context::use_current());
+}
+
+void SceneBakers::SetProbeLighting(bool enabled, const std::vector<LightmapLight>& lights)
+{
+	m_probeLighting = enabled;
+
+	if (enabled && m_probeGrid.probes.empty() && !m_probeBaking)
+	{
+		BakeProbes(lights);
+	}
+}
+
+// Loads the probes of the lights from the local folder, or bakes them on the CPU there. They are
+// kept on the CPU, where each model blends its own.
+void SceneBakers::BakeProbes(const std::vector<LightmapLight>& lights)
+{
+	m_probeBaking = true;
+
+	IrradianceProbes::Settings settings = IrradianceProbes::DefaultSettings();
+	uint64_t key = IrradianceProbes::Key(settings, lights);
+	std::string name = IrradianceProbes::CacheFileName(key);
+	std::wstring path = std::wstring(Windows::Storage::ApplicationData::Current->LocalFolder->Path->Data()) + L"\\" +
+		std::wstring(name.begin(), name.end());
+
+	uint32 count = static_cast<uint32>(lights.size());
+	concurrency::create_task([settings, lights, key, path]() {
+		IrradianceProbeGrid grid;
+		std::ifstream cached(path, std::ios::binary);
+		if (cached && IrradianceProbes::Load(cached, key, grid))
+		{
+			return grid;
+		}
+
+		WorkStealingPool pool(0);
+		grid = IrradianceProbes::Bake(settings, lights, pool);
+
+		std::ofstream file(path, std::ios::binary);
+		if (file)
+		{
+			IrradianceProbes::Save(grid, file);
+		}
+		return grid;
+	}).then([this, count](const IrradianceProbeGrid& grid) {
+		m_probeGrid = grid;
+		m_probeLights = count;
+		m_probeBaking = false;
+	}, concurrency::task_continuation_context::use_current());
+}
+
+void SceneBakers::BindProbes(const Sdf::float3& Position)
+{
+	auto context = m_deviceResources->GetD3DDeviceContext();
+
+	if (!m_probeConstantBuffer)
+	{
+		CD3D11_BUFFER_DESC probeBufferDesc(sizeof(ProbeConstantBuffer), D3D11_BIND_CONSTANT_BUFFER);
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateBuffer(&probeBufferDesc, nullptr, &m_probeConstantBuffer)
+		);
+	}
+
+	m_probeConstantBufferData = {};
+	if (m_probeLighting && !m_probeGrid.probes.empty())
+	{
+		ShL2 sh = IrradianceProbes::Interpolate(m_probeGrid, Position);
+		for (int i = 0; i < 9; i++)
+		{
+			m_probeConstantBufferData.sh[i] = XMFLOAT4(sh.c[i].x, sh.c[i].y, sh.c[i].z, 0.0f);
+		}
+		m_probeConstantBufferData.probeLights = m_probeLights;
+	}
+
+	context->UpdateSubresource1(m_probeConstantBuffer.Get(), 0, NULL, &m_probeConstantBufferData, 0, 0, 0);
+	context->PSSetConstantBuffers1(6, 1, m_probeConstantBuffer.GetAddressOf(), nullptr, nullptr);
+}
+
+void SceneBakers::SetAmbientOcclusion(bool enabled)
+{
+	m_ambientOcclusion = enabled;
+
+	if (enabled && !m_occlusionResourceView && !m_occlusionGenerating)
+	{
+		GenerateOcclusionVolume();
+	}
+}
+
+// Loads the occlusion volume of the scene from the local folder, or generates it on the CPU there.
+// The texture is created back on the calling thread once it is ready.
+void SceneBakers::GenerateOcclusionVolume()
+{
+	m_occlusionGenerating = true;
+
+	AmbientOcclusion::Settings settings = AmbientOcclusion::DefaultSettings();
+	uint64_t key = AmbientOcclusion::Key(settings);
+	std::string name = AmbientOcclusion::CacheFileName(key);
+	std::wstring path = std::wstring(Windows::Storage::ApplicationData::Current->LocalFolder->Path->Data()) + L"\\" +
+		std::wstring(name.begin(), name.end());
+
+	concurrency::create_task([settings, key, path]() {
+		AmbientOcclusionVolume volume;
+		std::ifstream cached(path, std::ios::binary);
+		if (cached && AmbientOcclusion::Load(cached, key, volume))
+		{
+			return volume;
+		}
+
+		WorkStealingPool pool(0);
+		volume = AmbientOcclusion::Generate(settings, pool);
+
+		std::ofstream file(path, std::ios::binary);
+		if (file)
+		{
+			AmbientOcclusion::Save(volume, file);
+		}
+		return volume;
+	}).then([this](const AmbientOcclusionVolume& volume) {
+		UINT resolution = volume.resolution;
+
+		D3D11_SUBRESOURCE_DATA textureData = { 0 };
+		textureData.pSysMem = volume.values.data();
+		textureData.SysMemPitch = resolution * sizeof(float);
+		textureData.SysMemSlicePitch = resolution * resolution * sizeof(float);
+
+		CD3D11_TEXTURE3D_DESC textureDesc(DXGI_FORMAT_R32_FLOAT, resolution, resolution, resolution, 1,
+			D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_IMMUTABLE);
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateTexture3D(&textureDesc, &textureData, m_occlusionTexture.ReleaseAndGetAddressOf())
+		);
+
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateShaderResourceView(m_occlusionTexture.Get(), nullptr, m_occlusionResourceView.ReleaseAndGetAddressOf())
+		);
+
+		m_occlusionGenerating = false;
+	}, concurrency::task_continuation_context::use_current());
+}
+
+bool SceneBakers::BindOcclusionVolume()
+{
+	if (!m_openOcclusionResourceView)
+	{
+		const float open = 1.0f;
+		D3D11_SUBRESOURCE_DATA textureData = { 0 };
+		textureData.pSysMem = &open;
+		textureData.SysMemPitch = sizeof(float);
+		textureData.SysMemSlicePitch = sizeof(float);
+
+		CD3D11_TEXTURE3D_DESC textureDesc(DXGI_FORMAT_R32_FLOAT, 1, 1, 1, 1,
+			D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_IMMUTABLE);
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateTexture3D(&textureDesc, &textureData, &m_openOcclusionTexture)
+		);
+
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateShaderResourceView(m_openOcclusionTexture.Get(), nullptr, &m_openOcclusionResourceView)
+		);
+	}
+
+	bool occlusion = m_ambientOcclusion && m_occlusionResourceView;
+	ID3D11ShaderResourceView* volume = occlusion ? m_occlusionResourceView.Get() : m_openOcclusionResourceView.Get();
+	m_deviceResources->GetD3DDeviceContext()->PSSetShaderResources(5, 1, &volume);
+	return occlusion;
+}
@@ -0,0 +1,81 @@
+﻿#pragma once
+
+#include "..\Common\DeviceResources.h"
+#include "ShaderStructures.h"
+#include "LightmapBaker.h"
+#include "IrradianceProbes.h"
+
+#include <vector>
+
+namespace Mystery_Treasure_Chamber
+{
+	// Light of the static scene, computed on the CPU in the background the first time it is turned
+	// on and cached in the app's local folder: the lightmap of the walls and the pillars, the
+	// irradiance probes of the models and the ambient occlusion volume. Binds each for the shaders.
+	class SceneBakers
+	{
+	public:
+		SceneBakers(const std::shared_ptr<DX::DeviceResources>& deviceResources);
+		void ReleaseDeviceDependentResources();
+
+		// Shades the walls and the pillars with a lightmap of lights, with soft shadows of the
+		// pillars and ambient occlusion, instead of lighting them every pixel. The lightmap is
+		// cached under the hash of the scene and the lights, see LightmapBaker.
+		void SetBakedLighting(bool enabled, const std::vector<LightmapLight>& lights);
+		bool GetBakedLighting() const					{ return m_bakedLighting; }
+
+		// The lightmap once it is baked, null before.
+		ID3D11ShaderResourceView* GetLightmap() const	{ return m_lightmapResourceView.Get(); }
+
+		// Darkens the dynamic light of the walls, the pillars, the floor and the models by a volume
+		// of ambient occlusion cone traced through the scene SDF, see AmbientOcclusion.
+		void SetAmbientOcclusion(bool enabled);
+		bool GetAmbientOcclusion() const				{ return m_ambientOcclusion; }
+
+		// Binds the occlusion volume, or one open voxel while it is off or not ready yet, since the
+		// shaders always sample it. Returns whether it is the scene's volume.
+		bool BindOcclusionVolume();
+
+		// Lights the models with a grid of spherical harmonic probes of lights, with the pillars'
+		// shadows and the occlusion of the open sky, blended at each model instead of shading the
+		// lights every pixel, see IrradianceProbes.
+		void SetProbeLighting(bool enabled, const std::vector<LightmapLight>& lights);
+		bool GetProbeLighting() const					{ return m_probeLighting; }
+
+		// Blends the probes at the position of the model about to be drawn, or turns them off for
+		// the model pixel shader while they are off or not baked yet.
+		void BindProbes(const Sdf::float3& Position);
+
+	private:
+		void BakeLightmap(const std::vector<LightmapLight>& lights);
+		void BakeProbes(const std::vector<LightmapLight>& lights);
+		void GenerateOcclusionVolume();
+
+	private:
+		// Cached pointer to device resources.
+		std::shared_ptr<DX::DeviceResources> m_deviceResources;
+
+		// Baked light of the static surfaces.
+		Microsoft::WRL::ComPtr<ID3D11Texture3D>			m_lightmapTexture;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	m_lightmapResourceView;
+
+		// Irradiance probes of the static lights, blended on the CPU for each model.
+		Microsoft::WRL::ComPtr<ID3D11Buffer>			m_probeConstantBuffer;
+		IrradianceProbeGrid								m_probeGrid;
+		uint32											m_probeLights;	// Lights the grid was baked from.
+
+		// Ambient occlusion of the room, and the single open voxel bound while it is off.
+		Microsoft::WRL::ComPtr<ID3D11Texture3D>			m_occlusionTexture;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	m_occlusionResourceView;
+		Microsoft::WRL::ComPtr<ID3D11Texture3D>			m_openOcclusionTexture;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	m_openOcclusionResourceView;
+
+		ProbeConstantBuffer		m_probeConstantBufferData;
+		bool	m_bakedLighting;
+		bool	m_lightmapBaking;
+		bool	m_ambientOcclusion;
+		bool	m_occlusionGenerating;
+		bool	m_probeLighting;
+		bool	m_probeBaking;
+	};
+}
@@ -0,0 +1,272 @@
+﻿#include "SdfBrickMap.h"
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+const int SdfBrickMap::BrickSize;
+const uint32_t SdfBrickMap::EmptyCell;
+
+SdfBrickMap::SdfBrickMap() :
+	m_cellSize(0.0f),
+	m_voxelSize(0.0f)
+{
+	m_cells[0] = m_cells[1] = m_cells[2] = 0;
+}
+
+void SdfBrickMap::Build(const Field& field, const float3& minimum, const float3& maximum, float voxelSize)
+{
+	// Neighbouring bricks share their border samples so interpolation never has to look at another brick.
+	m_voxelSize = voxelSize;
+	m_cellSize = voxelSize * (BrickSize - 1);
+	m_minimum = minimum;
+
+	for (int i = 0; i < 3; i++)
+	{
+		m_cells[i] = std::max(1, static_cast<int>(std::ceil((maximum[i] - minimum[i]) / m_cellSize)));
+	}
+
+	m_maximum = m_minimum + float3(m_cells[0] * m_cellSize, m_cells[1] * m_cellSize, m_cells[2] * m_cellSize);
+
+	m_indirection.assign(m_cells[0] * m_cells[1] * m_cells[2], EmptyCell);
+	m_cellDistance.assign(m_indirection.size(), 0.0f);
+	m_bricks.clear();
+
+	// A cell can only contain the surface if the centre distance is smaller than half its diagonal.
+	// The extra voxel of margin covers fields that are not exact distances.
+	float halfDiagonal = 0.5f * std::sqrt(3.0f) * m_cellSize + m_voxelSize;
+
+	int cell[3];
+	for (cell[2] = 0; cell[2] < m_cells[2]; cell[2]++)
+	{
+		for (cell[1] = 0; cell[1] < m_cells[1]; cell[1]++)
+		{
+			for (cell[0] = 0; cell[0] < m_cells[0]; cell[0]++)
+			{
+				uint32_t index = CellIndex(cell);
+				float3 cellMinimum = CellMinimum(cell);
+				float centre = field(cellMinimum + float3(0.5f * m_cellSize));
+
+				m_cellDistance[index] = centre;
+
+				if (std::fabs(centre) > halfDiagonal)
+				{
+					continue;
+				}
+
+				m_indirection[index] = GetBrickCount();
+
+				for (int z = 0; z < BrickSize; z++)
+				{
+					for (int y = 0; y < BrickSize; y++)
+					{
+						for (int x = 0; x < BrickSize; x++)
+						{
+							m_bricks.push_back(field(cellMinimum + float3(x * m_voxelSize, y * m_voxelSize, z * m_voxelSize)));
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+float SdfBrickMap::Sample(const float3& Position) const
+{
+	int cell[3];
+	if (!CellOf(Position, cell))
+	{
+		// Outside of the map the only thing we know is how far away the map is.
+		float3 d = max(max(m_minimum - Position, Position - m_maximum), 0.0f);
+		return length(d);
+	}
+
+	uint32_t index = CellIndex(cell);
+	float3 cellMinimum = CellMinimum(cell);
+
+	if (m_indirection[index] == EmptyCell)
+	{
+		// The field is 1-Lipschitz, so the centre value minus the distance to the centre is a safe bound.
+		float centre = m_cellDistance[index];
+		float bound = std::fabs(centre) - length(Position - (cellMinimum + float3(0.5f * m_cellSize)));
+		return std::copysign(std::max(bound, 0.0f), centre);
+	}
+
+	return SampleBrick(m_indirection[index], (Position - cellMinimum) / m_voxelSize);
+}
+
+bool SdfBrickMap::RayMarch(const float3& origin, const float3& direction, float start, float final, float& val, uint32_t* steps) const
+{
+	val = 0.0f;
+
+	// Axes the ray does not move along never bound its way out of a cell.
+	float3 inverse;
+	for (int i = 0; i < 3; i++)
+	{
+		inverse[i] = direction[i] != 0.0f ? 1.0f / direction[i] : 0.0f;
+	}
+
+	float time = start;
+	float leftTime = time;
+	float left = 0.0f;
+	bool hasLeft = false;
+	bool leftBound = false;
+	uint32_t count = 0;
+	bool hit = false;
+
+	while (time <= final)
+	{
+		count++;
+
+		float3 Position = origin + time * direction;
+		int cell[3];
+		if (!CellOf(Position, cell))
+		{
+			break;
+		}
+
+		uint32_t index = CellIndex(cell);
+		float3 cellMinimum = CellMinimum(cell);
+
+		// The centre distance bounds the field around it and is far cheaper to read than a brick.
+		// Only within a voxel of the bound running out is the brick worth sampling.
+		bool empty = m_indirection[index] == EmptyCell;
+		float centre = m_cellDistance[index];
+		float bound = std::fabs(centre) - length(Position - (cellMinimum + float3(0.5f * m_cellSize)));
+		bool isBound = empty || bound >= m_voxelSize;
+		float right, clear;
+
+		if (empty)
+		{
+			// No surface in the cell, so the ray can at least leave it.
+			float exit = final;
+			for (int i = 0; i < 3; i++)
+			{
+				if (inverse[i] != 0.0f)
+				{
+					float plane = inverse[i] > 0.0f ? cellMinimum[i] + m_cellSize : cellMinimum[i];
+					exit = std::min(exit, (plane - origin[i]) * inverse[i]);
+				}
+			}
+
+			right = std::copysign(std::max(bound, 0.0f), centre);
+			clear = std::max(exit - time, bound) + 0.01f * m_voxelSize;
+		}
+		else if (isBound)
+		{
+			right = std::copysign(bound, centre);
+			clear = bound;
+		}
+		else
+		{
+			// Sphere trace inside the brick. Only within a voxel of the surface does a minimum step
+			// take over, so the ray crosses it instead of creeping up to it.
+			right = SampleBrick(m_indirection[index], (Position - cellMinimum) / m_voxelSize);
+			clear = std::max(std::fabs(right), m_voxelSize);
+		}
+
+		// The surface lies between the last sample and this one. Two brick samples are close enough
+		// to interpolate, a bound is not, and the sign may even change on the face of an empty cell.
+		if (hasLeft && std::signbit(left) != std::signbit(right))
+		{
+			val = leftBound || isBound ? Refine(origin, direction, leftTime, time) : leftTime + (time - leftTime) * left / (left - right);
+			hit = true;
+			break;
+		}
+
+		left = right;
+		leftTime = time;
+		leftBound = isBound;
+		hasLeft = true;
+		time += clear;
+	}
+
+	if (steps)
+	{
+		*steps = count;
+	}
+	return hit;
+}
+
+float SdfBrickMap::Refine(const float3& origin, const float3& direction, float low, float high) const
+{
+	// Bounds only give the sign, so bisect on it until the bracket is a small part of a voxel,
+	// then interpolate the samples at its ends.
+	float lowValue = Sample(origin + low * direction);
+	float highValue = Sample(origin + high * direction);
+	while (high - low > 0.01f * m_voxelSize)
+	{
+		float middle = 0.5f * (low + high);
+		float value = Sample(origin + middle * direction);
+		if (std::signbit(value) == std::signbit(lowValue))
+		{
+			low = middle;
+			lowValue = value;
+		}
+		else
+		{
+			high = middle;
+			highValue = value;
+		}
+	}
+
+	return lowValue == highValue ? low : low + (high - low) * lowValue / (lowValue - highValue);
+}
+
+size_t SdfBrickMap::GetMemoryUsage() const
+{
+	return m_indirection.size() * sizeof(uint32_t) + m_cellDistance.size() * sizeof(float) + m_bricks.size() * sizeof(float);
+}
+
+size_t SdfBrickMap::GetDenseMemoryUsage() const
+{
+	size_t samples = 1;
+	for (int i = 0; i < 3; i++)
+	{
+		samples *= static_cast<size_t>(m_cells[i]) * (BrickSize - 1) + 1;
+	}
+	return samples * sizeof(float);
+}
+
+bool SdfBrickMap::CellOf(const float3& Position, int cell[3]) const
+{
+	for (int i = 0; i < 3; i++)
+	{
+		if (!(Position[i] >= m_minimum[i] && Position[i] <= m_maximum[i]))
+		{
+			return false;
+		}
+		cell[i] = std::min(static_cast<int>((Position[i] - m_minimum[i]) / m_cellSize), m_cells[i] - 1);
+	}
+	return true;
+}
+
+float3 SdfBrickMap::CellMinimum(const int cell[3]) const
+{
+	return m_minimum + float3(cell[0] * m_cellSize, cell[1] * m_cellSize, cell[2] * m_cellSize);
+}
+
+float SdfBrickMap::SampleBrick(uint32_t brick, const float3& local) const
+{
+	// Trilinear interpolation between the eight samples around local, which is in voxel units.
+	const float* data = &m_bricks[static_cast<size_t>(brick) * BrickVoxels];
+
+	int i[3];
+	float f[3];
+	for (int a = 0; a < 3; a++)
+	{
+		float v = clamp(local[a], 0.0f, static_cast<float>(BrickSize - 1));
+		i[a] = std::min(static_cast<int>(v), BrickSize - 2);
+		f[a] = v - i[a];
+	}
+
+	const float* p = data + (i[2] * BrickSize + i[1]) * BrickSize + i[0];
+	const int dy = BrickSize;
+	const int dz = BrickSize * BrickSize;
+
+	float x00 = lerp(p[0], p[1], f[0]);
+	float x10 = lerp(p[dy], p[dy + 1], f[0]);
+	float x01 = lerp(p[dz], p[dz + 1], f[0]);
+	float x11 = lerp(p[dz + dy], p[dz + dy + 1], f[0]);
+
+	return lerp(lerp(x00, x10, f[1]), lerp(x01, x11, f[1]), f[2]);
+}
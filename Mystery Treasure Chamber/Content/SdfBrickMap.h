@@ -0,0 +1,67 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "SdfMath.h"
+
+namespace Mystery_Treasure_Chamber
+{
+	// Sparse signed distance field. A coarse grid of cells covers the chamber and only the cells
+	// the surface passes through own an 8x8x8 brick of distance samples. Every cell keeps the
+	// distance at its centre, which is enough to skip an empty cell while marching, and to step
+	// through the parts of a brick away from the surface without reading it.
+	class SdfBrickMap
+	{
+	public:
+		static const int BrickSize = 8;
+		static const uint32_t EmptyCell = 0xFFFFFFFF;
+
+		typedef std::function<float(const Sdf::float3&)> Field;
+
+		SdfBrickMap();
+
+		// Samples the field over [minimum, maximum]. voxelSize is the spacing of samples inside a brick.
+		// The bounds need some margin around the surface, otherwise rays leave the map before they cross it.
+		void Build(const Field& field, const Sdf::float3& minimum, const Sdf::float3& maximum, float voxelSize);
+
+		// Distance at Position. Outside of a brick this is a conservative bound rather than the exact distance.
+		float Sample(const Sdf::float3& Position) const;
+
+		// Marches the ray between start and final, sphere tracing the bricks and stepping over empty
+		// cells by their distance. Returns the hit time in val.
+		bool RayMarch(const Sdf::float3& origin, const Sdf::float3& direction, float start, float final, float& val, uint32_t* steps = nullptr) const;
+
+		uint32_t GetBrickCount() const		{ return static_cast<uint32_t>(m_bricks.size() / BrickVoxels); }
+		uint32_t GetCellCount() const		{ return static_cast<uint32_t>(m_indirection.size()); }
+		float GetCellSize() const			{ return m_cellSize; }
+
+		// Bytes used by the indirection grid, the cell distances and the bricks.
+		size_t GetMemoryUsage() const;
+
+		// Bytes a dense grid with the same voxel spacing would need, for comparison.
+		size_t GetDenseMemoryUsage() const;
+
+	private:
+		static const int BrickVoxels = BrickSize * BrickSize * BrickSize;
+
+		bool CellOf(const Sdf::float3& Position, int cell[3]) const;
+		uint32_t CellIndex(const int cell[3]) const	{ return (cell[2] * m_cells[1] + cell[1]) * m_cells[0] + cell[0]; }
+		Sdf::float3 CellMinimum(const int cell[3]) const;
+		float SampleBrick(uint32_t brick, const Sdf::float3& local) const;
+
+		// Hit time between low and high, where the field changes sign.
+		float Refine(const Sdf::float3& origin, const Sdf::float3& direction, float low, float high) const;
+
+		Sdf::float3				m_minimum;
+		Sdf::float3				m_maximum;
+		float					m_cellSize;
+		float					m_voxelSize;
+		int						m_cells[3];
+
+		std::vector<uint32_t>	m_indirection;	// Brick index for each cell, or EmptyCell.
+		std::vector<float>		m_cellDistance;	// Distance at the centre of each cell.
+		std::vector<float>		m_bricks;		// BrickVoxels samples per brick, x fastest.
+	};
+}
@@ -0,0 +1,968 @@
+﻿#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <algorithm>
+
+#include "SdfMath.h"
+
+// The distance functions and operators of PillarPixelShader.hlsl as C++ expression templates.
+// A scene is written once as an expression such as
+//
+//     auto scene = Union(Translate(Torus(float2(1.0f, 0.2f)), float3(0, 1, 0)), Twist(Box(float3(0.5f))));
+//
+// and can then be evaluated on the CPU, where the whole tree inlines into one function, or turned
+// into HLSL with GenerateHlsl for the shaders. Every node evaluates with floats, doubles and any
+// lane type that has the functions below for the nodes it uses, so the packet marcher's types work too.
+//
+// Gradient returns the distance and its gradient together. Nodes with an analytic gradient compute
+// it directly, the others take four tetrahedral samples epsilon apart. Cost and GradientCost count
+// primitive evaluations, so the saving over six tap central differences is known at compile time.
+// The generated HLSL gradient computes every distance once into a temporary and then branches down
+// to the one primitive whose gradient counts, so its cost grows with the size of the tree.
+//
+// Twist and the soft operators do not give true distances, so sphere tracing them as they are can
+// step through the surface. Lipschitz combines a bound on the gradient length of the whole tree when
+// the scene is built, and Bound gives a distance that is never too far at a point, scaled by each
+// node only where it needs it, so exact parts of a scene keep their full steps.
+namespace Mystery_Treasure_Chamber
+{
+	namespace SdfExpression
+	{
+		// Scalar maths, with the HLSL meaning where C++ differs.
+		inline float Min(float a, float b)				{ return std::min(a, b); }
+		inline float Max(float a, float b)				{ return std::max(a, b); }
+		inline float Abs(float a)						{ return std::fabs(a); }
+		inline float Sqrt(float a)						{ return std::sqrt(a); }
+		inline float Sin(float a)						{ return std::sin(a); }
+		inline float Cos(float a)						{ return std::cos(a); }
+		inline float Fmod(float a, float b)				{ return std::fmod(a, b); }
+		inline float Sign(float a)						{ return a > 0.0f ? 1.0f : a < 0.0f ? -1.0f : 0.0f; }
+		inline bool Less(float a, float b)				{ return a < b; }
+		inline float Select(bool m, float a, float b)	{ return m ? a : b; }
+
+		// Doubles, for reference gradients.
+		inline double Min(double a, double b)				{ return std::min(a, b); }
+		inline double Max(double a, double b)				{ return std::max(a, b); }
+		inline double Abs(double a)							{ return std::fabs(a); }
+		inline double Sqrt(double a)						{ return std::sqrt(a); }
+		inline double Sin(double a)							{ return std::sin(a); }
+		inline double Cos(double a)							{ return std::cos(a); }
+		inline double Fmod(double a, double b)				{ return std::fmod(a, b); }
+		inline double Sign(double a)						{ return a > 0.0 ? 1.0 : a < 0.0 ? -1.0 : 0.0; }
+		inline bool Less(double a, double b)				{ return a < b; }
+		inline double Select(bool m, double a, double b)	{ return m ? a : b; }
+
+		template <class T>
+		struct Point
+		{
+			T x, y, z;
+		};
+
+		template <class T>
+		Point<T> MakePoint(const T& x, const T& y, const T& z)
+		{
+			Point<T> p = { x, y, z };
+			return p;
+		}
+
+		template <class T>
+		Point<T> Scale(const Point<T>& p, const T& s)
+		{
+			return MakePoint(p.x * s, p.y * s, p.z * s);
+		}
+
+		template <class T>
+		Point<T> Negate(const Point<T>& p)
+		{
+			T zero(0.0f);
+			return MakePoint(zero - p.x, zero - p.y, zero - p.z);
+		}
+
+		template <class M, class T>
+		Point<T> SelectPoint(const M& mask, const Point<T>& a, const Point<T>& b)
+		{
+			return MakePoint(Select(mask, a.x, b.x), Select(mask, a.y, b.y), Select(mask, a.z, b.z));
+		}
+
+		// -1 or 1, never 0, so a gradient never vanishes on a symmetry plane.
+		template <class T>
+		T SignOf(const T& a)
+		{
+			return Select(Less(a, T(0.0f)), T(-1.0f), T(1.0f));
+		}
+
+		// Sum of f(p + epsilon * k) * k over the corners k of a tetrahedron, which is 4 * epsilon times
+		// the gradient up to second order, from four evaluations instead of six. Returns the mean of
+		// the samples as the distance, which is also right to second order.
+		template <class E, class T>
+		T TetrahedralGradient(const E& e, const Point<T>& p, float epsilon, Point<T>& gradient)
+		{
+			T h(epsilon);
+			T a = e.Evaluate(MakePoint(p.x + h, p.y - h, p.z - h));	// ( 1, -1, -1)
+			T b = e.Evaluate(MakePoint(p.x - h, p.y - h, p.z + h));	// (-1, -1,  1)
+			T c = e.Evaluate(MakePoint(p.x - h, p.y + h, p.z - h));	// (-1,  1, -1)
+			T d = e.Evaluate(MakePoint(p.x + h, p.y + h, p.z + h));	// ( 1,  1,  1)
+
+			T scale(0.25f / epsilon);
+			gradient = MakePoint((a - b - c + d) * scale, (c + d - a - b) * scale, (b + d - a - c) * scale);
+			return (a + b + c + d) * T(0.25f);
+		}
+
+		// The tetrahedral sum in HLSL for a sub-expression without an analytic gradient.
+		template <class E>
+		std::string HlslTetrahedralGradient(const E& e, const std::string& p, const std::string& epsilon)
+		{
+			return "Tetrahedral(" +
+				e.Hlsl("(" + p + " + " + epsilon + " * float3(1.0, -1.0, -1.0))") + ", " +
+				e.Hlsl("(" + p + " + " + epsilon + " * float3(-1.0, -1.0, 1.0))") + ", " +
+				e.Hlsl("(" + p + " + " + epsilon + " * float3(-1.0, 1.0, -1.0))") + ", " +
+				e.Hlsl("(" + p + " + " + epsilon + " * float3(1.0, 1.0, 1.0))") + ", " + epsilon + ")";
+		}
+
+		// Statements of a generated gradient function. The distance of the node at pre-order index i
+		// of the tree goes into the temporary di, and the chosen gradient into gradient.
+		struct HlslBlock
+		{
+			std::string	source;
+			uint32_t	depth;
+
+			HlslBlock() : depth(1) {}
+
+			static std::string Distance(uint32_t index)	{ return "d" + std::to_string(index); }
+
+			void Line(const std::string& line)			{ source += std::string(depth, '\t') + line + "\n"; }
+			void Open()									{ Line("{"); depth++; }
+			void Close()								{ depth--; Line("}"); }
+
+			std::string Declare(const std::string& value, uint32_t index)
+			{
+				Line("float " + Distance(index) + " = " + value + ";");
+				return Distance(index);
+			}
+		};
+
+		// The HLSL functions an expression calls, so only those are emitted.
+		enum HlslHelper : uint32_t
+		{
+			HelperSphere = 1 << 0,
+			HelperBox = 1 << 1,
+			HelperTorus = 1 << 2,
+			HelperCylinder = 1 << 3,
+			HelperCappedCone = 1 << 4,
+			HelperSoftMin = 1 << 5,
+			HelperUnion = 1 << 6,
+			HelperSubtract = 1 << 7,
+			HelperRepeat = 1 << 8,
+			HelperTwist = 1 << 9,
+			HelperTetrahedral = 1 << 10,
+			HelperSoftMax = 1 << 11,
+		};
+
+		// Float literals that read back as the same float.
+		inline std::string Literal(float v)
+		{
+			char text[32];
+			std::snprintf(text, sizeof(text), "%.9g", v);
+			std::string result(text);
+			if (result.find_first_of(".en") == std::string::npos)
+				result += ".0";
+			return result;
+		}
+
+		inline std::string Literal(const Sdf::float2& v)
+		{
+			return "float2(" + Literal(v.x) + ", " + Literal(v.y) + ")";
+		}
+
+		inline std::string Literal(const Sdf::float3& v)
+		{
+			return "float3(" + Literal(v.x) + ", " + Literal(v.y) + ", " + Literal(v.z) + ")";
+		}
+
+		// Base of every node, so the operators below only take expressions.
+		// Primitives are exact distances, the operators that are not override Lipschitz and Bound.
+		template <class Derived>
+		struct Expression
+		{
+			const Derived& Self() const	{ return static_cast<const Derived&>(*this); }
+
+			// Largest gradient length for points within radius of the origin.
+			float Lipschitz(float) const	{ return 1.0f; }
+
+			// A distance to the surface that is never larger than the true one.
+			template <class T>
+			T Bound(const Point<T>& p) const	{ return Self().Evaluate(p); }
+
+			// Leaves of the generated gradient: nodes whose gradient is one expression, the primitives
+			// and the tetrahedral ones. Operators that pick between children override both.
+			std::string HlslDistance(HlslBlock&, const std::string& p, uint32_t) const	{ return Self().Hlsl(p); }
+
+			void HlslGradientStatements(HlslBlock& block, const std::string& p, const std::string& epsilon, uint32_t) const
+			{
+				block.Line("gradient = " + Self().HlslGradient(p, epsilon) + ";");
+			}
+		};
+
+		// softAbs2 of the shaders without the branch: |x| rounded off over a width of k. Its slope
+		// never exceeds 1.
+		template <class T>
+		T SoftAbs(const T& x, float k)
+		{
+			T xx = T(2.0f) * x / T(k);
+			T abs2 = Abs(xx);
+			T smooth = T(0.5f) * xx * xx * (T(1.0f) - abs2 / T(6.0f)) + T(2.0f / 3.0f);
+			return Select(Less(abs2, T(2.0f)), smooth, abs2) * T(k) / T(2.0f);
+		}
+
+		//------------------------------------------------------------------------------------------
+		// Primitives
+
+		struct SphereNode : Expression<SphereNode>
+		{
+			static const uint32_t Helpers = HelperSphere;
+			static const uint32_t Cost = 1;
+			static const uint32_t GradientCost = 1;
+			static const uint32_t Nodes = 1;
+			float s;
+
+			explicit SphereNode(float s) : s(s) {}
+
+			template <class T>
+			T Evaluate(const Point<T>& p) const
+			{
+				return Sqrt(p.x * p.x + p.y * p.y + p.z * p.z) - T(s);
+			}
+
+			template <class T>
+			T Gradient(const Point<T>& p, float, Point<T>& gradient) const
+			{
+				T length = Sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+				gradient = Scale(p, T(1.0f) / length);
+				return length - T(s);
+			}
+
+			std::string Hlsl(const std::string& p) const	{ return "sdSphere(" + p + ", " + Literal(s) + ")"; }
+			std::string HlslGradient(const std::string& p, const std::string&) const	{ return "normalize(" + p + ")"; }
+		};
+
+		struct BoxNode : Expression<BoxNode>
+		{
+			static const uint32_t Helpers = HelperBox;
+			static const uint32_t Cost = 1;
+			static const uint32_t GradientCost = 1;
+			static const uint32_t Nodes = 1;
+			Sdf::float3 b;
+
+			explicit BoxNode(const Sdf::float3& b) : b(b) {}
+
+			template <class T>
+			T Evaluate(const Point<T>& p) const
+			{
+				T zero(0.0f);
+				T dx = Abs(p.x) - T(b.x);
+				T dy = Abs(p.y) - T(b.y);
+				T dz = Abs(p.z) - T(b.z);
+				T ox = Max(dx, zero), oy = Max(dy, zero), oz = Max(dz, zero);
+				return Min(Max(dx, Max(dy, dz)), zero) + Sqrt(ox * ox + oy * oy + oz * oz);
+			}
+
+			// Outside, the direction from the nearest point of the box. Inside, the axis of the nearest face.
+			template <class T>
+			T Gradient(const Point<T>& p, float, Point<T>& gradient) const
+			{
+				T zero(0.0f);
+				T dx = Abs(p.x) - T(b.x);
+				T dy = Abs(p.y) - T(b.y);
+				T dz = Abs(p.z) - T(b.z);
+				T ox = Max(dx, zero), oy = Max(dy, zero), oz = Max(dz, zero);
+				T outside = Sqrt(ox * ox + oy * oy + oz * oz);
+				T inside = Min(Max(dx, Max(dy, dz)), zero);
+
+				Point<T> out = MakePoint(SignOf(p.x) * ox / outside, SignOf(p.y) * oy / outside, SignOf(p.z) * oz / outside);
+				Point<T> x = MakePoint(SignOf(p.x), zero, zero);
+				Point<T> y = MakePoint(zero, SignOf(p.y), zero);
+				Point<T> z = MakePoint(zero, zero, SignOf(p.z));
+				Point<T> in = SelectPoint(Less(dx, dy), SelectPoint(Less(dy, dz), z, y), SelectPoint(Less(dx, dz), z, x));
+
+				gradient = SelectPoint(Less(zero, outside), out, in);
+				return inside + outside;
+			}
+
+			std::string Hlsl(const std::string& p) const	{ return "sdBox(" + p + ", " + Literal(b) + ")"; }
+			std::string HlslGradient(const std::string& p, const std::string&) const	{ return "sdBoxGradient(" + p + ", " + Literal(b) + ")"; }
+		};
+
+		struct TorusNode : Expression<TorusNode>
+		{
+			static const uint32_t Helpers = HelperTorus;
+			static const uint32_t Cost = 1;
+			static const uint32_t GradientCost = 1;
+			static const uint32_t Nodes = 1;
+			Sdf::float2 t;
+
+			explicit TorusNode(const Sdf::float2& t) : t(t) {}
+
+			template <class T>
+			T Evaluate(const Point<T>& p) const
+			{
+				T qx = Sqrt(p.x * p.x + p.z * p.z) - T(t.x);
+				return Sqrt(qx * qx + p.y * p.y) - T(t.y);
+			}
+
+			template <class T>
+			T Gradient(const Point<T>& p, float, Point<T>& gradient) const
+			{
+				T ring = Sqrt(p.x * p.x + p.z * p.z);
+				T qx = ring - T(t.x);
+				T length = Sqrt(qx * qx + p.y * p.y);
+				T radial = qx / (ring * length);
+				gradient = MakePoint(p.x * radial, p.y / length, p.z * radial);
+				return length - T(t.y);
+			}
+
+			std::string Hlsl(const std::string& p) const	{ return "sdTorus(" + p + ", " + Literal(t) + ")"; }
+			std::string HlslGradient(const std::string& p, const std::string&) const	{ return "sdTorusGradient(" + p + ", " + Literal(t) + ")"; }
+		};
+
+		// Infinite along y through (c.x, 0, c.y) with radius c.z.
+		struct CylinderNode : Expression<CylinderNode>
+		{
+			static const uint32_t Helpers = HelperCylinder;
+			static const uint32_t Cost = 1;
+			static const uint32_t GradientCost = 1;
+			static const uint32_t Nodes = 1;
+			Sdf::float3 c;
+
+			explicit CylinderNode(const Sdf::float3& c) : c(c) {}
+
+			template <class T>
+			T Evaluate(const Point<T>& p) const
+			{
+				T dx = p.x - T(c.x);
+				T dz = p.z - T(c.y);
+				return Sqrt(dx * dx + dz * dz) - T(c.z);
+			}
+
+			template <class T>
+			T Gradient(const Point<T>& p, float, Point<T>& gradient) const
+			{
+				T dx = p.x - T(c.x);
+				T dz = p.z - T(c.y);
+				T length = Sqrt(dx * dx + dz * dz);
+				gradient = MakePoint(dx / length, T(0.0f), dz / length);
+				return length - T(c.z);
+			}
+
+			std::string Hlsl(const std::string& p) const	{ return "sdCylinder(" + p + ", " + Literal(c) + ")"; }
+			std::string HlslGradient(const std::string& p, const std::string&) const	{ return "sdCylinderGradient(" + p + ", " + Literal(c) + ")"; }
+		};
+
+		struct CappedConeNode : Expression<CappedConeNode>
+		{
+			static const uint32_t Helpers = HelperCappedCone | HelperTetrahedral;
+			static const uint32_t Cost = 1;
+			static const uint32_t GradientCost = 4;
+			static const uint32_t Nodes = 1;
+			Sdf::float3 c;
+
+			explicit CappedConeNode(const Sdf::float3& c) : c(c) {}
+
+			template <class T>
+			T Evaluate(const Point<T>& p) const
+			{
+				// v and the terms made of it alone are constants.
+				float vx = c.z * c.y / c.x, vy = -c.z;
+				float vvx = vx * vx + vy * vy, vvy = vx * vx;
+
+				T zero(0.0f);
+				T qx = Sqrt(p.x * p.x + p.z * p.z);
+				T qy = p.y;
+				T wx = T(vx) - qx, wy = T(vy) - qy;
+				T qvx = T(vx) * wx + T(vy) * wy;
+				T qvy = T(vx) * wx;
+				T dx = Max(qvx, zero) * qvx / T(vvx);
+				T dy = Max(qvy, zero) * qvy / T(vvy);
+				// Rounding can take the square below 0 on the surface, which would give NaN.
+				return Sqrt(Max(wx * wx + wy * wy - Max(dx, dy), zero)) * Sign(Max(qy * T(vx) - qx * T(vy), wy));
+			}
+
+			template <class T>
+			T Gradient(const Point<T>& p, float epsilon, Point<T>& gradient) const	{ return TetrahedralGradient(*this, p, epsilon, gradient); }
+
+			std::string Hlsl(const std::string& p) const	{ return "sdCappedCone(" + p + ", " + Literal(c) + ")"; }
+			std::string HlslGradient(const std::string& p, const std::string& epsilon) const	{ return HlslTetrahedralGradient(*this, p, epsilon); }
+		};
+
+		//------------------------------------------------------------------------------------------
+		// Operators on distances
+
+		template <class A>
+		struct NegateNode : Expression<NegateNode<A> >
+		{
+			static const uint32_t Helpers = A::Helpers;
+			static const uint32_t Cost = A::Cost;
+			static const uint32_t GradientCost = A::GradientCost;
+			static const uint32_t Nodes = 1 + A::Nodes;
+			A a;
+
+			explicit NegateNode(const A& a) : a(a) {}
+
+			template <class T>
+			T Evaluate(const Point<T>& p) const					{ return T(0.0f) - a.Evaluate(p); }
+
+			float Lipschitz(float radius) const					{ return a.Lipschitz(radius); }
+
+			template <class T>
+			T Bound(const Point<T>& p) const					{ return T(0.0f) - a.Bound(p); }
+
+			template <class T>
+			T Gradient(const Point<T>& p, float epsilon, Point<T>& gradient) const
+			{
+				T d = a.Gradient(p, epsilon, gradient);
+				gradient = Negate(gradient);
+				return T(0.0f) - d;
+			}
+
+			std::string Hlsl(const std::string& p) const		{ return "(-" + a.Hlsl(p) + ")"; }
+
+			std::string HlslDistance(HlslBlock& block, const std::string& p, uint32_t index) const
+			{
+				return "(-" + a.HlslDistance(block, p, index + 1) + ")";
+			}
+
+			void HlslGradientStatements(HlslBlock& block, const std::string& p, const std::string& epsilon, uint32_t index) const
+			{
+				a.HlslGradientStatements(block, p, epsilon, index + 1);
+				block.Line("gradient = -gradient;");
+			}
+		};
+
+		template <class A, class B>
+		struct UnionNode : Expression<UnionNode<A, B> >
+		{
+			static const uint32_t Helpers = A::Helpers | B::Helpers | HelperUnion;
+			static const uint32_t Cost = A::Cost + B::Cost;
+			static const uint32_t GradientCost = A::GradientCost + B::GradientCost;
+			static const uint32_t Nodes = 1 + A::Nodes + B::Nodes;
+			A a;
+			B b;
+
+			UnionNode(const A& a, const B& b) : a(a), b(b) {}
+
+			template <class T>
+			T Evaluate(const Point<T>& p) const					{ return Min(a.Evaluate(p), b.Evaluate(p)); }
+
+			float Lipschitz(float radius) const					{ return std::max(a.Lipschitz(radius), b.Lipschitz(radius)); }
+
+			template <class T>
+			T Bound(const Point<T>& p) const					{ return Min(a.Bound(p), b.Bound(p)); }
+
+			// The gradient of whichever side min() picks.
+			template <class T>
+			T Gradient(const Point<T>& p, float epsilon, Point<T>& gradient) const
+			{
+				Point<T> ga, gb;
+				T da = a.Gradient(p, epsilon, ga);
+				T db = b.Gradient(p, epsilon, gb);
+				gradient = SelectPoint(Less(db, da), gb, ga);
+				return Min(da, db);
+			}
+
+			std::string Hlsl(const std::string& p) const		{ return "Union(" + a.Hlsl(p) + ", " + b.Hlsl(p) + ")"; }
+
+			std::string HlslDistance(HlslBlock& block, const std::string& p, uint32_t index) const
+			{
+				std::string da = block.Declare(a.HlslDistance(block, p, index + 1), index + 1);
+				std::string db = block.Declare(b.HlslDistance(block, p, index + 1 + A::Nodes), index + 1 + A::Nodes);
+				return "Union(" + da + ", " + db + ")";
+			}
+
+			void HlslGradientStatements(HlslBlock& block, const std::string& p, const std::string& epsilon, uint32_t index) const
+			{
+				block.Line("if (" + HlslBlock::Distance(index + 1 + A::Nodes) + " < " + HlslBlock::Distance(index + 1) + ")");
+				block.Open();
+				b.HlslGradientStatements(block, p, epsilon, index + 1 + A::Nodes);
+				block.Close();
+				block.Line("else");
+				block.Open();
+				a.HlslGradientStatements(block, p, epsilon, index + 1);
+				block.Close();
+			}
+		};
+
+		// a with b cut out of it.
+		template <class A, class B>
+		struct SubtractNode : Expression<SubtractNode<A, B> >
+		{
+			static const uint32_t Helpers = A::Helpers | B::Helpers | HelperSubtract;
+			static const uint32_t Cost = A::Cost + B::Cost;
+			static const uint32_t GradientCost = A::GradientCost + B::GradientCost;
+			static const uint32_t Nodes = 1 + A::Nodes + B::Nodes;
+			A a;
+			B b;
+
+			SubtractNode(const A& a, const B& b) : a(a), b(b) {}
+
+			template <class T>
+			T Evaluate(const Point<T>& p) const					{ return Max(T(0.0f) - b.Evaluate(p), a.Evaluate(p)); }
+
+			float Lipschitz(float radius) const					{ return std::max(a.Lipschitz(radius), b.Lipschitz(radius)); }
+
+			template <class T>
+			T Bound(const Point<T>& p) const					{ return Max(T(0.0f) - b.Bound(p), a.Bound(p)); }
+
+			template <class T>
+			T Gradient(const Point<T>& p, float epsilon, Point<T>& gradient) const
+			{
+				Point<T> ga, gb;
+				T da = a.Gradient(p, epsilon, ga);
+				T nb = T(0.0f) - b.Gradient(p, epsilon, gb);
+				gradient = SelectPoint(Less(nb, da), ga, Negate(gb));
+				return Max(nb, da);
+			}
+
+			std::string Hlsl(const std::string& p) const		{ return "Subtract(" + a.Hlsl(p) + ", " + b.Hlsl(p) + ")"; }
+
+			std::string HlslDistance(HlslBlock& block, const std::string& p, uint32_t index) const
+			{
+				std::string da = block.Declare(a.HlslDistance(block, p, index + 1), index + 1);
+				std::string db = block.Declare(b.HlslDistance(block, p, index + 1 + A::Nodes), index + 1 + A::Nodes);
+				return "Subtract(" + da + ", " + db + ")";
+			}
+
+			void HlslGradientStatements(HlslBlock& block, const std::string& p, const std::string& epsilon, uint32_t index) const
+			{
+				block.Line("if (-" + HlslBlock::Distance(index + 1 + A::Nodes) + " < " + HlslBlock::Distance(index + 1) + ")");
+				block.Open();
+				a.HlslGradientStatements(block, p, epsilon, index + 1);
+				block.Close();
+				block.Line("else");
+				block.Open();
+				b.HlslGradientStatements(block, p, epsilon, index + 1 + A::Nodes);
+				block.Line("gradient = -gradient;");
+				block.Close();
+			}
+		};
+
+		// softMin2: a union blended over a distance of k. Its gradient is a weighted average of the two
+		// sides' and it grows with both, so with bounds for a and b it is a bound itself.
+		template <class A, class B>
+		struct SoftUnionNode : Expression<SoftUnionNode<A, B> >
+		{
+			static const uint32_t Helpers = A::Helpers | B::Helpers | HelperSoftMin | HelperTetrahedral;
+			static const uint32_t Cost = A::Cost + B::Cost;
+			static const uint32_t GradientCost = 4 * Cost;
+			static const uint32_t Nodes = 1 + A::Nodes + B::Nodes;
+			A a;
+			B b;
+			float k;
+
+			SoftUnionNode(const A& a, const B& b, float k) : a(a), b(b), k(k) {}
+
+			template <class T>
+			static T Blend(const T& x, const T& y, float k)		{ return T(-0.5f) * (T(0.0f) - x - y + SoftAbs(x - y, k)); }
+
+			template <class T>
+			T Evaluate(const Point<T>& p) const					{ return Blend(a.Evaluate(p), b.Evaluate(p), k); }
+
+			float Lipschitz(float radius) const					{ return std::max(a.Lipschitz(radius), b.Lipschitz(radius)); }
+
+			template <class T>
+			T Bound(const Point<T>& p) const					{ return Blend(a.Bound(p), b.Bound(p), k); }
+
+			template <class T>
+			T Gradient(const Point<T>& p, float epsilon, Point<T>& gradient) const	{ return TetrahedralGradient(*this, p, epsilon, gradient); }
+
+			std::string Hlsl(const std::string& p) const		{ return "softMin2(" + a.Hlsl(p) + ", " + b.Hlsl(p) + ", " + Literal(k) + ")"; }
+			std::string HlslGradient(const std::string& p, const std::string& epsilon) const	{ return HlslTetrahedralGradient(*this, p, epsilon); }
+		};
+
+		// softMax2: an intersection blended over a distance of k. Like softMin2 it never steepens the
+		// field, so it is a bound wherever a and b are.
+		template <class A, class B>
+		struct SoftIntersectNode : Expression<SoftIntersectNode<A, B> >
+		{
+			static const uint32_t Helpers = A::Helpers | B::Helpers | HelperSoftMax | HelperTetrahedral;
+			static const uint32_t Cost = A::Cost + B::Cost;
+			static const uint32_t GradientCost = 4 * Cost;
+			static const uint32_t Nodes = 1 + A::Nodes + B::Nodes;
+			A a;
+			B b;
+			float k;
+
+			SoftIntersectNode(const A& a, const B& b, float k) : a(a), b(b), k(k) {}
+
+			template <class T>
+			static T Blend(const T& x, const T& y, float k)		{ return T(0.5f) * (x + y + SoftAbs(x - y, k)); }
+
+			template <class T>
+			T Evaluate(const Point<T>& p) const					{ return Blend(a.Evaluate(p), b.Evaluate(p), k); }
+
+			float Lipschitz(float radius) const					{ return std::max(a.Lipschitz(radius), b.Lipschitz(radius)); }
+
+			template <class T>
+			T Bound(const Point<T>& p) const					{ return Blend(a.Bound(p), b.Bound(p), k); }
+
+			template <class T>
+			T Gradient(const Point<T>& p, float epsilon, Point<T>& gradient) const	{ return TetrahedralGradient(*this, p, epsilon, gradient); }
+
+			std::string Hlsl(const std::string& p) const		{ return "softMax2(" + a.Hlsl(p) + ", " + b.Hlsl(p) + ", " + Literal(k) + ")"; }
+			std::string HlslGradient(const std::string& p, const std::string& epsilon) const	{ return HlslTetrahedralGradient(*this, p, epsilon); }
+		};
+
+		//------------------------------------------------------------------------------------------
+		// Operators on the point
+
+		// The shaders write Position + offset, so that is what offset means here too.
+		template <class A>
+		struct TranslateNode : Expression<TranslateNode<A> >
+		{
+			static const uint32_t Helpers = A::Helpers;
+			static const uint32_t Cost = A::Cost;
+			static const uint32_t GradientCost = A::GradientCost;
+			static const uint32_t Nodes = 1 + A::Nodes;
+			A a;
+			Sdf::float3 offset;
+
+			TranslateNode(const A& a, const Sdf::float3& offset) : a(a), offset(offset) {}
+
+			template <class T>
+			T Evaluate(const Point<T>& p) const
+			{
+				return a.Evaluate(MakePoint(p.x + T(offset.x), p.y + T(offset.y), p.z + T(offset.z)));
+			}
+
+			float Lipschitz(float radius) const					{ return a.Lipschitz(radius + Sdf::length(offset)); }
+
+			template <class T>
+			T Bound(const Point<T>& p) const
+			{
+				return a.Bound(MakePoint(p.x + T(offset.x), p.y + T(offset.y), p.z + T(offset.z)));
+			}
+
+			template <class T>
+			T Gradient(const Point<T>& p, float epsilon, Point<T>& gradient) const
+			{
+				return a.Gradient(MakePoint(p.x + T(offset.x), p.y + T(offset.y), p.z + T(offset.z)), epsilon, gradient);
+			}
+
+			std::string Hlsl(const std::string& p) const		{ return a.Hlsl("(" + p + " + " + Literal(offset) + ")"); }
+
+			std::string HlslDistance(HlslBlock& block, const std::string& p, uint32_t index) const
+			{
+				return a.HlslDistance(block, "(" + p + " + " + Literal(offset) + ")", index + 1);
+			}
+
+			void HlslGradientStatements(HlslBlock& block, const std::string& p, const std::string& epsilon, uint32_t index) const
+			{
+				a.HlslGradientStatements(block, "(" + p + " + " + Literal(offset) + ")", epsilon, index + 1);
+			}
+		};
+
+		// fmod(p, c) - 0.5 * c, repeating a every c. Like the shader, cells are only regular for p >= 0.
+		template <class A>
+		struct RepeatNode : Expression<RepeatNode<A> >
+		{
+			static const uint32_t Helpers = A::Helpers | HelperRepeat;
+			static const uint32_t Cost = A::Cost;
+			static const uint32_t GradientCost = A::GradientCost;
+			static const uint32_t Nodes = 1 + A::Nodes;
+			A a;
+			Sdf::float3 c;
+
+			RepeatNode(const A& a, const Sdf::float3& c) : a(a), c(c) {}
+
+			template <class T>
+			T Evaluate(const Point<T>& p) const
+			{
+				return a.Evaluate(MakePoint(
+					Fmod(p.x, T(c.x)) - T(0.5f * c.x),
+					Fmod(p.y, T(c.y)) - T(0.5f * c.y),
+					Fmod(p.z, T(c.z)) - T(0.5f * c.z)));
+			}
+
+			// Only holds within a cell. Across cell boundaries the distance jumps unless a fits in its cell.
+			float Lipschitz(float) const						{ return a.Lipschitz(1.5f * Sdf::length(c)); }
+
+			template <class T>
+			T Bound(const Point<T>& p) const
+			{
+				return a.Bound(MakePoint(
+					Fmod(p.x, T(c.x)) - T(0.5f * c.x),
+					Fmod(p.y, T(c.y)) - T(0.5f * c.y),
+					Fmod(p.z, T(c.z)) - T(0.5f * c.z)));
+			}
+
+			// fmod only shifts the point, so within a cell the gradient is the child's.
+			template <class T>
+			T Gradient(const Point<T>& p, float epsilon, Point<T>& gradient) const
+			{
+				return a.Gradient(MakePoint(
+					Fmod(p.x, T(c.x)) - T(0.5f * c.x),
+					Fmod(p.y, T(c.y)) - T(0.5f * c.y),
+					Fmod(p.z, T(c.z)) - T(0.5f * c.z)), epsilon, gradient);
+			}
+
+			std::string Hlsl(const std::string& p) const		{ return a.Hlsl("Repeat(" + p + ", " + Literal(c) + ")"); }
+
+			std::string HlslDistance(HlslBlock& block, const std::string& p, uint32_t index) const
+			{
+				return a.HlslDistance(block, "Repeat(" + p + ", " + Literal(c) + ")", index + 1);
+			}
+
+			void HlslGradientStatements(HlslBlock& block, const std::string& p, const std::string& epsilon, uint32_t index) const
+			{
+				a.HlslGradientStatements(block, "Repeat(" + p + ", " + Literal(c) + ")", epsilon, index + 1);
+			}
+		};
+
+		// Rotates xz by an angle that grows with y. The shader returns float3(rotated xz, p.y),
+		// which also swaps y and z, and so does this. The angle turns 10 radians per unit of y, so the
+		// twist stretches space by (rho + sqrt(rho^2 + 4)) / 2 with rho = 10 times the distance from the y axis.
+		template <class A>
+		struct TwistNode : Expression<TwistNode<A> >
+		{
+			static const uint32_t Helpers = A::Helpers | HelperTwist | HelperTetrahedral;
+			static const uint32_t Cost = A::Cost;
+			static const uint32_t GradientCost = 4 * Cost;
+			static const uint32_t Nodes = 1 + A::Nodes;
+			A a;
+
+			explicit TwistNode(const A& a) : a(a) {}
+
+			template <class T>
+			T Evaluate(const Point<T>& p) const
+			{
+				T angle = T(10.0f) * p.y + T(10.0f);
+				T c = Cos(angle);
+				T s = Sin(angle);
+				return a.Evaluate(MakePoint(c * p.x - s * p.z, s * p.x + c * p.z, p.y));
+			}
+
+			template <class T>
+			static T Stretch(const T& axisDistance)
+			{
+				T rho = T(10.0f) * axisDistance;
+				return T(0.5f) * (rho + Sqrt(rho * rho + T(4.0f)));
+			}
+
+			float Lipschitz(float radius) const					{ return Stretch(radius) * a.Lipschitz(radius); }
+
+			// A step s from p stays within |p.xz| + s of the axis, where the stretch is at most
+			// 10 (|p.xz| + s) + 1. The largest s that stretch cannot take past the child's bound d
+			// solves 10 s^2 + (10 |p.xz| + 1) s = |d|.
+			template <class T>
+			T Bound(const Point<T>& p) const
+			{
+				T angle = T(10.0f) * p.y + T(10.0f);
+				T c = Cos(angle);
+				T s = Sin(angle);
+				T d = a.Bound(MakePoint(c * p.x - s * p.z, s * p.x + c * p.z, p.y));
+
+				T linear = T(10.0f) * Sqrt(p.x * p.x + p.z * p.z) + T(1.0f);
+				T step = (Sqrt(linear * linear + T(40.0f) * Abs(d)) - linear) / T(20.0f);
+				return Select(Less(d, T(0.0f)), T(0.0f) - step, step);
+			}
+
+			template <class T>
+			T Gradient(const Point<T>& p, float epsilon, Point<T>& gradient) const	{ return TetrahedralGradient(*this, p, epsilon, gradient); }
+
+			std::string Hlsl(const std::string& p) const		{ return a.Hlsl("Twist(" + p + ")"); }
+			std::string HlslGradient(const std::string& p, const std::string& epsilon) const	{ return HlslTetrahedralGradient(*this, p, epsilon); }
+		};
+
+		//------------------------------------------------------------------------------------------
+		// Building expressions
+
+		inline SphereNode Sphere(float s)								{ return SphereNode(s); }
+		inline BoxNode Box(const Sdf::float3& b)						{ return BoxNode(b); }
+		inline TorusNode Torus(const Sdf::float2& t)					{ return TorusNode(t); }
+		inline CylinderNode Cylinder(const Sdf::float3& c)				{ return CylinderNode(c); }
+		inline CappedConeNode CappedCone(const Sdf::float3& c)			{ return CappedConeNode(c); }
+
+		template <class A>
+		NegateNode<A> operator-(const Expression<A>& a)					{ return NegateNode<A>(a.Self()); }
+
+		template <class A, class B>
+		UnionNode<A, B> Union(const Expression<A>& a, const Expression<B>& b)	{ return UnionNode<A, B>(a.Self(), b.Self()); }
+
+		template <class A, class B>
+		SubtractNode<A, B> Subtract(const Expression<A>& a, const Expression<B>& b)	{ return SubtractNode<A, B>(a.Self(), b.Self()); }
+
+		template <class A, class B>
+		SoftUnionNode<A, B> SoftUnion(const Expression<A>& a, const Expression<B>& b, float k)	{ return SoftUnionNode<A, B>(a.Self(), b.Self(), k); }
+
+		template <class A, class B>
+		SoftIntersectNode<A, B> SoftIntersect(const Expression<A>& a, const Expression<B>& b, float k)	{ return SoftIntersectNode<A, B>(a.Self(), b.Self(), k); }
+
+		template <class A>
+		TranslateNode<A> Translate(const Expression<A>& a, const Sdf::float3& offset)	{ return TranslateNode<A>(a.Self(), offset); }
+
+		template <class A>
+		RepeatNode<A> Repeat(const Expression<A>& a, const Sdf::float3& c)	{ return RepeatNode<A>(a.Self(), c); }
+
+		template <class A>
+		TwistNode<A> Twist(const Expression<A>& a)						{ return TwistNode<A>(a.Self()); }
+
+		//------------------------------------------------------------------------------------------
+		// Evaluating and generating
+
+		template <class E>
+		float Evaluate(const Expression<E>& e, const Sdf::float3& p)
+		{
+			return e.Self().Evaluate(MakePoint(p.x, p.y, p.z));
+		}
+
+		// Gradient length bound of e for points within radius of the origin, from its nodes.
+		template <class E>
+		float Lipschitz(const Expression<E>& e, float radius)
+		{
+			return e.Self().Lipschitz(radius);
+		}
+
+		template <class E>
+		float Bound(const Expression<E>& e, const Sdf::float3& p)
+		{
+			return e.Self().Bound(MakePoint(p.x, p.y, p.z));
+		}
+
+		// Unit normal at p. epsilon only matters for nodes without an analytic gradient, see NormalEpsilon.
+		template <class E>
+		Sdf::float3 Normal(const Expression<E>& e, const Sdf::float3& p, float epsilon)
+		{
+			Point<float> gradient;
+			e.Self().Gradient(MakePoint(p.x, p.y, p.z), epsilon, gradient);
+			return Sdf::normalize(Sdf::float3(gradient.x, gradient.y, gradient.z));
+		}
+
+		// Finite difference step for a hit t along the ray: about the width of a pixel there, so
+		// near hits keep their detail and far ones are not noisy. pixelAngle is the angle one pixel covers.
+		inline float NormalEpsilon(float t, float pixelAngle, float minimum)
+		{
+			return std::max(minimum, t * pixelAngle);
+		}
+
+		// Primitive evaluations per normal with central differences, tetrahedral sampling of the
+		// whole field, and Gradient.
+		template <class E>
+		uint32_t CentralDifferenceCost()	{ return 6 * E::Cost; }
+
+		template <class E>
+		uint32_t TetrahedralCost()			{ return 4 * E::Cost; }
+
+		template <class E>
+		uint32_t GradientCost()				{ return E::GradientCost; }
+
+		// Points and distances as separate arrays, a loop the compiler can vectorize.
+		template <class E>
+		void EvaluateBatch(const Expression<E>& e, const float* x, const float* y, const float* z, float* distance, size_t count)
+		{
+			const E& expression = e.Self();
+			for (size_t i = 0; i < count; i++)
+			{
+				distance[i] = expression.Evaluate(MakePoint(x[i], y[i], z[i]));
+			}
+		}
+
+		// The HLSL functions for helpers, the same code as in PillarPixelShader.hlsl.
+		inline std::string GenerateHlslHelpers(uint32_t helpers)
+		{
+			std::string source;
+
+			if (helpers & HelperSphere)
+				source += "float sdSphere(float3 p, float s)\n{\n\treturn length(p) - s;\n}\n\n";
+
+			if (helpers & HelperBox)
+				source += "float sdBox(float3 p, float3 b)\n{\n\tfloat3 d = abs(p) - b;\n\treturn min(max(d.x, max(d.y, d.z)), 0.0) + length(max(d, 0.0));\n}\n\n"
+					"float3 sdBoxGradient(float3 p, float3 b)\n{\n"
+					"\tfloat3 d = abs(p) - b;\n"
+					"\tfloat3 s = p < 0.0 ? -1.0 : 1.0;\n"
+					"\tfloat3 o = max(d, 0.0);\n"
+					"\tif (length(o) > 0.0)\n"
+					"\t\treturn s * o / length(o);\n"
+					"\treturn s * (d.x < d.y ? (d.y < d.z ? float3(0.0, 0.0, 1.0) : float3(0.0, 1.0, 0.0)) : (d.x < d.z ? float3(0.0, 0.0, 1.0) : float3(1.0, 0.0, 0.0)));\n}\n\n";
+
+			if (helpers & HelperTorus)
+				source += "float sdTorus(float3 p, float2 t)\n{\n\tfloat2 q = float2(length(p.xz) - t.x, p.y);\n\treturn length(q) - t.y;\n}\n\n"
+					"float3 sdTorusGradient(float3 p, float2 t)\n{\n"
+					"\tfloat ring = length(p.xz);\n"
+					"\tfloat2 q = float2(ring - t.x, p.y);\n"
+					"\treturn float3(p.x * q.x / ring, q.y, p.z * q.x / ring) / length(q);\n}\n\n";
+
+			if (helpers & HelperCylinder)
+				source += "float sdCylinder(float3 p, float3 c)\n{\n\treturn length(p.xz - c.xy) - c.z;\n}\n\n"
+					"float3 sdCylinderGradient(float3 p, float3 c)\n{\n\tfloat2 q = p.xz - c.xy;\n\treturn float3(q.x, 0.0, q.y) / length(q);\n}\n\n";
+
+			if (helpers & HelperCappedCone)
+				source += "float sdCappedCone(in float3 p, in float3 c)\n{\n"
+					"\tfloat2 q = float2(length(p.xz), p.y);\n"
+					"\tfloat2 v = float2(c.z*c.y / c.x, -c.z);\n"
+					"\tfloat2 w = v - q;\n"
+					"\tfloat2 vv = float2(dot(v, v), v.x*v.x);\n"
+					"\tfloat2 qv = float2(dot(v, w), v.x*w.x);\n"
+					"\tfloat2 d = max(qv, 0.0)*qv / vv;\n"
+					"\treturn sqrt(max(dot(w, w) - max(d.x, d.y), 0.0)) * sign(max(q.y*v.x - q.x*v.y, w.y));\n}\n\n";
+
+			if (helpers & (HelperSoftMin | HelperSoftMax))
+				source += "float softAbs2(float x, float a)\n{\n"
+					"\tfloat xx = 2.0*x / a;\n"
+					"\tfloat abs2 = abs(xx);\n"
+					"\tif (abs2<2.0)\n"
+					"\t\tabs2 = 0.5*xx*xx*(1.0 - abs2 / 6) + 2.0 / 3.0;\n"
+					"\treturn abs2 * a / 2.0;\n}\n\n";
+
+			if (helpers & HelperSoftMin)
+				source += "float softMin2(float x, float y, float a)\n{\n\treturn   -0.5*(-x - y + softAbs2(x - y, a));\n}\n\n";
+
+			if (helpers & HelperSoftMax)
+				source += "float softMax2(float x, float y, float a)\n{\n\treturn 0.5*(x + y + softAbs2(x - y, a));\n}\n\n";
+
+			if (helpers & HelperUnion)
+				source += "float Union(float d1, float d2)\n{\n\treturn min(d1, d2);\n}\n\n";
+
+			if (helpers & HelperSubtract)
+				source += "float Subtract(float d1, float d2)\n{\n\treturn max(-d2, d1);\n}\n\n";
+
+			if (helpers & HelperRepeat)
+				source += "float3 Repeat(float3 p, float3 c)\n{\n\treturn fmod(p, c) - 0.5*c;\n}\n\n";
+
+			if (helpers & HelperTwist)
+				source += "float3 Twist(float3 p)\n{\n"
+					"\tfloat  c = cos(10.0*p.y + 10.0);\n"
+					"\tfloat  s = sin(10.0*p.y + 10.0);\n"
+					"\tfloat2x2   m = float2x2(c, -s, s, c);\n"
+					"\treturn float3(mul(m, p.xz), p.y);\n}\n\n";
+
+			if (helpers & HelperTetrahedral)
+				source += "//Gradient from four samples at the corners of a tetrahedron epsilon from the point\n"
+					"float3 Tetrahedral(float a, float b, float c, float d, float epsilon)\n{\n"
+					"\treturn float3(a - b - c + d, c + d - a - b, b + d - a - c) * (0.25 / epsilon);\n}\n\n";
+
+			return source;
+		}
+
+		// float3 nameGradient(float3 p, float epsilon) returning the gradient of e, not normalized.
+		// The distances the unions and subtractions compare are computed first, each once, then
+		// only the branch that reaches the nearest primitive evaluates a gradient.
+		template <class E>
+		std::string GenerateHlslGradientFunction(const char* name, const Expression<E>& e)
+		{
+			HlslBlock block;
+			e.Self().HlslDistance(block, "p", 0);
+			block.Line("float3 gradient;");
+			e.Self().HlslGradientStatements(block, "p", "epsilon", 0);
+			block.Line("return gradient;");
+			return "float3 " + std::string(name) + "Gradient(float3 p, float epsilon)\n{\n" + block.source + "}\n\n";
+		}
+
+		// float name(float3 p) returning the distance of e, without the helpers it calls.
+		template <class E>
+		std::string GenerateHlslFunction(const char* name, const Expression<E>& e)
+		{
+			return "float " + std::string(name) + "(float3 p)\n{\n\treturn " + e.Self().Hlsl("p") + ";\n}\n\n";
+		}
+	}
+}
@@ -0,0 +1,112 @@
+﻿#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+// Minimal HLSL-like vector maths so the distance functions from the ray marching shaders
+// can be ported to the CPU line by line. Only depends on the standard library.
+namespace Mystery_Treasure_Chamber
+{
+	namespace Sdf
+	{
+		struct float2
+		{
+			float x, y;
+
+			float2() : x(0.0f), y(0.0f) {}
+			float2(float x, float y) : x(x), y(y) {}
+		};
+
+		struct float3
+		{
+			float x, y, z;
+
+			float3() : x(0.0f), y(0.0f), z(0.0f) {}
+			explicit float3(float s) : x(s), y(s), z(s) {}
+			float3(float x, float y, float z) : x(x), y(y), z(z) {}
+
+			float& operator[](int i)		{ return (&x)[i]; }
+			float operator[](int i) const	{ return (&x)[i]; }
+		};
+
+		struct float4
+		{
+			float x, y, z, w;
+
+			float4() : x(0.0f), y(0.0f), z(0.0f), w(0.0f) {}
+			float4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+			float4(const float3& v, float w) : x(v.x), y(v.y), z(v.z), w(w) {}
+		};
+
+		inline float4 operator+(const float4& a, const float4& b)	{ return float4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w); }
+		inline float4 operator*(const float4& a, const float4& b)	{ return float4(a.x * b.x, a.y * b.y, a.z * b.z, a.w * b.w); }
+		inline float4 operator*(const float4& a, float s)			{ return float4(a.x * s, a.y * s, a.z * s, a.w * s); }
+		inline float4 operator*(float s, const float4& a)			{ return a * s; }
+		inline float4& operator+=(float4& a, const float4& b)		{ a = a + b; return a; }
+
+		inline float2 operator+(const float2& a, const float2& b)	{ return float2(a.x + b.x, a.y + b.y); }
+		inline float2 operator-(const float2& a, const float2& b)	{ return float2(a.x - b.x, a.y - b.y); }
+		inline float2 operator*(const float2& a, float s)			{ return float2(a.x * s, a.y * s); }
+
+		inline float3 operator+(const float3& a, const float3& b)	{ return float3(a.x + b.x, a.y + b.y, a.z + b.z); }
+		inline float3 operator-(const float3& a, const float3& b)	{ return float3(a.x - b.x, a.y - b.y, a.z - b.z); }
+		inline float3 operator-(const float3& a)					{ return float3(-a.x, -a.y, -a.z); }
+		inline float3 operator*(const float3& a, const float3& b)	{ return float3(a.x * b.x, a.y * b.y, a.z * b.z); }
+		inline float3 operator/(const float3& a, const float3& b)	{ return float3(a.x / b.x, a.y / b.y, a.z / b.z); }
+		inline float3 operator*(const float3& a, float s)			{ return float3(a.x * s, a.y * s, a.z * s); }
+		inline float3 operator*(float s, const float3& a)			{ return float3(a.x * s, a.y * s, a.z * s); }
+		inline float3 operator/(const float3& a, float s)			{ return float3(a.x / s, a.y / s, a.z / s); }
+		inline float3& operator+=(float3& a, const float3& b)		{ a.x += b.x; a.y += b.y; a.z += b.z; return a; }
+
+		inline float dot(const float2& a, const float2& b)			{ return a.x * b.x + a.y * b.y; }
+		inline float dot(const float3& a, const float3& b)			{ return a.x * b.x + a.y * b.y + a.z * b.z; }
+		inline float length(const float2& a)						{ return std::sqrt(dot(a, a)); }
+		inline float length(const float3& a)						{ return std::sqrt(dot(a, a)); }
+		inline float3 normalize(const float3& a)					{ return a / length(a); }
+
+		inline float3 cross(const float3& a, const float3& b)
+		{
+			return float3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+		}
+
+		inline float3 abs(const float3& a)							{ return float3(std::fabs(a.x), std::fabs(a.y), std::fabs(a.z)); }
+		inline float3 min(const float3& a, const float3& b)			{ return float3(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z)); }
+		inline float3 max(const float3& a, const float3& b)			{ return float3(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z)); }
+		inline float3 max(const float3& a, float s)					{ return max(a, float3(s)); }
+		inline float2 max(const float2& a, float s)					{ return float2(std::max(a.x, s), std::max(a.y, s)); }
+
+		inline float clamp(float x, float lo, float hi)				{ return std::min(std::max(x, lo), hi); }
+		inline float saturate(float x)								{ return clamp(x, 0.0f, 1.0f); }
+		inline float lerp(float a, float b, float t)				{ return a + (b - a) * t; }
+
+		inline float3 reflect(const float3& i, const float3& n)		{ return i - 2.0f * dot(n, i) * n; }
+
+		// Row major, used with row vectors like DirectXMath: mul(v, m) transforms v by m.
+		struct float4x4
+		{
+			float m[4][4];
+		};
+
+		inline float4 mul(const float4& v, const float4x4& a)
+		{
+			return float4(
+				v.x * a.m[0][0] + v.y * a.m[1][0] + v.z * a.m[2][0] + v.w * a.m[3][0],
+				v.x * a.m[0][1] + v.y * a.m[1][1] + v.z * a.m[2][1] + v.w * a.m[3][1],
+				v.x * a.m[0][2] + v.y * a.m[1][2] + v.z * a.m[2][2] + v.w * a.m[3][2],
+				v.x * a.m[0][3] + v.y * a.m[1][3] + v.z * a.m[2][3] + v.w * a.m[3][3]);
+		}
+
+		inline float4x4 mul(const float4x4& a, const float4x4& b)
+		{
+			float4x4 r;
+			for (int i = 0; i < 4; i++)
+			{
+				for (int j = 0; j < 4; j++)
+				{
+					r.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j] + a.m[i][3] * b.m[3][j];
+				}
+			}
+			return r;
+		}
+	}
+}
@@ -0,0 +1,31 @@
+﻿#include "SdfScene.h"
+
+#include <cstdio>
+
+using namespace Mystery_Treasure_Chamber;
+
+std::string SdfScene::GenerateHlsl()
+{
+	auto room = Room();
+	auto pillars = Pillars();
+
+	std::string source =
+		"//Generated by SdfScene::WriteHlsl from Content/SdfScene.h, edit the scene there and generate it again.\n\n";
+	source += SdfExpression::GenerateHlslHelpers(decltype(room)::Helpers | decltype(pillars)::Helpers);
+	source += SdfExpression::GenerateHlslFunction("room", room);
+	source += SdfExpression::GenerateHlslFunction("pillars", pillars);
+	source += SdfExpression::GenerateHlslGradientFunction("room", room);
+	source += SdfExpression::GenerateHlslGradientFunction("pillars", pillars);
+	return source;
+}
+
+bool SdfScene::WriteHlsl(const char* path)
+{
+	FILE* file = std::fopen(path, "wb");
+	if (file == nullptr)
+		return false;
+
+	std::string source = GenerateHlsl();
+	bool written = std::fwrite(source.data(), 1, source.size(), file) == source.size();
+	return std::fclose(file) == 0 && written;
+}
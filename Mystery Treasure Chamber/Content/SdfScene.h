@@ -0,0 +1,51 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "SdfExpression.h"
+
+namespace Mystery_Treasure_Chamber
+{
+	// The room and the pillars written once as SDF expressions. SdfScene.hlsli, which the room,
+	// pillar and fused pixel shaders include, is generated from these by GenerateHlsl.
+	namespace SdfScene
+	{
+		inline auto Room()
+		{
+			using namespace SdfExpression;
+			return -Box(Sdf::float3(5.0f, 5.0f, 5.0f));
+		}
+
+		// The pillars are infinite along y, each translated by one of these offsets, so one stands
+		// at -offset.
+		const float PillarRadius = 0.5f;
+		const uint32_t PillarCount = 4;
+		const Sdf::float3 PillarOffsets[PillarCount] =
+		{
+			Sdf::float3(3.5f, 0.0f, 3.5f),
+			Sdf::float3(-3.5f, 0.0f, 3.5f),
+			Sdf::float3(-3.5f, 0.0f, 0.0f),
+			Sdf::float3(3.5f, 0.0f, 0.0f),
+		};
+
+		inline auto Pillars()
+		{
+			using namespace SdfExpression;
+			CylinderNode pillar(Sdf::float3(0.0f, 0.0f, PillarRadius));
+
+			return Union(Union(Union(
+				Translate(pillar, PillarOffsets[0]),
+				Translate(pillar, PillarOffsets[1])),
+				Translate(pillar, PillarOffsets[2])),
+				Translate(pillar, PillarOffsets[3]));
+		}
+
+		// The contents of SdfScene.hlsli: the helpers the scene needs, then room() and pillars() and
+		// their gradients roomGradient() and pillarsGradient().
+		std::string GenerateHlsl();
+
+		// Writes GenerateHlsl() to path. Run it after changing the scene and commit the result.
+		bool WriteHlsl(const char* path);
+	}
+}
@@ -0,0 +1,115 @@
+﻿#include "ShaderPermutations.h"
+
+#include <sstream>
+
+using namespace Mystery_Treasure_Chamber;
+
+namespace
+{
+	bool Satisfies(uint32_t key, uint32_t required)
+	{
+		return key == 0 || key >= required;
+	}
+
+	// Shading cost grows with lights times steps. Keys the shader does not have cost nothing.
+	uint64_t Cost(const PermutationKeys& keys)
+	{
+		uint64_t lights = keys.lights > 0 ? keys.lights : 1;
+		uint64_t steps = keys.marchSteps > 0 ? keys.marchSteps : 1;
+		return lights * steps;
+	}
+
+	bool Cheaper(const PermutationKeys& a, const PermutationKeys& b)
+	{
+		if (Cost(a) != Cost(b))
+			return Cost(a) < Cost(b);
+		if (a.lights != b.lights)
+			return a.lights < b.lights;
+		return a.marchSteps < b.marchSteps;
+	}
+}
+
+bool ShaderPermutations::Load(std::istream& stream)
+{
+	m_tiers.clear();
+	m_variants.clear();
+
+	std::string line;
+	while (std::getline(stream, line))
+	{
+		std::istringstream words(line);
+		std::string kind;
+		if (!(words >> kind) || kind[0] == '#')
+			continue;
+
+		bool parsed = false;
+		if (kind == "tier")
+		{
+			QualityTier tier;
+			parsed = static_cast<bool>(words >> tier.name >> tier.keys.lights >> tier.keys.marchSteps);
+			if (parsed)
+				m_tiers.push_back(tier);
+		}
+		else if (kind == "variant")
+		{
+			ShaderVariant variant;
+			std::string file;
+			parsed = static_cast<bool>(words >> variant.shader >> variant.keys.lights >> variant.keys.marchSteps >> file);
+			if (parsed)
+			{
+				variant.file.assign(file.begin(), file.end());
+				m_variants.push_back(variant);
+			}
+		}
+
+		if (!parsed)
+		{
+			m_tiers.clear();
+			m_variants.clear();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+const ShaderVariant* ShaderPermutations::Select(const std::string& shader, const PermutationKeys& required) const
+{
+	const ShaderVariant* best = nullptr;
+	const ShaderVariant* largest = nullptr;
+	for (const ShaderVariant& variant : m_variants)
+	{
+		if (variant.shader != shader)
+			continue;
+
+		if (!largest || Cheaper(largest->keys, variant.keys))
+			largest = &variant;
+
+		if (Satisfies(variant.keys.lights, required.lights) && Satisfies(variant.keys.marchSteps, required.marchSteps) &&
+			(!best || Cheaper(variant.keys, best->keys)))
+		{
+			best = &variant;
+		}
+	}
+
+	return best ? best : largest;
+}
+
+const ShaderVariant* ShaderPermutations::Select(const std::string& shader, uint32_t tier) const
+{
+	if (tier >= m_tiers.size())
+		return nullptr;
+
+	return Select(shader, m_tiers[tier].keys);
+}
+
+uint32_t ShaderPermutations::FindTier(const std::string& name) const
+{
+	for (uint32_t i = 0; i < m_tiers.size(); i++)
+	{
+		if (m_tiers[i].name == name)
+			return i;
+	}
+
+	return GetTierCount();
+}
@@ -0,0 +1,62 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace Mystery_Treasure_Chamber
+{
+	// What a shader variant was compiled for. 0 means the shader has no such key, which matches
+	// anything.
+	struct PermutationKeys
+	{
+		uint32_t	lights;			// NUMLIGHTS, lights in the shading loops.
+		uint32_t	marchSteps;		// INTERVALS, fixed steps of the ray marching.
+	};
+
+	// A quality tier is the least each shader must do at that tier.
+	struct QualityTier
+	{
+		std::string		name;
+		PermutationKeys	keys;
+	};
+
+	// One compiled variant of a shader, see Permutations\.
+	struct ShaderVariant
+	{
+		std::string		shader;		// Name of the .hlsl file the variant is built from, without extension.
+		PermutationKeys	keys;
+		std::wstring	file;		// Compiled bytecode.
+	};
+
+	// The index of Assets\Shaders\Permutations.txt. Each line is a comment starting with #, or
+	//     tier <name> <lights> <march steps>
+	//     variant <shader> <lights> <march steps> <file>
+	// with tiers listed from the lowest quality up. New tiers and variants only need a line here and
+	// a wrapper in Permutations\ that defines the keys and includes the shader.
+	class ShaderPermutations
+	{
+	public:
+		// Replaces the index. Returns false and leaves it empty if a line does not parse.
+		bool Load(std::istream& stream);
+
+		// The cheapest variant of shader that does at least what required asks for. If none does,
+		// the most capable one. nullptr if the shader has no variants.
+		const ShaderVariant* Select(const std::string& shader, const PermutationKeys& required) const;
+
+		// Select with the keys of a tier.
+		const ShaderVariant* Select(const std::string& shader, uint32_t tier) const;
+
+		uint32_t GetTierCount() const							{ return static_cast<uint32_t>(m_tiers.size()); }
+		const QualityTier& GetTier(uint32_t tier) const			{ return m_tiers[tier]; }
+		const std::vector<ShaderVariant>& GetVariants() const	{ return m_variants; }
+
+		// Index of the tier called name, or GetTierCount() if there is none.
+		uint32_t FindTier(const std::string& name) const;
+
+	private:
+		std::vector<QualityTier>	m_tiers;
+		std::vector<ShaderVariant>	m_variants;
+	};
+}
@@ -51,6 +51,95 @@ namespace Mystery_Treasure_Chamber
 		DirectX::XMFLOAT2 padding;
 	};
 
+	// Selects how many pixels the ray marching passes march, see RaymarchResolution, whether
+	// they start from the cone march prepass's bounds, which part of the proxy pillar pass
+	// is drawn, see ProxyPass, and how many of the first lights come from the lightmap.
+	struct RaymarchConstantBuffer
+	{
+		uint32 mode;
+		uint32 hasBackground;
+		uint32 coneBounded;
+		uint32 proxyPass;
+		uint32 bakedLights;
+		DirectX::XMFLOAT3 padding;
+	};
+
+	enum class ProxyPass : uint32
+	{
+		None,		// The pillar pass marches every pixel of the canvas quad.
+		Background,	// The canvas quad only copies the room.
+		March,		// The proxy boxes march the pixels they cover.
+	};
+
+	// Last frame's camera, used to reproject ray marching history.
+	struct TemporalConstantBuffer
+	{
+		DirectX::XMFLOAT4 previousEye;
+		float previousNearPlane;
+		uint32 frameIndex;
+		uint32 cameraChanged;
+		float padding;
+	};
+
+	// Raster camera for the depth tested ray marching.
+	struct DepthConstantBuffer
+	{
+		DirectX::XMFLOAT4X4 viewProjection;
+		DirectX::XMFLOAT4X4 inverseViewProjection;
+		uint32 depthTested;
+		DirectX::XMFLOAT3 padding;
+	};
+
+	// Pillar grid of the colonnade pass, see ColonnadeLayout.
+	struct ColonnadeConstantBuffer
+	{
+		uint32 pillarsPerSide;
+		float spacing;
+		float radius;
+		float jitter;
+		DirectX::XMFLOAT4 hallSize;
+	};
+
+	// Boxes of the proxy pillar pass, see RaymarchProxies.
+	struct ProxyConstantBuffer
+	{
+		DirectX::XMFLOAT4 minimum[16];
+		DirectX::XMFLOAT4 maximum[16];
+	};
+
+	// Canvas camera the light clusters were built for, see LightClusters.
+	struct ClusterConstantBuffer
+	{
+		DirectX::XMFLOAT4 eye;		// nearPlane in w.
+		DirectX::XMFLOAT4 canvas;	// Half extents of the canvas, slices per log depth and LightClusters::NearDepth.
+		uint32 tilesX;
+		uint32 tilesY;
+		uint32 slices;
+		float axis;
+	};
+
+	// Screen space tessellation of the floor, see FloorTessellation.
+	struct TessellationConstantBuffer
+	{
+		DirectX::XMFLOAT3 eye;
+		float screenScale;		// Pixels covered by one unit at distance one.
+		float targetPixels;		// 0 for maxFactor everywhere.
+		float maxFactor;
+		float displacementLow;	// Most the floor moves along y, down and up.
+		float displacementHigh;
+		float maxSlope;
+		uint32 patchRanges;		// 1 when the hull shader's buffer holds each patch's displacement range.
+		DirectX::XMFLOAT2 padding;
+	};
+
+	// Irradiance probes blended at the object being drawn, see IrradianceProbes.
+	struct ProbeConstantBuffer
+	{
+		DirectX::XMFLOAT4 sh[9];	// Irradiance coefficients in rgb.
+		uint32 probeLights;			// Scene lights the probes hold, 0 with the probes off.
+		DirectX::XMFLOAT3 padding;
+	};
+
 	struct Particle {
 		DirectX::XMFLOAT3 position;
 		DirectX::XMFLOAT3 speed;
@@ -0,0 +1,156 @@
+﻿#include "TemporalReprojection.h"
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+float3 RaymarchCamera::Ray(float x, float y) const
+{
+	// Same as the canvas vertex shader: canvasXY spans [-width, width] x [-height, height], y up.
+	float canvasX = (2.0f * x / width - 1.0f) * width;
+	float canvasY = (1.0f - 2.0f * y / height) * height;
+
+	float3 PixelPos(zoom * canvasX, zoom * canvasY, nearPlane);
+	return normalize(PixelPos - eye);
+}
+
+bool RaymarchCamera::Project(const float3& Position, float& x, float& y) const
+{
+	// Intersect the line from the eye to Position with the canvas plane.
+	float3 d = Position - eye;
+	if (d.z == 0.0f)
+		return false;
+
+	float s = (nearPlane - eye.z) / d.z;
+	if (s <= 0.0f)
+		return false;
+
+	float canvasX = (eye.x + s * d.x) / zoom;
+	float canvasY = (eye.y + s * d.y) / zoom;
+
+	x = (canvasX / width + 1.0f) * 0.5f * width;
+	y = (1.0f - canvasY / height) * 0.5f * height;
+	return true;
+}
+
+bool RaymarchCamera::operator==(const RaymarchCamera& other) const
+{
+	return eye.x == other.eye.x && eye.y == other.eye.y && eye.z == other.eye.z &&
+		nearPlane == other.nearPlane && zoom == other.zoom &&
+		width == other.width && height == other.height;
+}
+
+bool TemporalReprojection::IsRefreshed(uint32_t x, uint32_t y, uint32_t frameIndex)
+{
+	// A 4x4 pattern, so each frame refreshes pixels spread evenly over the screen.
+	return (x & 3) + 4 * (y & 3) == frameIndex % RefreshPeriod;
+}
+
+bool TemporalReprojection::IsEdge(const std::vector<RaymarchSample>& history, uint32_t width, uint32_t height, uint32_t x, uint32_t y)
+{
+	const RaymarchSample& center = history[y * width + x];
+	const int offsets[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+	for (const int* offset : offsets)
+	{
+		int nx = static_cast<int>(x) + offset[0];
+		int ny = static_cast<int>(y) + offset[1];
+		if (nx < 0 || ny < 0 || nx >= static_cast<int>(width) || ny >= static_cast<int>(height))
+			continue;
+
+		const RaymarchSample& neighbour = history[ny * width + nx];
+		if (neighbour.depth < 0.0f ||
+			std::fabs(neighbour.depth - center.depth) > EdgeDepthTolerance * center.depth ||
+			dot(neighbour.normal, center.normal) < EdgeNormalTolerance)
+			return true;
+	}
+	return false;
+}
+
+bool TemporalReprojection::Reproject(const RaymarchCamera& previous,
+	const RaymarchCamera& current,
+	const std::vector<RaymarchSample>& history,
+	uint32_t x,
+	uint32_t y,
+	uint32_t frameIndex,
+	RaymarchSample& result)
+{
+	if (IsRefreshed(x, y, frameIndex))
+		return false;
+
+	uint32_t width = static_cast<uint32_t>(current.width);
+	uint32_t height = static_cast<uint32_t>(current.height);
+	const RaymarchSample& same = history[y * width + x];
+
+	// Nothing moved, so last frame's pixel is exactly right, misses included.
+	if (previous == current)
+	{
+		result = same;
+		return true;
+	}
+
+	// Without the new hit distance, guess it from last frame's pixel at the same place.
+	if (same.depth < 0.0f)
+		return false;
+
+	float3 direction = current.Ray(x + 0.5f, y + 0.5f);
+	float3 guess = current.eye + direction * same.depth;
+
+	float px, py;
+	if (!previous.Project(guess, px, py) || px < 0.0f || py < 0.0f || px >= width || py >= height)
+		return false;
+
+	const RaymarchSample& candidate = history[static_cast<uint32_t>(py) * width + static_cast<uint32_t>(px)];
+	if (candidate.depth < 0.0f || IsEdge(history, width, height, static_cast<uint32_t>(px), static_cast<uint32_t>(py)))
+		return false;
+
+	// Where last frame actually hit, and whether that point is on the new ray.
+	float3 hit = previous.eye + previous.Ray(std::floor(px) + 0.5f, std::floor(py) + 0.5f) * candidate.depth;
+	float3 toHit = hit - current.eye;
+	float along = dot(toHit, direction);
+	if (along <= 0.0f)
+		return false;
+
+	// One pixel covers 2 * zoom of the canvas, which is this far from the eye along the ray.
+	float pixelAngle = 2.0f * current.zoom * std::fabs(direction.z) / std::fabs(current.nearPlane - current.eye.z);
+
+	float off = length(cross(toHit, direction));
+	if (off > RayTolerance * pixelAngle * along)
+		return false;
+
+	// Surfaces facing away from the new eye were not visible from it.
+	if (dot(candidate.normal, direction) >= 0.0f)
+		return false;
+
+	result.color = candidate.color;
+	result.normal = candidate.normal;
+	result.depth = along;
+	return true;
+}
+
+uint32_t TemporalReprojection::ReprojectFrame(const RaymarchCamera& previous,
+	const RaymarchCamera& current,
+	const std::vector<RaymarchSample>& history,
+	uint32_t frameIndex,
+	std::vector<RaymarchSample>& output,
+	std::vector<bool>& remarch)
+{
+	uint32_t width = static_cast<uint32_t>(current.width);
+	uint32_t height = static_cast<uint32_t>(current.height);
+
+	output.resize(width * height);
+	remarch.assign(width * height, false);
+
+	uint32_t count = 0;
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			if (!Reproject(previous, current, history, x, y, frameIndex, output[y * width + x]))
+			{
+				remarch[y * width + x] = true;
+				count++;
+			}
+		}
+	}
+
+	return count;
+}
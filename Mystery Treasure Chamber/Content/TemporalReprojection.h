@@ -0,0 +1,71 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "SdfMath.h"
+#include "RaymarchReconstruction.h"
+
+namespace Mystery_Treasure_Chamber
+{
+	// The camera the ray marching shaders use: rays start at the eye and go through a canvas
+	// at z = nearPlane, scaled by zoom (see main() in RoomPixelShader.hlsl).
+	struct RaymarchCamera
+	{
+		Sdf::float3	eye;
+		float		nearPlane;
+		float		zoom;
+		float		width;
+		float		height;
+
+		// Direction of the ray through pixel coordinates (x, y), measured from the top left corner.
+		Sdf::float3 Ray(float x, float y) const;
+
+		// Pixel coordinates Position is seen at. Returns false if it is behind the eye.
+		bool Project(const Sdf::float3& Position, float& x, float& y) const;
+
+		bool operator==(const RaymarchCamera& other) const;
+	};
+
+	// CPU reference of ReprojectPixelShader.hlsl. A pixel reuses last frame's result when the
+	// surface it saw, moved into the new camera, still lies on the new ray and faces the eye.
+	namespace TemporalReprojection
+	{
+		// Every pixel is marched again once per this many frames even if its history is valid.
+		const uint32_t RefreshPeriod = 16;
+
+		// How far off the new ray a reprojected hit may be, in pixels.
+		const float RayTolerance = 1.0f;
+
+		// Relative hit distance difference and normal dot product at which last frame's pixel is on
+		// an edge with its neighbour. Edge pixels are not reused, since which side of the edge the
+		// new ray falls on is only known by marching it.
+		const float EdgeDepthTolerance = 0.05f;
+		const float EdgeNormalTolerance = 0.9f;
+
+		// Whether pixel (x, y) of history is next to a miss or another surface.
+		bool IsEdge(const std::vector<RaymarchSample>& history, uint32_t width, uint32_t height, uint32_t x, uint32_t y);
+
+		// Whether pixel (x, y) is due for a refresh this frame.
+		bool IsRefreshed(uint32_t x, uint32_t y, uint32_t frameIndex);
+
+		// Tries to reuse history for pixel (x, y). On success result holds the colour and geometry
+		// seen from the current camera.
+		bool Reproject(const RaymarchCamera& previous,
+			const RaymarchCamera& current,
+			const std::vector<RaymarchSample>& history,
+			uint32_t x,
+			uint32_t y,
+			uint32_t frameIndex,
+			RaymarchSample& result);
+
+		// Reprojects a whole frame. remarch is set for every pixel that has to be marched again and
+		// the number of those pixels is returned.
+		uint32_t ReprojectFrame(const RaymarchCamera& previous,
+			const RaymarchCamera& current,
+			const std::vector<RaymarchSample>& history,
+			uint32_t frameIndex,
+			std::vector<RaymarchSample>& output,
+			std::vector<bool>& remarch);
+	}
+}
@@ -0,0 +1,104 @@
+﻿#include "TileRenderer.h"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace Mystery_Treasure_Chamber;
+
+namespace
+{
+	// The coarsest block size, tiles are a multiple of it so blocks never straddle two tiles.
+	const uint32_t LargestBlock = 4;
+}
+
+TileRenderer::TileRenderer(uint32_t threadCount, uint32_t tileSize) :
+	m_pool(threadCount),
+	m_tileSize(std::max(LargestBlock, (tileSize + LargestBlock - 1) / LargestBlock * LargestBlock))
+{
+}
+
+uint32_t TileRenderer::GetStageCount(RefinementMode mode)
+{
+	return mode == RefinementMode::Progressive ? 3 : 1;
+}
+
+uint32_t TileRenderer::GetBlockSize(RefinementMode mode, uint32_t stage)
+{
+	if (mode != RefinementMode::Progressive)
+		return 1;
+
+	// 1/16, 1/4 and then all of the rays.
+	static const uint32_t sizes[3] = { 4, 2, 1 };
+	return sizes[std::min(stage, 2u)];
+}
+
+uint32_t TileRenderer::Render(PacketRaymarch::SimdLevel level,
+	const RaymarchCamera& camera,
+	const RaymarchLighting& lighting,
+	RefinementMode mode,
+	std::vector<RaymarchSample>& image,
+	const std::atomic<bool>* cancel,
+	const std::function<void(uint32_t stage)>& onStage)
+{
+	uint32_t width = static_cast<uint32_t>(camera.width);
+	uint32_t height = static_cast<uint32_t>(camera.height);
+	uint32_t tilesX = (width + m_tileSize - 1) / m_tileSize;
+	uint32_t tilesY = (height + m_tileSize - 1) / m_tileSize;
+	uint32_t tileCount = tilesX * tilesY;
+	uint32_t stageCount = GetStageCount(mode);
+
+	image.resize(width * height);
+	m_tileCosts.assign(tileCount * stageCount, TileCost());
+	m_threadMilliseconds.assign(GetThreadCount(), 0.0);
+
+	for (uint32_t stage = 0; stage < stageCount; stage++)
+	{
+		uint32_t blockSize = GetBlockSize(mode, stage);
+
+		// A coarse pass writes every pixel of its blocks, so the image is complete after each pass.
+		m_pool.Run(tileCount, [&](uint32_t index, uint32_t thread)
+		{
+			TileCost& cost = m_tileCosts[stage * tileCount + index];
+			cost.x = (index % tilesX) * m_tileSize;
+			cost.y = (index / tilesX) * m_tileSize;
+			cost.width = std::min(m_tileSize, width - cost.x);
+			cost.height = std::min(m_tileSize, height - cost.y);
+			cost.stage = stage;
+			cost.thread = thread;
+
+			if (cancel != nullptr && *cancel)
+				return;
+
+			auto start = std::chrono::steady_clock::now();
+			PacketRaymarch::RenderTile(level, camera, lighting, cost.x, cost.y, cost.width, cost.height, blockSize, image.data());
+			auto end = std::chrono::steady_clock::now();
+
+			cost.milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+			m_threadMilliseconds[thread] += cost.milliseconds;
+		});
+
+		// Part of this pass may have been skipped, the earlier passes are what is complete.
+		if (cancel != nullptr && *cancel)
+			return stage;
+
+		if (onStage)
+			onStage(stage);
+	}
+
+	return stageCount;
+}
+
+double TileRenderer::GetImbalance() const
+{
+	double total = 0.0, busiest = 0.0;
+	for (double milliseconds : m_threadMilliseconds)
+	{
+		total += milliseconds;
+		busiest = std::max(busiest, milliseconds);
+	}
+
+	if (total <= 0.0)
+		return 1.0;
+
+	return busiest * m_threadMilliseconds.size() / total;
+}
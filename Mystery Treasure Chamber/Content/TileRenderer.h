@@ -0,0 +1,74 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "PacketRaymarch.h"
+#include "WorkStealingPool.h"
+
+namespace Mystery_Treasure_Chamber
+{
+	// How a frame is built up.
+	enum class RefinementMode : uint32_t
+	{
+		Full = 0,			// One pass at full resolution.
+		Progressive = 1,	// One ray per 4x4 block, then per 2x2 block, then per pixel.
+	};
+
+	// What one tile of one pass cost.
+	struct TileCost
+	{
+		uint32_t	x;
+		uint32_t	y;
+		uint32_t	width;
+		uint32_t	height;
+		uint32_t	stage;
+		uint32_t	thread;
+		double		milliseconds;
+	};
+
+	// Renders the ray marched scene on the CPU in parallel. The frame is cut into square tiles
+	// that are traced with PacketRaymarch on a work stealing pool.
+	class TileRenderer
+	{
+	public:
+		// threadCount 0 uses one thread per hardware thread.
+		TileRenderer(uint32_t threadCount, uint32_t tileSize);
+
+		// Renders a frame into image. onStage, if set, is called after each pass with its index, when
+		// image holds that pass's result. Setting cancel stops the frame after the tiles in flight,
+		// leaving the last finished pass in image. Returns how many passes finished.
+		uint32_t Render(PacketRaymarch::SimdLevel level,
+			const RaymarchCamera& camera,
+			const RaymarchLighting& lighting,
+			RefinementMode mode,
+			std::vector<RaymarchSample>& image,
+			const std::atomic<bool>* cancel,
+			const std::function<void(uint32_t stage)>& onStage);
+
+		static uint32_t GetStageCount(RefinementMode mode);
+
+		// Pixels per side of the blocks that share one ray in a pass.
+		static uint32_t GetBlockSize(RefinementMode mode, uint32_t stage);
+
+		uint32_t GetThreadCount() const						{ return m_pool.GetThreadCount(); }
+		uint64_t GetSteals() const							{ return m_pool.GetSteals(); }
+
+		// Every tile of the last frame, in the order of the passes and the tiles within them.
+		const std::vector<TileCost>& GetTileCosts() const	{ return m_tileCosts; }
+
+		// Time each thread spent tracing in the last frame.
+		const std::vector<double>& GetThreadMilliseconds() const	{ return m_threadMilliseconds; }
+
+		// The busiest thread's time over the average of all of them, 1 when the work was spread evenly.
+		double GetImbalance() const;
+
+	private:
+		WorkStealingPool		m_pool;
+		uint32_t				m_tileSize;
+		std::vector<TileCost>	m_tileCosts;
+		std::vector<double>		m_threadMilliseconds;
+	};
+}
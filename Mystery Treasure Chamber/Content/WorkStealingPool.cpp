@@ -0,0 +1,135 @@
+﻿#include "WorkStealingPool.h"
+
+#include <algorithm>
+
+using namespace Mystery_Treasure_Chamber;
+
+WorkStealingPool::WorkStealingPool(uint32_t threadCount) :
+	m_task(nullptr),
+	m_generation(0),
+	m_busyThreads(0),
+	m_remaining(0),
+	m_steals(0),
+	m_stop(false)
+{
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	for (uint32_t i = 0; i < threadCount; i++)
+	{
+		m_queues.push_back(std::unique_ptr<Queue>(new Queue()));
+	}
+
+	for (uint32_t i = 0; i < threadCount; i++)
+	{
+		m_threads.push_back(std::thread(&WorkStealingPool::Work, this, i));
+	}
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+
+	for (auto& thread : m_threads)
+	{
+		thread.join();
+	}
+}
+
+void WorkStealingPool::Run(uint32_t count, const std::function<void(uint32_t index, uint32_t thread)>& task)
+{
+	if (count == 0)
+		return;
+
+	// Neighbouring indices go to the same thread, which keeps neighbouring tiles together.
+	uint32_t threadCount = GetThreadCount();
+	for (uint32_t thread = 0; thread < threadCount; thread++)
+	{
+		uint32_t first = static_cast<uint32_t>(static_cast<uint64_t>(count) * thread / threadCount);
+		uint32_t last = static_cast<uint32_t>(static_cast<uint64_t>(count) * (thread + 1) / threadCount);
+
+		std::lock_guard<std::mutex> lock(m_queues[thread]->mutex);
+		for (uint32_t index = first; index < last; index++)
+		{
+			m_queues[thread]->tasks.push_back(index);
+		}
+	}
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_task = &task;
+	m_remaining = count;
+	m_busyThreads = threadCount;
+	m_generation++;
+	m_wake.notify_all();
+
+	// Every thread has to be out of the task too, so none of them can still be holding it on return.
+	m_done.wait(lock, [this] { return m_remaining == 0 && m_busyThreads == 0; });
+	m_task = nullptr;
+}
+
+void WorkStealingPool::Work(uint32_t thread)
+{
+	uint64_t generation = 0;
+
+	for (;;)
+	{
+		const std::function<void(uint32_t, uint32_t)>* task;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [&] { return m_stop || m_generation != generation; });
+			if (m_stop)
+				return;
+
+			generation = m_generation;
+			task = m_task;
+		}
+
+		uint32_t index;
+		while (Take(thread, index))
+		{
+			(*task)(index, thread);
+			m_remaining--;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_busyThreads--;
+		}
+		m_done.notify_one();
+	}
+}
+
+bool WorkStealingPool::Take(uint32_t thread, uint32_t& index)
+{
+	{
+		Queue& own = *m_queues[thread];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty())
+		{
+			index = own.tasks.back();
+			own.tasks.pop_back();
+			return true;
+		}
+	}
+
+	// Steal from the far end of the other queues, starting with the next thread along.
+	uint32_t threadCount = GetThreadCount();
+	for (uint32_t i = 1; i < threadCount; i++)
+	{
+		Queue& other = *m_queues[(thread + i) % threadCount];
+		std::lock_guard<std::mutex> lock(other.mutex);
+		if (!other.tasks.empty())
+		{
+			index = other.tasks.front();
+			other.tasks.pop_front();
+			m_steals++;
+			return true;
+		}
+	}
+
+	return false;
+}
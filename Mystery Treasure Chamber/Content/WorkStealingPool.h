@@ -0,0 +1,57 @@
+﻿#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Mystery_Treasure_Chamber
+{
+	// A fixed set of worker threads for the CPU side tools. Each worker has its own queue of task
+	// indices. It takes work from the back of its own queue and, once that is empty, steals from
+	// the front of the others, so uneven tasks still keep every thread busy.
+	class WorkStealingPool
+	{
+	public:
+		// threadCount 0 uses one thread per hardware thread.
+		explicit WorkStealingPool(uint32_t threadCount);
+		~WorkStealingPool();
+
+		// Calls task(index, thread) for every index in [0, count) and returns once all of them are done.
+		// thread is in [0, GetThreadCount()).
+		void Run(uint32_t count, const std::function<void(uint32_t index, uint32_t thread)>& task);
+
+		uint32_t GetThreadCount() const	{ return static_cast<uint32_t>(m_threads.size()); }
+
+		// Tasks taken from another thread's queue since the pool was created.
+		uint64_t GetSteals() const		{ return m_steals; }
+
+	private:
+		struct Queue
+		{
+			std::mutex				mutex;
+			std::deque<uint32_t>	tasks;
+		};
+
+		void Work(uint32_t thread);
+		bool Take(uint32_t thread, uint32_t& index);
+
+		std::vector<std::thread>				m_threads;
+		std::vector<std::unique_ptr<Queue>>		m_queues;
+
+		std::mutex								m_mutex;
+		std::condition_variable					m_wake;
+		std::condition_variable					m_done;
+		const std::function<void(uint32_t, uint32_t)>*	m_task;
+		uint64_t								m_generation;
+		uint32_t								m_busyThreads;
+		std::atomic<uint32_t>					m_remaining;
+		std::atomic<uint64_t>					m_steals;
+		bool									m_stop;
+	};
+}
@@ -0,0 +1,44 @@
+//G-buffer of the deferred mode. The floor, model and fused shaders built with GBUFFER write what they see into it,
+//and DeferredPixelShader.hlsl lights each pixel once. Packing is the same as DeferredShading::PackAlbedo and PackNormal.
+
+#ifndef MATERIAL_NONE	//FusedPixelShader.hlsl has its own, with the same values
+#define MATERIAL_NONE 0
+#define MATERIAL_ROOM 1
+#define MATERIAL_PILLAR 2
+#endif
+#define MATERIAL_FLOOR 3
+#define MATERIAL_MODEL 4
+
+struct GBUFFER_OUTPUT
+{
+	float4 albedo : SV_TARGET0;	//R8G8B8A8_UNORM, material in alpha
+	float4 normal : SV_TARGET1;	//R10G10B10A2_UNORM
+};
+
+float4 PackAlbedo(float3 albedo, uint material)
+{
+	return float4(albedo, material / 255.0);
+}
+
+float4 PackNormal(float3 normal)
+{
+	return float4(normal * 0.5 + 0.5, 0.0);
+}
+
+GBUFFER_OUTPUT PackGBuffer(float3 albedo, float3 normal, uint material)
+{
+	GBUFFER_OUTPUT output;
+	output.albedo = PackAlbedo(albedo, material);
+	output.normal = PackNormal(normal);
+	return output;
+}
+
+uint UnpackMaterial(float4 albedo)
+{
+	return (uint)round(albedo.a * 255.0);
+}
+
+float3 UnpackNormal(float4 normal)
+{
+	return normalize(normal.xyz * 2.0 - 1.0);
+}
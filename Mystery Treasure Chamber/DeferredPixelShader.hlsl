@@ -0,0 +1,70 @@
+//Lighting pass of the deferred mode. Lights every pixel of the G-buffer once, the way the forward shader of its
+//material would have, with the Shade of SurfaceShading.hlsli that the forward fused pass uses as well.
+
+Texture2D txAlbedo : register(t0);
+Texture2D txNormal : register(t1);
+Texture2D txDepth : register(t2);	//copy of the depth buffer after the G-buffer passes
+SamplerState txSampler : register(s0);
+
+#ifndef NUMLIGHTS
+#define NUMLIGHTS 4096	//most lights of a cluster shaded per pixel, LightClusters::MaxLights so none is dropped
+#endif
+
+cbuffer PixelShaderConstantBuffer : register(b0)
+{
+	float4 Eye;
+	float4 LightColor;
+	float4 backgroundColor;
+	float4 LightPos[3];
+	float nearPlane;
+	float farPlane;
+	float2 padding;
+};
+
+cbuffer RaymarchConstantBuffer : register(b1)
+{
+	uint raymarchMode;
+	uint hasBackground;
+	uint coneBounded;
+	uint proxyPass;
+	uint bakedLights;	//the first bakedLights lights are in txLightmap
+};
+
+cbuffer DepthConstantBuffer : register(b3)
+{
+	matrix viewProjection;
+	matrix inverseViewProjection;
+	uint depthTested;
+	float3 depthPadding;
+};
+
+//Canvas
+struct VS_Canvas
+{
+	float4 Position : SV_POSITION;	//vertex position
+	float2 canvasXY : TEXCOORD0;	//vertex texture coordinates
+};
+
+#include "LightClusters.hlsli"
+#include "Lightmap.hlsli"
+#include "AmbientOcclusion.hlsli"
+#include "Deferred.hlsli"
+#include "SurfaceShading.hlsli"
+
+float4 main(VS_Canvas input) : SV_TARGET
+{
+	int3 pixel = int3(input.Position.xy, 0);
+	float4 albedo = txAlbedo.Load(pixel);
+	uint material = UnpackMaterial(albedo);
+
+	//Nothing was drawn here, the back buffer keeps its clear colour
+	if (material == MATERIAL_NONE)
+		discard;
+
+	uint width, height;
+	txDepth.GetDimensions(width, height);
+	float2 ndc = float2(2.0 * input.Position.x / width - 1.0, 1.0 - 2.0 * input.Position.y / height);
+	float4 Position = mul(float4(ndc, txDepth.Load(pixel).r, 1.0), inverseViewProjection);
+
+	return Shade(material, albedo.rgb, UnpackNormal(txNormal.Load(pixel)), Position.xyz / Position.w);
+}
@@ -15,6 +15,7 @@ struct DS_OUTPUT
 {
 	float4 vPosition  : SV_POSITION;
 	float2 Texture : TEXCOORD0;
+	float3 worldPosition : TEXCOORD1;	//the floor is lit in world space
 	// TODO: change/add other stuff
 };
 
@@ -91,13 +92,20 @@ DS_OUTPUT main(
 			+ UV.y* patch[3].vPosition.xyz;
 	float3 uvPos = (1.0 - UV.x)*vPos1 + UV.x* vPos2;
 
-	uvPos += 0.03f * txDisplacement.SampleLevel(txSampler, UV, 0).xyz * -patch[0].normal;
+	//The patch is one of a grid over the floor, and its texture coordinates are blended the same way
+	float2 tex1 = (1.0 - UV.y) * patch[0].tex + UV.y * patch[1].tex;
+	float2 tex2 = (1.0 - UV.y) * patch[2].tex + UV.y * patch[3].tex;
+	float2 uvTex = (1.0 - UV.x) * tex1 + UV.x * tex2;
+
+	//FloorMeshBaker in Content/FloorMesh.cpp bakes the same displacement into a mesh once, keep the two in step
+	uvPos += 0.03f * txDisplacement.SampleLevel(txSampler, uvTex, 0).xyz * -patch[0].normal;
 
 	Output.vPosition = mul(float4(uvPos, 1.0f), model);
+	Output.worldPosition = Output.vPosition.xyz;
 	Output.vPosition = mul(Output.vPosition, view);
 	Output.vPosition = mul(Output.vPosition, projection);
 
-	Output.Texture = UV;
+	Output.Texture = uvTex;
 
 	return Output;
 }
@@ -0,0 +1,36 @@
+//Draws the floor mesh baked on the CPU by FloorMeshBaker in Content/FloorMesh.cpp, already displaced the way DomainShader.hlsl
+//displaces the tessellated floor, so FloorPixelShader.hlsl gets the same inputs without the hull and domain shaders.
+
+cbuffer ModelViewProjectionConstantBuffer : register(b0)
+{
+	matrix model;
+	matrix view;
+	matrix projection;
+};
+
+struct VS_INPUT
+{
+	float3 pos : POSITION;
+	float2 tex : TEXCOORD0;
+};
+
+struct VS_OUTPUT
+{
+	float4 Position : SV_POSITION;
+	float2 Texture : TEXCOORD0;
+	float3 worldPosition : TEXCOORD1;	//the floor is lit in world space
+};
+
+VS_OUTPUT main(VS_INPUT input)
+{
+	VS_OUTPUT output;
+
+	output.Position = mul(float4(input.pos, 1.0f), model);
+	output.worldPosition = output.Position.xyz;
+	output.Position = mul(output.Position, view);
+	output.Position = mul(output.Position, projection);
+
+	output.Texture = input.tex;
+
+	return output;
+}
@@ -4,7 +4,13 @@ SamplerState txSampler : register(s0);
 Texture2D txTexture : register(t0);
 Texture2D txNormal : register(t1);
 
-#define NUMLIGHTS 3
+#ifdef PARALLAX	//set by the parallax variants in the Permutations folder, drawn on a flat quad instead of the displaced floor
+Texture2D txDisplacement : register(t2);
+#endif
+
+#ifndef NUMLIGHTS	//set by the variant wrappers in the Permutations folder
+#define NUMLIGHTS 4096	//most lights of a cluster shaded per pixel, LightClusters::MaxLights so none is dropped
+#endif
 
 cbuffer PixelShaderConstantBuffer : register(b0)
 {
@@ -17,10 +23,15 @@ cbuffer PixelShaderConstantBuffer : register(b0)
 	float2 padding;
 };
 
+#include "LightClusters.hlsli"
+#include "AmbientOcclusion.hlsli"
+#include "Deferred.hlsli"
+
 struct VS_OUTPUT
 {
 	float4 Position : SV_POSITION;
 	float2 Texture : TEXCOORD0;
+	float3 worldPosition : TEXCOORD1;
 };
 
 float4 Phong(float3 n, float3 l, float3 v, float shininess, float4 diffuseColor, float4 specularColor)
@@ -32,26 +43,94 @@ float4 Phong(float3 n, float3 l, float3 v, float shininess, float4 diffuseColor,
 	return diff * diffuseColor + spec * specularColor;
 }
 
+#ifdef PARALLAX
+#define PARALLAX_DEPTH 0.15	//how far below the flat floor the displacement reaches in world units, DomainShader's 0.03 times the floor's scale of 5
+#define PARALLAX_TEXTURE_SCALE 0.1	//texture coordinates per world unit along x, and against z
+#define PARALLAX_MIN_LAYERS 8	//looking straight down
+#define PARALLAX_MAX_LAYERS 32	//looking along the floor
+
+//Parallax occlusion mapping: the floor is drawn flat at the top of its displacement, and the view ray marches down through the
+//displacement texture in layers until it is below the surface. The pixel is then shaded with the texture coordinates and the position
+//where it went below. FloorParallax::March in Content/FloorParallax.cpp does the same on the CPU, keep the two in step.
+void ParallaxOcclusion(inout VS_OUTPUT Input)
+{
+	float3 view = normalize(Input.worldPosition - Eye.xyz);
+	float down = max(-view.y, 1e-3);
+	float2 delta = float2(view.x, -view.z) * (PARALLAX_TEXTURE_SCALE * PARALLAX_DEPTH / down);	//from the top of the displacement to the bottom
+
+	//The loop cannot take gradients, so the flat floor's pick the mip
+	float2 dx = ddx(Input.Texture);
+	float2 dy = ddy(Input.Texture);
+
+	uint layers = (uint)lerp(PARALLAX_MAX_LAYERS, PARALLAX_MIN_LAYERS, down);
+	float step = 1.0 / layers;
+
+	float2 start = Input.Texture;
+	float depth = 0;
+	float surface = txDisplacement.SampleGrad(txSampler, start, dx, dy).y;
+	float previousDepth = 0;
+	float previousGap = surface;
+	uint i = 0;
+	[loop]
+	for (; i < layers && depth < surface; i++)
+	{
+		previousDepth = depth;
+		previousGap = surface - depth;
+		depth = (i + 1) * step;
+		surface = txDisplacement.SampleGrad(txSampler, start + delta * depth, dx, dy).y;
+	}
+
+	//The surface is taken as a straight line between the last two layers
+	if (i > 0)
+	{
+		float gap = surface - depth;
+		depth = previousDepth + (depth - previousDepth) * previousGap / max(previousGap - gap, 1e-6);
+	}
+
+	Input.Texture = start + delta * depth;
+	Input.worldPosition += view * (PARALLAX_DEPTH * depth / down);
+}
+#endif
+
+#ifdef GBUFFER
+GBUFFER_OUTPUT main(VS_OUTPUT Input)
+{
+#ifdef PARALLAX
+	ParallaxOcclusion(Input);
+#endif
+	float3 normal = normalize((txNormal.Sample(txSampler, Input.Texture).rgb) * 2 - (float3)1);
+	return PackGBuffer(txTexture.Sample(txSampler, Input.Texture).rgb, normal, MATERIAL_FLOOR);
+}
+#else
 float4 main(VS_OUTPUT Input) : SV_TARGET
 {
+#ifdef PARALLAX
+	ParallaxOcclusion(Input);
+#endif
 	float4 spec = float4(1, 1, 1, 1);
 	float4 diff = txTexture.Sample(txSampler, Input.Texture);
 
 	float4 color = (float4)0;
 	float3 lightDir;
-	float3 viewDir = normalize(Eye.xyz - Input.Position.xyz);
+	float3 viewDir = normalize(Eye.xyz - Input.worldPosition);
 
 	float3 normal = normalize((txNormal.Sample(txSampler, Input.Texture).rgb) * 2 - (float3)1);
 
-	for (int i = 0; i < NUMLIGHTS; i++)
+	uint2 range = clusterRanges[ClusterIndex(Input.worldPosition)];
+	for (uint i = 0; i < min(range.y, NUMLIGHTS); i++)
 	{
-		lightDir = normalize(LightPos[i].xyz - Input.Position.xyz);
-		color += Phong(normal, lightDir, viewDir, 40, diff, spec);
+		ClusterLight light = clusterLights[clusterLightIndices[range.x + i]];
+		lightDir = normalize(light.position - Input.worldPosition);
+		color += float4(light.color, 1.0) * ClusterAttenuation(light, Input.worldPosition) * Phong(normal, lightDir, viewDir, 40, diff, spec);
 	}
 
+	//The normal map only bends the lighting, the floor faces up
+	color *= SurfaceOcclusion(txSampler, Input.worldPosition, float3(0, 1, 0));
+
 	return saturate(LightColor * 0.5f * color);
 
 }
+#endif
 
 
 
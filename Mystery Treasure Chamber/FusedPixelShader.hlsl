@@ -0,0 +1,271 @@
+//Marches the room and the pillars in one pass, replacing the room pass, its intermediate target and the pillar pass.
+//The floor is rasterized first. Pillars write the nearest depth so they stay on top of it, the room writes the farthest so the floor stays on top of the room.
+//In depth tested mode the rays go through the raster camera instead, the floor and the models are drawn first and marching stops at their depth.
+//The raster camera looks down at the floor from the same eye, so switching the mode changes the view of the room and the pillars, not just their depth.
+//Hits are lit with the Shade of SurfaceShading.hlsli, the same as the deferred lighting pass does.
+//FusedRaymarch.cpp, RaymarchDepth.cpp and DeferredShading.cpp are the CPU references of this shader.
+
+Texture2D txTexture : register(t0);
+Texture2D txNormal : register(t1);
+Texture2D txDepth : register(t2);	//copy of the rasterized depth, only used when depthTested is set
+SamplerState txSampler : register(s0);
+
+#ifndef NUMLIGHTS	//set by the variant wrappers in the Permutations folder
+#define NUMLIGHTS 4096	//most lights of a cluster shaded per pixel, LightClusters::MaxLights so none is dropped
+#endif
+
+#define MIN_XYZ -5.0
+#define MAX_XYZ 5.0
+static const float3 BoxMinimum = (float3)MIN_XYZ;
+static const float3 BoxMaximum = (float3)MAX_XYZ;
+#ifndef INTERVALS	//set by the variant wrappers in the Permutations folder
+#define INTERVALS 200	//fixed steps of the march
+#endif
+
+static const float3 AxisX = float3 (1.0, 0.0, 0.0);
+static const float3 AxisY = float3 (0.0, 1.0, 0.0);
+static const float3 AxisZ = float3 (0.0, 0.0, 1.0);
+//Finite difference step of the normals, about a pixel wide at the hit: SdfScene::PixelAngle of the default camera
+#define PIXEL_ANGLE 0.0015
+#define MIN_EPSILON 0.001
+
+#define MATERIAL_NONE 0
+#define MATERIAL_ROOM 1
+#define MATERIAL_PILLAR 2
+
+cbuffer PixelShaderConstantBuffer : register(b0)
+{
+float4 Eye;
+float4 LightColor;
+float4 backgroundColor;
+float4 LightPos[3];
+float nearPlane;
+float farPlane;
+float2 padding;
+};
+
+cbuffer RaymarchConstantBuffer : register(b1)
+{
+	uint raymarchMode;
+	uint hasBackground;
+	uint coneBounded;
+	uint proxyPass;
+	uint bakedLights;	//the first bakedLights lights are in txLightmap
+};
+
+cbuffer DepthConstantBuffer : register(b3)
+{
+	matrix viewProjection;
+	matrix inverseViewProjection;
+	uint depthTested;
+	float3 depthPadding;
+};
+
+struct PS_OUTPUT
+{
+	float4 color : SV_TARGET0;	//albedo and material when GBUFFER is set
+#ifdef GBUFFER
+	float4 normal : SV_TARGET1;
+#endif
+	float depth : SV_DepthGreaterEqual;	//the canvas quad is at depth 0 and nothing is written nearer, so the early depth test stays on
+};
+
+struct Ray
+{
+	float3 o;	//origin
+	float3 d;	//direction
+};
+
+//Canvas
+struct VS_Canvas
+{
+	float4 Position : SV_POSITION;	//vertex position
+	float2 canvasXY : TEXCOORD0;	//vertex texture coordinates
+	float2 tex : TEXCOORD1;
+};
+
+//------------------------------------------------------------------------------------------------------------------
+
+//sdBox, sdCylinder, room(), pillars() and their gradients, generated from the scene in Content/SdfScene.h
+#include "SdfScene.hlsli"
+#include "LightClusters.hlsli"
+#include "Lightmap.hlsli"
+#include "AmbientOcclusion.hlsli"
+#include "Deferred.hlsli"
+#include "SurfaceShading.hlsli"
+
+//-------------------------------------------------------------------------------------------------------------------
+
+float Function(float3 Position)
+{
+	return min(room(Position), pillars(Position));
+}
+
+//Whichever surface the hit is closer to is the one the ray crossed
+int Material(float3 Position)
+{
+	return abs(pillars(Position)) < abs(room(Position)) ? MATERIAL_PILLAR : MATERIAL_ROOM;
+}
+
+bool IntersectBox(in Ray ray, in float3 minimum, in float3 maximum, out float timeIn, out float timeOut)
+{
+	float3 OMIN = (minimum - ray.o) / ray.d;
+	float3 OMAX = (maximum - ray.o) / ray.d;
+	float3 MAX = max(OMAX, OMIN);
+	float3 MIN = min(OMAX, OMIN);
+	timeOut = min(MAX.x, min(MAX.y, MAX.z));
+	timeIn = max(max(MIN.x, 0.0), max(MIN.y, MIN.z));
+
+	return timeOut > timeIn;
+}
+
+//Stops early once it passes limit, the step size stays that of the whole box
+bool RayMarchingInsideCube(in Ray ray, in float start, in float final, in float limit, out float val)
+{
+	val = 0.0;
+	float step = (final - start) / float(INTERVALS);
+	float time = start;
+	float3 Position = ray.o + time * ray.d;
+	float right, left = Function(Position);
+
+	for (int i = 0; i < INTERVALS; i++)
+	{
+		if (time > limit)
+			return false;
+
+		time += step;
+		Position += step * ray.d;
+		right = Function(Position);
+		if (left * right < 0.0)
+		{
+			val = time + right * step / (left - right);
+			return true;
+		}
+		left = right;
+	}
+
+	return false;
+}
+
+//The normal of the surface that was hit, not of the union, so it matches the separate passes
+float3 CalcNormal(float3 Position, int material, float t) {
+	float epsilon = max(MIN_EPSILON, t * PIXEL_ANGLE);
+	float3 gradient;
+	if (material == MATERIAL_PILLAR)
+		gradient = pillarsGradient(Position, epsilon);
+	else
+		gradient = roomGradient(Position, epsilon);
+	return normalize(gradient);
+}
+
+float2 CalcUV(float3 Position, float3 normal)
+{
+	float3 u = float3(normal.y, -normal.x, 0);
+	u = normalize(u);
+	float3 v = cross(normal, u);
+
+	return float2(dot(u, Position), dot(v, Position));
+
+}
+
+float4 Unproject(float2 ndc, float depth)
+{
+	float4 Position = mul(float4(ndc, depth, 1.0), inverseViewProjection);
+	return Position / Position.w;
+}
+
+//Depth buffer value the rasterizer would write for Position
+float ProjectDepth(float3 Position)
+{
+	float4 clip = mul(float4(Position, 1.0), viewProjection);
+	return clip.z / clip.w;
+}
+
+PS_OUTPUT RayMarching(Ray ray, float limit)
+{
+	PS_OUTPUT output;
+	output.color = (float4)0;
+#ifdef GBUFFER
+	output.normal = (float4)0;
+#endif
+	output.depth = 1.0;
+
+	float start, final;
+	float t;
+	if (IntersectBox(ray, BoxMinimum, BoxMaximum, start, final))
+	{
+		if (RayMarchingInsideCube(ray, start, final, min(limit, final), t))
+		{
+			float3 Position = ray.o + ray.d * t;
+			int material = Material(Position);
+			float3 normal = CalcNormal(Position, material, t);
+			float2 UV = CalcUV(Position, normal);
+
+			if (material == MATERIAL_PILLAR)
+			{
+				float3 color = txTexture.Sample(txSampler, 0.5 * UV);
+				float3 texNormal = normalize(2 * txNormal.Sample(txSampler, 0.5 * UV).rgb - float3(1, 1, 1));
+
+#ifdef GBUFFER
+				output.color = PackAlbedo(color, MATERIAL_PILLAR);
+				output.normal = PackNormal(texNormal);
+#else
+				output.color = Shade(MATERIAL_PILLAR, color, texNormal, Position);
+#endif
+				output.depth = 0.0;
+			}
+			else
+			{
+				float3 color = txTexture.Sample(txSampler, UV);
+
+#ifdef GBUFFER
+				output.color = PackAlbedo(color, MATERIAL_ROOM);
+				output.normal = PackNormal(normal);
+#else
+				output.color = Shade(MATERIAL_ROOM, color, normal, Position);
+#endif
+			}
+
+			if (depthTested)
+				output.depth = ProjectDepth(Position);
+		}
+	}
+
+	return output;
+}
+
+PS_OUTPUT main(VS_Canvas input)
+{
+	Ray eyeRay;
+	eyeRay.o = Eye.xyz;
+
+	if (!depthTested)
+	{
+		float zoom = 0.004;
+		float2 xy = zoom * input.canvasXY;
+		float distEye2Canvas = nearPlane;
+		float3 PixelPos = float3(xy, distEye2Canvas);
+
+		eyeRay.d = normalize(PixelPos - Eye.xyz);	//view direction
+		return RayMarching(eyeRay, farPlane);
+	}
+
+	uint width, height;
+	txDepth.GetDimensions(width, height);
+	float2 ndc = float2(2.0 * input.Position.x / width - 1.0, 1.0 - 2.0 * input.Position.y / height);
+
+	float4 farPoint = Unproject(ndc, 1.0);
+	eyeRay.d = normalize(farPoint.xyz - Eye.xyz);
+
+	//Nothing behind the rasterized geometry can be seen, so marching stops there
+	float rasterDepth = txDepth.Load(int3(input.Position.xy, 0)).r;
+	float limit = farPlane;
+	if (rasterDepth < 1.0)
+		limit = dot(Unproject(ndc, rasterDepth).xyz - Eye.xyz, eyeRay.d);
+
+	PS_OUTPUT output = RayMarching(eyeRay, limit);
+	if (output.depth >= 1.0)
+		discard;
+
+	return output;
+}
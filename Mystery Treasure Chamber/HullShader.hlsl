@@ -1,5 +1,30 @@
 //Generates tessellation factors based on the eye position for the floor
 
+// A constant buffer that stores the three basic column-major matrices for composing geometry.
+cbuffer ModelViewProjectionConstantBuffer : register(b0)
+{
+	matrix model;
+	matrix view;
+	matrix projection;
+};
+
+cbuffer TessellationConstantBuffer : register(b1)
+{
+	float3 tessellationEye;
+	float screenScale;	//pixels covered by one unit at distance one
+	float targetPixels;	//edge of a triangle on screen, 0 for maxFactor everywhere
+	float maxFactor;
+	float displacementLow;	//most the domain shader moves the floor along y in world space, down and up
+	float displacementHigh;
+	float maxSlope;	//steepest a tessellated triangle can be
+	uint patchRanges;	//1 when patchDisplacement holds a range for each patch
+	float2 tessellationPadding;
+};
+
+//World space displacement range of each patch, down and up, in the order the patches are drawn. Bounded from the min/max
+//pyramid of the displacement texture by FloorTessellation::PatchDisplacements in Content/FloorTessellation.cpp.
+StructuredBuffer<float2> patchDisplacement : register(t0);
+
 struct HS_INPUT
 {
 	float4 pos : SV_POSITION;
@@ -25,6 +50,48 @@ struct HS_CONSTANT_DATA_OUTPUT
 
 #define NUM_CONTROL_POINTS 4
 
+//Same as FloorTessellation::EdgeFactor, splits the edge so each segment covers about targetPixels of the
+//screen. It only depends on the two end points, so the patches on either side of an edge agree on it.
+float EdgeFactor(float3 a, float3 b)
+{
+	if (targetPixels <= 0.0)
+		return maxFactor;
+
+	float3 centre = (a + b) * 0.5;
+	float diameter = length(a - b);
+	float distance = max(length(centre - tessellationEye), 0.5 * diameter);
+	float pixels = diameter * screenScale / max(distance, 1e-4);
+
+	return clamp(pixels / targetPixels, 1.0, maxFactor);
+}
+
+//Same as FloorTessellation::InFrustum, false when the whole box is outside one clip plane
+bool InFrustum(float3 minimum, float3 maximum)
+{
+	float outside[6] = { 0, 0, 0, 0, 0, 0 };
+	for (uint i = 0; i < 8; i++)
+	{
+		float3 corner = float3((i & 1) ? maximum.x : minimum.x, (i & 2) ? maximum.y : minimum.y, (i & 4) ? maximum.z : minimum.z);
+		float4 clip = mul(mul(float4(corner, 1.0f), view), projection);
+
+		outside[0] += clip.x < -clip.w;
+		outside[1] += clip.x > clip.w;
+		outside[2] += clip.y < -clip.w;
+		outside[3] += clip.y > clip.w;
+		outside[4] += clip.z < 0.0;
+		outside[5] += clip.z > clip.w;
+	}
+
+	return !(outside[0] == 8 || outside[1] == 8 || outside[2] == 8 || outside[3] == 8 || outside[4] == 8 || outside[5] == 8);
+}
+
+//Same as FloorTessellation::FacesAway, true when no triangle in the box can face the eye
+bool FacesAway(float3 minimum, float3 maximum)
+{
+	float2 d = max(abs(tessellationEye.xz - minimum.xz), abs(tessellationEye.xz - maximum.xz));
+	return tessellationEye.y - minimum.y + maxSlope * (d.x + d.y) < 0.0;
+}
+
 // Patch Constant Function
 HS_CONSTANT_DATA_OUTPUT CalcHSPatchConstants(
 	InputPatch<HS_INPUT, NUM_CONTROL_POINTS> ip,
@@ -32,13 +99,32 @@ HS_CONSTANT_DATA_OUTPUT CalcHSPatchConstants(
 {
 	HS_CONSTANT_DATA_OUTPUT Output;
 
-	// Insert code to compute Output here
-	Output.EdgeTessFactor[0] = 
-		Output.EdgeTessFactor[1] = 
-		Output.EdgeTessFactor[2] =
-		Output.EdgeTessFactor[3] =
-		Output.InsideTessFactor[0] =
-		Output.InsideTessFactor[1] = 32.0f; // e.g. could calculate dynamic tessellation factors instead
+	float3 corners[NUM_CONTROL_POINTS];
+	for (uint i = 0; i < NUM_CONTROL_POINTS; i++)
+	{
+		corners[i] = mul(float4(ip[i].pos.xyz, 1.0f), model).xyz;
+	}
+
+	//Patches that cannot be seen get 0 and the tessellator drops them
+	float3 minimum = min(min(corners[0], corners[1]), min(corners[2], corners[3]));
+	float3 maximum = max(max(corners[0], corners[1]), max(corners[2], corners[3]));
+	float2 displacement = patchRanges ? patchDisplacement[PatchID] : float2(displacementLow, displacementHigh);
+	minimum.y += displacement.x;
+	maximum.y += displacement.y;
+	if (!InFrustum(minimum, maximum) || FacesAway(minimum, maximum))
+	{
+		Output.EdgeTessFactor[0] = Output.EdgeTessFactor[1] = Output.EdgeTessFactor[2] = Output.EdgeTessFactor[3] = 0.0;
+		Output.InsideTessFactor[0] = Output.InsideTessFactor[1] = 0.0;
+		return Output;
+	}
+
+	//The domain shader blends lerp(lerp(p0, p1, v), lerp(p2, p3, v), u), so the edges at u = 0, v = 0, u = 1 and v = 1
+	Output.EdgeTessFactor[0] = EdgeFactor(corners[0], corners[1]);
+	Output.EdgeTessFactor[1] = EdgeFactor(corners[0], corners[2]);
+	Output.EdgeTessFactor[2] = EdgeFactor(corners[2], corners[3]);
+	Output.EdgeTessFactor[3] = EdgeFactor(corners[1], corners[3]);
+	Output.InsideTessFactor[0] = max(Output.EdgeTessFactor[1], Output.EdgeTessFactor[3]);
+	Output.InsideTessFactor[1] = max(Output.EdgeTessFactor[0], Output.EdgeTessFactor[2]);
 
 	return Output;
 }
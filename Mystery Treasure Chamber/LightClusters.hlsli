@@ -0,0 +1,47 @@
+//Lights of the froxel clusters of the canvas camera, built each frame on the CPU by LightClusters::Build in Content/LightClusters.cpp.
+//A shader looks up the cluster of the point it shades and loops over that cluster's lights only.
+
+struct ClusterLight
+{
+	float3 position;
+	float radius;	//light is gone at this distance
+	float3 color;
+	float falloff;	//1 fades out at radius, 0 is a distant light that does not fade
+};
+
+StructuredBuffer<ClusterLight> clusterLights : register(t8);
+StructuredBuffer<uint2> clusterRanges : register(t9);	//offset into clusterLightIndices and light count of each cluster
+StructuredBuffer<uint> clusterLightIndices : register(t10);
+
+cbuffer ClusterConstantBuffer : register(b5)
+{
+	float4 clusterEye;	//eye of the canvas camera, nearPlane in w
+	float4 clusterCanvas;	//half extents of the canvas, slices per log depth, depth where the second slice starts
+	uint clusterTilesX;
+	uint clusterTilesY;
+	uint clusterSlices;
+	float clusterAxis;	//sign of the view axis along z
+};
+
+//Same as LightClusters::ClusterOf, points outside the canvas camera's view go to the nearest cluster
+uint ClusterIndex(float3 Position)
+{
+	float3 d = Position - clusterEye.xyz;
+	float w = max(d.z / (clusterEye.w - clusterEye.z), 1e-6);
+	float2 canvas = (clusterEye.xy * w + d.xy) / (w * clusterCanvas.xy);
+	float2 tiles = float2(clusterTilesX, clusterTilesY);
+	uint2 tile = (uint2)clamp(floor((canvas * 0.5 + 0.5) * tiles), 0.0, tiles - 1.0);
+
+	float depth = clusterAxis * d.z;
+	uint slice = depth < clusterCanvas.w ? 0 : min(1 + (uint)(log(depth / clusterCanvas.w) * clusterCanvas.z), clusterSlices - 1);
+
+	return (slice * clusterTilesY + tile.y) * clusterTilesX + tile.x;
+}
+
+//Falls smoothly to nothing at the light's radius, distant lights do not fall off
+float ClusterAttenuation(ClusterLight light, float3 Position)
+{
+	float3 d = (light.position - Position) / light.radius;
+	float falloff = saturate(1.0 - dot(d, d));
+	return lerp(1.0, falloff * falloff, light.falloff);
+}
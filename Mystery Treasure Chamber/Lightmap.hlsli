@@ -0,0 +1,16 @@
+//Diffuse light of the static lights with soft shadows and ambient occlusion, baked on the CPU by LightmapBaker::Bake in Content/LightmapBaker.cpp.
+//Each texel holds the light at the surface nearest to it, so one sample gives the light anywhere on the walls and the pillars.
+
+Texture3D txLightmap : register(t4);
+
+#define LIGHTMAP_BOX 5.0	//half size of the room's box, which the lightmap covers
+
+//Same as LightmapBaker::Sample
+float3 BakedLight(SamplerState linearSampler, float3 Position)
+{
+	uint width, height, depth;
+	txLightmap.GetDimensions(width, height, depth);
+	float3 halfTexel = 0.5 / float3(width, height, depth);
+	float3 uvw = clamp((Position + LIGHTMAP_BOX) / (2.0 * LIGHTMAP_BOX), halfTexel, 1.0 - halfTexel);
+	return txLightmap.SampleLevel(linearSampler, uvw, 0).rgb;
+}
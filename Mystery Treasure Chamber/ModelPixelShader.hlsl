@@ -3,7 +3,9 @@
 SamplerState txSampler : register(s0);
 Texture2D txTexture : register(t0);
 
-#define NUMLIGHTS 3
+#ifndef NUMLIGHTS	//set by the variant wrappers in the Permutations folder
+#define NUMLIGHTS 4096	//most lights of a cluster shaded per pixel, LightClusters::MaxLights so none is dropped
+#endif
 
 cbuffer PixelShaderConstantBuffer : register(b0)
 {
@@ -16,11 +18,17 @@ cbuffer PixelShaderConstantBuffer : register(b0)
 	float2 padding;
 };
 
+#include "LightClusters.hlsli"
+#include "AmbientOcclusion.hlsli"
+#include "ProbeLighting.hlsli"
+#include "Deferred.hlsli"
+
 struct VS_OUTPUT
 {
 	float4 Position : SV_POSITION;
 	float2 Texture : TEXCOORD0;
 	float3 normal : NORMAL;
+	float3 worldPosition : TEXCOORD1;
 };
 
 float4 Phong(float3 n, float3 l, float3 v, float shininess, float4 diffuseColor, float4 specularColor)
@@ -32,6 +40,12 @@ float4 Phong(float3 n, float3 l, float3 v, float shininess, float4 diffuseColor,
 	return diff * diffuseColor + spec * specularColor;
 }
 
+#ifdef GBUFFER
+GBUFFER_OUTPUT main(VS_OUTPUT Input)
+{
+	return PackGBuffer(txTexture.Sample(txSampler, Input.Texture).rgb, normalize(Input.normal), MATERIAL_MODEL);
+}
+#else
 float4 main(VS_OUTPUT Input) : SV_TARGET
 {
 	float4 spec = float4(1, 1, 1, 1);
@@ -39,17 +53,29 @@ float4 main(VS_OUTPUT Input) : SV_TARGET
 
 	float4 color = (float4)0;
 	float3 lightDir;
-	float3 viewDir = normalize(Eye.xyz - Input.Position.xyz);
+	float3 viewDir = normalize(Eye.xyz - Input.worldPosition);
 
-	for (int i = 0; i < 1; i++)
+	uint2 range = clusterRanges[ClusterIndex(Input.worldPosition)];
+	for (uint i = 0; i < min(range.y, NUMLIGHTS); i++)
 	{
-		lightDir = normalize(LightPos[i].xyz - Input.Position.xyz);
-		color += Phong(Input.normal, lightDir, viewDir, 40, diff, spec);
+		uint index = clusterLightIndices[range.x + i];
+		if (index < probeLights)	//already in the probes
+			continue;
+
+		ClusterLight light = clusterLights[index];
+		lightDir = normalize(light.position - Input.worldPosition);
+		color += float4(light.color, 1.0) * ClusterAttenuation(light, Input.worldPosition) * Phong(Input.normal, lightDir, viewDir, 40, diff, spec);
 	}
 
-	return saturate(LightColor * color);
+	color *= SurfaceOcclusion(txSampler, Input.worldPosition, normalize(Input.normal));
+
+	//The probes are shadowed and occluded already
+	float3 probe = probeLights > 0 ? diff.rgb * ProbeIrradiance(normalize(Input.normal)) : 0.0;
+
+	return saturate(LightColor * color + float4(probe, 0.0));
 
 }
+#endif
 
 
 
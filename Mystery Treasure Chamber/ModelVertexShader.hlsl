@@ -34,6 +34,7 @@ struct VS_OUTPUT
 	float4 Position : SV_POSITION;
 	float2 Texture : TEXCOORD0;
 	float3 normal : NORMAL;
+	float3 worldPosition : TEXCOORD1;	//the models are lit in world space
 };
 
 VS_OUTPUT main(VS_INPUT Input)
@@ -51,6 +52,7 @@ VS_OUTPUT main(VS_INPUT Input)
 		Pos.x += 0.07f * sin(5 * Pos.z * t);
 
 	Output.Position = mul(Pos, model);
+	Output.worldPosition = Output.Position.xyz;
 	Output.Position = mul(Output.Position, view);
 	Output.Position = mul(Output.Position, projection);
 	Output.Texture = Input.tex;
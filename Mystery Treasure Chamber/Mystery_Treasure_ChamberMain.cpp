@@ -48,6 +48,7 @@ void Mystery_Treasure_ChamberMain::Update()
 	{
 		// TODO: Replace this with your app's content update functions.
 		m_sceneRenderer->Update(m_timer);
+		m_fpsTextRenderer->SetDetail(m_sceneRenderer->GetFloorCosts().Report());
 		m_fpsTextRenderer->Update(m_timer);
 	});
 }
@@ -0,0 +1,3 @@
+//G-buffer variant of FloorPixelShader.hlsl for the deferred mode, loaded directly by Sample3DSceneRenderer
+#define GBUFFER
+#include "../FloorPixelShader.hlsl"
@@ -0,0 +1,3 @@
+//Low quality variant of FloorPixelShader.hlsl, listed in Assets/Shaders/Permutations.txt
+#define NUMLIGHTS 1
+#include "../FloorPixelShader.hlsl"
@@ -0,0 +1,3 @@
+//Parallax occlusion variant of FloorPixelShader.hlsl for FloorMode::Parallax, loaded directly by Sample3DSceneRenderer
+#define PARALLAX
+#include "../FloorPixelShader.hlsl"
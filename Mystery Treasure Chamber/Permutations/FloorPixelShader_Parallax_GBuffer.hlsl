@@ -0,0 +1,4 @@
+//G-buffer variant of the parallax occlusion floor for the deferred mode, loaded directly by Sample3DSceneRenderer
+#define PARALLAX
+#define GBUFFER
+#include "../FloorPixelShader.hlsl"
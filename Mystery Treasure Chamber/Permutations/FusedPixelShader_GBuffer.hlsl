@@ -0,0 +1,3 @@
+//G-buffer variant of FusedPixelShader.hlsl for the deferred mode, loaded directly by Sample3DSceneRenderer
+#define GBUFFER
+#include "../FusedPixelShader.hlsl"
@@ -0,0 +1,4 @@
+//Medium quality variant of FusedPixelShader.hlsl, listed in Assets/Shaders/Permutations.txt
+#define NUMLIGHTS 3
+#define INTERVALS 150
+#include "../FusedPixelShader.hlsl"
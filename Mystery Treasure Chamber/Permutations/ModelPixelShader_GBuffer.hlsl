@@ -0,0 +1,3 @@
+//G-buffer variant of ModelPixelShader.hlsl for the deferred mode, loaded directly by Sample3DSceneRenderer
+#define GBUFFER
+#include "../ModelPixelShader.hlsl"
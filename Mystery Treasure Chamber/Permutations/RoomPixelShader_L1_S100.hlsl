@@ -0,0 +1,4 @@
+//Low quality variant of RoomPixelShader.hlsl, listed in Assets/Shaders/Permutations.txt
+#define NUMLIGHTS 1
+#define INTERVALS 100
+#include "../Content/RoomPixelShader.hlsl"
@@ -0,0 +1,4 @@
+//Medium quality variant of RoomPixelShader.hlsl, listed in Assets/Shaders/Permutations.txt
+#define NUMLIGHTS 3
+#define INTERVALS 150
+#include "../Content/RoomPixelShader.hlsl"
@@ -3,9 +3,12 @@
 Texture2D txRoom : register(t0);
 Texture2D txTexture : register(t1);
 Texture2D txNormal : register(t2);
+Texture2D<float> txConeBound : register(t3);	//distance the scene is empty for along the rays of each tile
 SamplerState txSampler : register(s0);
 
-#define NUMLIGHTS 3
+#ifndef NUMLIGHTS	//set by the variant wrappers in the Permutations folder
+#define NUMLIGHTS 4096	//most lights of a cluster shaded per pixel, LightClusters::MaxLights so none is dropped
+#endif
 
 //static float4 Eye = float4(0, 3.5, 5, 1);//eye position
 //static float nearPlane = 1.0;
@@ -18,14 +21,19 @@ SamplerState txSampler : register(s0);
 #define MAX_XYZ 5.0
 static const float3 BoxMinimum = (float3)MIN_XYZ;
 static const float3 BoxMaximum = (float3)MAX_XYZ;
-#define INTERVALS 200
+#ifndef INTERVALS	//set by the variant wrappers in the Permutations folder
+#define INTERVALS 200	//fixed steps of the march
+#endif
+#define TILE_SIZE 8	//pixels per side of the tiles of txConeBound
 
 static const float3 Zero = float3 (0.0, 0.0, 0.0);
 static const float3 Unit = float3 (1.0, 1.0, 1.0);
 static const float3 AxisX = float3 (1.0, 0.0, 0.0);
 static const float3 AxisY = float3 (0.0, 1.0, 0.0);
 static const float3 AxisZ = float3 (0.0, 0.0, 1.0);
-#define STEP 0.01
+//Finite difference step of the normals, about a pixel wide at the hit: SdfScene::PixelAngle of the default camera
+#define PIXEL_ANGLE 0.0015
+#define MIN_EPSILON 0.001
 
 cbuffer PixelShaderConstantBuffer : register(b0)
 {
@@ -38,18 +46,51 @@ float farPlane;
 float2 padding;
 };
 
+#define RAYMARCH_FULL 0
+#define RAYMARCH_CHECKERBOARD 1
+#define RAYMARCH_HALF 2
+
+#define PROXY_NONE 0
+#define PROXY_BACKGROUND 1	//the canvas quad only copies the room
+#define PROXY_MARCH 2	//the proxy boxes march the pixels they cover
+#define PROXY_TRIANGLES 12	//triangles of each proxy box, in the order of the boxes
+#define MAX_PROXIES 16
+
+cbuffer RaymarchConstantBuffer : register(b1)
+{
+	uint raymarchMode;
+	uint hasBackground;
+	uint coneBounded;	//txConeBound holds this frame's cone march prepass
+	uint proxyPass;
+	uint bakedLights;	//the first bakedLights lights are in txLightmap
+};
+
+//A box around each pillar, see RaymarchProxy.cpp
+cbuffer ProxyConstantBuffer : register(b2)
+{
+	float4 proxyMinimum[MAX_PROXIES];
+	float4 proxyMaximum[MAX_PROXIES];
+};
+
+struct PS_OUTPUT
+{
+	float4 color : SV_TARGET0;
+	float4 geometry : SV_TARGET1;	//normal and hit distance, negative distance on a miss
+	float depth : SV_DEPTH;	//of the pillar hit for the proxy boxes, which can overlap
+};
+
 struct Ray
 {
 	float3 o;	//origin
 	float3 d;	//direction
 };
 
-//Canvas
+//Canvas. The proxy boxes are drawn in perspective, but the canvas coordinates stay linear on the screen.
 struct VS_Canvas
 {
 	float4 Position : SV_POSITION;	//vertex position
-	float2 canvasXY : TEXCOORD0;	//vertex texture coordinates
-	float2 tex : TEXCOORD1;
+	noperspective float2 canvasXY : TEXCOORD0;	//vertex texture coordinates
+	noperspective float2 tex : TEXCOORD1;
 };
 
 //------------------------------------------------------------------------------------------------------------------
@@ -69,23 +110,12 @@ float udRoundBox(float3 p, float3 b, float r)
 	return length(max(abs(p) - b, 0.0)) - r;
 }
 
-float sdBox(float3 p, float3 b)
-{
-	float3 d = abs(p) - b;
-	return min(max(d.x, max(d.y, d.z)), 0.0) + length(max(d, 0.0));
-}
-
 float sdTorus(float3 p, float2 t)
 {
 	float2 q = float2(length(p.xz) - t.x, p.y);
 	return length(q) - t.y;
 }
 
-float sdCylinder(float3 p, float3 c)
-{
-	return length(p.xz - c.xy) - c.z;
-}
-
 float sdCone(float3 p, float2 c)
 {
 	// c must be normalized
@@ -128,7 +158,7 @@ float sdCappedCone(in float3 p, in float3 c)
 	float2 vv = float2(dot(v, v), v.x*v.x);
 	float2 qv = float2(dot(v, w), v.x*w.x);
 	float2 d = max(qv, 0.0)*qv / vv;
-	return sqrt(dot(w, w) - max(d.x, d.y)) * sign(max(q.y*v.x - q.x*v.y, w.y));
+	return sqrt(max(dot(w, w) - max(d.x, d.y), 0.0)) * sign(max(q.y*v.x - q.x*v.y, w.y));
 }
 
 
@@ -154,11 +184,6 @@ float softMin2(float x, float y, float a)
 	return   -0.5*(-x - y + softAbs2(x - y, a));
 }
 
-float Union(float d1, float d2)
-{
-	return min(d1, d2);
-}
-
 float Subtract(float d1, float d2)
 {
 	return max(-d2, d1);
@@ -177,20 +202,10 @@ float3 Twist(float3 p)
 	return float3(mul(m, p.xz), p.y);
 }
 
-float room(float3 Position)
-{
-	return -sdBox(Position, float3(5, 5, 5));
-}
-
-float pillars(float3 Position)
-{
-	float Fun = sdCylinder(Position + float3(3.5, 0, 3.5), float3(0, 0, 0.5));
-	Fun = min(Fun, sdCylinder(Position + float3(-3.5, 0, 3.5), float3(0, 0, 0.5)));
-	Fun = min(Fun, sdCylinder(Position + float3(-3.5, 0, 0), float3(0, 0, 0.5)));
-	Fun = min(Fun, sdCylinder(Position + float3(3.5, 0, 0), float3(0, 0, 0.5)));
-
-	return Fun;
-}
+#include "SdfScene.hlsli"
+#include "LightClusters.hlsli"
+#include "Lightmap.hlsli"
+#include "AmbientOcclusion.hlsli"
 //-------------------------------------------------------------------------------------------------------------------
 
 float Function(float3 Position)
@@ -212,18 +227,26 @@ bool IntersectBox(in Ray ray, in float3 minimum, in float3 maximum, out float ti
 	return timeOut > timeIn;
 }
 
-bool RayMarchingInsideCube(in Ray ray, in float start, in float final, out float val)
+//Only the intervals from the one holding bound up to limit are marched
+bool RayMarchingInsideCube(in Ray ray, in float start, in float final, in float bound, in float limit, out float val)
 {
 	val = 0.0;
 	float step = (final - start) / float(INTERVALS);
-	float time = start;
+
+	//Nothing is closer than bound, so the march starts at the interval holding it. Every sample is placed from start directly, so it lands on the same point whichever interval the march starts from.
+	int first = clamp((int)floor((bound - start) / step), 0, INTERVALS);
+	float time = start + first * step;
 	float3 Position = ray.o + time * ray.d;
+
 	float right, left = Function(Position);
 
-	for (int i = 0; i < INTERVALS; i++)
+	for (int i = first; i < INTERVALS; i++)
 	{
-		time += step;
-		Position += step * ray.d;
+		if (time > limit)
+			return false;
+
+		time = start + (i + 1) * step;
+		Position = ray.o + time * ray.d;
 		right = Function(Position);
 		if (left * right < 0.0)
 		{
@@ -236,14 +259,9 @@ bool RayMarchingInsideCube(in Ray ray, in float start, in float final, out float
 	return false;
 }
 
-float3 CalcNormal(float3 Position) {
-	float A = Function(Position + AxisX * STEP)
-		- Function(Position - AxisX * STEP);
-	float B = Function(Position + AxisY * STEP)
-		- Function(Position - AxisY * STEP);
-	float C = Function(Position + AxisZ * STEP)
-		- Function(Position - AxisZ * STEP);
-	return normalize(float3 (A, B, C));
+//Analytic gradient of the pillars, t is the hit distance along the ray
+float3 CalcNormal(float3 Position, float t) {
+	return normalize(pillarsGradient(Position, max(MIN_EPSILON, t * PIXEL_ANGLE)));
 }
 
 float4 Phong(float3 n, float3 l, float3 v, float shininess, float4 diffuseColor, float4 specularColor)
@@ -262,12 +280,25 @@ float4 Shade(float3 Position, float3 normal, float3 viewDir, float3 color)
 	float4 output = (float4)0;
 	float3 lightDir;
 
-	for (int i = 0; i < NUMLIGHTS; i++)
+	uint2 range = clusterRanges[ClusterIndex(Position)];
+	for (uint i = 0; i < min(range.y, NUMLIGHTS); i++)
 	{
-		lightDir = normalize(LightPos[i] - Position);
-		output += Phong(normal, lightDir, viewDir, 40, float4(color, 1.0f), spec);
+		uint index = clusterLightIndices[range.x + i];
+		if (index < bakedLights)
+			continue;
+
+		ClusterLight light = clusterLights[index];
+		lightDir = normalize(light.position - Position);
+		output += float4(light.color, 1.0) * ClusterAttenuation(light, Position) * Phong(normal, lightDir, viewDir, 40, float4(color, 1.0f), spec);
 	}
 
+	//The baked lights carry their own occlusion
+	output *= SurfaceOcclusion(txSampler, Position, normal);
+
+	//The baked lights are diffuse only, their highlights depend on the view
+	if (bakedLights > 0)
+		output += float4(color * BakedLight(txSampler, Position), 1.0);
+
 	return saturate(LightColor * output);
 }
 
@@ -281,17 +312,18 @@ float2 CalcUV(float3 Position, float3 normal)
 
 }
 
-float4 RayMarching(Ray ray, float2 tex)
+float4 RayMarching(Ray ray, float2 tex, float bound, float limit, out float4 geometry)
 {
 	float4 result = (float4)0;
 	float start, final;
 	float t;
+	geometry = float4(0, 0, 0, -1);
 	if (IntersectBox(ray, BoxMinimum, BoxMaximum, start, final))
 	{
-		if (RayMarchingInsideCube(ray, start, final, t))
+		if (RayMarchingInsideCube(ray, start, final, bound, min(limit, final), t))
 		{
 			float3 Position = ray.o + ray.d * t;
-			float3 normal = CalcNormal(Position);
+			float3 normal = CalcNormal(Position, t);
 			
 			float P = Function(Position);
 
@@ -302,6 +334,7 @@ float4 RayMarching(Ray ray, float2 tex)
 			float3 texNormal = normalize(2 * txNormal.Sample(txSampler, 0.5 * UV).rgb - float3(1, 1, 1));
 
 			result = Shade(Position, texNormal, ray.d, color);
+			geometry = float4(normal, t);
 		}
 		else
 		{
@@ -313,8 +346,12 @@ float4 RayMarching(Ray ray, float2 tex)
 
 }
 
-float4 main(VS_Canvas input) : SV_TARGET
+PS_OUTPUT main(VS_Canvas input, uint primitive : SV_PrimitiveID)
 {
+	//Only every other pixel is marched in checkerboard mode, the rest is reconstructed afterwards
+	if (raymarchMode == RAYMARCH_CHECKERBOARD && (((uint)input.Position.x + (uint)input.Position.y) & 1))
+		discard;
+
 	float zoom = 0.004;
 float2 xy = zoom * input.canvasXY;
 float distEye2Canvas = nearPlane;
@@ -324,5 +361,40 @@ Ray eyeRay;
 eyeRay.o = Eye.xyz;
 eyeRay.d = normalize(PixelPos - Eye.xyz);	//view direction
 
-return RayMarching(eyeRay, input.tex);
+float bound = coneBounded ? txConeBound.Load(int3(input.Position.xy / TILE_SIZE, 0)) : 0.0;
+
+PS_OUTPUT output;
+output.depth = input.Position.z;
+
+if (proxyPass == PROXY_BACKGROUND)
+{
+	output.color = txRoom.Sample(txSampler, input.tex);
+	output.geometry = float4(0, 0, 0, -1);
+	return output;
+}
+
+//The ray only meets the pillar of this box between where it enters and leaves the box
+float limit = farPlane;
+if (proxyPass == PROXY_MARCH)
+{
+	uint proxy = primitive / PROXY_TRIANGLES;
+	float timeIn, timeOut;
+	if (!IntersectBox(eyeRay, proxyMinimum[proxy].xyz, proxyMaximum[proxy].xyz, timeIn, timeOut))
+		discard;
+
+	bound = max(bound, timeIn);
+	limit = timeOut;
 }
+
+output.color = RayMarching(eyeRay, input.tex, bound, limit, output.geometry);
+
+//Missed pixels keep the room of the background pass, the nearest hit of overlapping boxes wins
+if (proxyPass == PROXY_MARCH)
+{
+	if (output.geometry.w < 0.0)
+		discard;
+	output.depth = saturate(output.geometry.w / farPlane);
+}
+
+return output;
+}
\ No newline at end of file
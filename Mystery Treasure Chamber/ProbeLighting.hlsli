@@ -0,0 +1,20 @@
+//Irradiance of the static lights and the open sky at one object, blended from a grid of L2 spherical harmonic probes
+//baked on the CPU by IrradianceProbes::Bake in Content/IrradianceProbes.cpp and interpolated at the object's position.
+
+cbuffer ProbeConstantBuffer : register(b6)
+{
+	float4 probeSH[9];	//irradiance coefficients, rgb
+	uint probeLights;	//scene lights the probes hold, the first ones of the clusters, 0 with the probes off
+	float3 probePadding;
+};
+
+//Same as IrradianceProbes::Evaluate
+float3 ProbeIrradiance(float3 normal)
+{
+	float3 result = 0.282095 * probeSH[0].rgb;
+	result += 0.488603 * (normal.y * probeSH[1].rgb + normal.z * probeSH[2].rgb + normal.x * probeSH[3].rgb);
+	result += 1.092548 * (normal.x * normal.y * probeSH[4].rgb + normal.y * normal.z * probeSH[5].rgb + normal.x * normal.z * probeSH[7].rgb);
+	result += 0.315392 * (3.0 * normal.z * normal.z - 1.0) * probeSH[6].rgb;
+	result += 0.546274 * (normal.x * normal.x - normal.y * normal.y) * probeSH[8].rgb;
+	return result;
+}
@@ -0,0 +1,55 @@
+//Projects the proxy boxes of the pillar pass through the canvas camera of the ray marching passes, so each pixel they cover
+//gets the canvas coordinates of the canvas quad and marches the same ray. RaymarchProxy.cpp is the CPU reference of this shader.
+
+cbuffer ChangesOnResizeConstantBuffer : register(b1)
+{
+	float height;
+	float width;
+	float2 padding;
+}
+
+cbuffer PixelShaderConstantBuffer : register(b3)
+{
+	float4 Eye;
+	float4 LightColor;
+	float4 backgroundColor;
+	float4 LightPos[3];
+	float nearPlane;
+	float farPlane;
+	float2 psPadding;
+};
+
+#define ZOOM 0.004	//canvas units per pixel of the pillar pass
+
+struct VertexShaderInput
+{
+	float3 pos : POSITION;
+	float3 color : COLOR0;
+};
+
+//Canvas
+struct VS_Canvas
+{
+	float4 Position : SV_POSITION;	//vertex position
+	noperspective float2 canvasXY : TEXCOORD0;	//vertex texture coordinates
+	noperspective float2 tex : TEXCOORD1;
+};
+
+VS_Canvas main(VertexShaderInput input)
+{
+	VS_Canvas Output;
+
+	//The pixel ray goes through eye + (pos - eye) / w on the canvas plane z = nearPlane
+	float3 d = input.pos - Eye.xyz;
+	float w = d.z / (nearPlane - Eye.z);
+	float2 canvasSize = float2(width, height);
+	float2 canvas = (Eye.xy * w + d.xy) / ZOOM;
+
+	//Depth comes from the pixel shader
+	Output.Position = float4(canvas / canvasSize, 0.5 * w, w);
+
+	Output.canvasXY = canvas / w;
+	Output.tex = float2((Output.canvasXY.x / width + 1) / 2, (Output.canvasXY.y / height - 1) / -2);
+
+	return Output;
+}
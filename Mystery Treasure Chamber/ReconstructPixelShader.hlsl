@@ -0,0 +1,175 @@
+//Fills in the pixels the ray marching passes skipped in checkerboard or half resolution mode.
+//Neighbouring samples are only blended when their hit distance and normal agree, so edges stay sharp.
+//RaymarchReconstruction.cpp is the CPU reference of this shader.
+
+Texture2D txColor : register(t0);		//marched colour
+Texture2D txGeometry : register(t1);	//marched normal and hit distance, negative distance on a miss
+Texture2D txBackground : register(t2);	//what a miss shows, only used when hasBackground is set
+
+#define RAYMARCH_FULL 0
+#define RAYMARCH_CHECKERBOARD 1
+#define RAYMARCH_HALF 2
+
+#define DEPTH_TOLERANCE 0.05
+#define NORMAL_POWER 8.0
+
+cbuffer RaymarchConstantBuffer : register(b1)
+{
+	uint raymarchMode;
+	uint hasBackground;
+	uint coneBounded;
+	uint proxyPass;
+};
+
+//Canvas
+struct VS_Canvas
+{
+	float4 Position : SV_POSITION;	//vertex position
+	float2 canvasXY : TEXCOORD0;	//vertex texture coordinates
+	float2 tex : TEXCOORD1;
+};
+
+struct Sample
+{
+	float4 color;
+	float4 geometry;
+};
+
+Sample Fetch(int2 pixel)
+{
+	Sample s;
+	s.color = txColor.Load(int3(pixel, 0));
+	s.geometry = txGeometry.Load(int3(pixel, 0));
+	return s;
+}
+
+float Discontinuity(Sample a, Sample b)
+{
+	bool missA = a.geometry.w < 0.0;
+	bool missB = b.geometry.w < 0.0;
+
+	if (missA && missB)
+		return 0.0;
+	if (missA != missB)
+		return 1000.0;
+
+	float depth = abs(a.geometry.w - b.geometry.w) / max(min(a.geometry.w, b.geometry.w), 1e-4);
+	return depth + (1.0 - dot(a.geometry.xyz, b.geometry.xyz));
+}
+
+float Similarity(Sample s, Sample reference)
+{
+	bool missSample = s.geometry.w < 0.0;
+	bool missReference = reference.geometry.w < 0.0;
+
+	if (missSample || missReference)
+		return missSample == missReference ? 1.0 : 0.0;
+
+	float depth = abs(s.geometry.w - reference.geometry.w) / max(reference.geometry.w, 1e-4);
+	float normal = pow(saturate(dot(s.geometry.xyz, reference.geometry.xyz)), NORMAL_POWER);
+	return exp(-depth / DEPTH_TOLERANCE) * normal;
+}
+
+int Mirror(int i, int size)
+{
+	//Stepping off the edge picks the pixel on the other side, which has the same checkerboard parity
+	if (i < 0)
+		return 1;
+	if (i >= size)
+		return size - 2;
+	return i;
+}
+
+float4 ReconstructCheckerboard(int2 pixel, int2 size)
+{
+	Sample left = Fetch(int2(Mirror(pixel.x - 1, size.x), pixel.y));
+	Sample right = Fetch(int2(Mirror(pixel.x + 1, size.x), pixel.y));
+	Sample up = Fetch(int2(pixel.x, Mirror(pixel.y - 1, size.y)));
+	Sample down = Fetch(int2(pixel.x, Mirror(pixel.y + 1, size.y)));
+
+	//Interpolate along the direction that does not cross an edge
+	float horizontal = Discontinuity(left, right);
+	float vertical = Discontinuity(up, down);
+
+	Sample a = left;
+	Sample b = right;
+	if (vertical < horizontal)
+	{
+		a = up;
+		b = down;
+	}
+
+	if (a.geometry.w < 0.0 && b.geometry.w < 0.0 && hasBackground)
+		return txBackground.Load(int3(pixel, 0));
+
+	if (abs(horizontal - vertical) < DEPTH_TOLERANCE)
+		return 0.25 * (left.color + right.color + up.color + down.color);
+
+	return 0.5 * (a.color + b.color);
+}
+
+float4 UpsampleHalf(int2 pixel, int2 size)
+{
+	int2 marchedSize = (size + 1) / 2;
+
+	//Position of the pixel centre in the half resolution image
+	float2 q = (pixel + 0.5) * 0.5 - 0.5;
+	float2 q0 = floor(q);
+	float2 f = q - q0;
+
+	int2 p0 = max((int2)q0, 0);
+	int2 p1 = min((int2)q0 + 1, marchedSize - 1);
+
+	Sample taps[4];
+	taps[0] = Fetch(int2(p0.x, p0.y));
+	taps[1] = Fetch(int2(p1.x, p0.y));
+	taps[2] = Fetch(int2(p0.x, p1.y));
+	taps[3] = Fetch(int2(p1.x, p1.y));
+
+	float weights[4];
+	weights[0] = (1.0 - f.x) * (1.0 - f.y);
+	weights[1] = f.x * (1.0 - f.y);
+	weights[2] = (1.0 - f.x) * f.y;
+	weights[3] = f.x * f.y;
+
+	//The nearest tap decides which surface the pixel belongs to, the others only contribute if they agree
+	int nearest = 0;
+	[unroll]
+	for (int i = 1; i < 4; i++)
+	{
+		if (weights[i] > weights[nearest])
+			nearest = i;
+	}
+
+	Sample reference = taps[nearest];
+	if (reference.geometry.w < 0.0 && hasBackground)
+		return txBackground.Load(int3(pixel, 0));
+
+	float4 color = (float4)0;
+	float total = 0.0;
+	[unroll]
+	for (int j = 0; j < 4; j++)
+	{
+		float w = weights[j] * Similarity(taps[j], reference);
+		color += taps[j].color * w;
+		total += w;
+	}
+
+	return total > 1e-4 ? color / total : reference.color;
+}
+
+float4 main(VS_Canvas input) : SV_TARGET
+{
+	int2 pixel = (int2)input.Position.xy;
+	uint width, height;
+	txColor.GetDimensions(width, height);
+	int2 size = int2(width, height);
+
+	if (raymarchMode == RAYMARCH_HALF)
+		return UpsampleHalf(pixel, size);
+
+	if (((pixel.x + pixel.y) & 1) == 0 || raymarchMode == RAYMARCH_FULL)
+		return txColor.Load(int3(pixel, 0));
+
+	return ReconstructCheckerboard(pixel, size);
+}
@@ -0,0 +1,152 @@
+//Reuses last frame's ray marching result where it is still valid.
+//The surface a pixel saw last frame is moved into the current camera and accepted if it lies on the new ray and faces the eye.
+//Rejected pixels are discarded, which leaves their stencil set so only they are marched afterwards.
+//TemporalReprojection.cpp is the CPU reference of this shader.
+
+Texture2D txHistoryColor : register(t0);
+Texture2D txHistoryGeometry : register(t1);	//normal and hit distance, negative distance on a miss
+
+#define ZOOM 0.004
+#define REFRESH_PERIOD 16
+#define RAY_TOLERANCE 1.0
+#define EDGE_DEPTH_TOLERANCE 0.05
+#define EDGE_NORMAL_TOLERANCE 0.9
+
+cbuffer PixelShaderConstantBuffer : register(b0)
+{
+float4 Eye;
+float4 LightColor;
+float4 backgroundColor;
+float4 LightPos[3];
+float nearPlane;
+float farPlane;
+float2 padding;
+};
+
+cbuffer TemporalConstantBuffer : register(b2)
+{
+	float4 previousEye;
+	float previousNearPlane;
+	uint frameIndex;
+	uint cameraChanged;
+	float temporalPadding;
+};
+
+//Canvas
+struct VS_Canvas
+{
+	float4 Position : SV_POSITION;	//vertex position
+	float2 canvasXY : TEXCOORD0;	//vertex texture coordinates
+	float2 tex : TEXCOORD1;
+};
+
+struct PS_OUTPUT
+{
+	float4 color : SV_TARGET0;
+	float4 geometry : SV_TARGET1;	//normal and hit distance, negative distance on a miss
+};
+
+//Same ray as main() in the ray marching shaders, for a pixel position measured from the top left corner
+float3 CanvasRay(float2 pixel, float2 size, float3 eye, float near)
+{
+	float2 canvasXY = float2(2.0 * pixel.x / size.x - 1.0, 1.0 - 2.0 * pixel.y / size.y) * size;
+	float3 PixelPos = float3(ZOOM * canvasXY, near);
+	return normalize(PixelPos - eye);
+}
+
+//Pixel position Position is seen at from the previous eye
+bool Project(float3 Position, float2 size, out float2 pixel)
+{
+	pixel = (float2)0;
+	float3 d = Position - previousEye.xyz;
+	if (d.z == 0.0)
+		return false;
+
+	float s = (previousNearPlane - previousEye.z) / d.z;
+	if (s <= 0.0)
+		return false;
+
+	float2 canvasXY = (previousEye.xy + s * d.xy) / ZOOM;
+	pixel = float2(canvasXY.x / size.x + 1.0, 1.0 - canvasXY.y / size.y) * 0.5 * size;
+	return true;
+}
+
+//Whether last frame's pixel is next to a miss or another surface, where only marching tells which side the new ray falls on
+bool IsEdge(int2 location, int2 size)
+{
+	float4 center = txHistoryGeometry.Load(int3(location, 0));
+	const int2 offsets[4] = { int2(-1, 0), int2(1, 0), int2(0, -1), int2(0, 1) };
+	for (int i = 0; i < 4; i++)
+	{
+		int2 neighbourLocation = location + offsets[i];
+		if (any(neighbourLocation < 0) || any(neighbourLocation >= size))
+			continue;
+
+		float4 neighbour = txHistoryGeometry.Load(int3(neighbourLocation, 0));
+		if (neighbour.w < 0.0 ||
+			abs(neighbour.w - center.w) > EDGE_DEPTH_TOLERANCE * center.w ||
+			dot(neighbour.xyz, center.xyz) < EDGE_NORMAL_TOLERANCE)
+			return true;
+	}
+	return false;
+}
+
+PS_OUTPUT main(VS_Canvas input)
+{
+	PS_OUTPUT output;
+	uint2 pixel = (uint2)input.Position.xy;
+
+	//A few pixels are marched again every frame so the history never goes stale
+	if ((pixel.x & 3) + 4 * (pixel.y & 3) == frameIndex % REFRESH_PERIOD)
+		discard;
+
+	uint width, height;
+	txHistoryGeometry.GetDimensions(width, height);
+	float2 size = float2(width, height);
+
+	float4 same = txHistoryGeometry.Load(int3(pixel, 0));
+
+	//Nothing moved, so last frame's pixel is exactly right, misses included
+	if (!cameraChanged)
+	{
+		output.color = txHistoryColor.Load(int3(pixel, 0));
+		output.geometry = same;
+		return output;
+	}
+
+	//Without the new hit distance, guess it from last frame's pixel at the same place
+	if (same.w < 0.0)
+		discard;
+
+	float3 direction = CanvasRay(pixel + 0.5, size, Eye.xyz, nearPlane);
+	float3 guess = Eye.xyz + direction * same.w;
+
+	float2 previousPixel;
+	if (!Project(guess, size, previousPixel) || any(previousPixel < 0.0) || any(previousPixel >= size))
+		discard;
+
+	int3 location = int3((int2)previousPixel, 0);
+	float4 candidate = txHistoryGeometry.Load(location);
+	if (candidate.w < 0.0 || IsEdge(location.xy, int2(width, height)))
+		discard;
+
+	//Where last frame actually hit, and whether that point is on the new ray
+	float3 hit = previousEye.xyz + CanvasRay(floor(previousPixel) + 0.5, size, previousEye.xyz, previousNearPlane) * candidate.w;
+	float3 toHit = hit - Eye.xyz;
+	float along = dot(toHit, direction);
+	if (along <= 0.0)
+		discard;
+
+	//One pixel covers 2 * ZOOM of the canvas, which is this far from the eye along the ray
+	float pixelAngle = 2.0 * ZOOM * abs(direction.z) / abs(nearPlane - Eye.z);
+	if (length(cross(toHit, direction)) > RAY_TOLERANCE * pixelAngle * along)
+		discard;
+
+	//Surfaces facing away from the new eye were not visible from it
+	if (dot(candidate.xyz, direction) >= 0.0)
+		discard;
+
+	output.color = txHistoryColor.Load(location);
+	output.geometry = float4(candidate.xyz, along);
+	return output;
+}
@@ -0,0 +1,86 @@
+//Generated by SdfScene::WriteHlsl from Content/SdfScene.h, edit the scene there and generate it again.
+
+float sdBox(float3 p, float3 b)
+{
+	float3 d = abs(p) - b;
+	return min(max(d.x, max(d.y, d.z)), 0.0) + length(max(d, 0.0));
+}
+
+float3 sdBoxGradient(float3 p, float3 b)
+{
+	float3 d = abs(p) - b;
+	float3 s = p < 0.0 ? -1.0 : 1.0;
+	float3 o = max(d, 0.0);
+	if (length(o) > 0.0)
+		return s * o / length(o);
+	return s * (d.x < d.y ? (d.y < d.z ? float3(0.0, 0.0, 1.0) : float3(0.0, 1.0, 0.0)) : (d.x < d.z ? float3(0.0, 0.0, 1.0) : float3(1.0, 0.0, 0.0)));
+}
+
+float sdCylinder(float3 p, float3 c)
+{
+	return length(p.xz - c.xy) - c.z;
+}
+
+float3 sdCylinderGradient(float3 p, float3 c)
+{
+	float2 q = p.xz - c.xy;
+	return float3(q.x, 0.0, q.y) / length(q);
+}
+
+float Union(float d1, float d2)
+{
+	return min(d1, d2);
+}
+
+float room(float3 p)
+{
+	return (-sdBox(p, float3(5.0, 5.0, 5.0)));
+}
+
+float pillars(float3 p)
+{
+	return Union(Union(Union(sdCylinder((p + float3(3.5, 0.0, 3.5)), float3(0.0, 0.0, 0.5)), sdCylinder((p + float3(-3.5, 0.0, 3.5)), float3(0.0, 0.0, 0.5))), sdCylinder((p + float3(-3.5, 0.0, 0.0)), float3(0.0, 0.0, 0.5))), sdCylinder((p + float3(3.5, 0.0, 0.0)), float3(0.0, 0.0, 0.5)));
+}
+
+float3 roomGradient(float3 p, float epsilon)
+{
+	float3 gradient;
+	gradient = sdBoxGradient(p, float3(5.0, 5.0, 5.0));
+	gradient = -gradient;
+	return gradient;
+}
+
+float3 pillarsGradient(float3 p, float epsilon)
+{
+	float d3 = sdCylinder((p + float3(3.5, 0.0, 3.5)), float3(0.0, 0.0, 0.5));
+	float d5 = sdCylinder((p + float3(-3.5, 0.0, 3.5)), float3(0.0, 0.0, 0.5));
+	float d2 = Union(d3, d5);
+	float d7 = sdCylinder((p + float3(-3.5, 0.0, 0.0)), float3(0.0, 0.0, 0.5));
+	float d1 = Union(d2, d7);
+	float d9 = sdCylinder((p + float3(3.5, 0.0, 0.0)), float3(0.0, 0.0, 0.5));
+	float3 gradient;
+	if (d9 < d1)
+	{
+		gradient = sdCylinderGradient((p + float3(3.5, 0.0, 0.0)), float3(0.0, 0.0, 0.5));
+	}
+	else
+	{
+		if (d7 < d2)
+		{
+			gradient = sdCylinderGradient((p + float3(-3.5, 0.0, 0.0)), float3(0.0, 0.0, 0.5));
+		}
+		else
+		{
+			if (d5 < d3)
+			{
+				gradient = sdCylinderGradient((p + float3(-3.5, 0.0, 3.5)), float3(0.0, 0.0, 0.5));
+			}
+			else
+			{
+				gradient = sdCylinderGradient((p + float3(3.5, 0.0, 3.5)), float3(0.0, 0.0, 0.5));
+			}
+		}
+	}
+	return gradient;
+}
+
@@ -0,0 +1,46 @@
+//Lighting of a surface point the way the forward shader of its material does it, shared by the fused pass and the
+//deferred lighting pass so that both modes light the same. DeferredShading::Shade in Content/DeferredShading.cpp is its CPU reference.
+//Needs Eye, LightColor and bakedLights, txSampler, and LightClusters.hlsli, Lightmap.hlsli, AmbientOcclusion.hlsli and Deferred.hlsli included first.
+
+float4 Phong(float3 n, float3 l, float3 v, float shininess, float4 diffuseColor, float4 specularColor)
+{
+	float NdotL = dot(n, l);
+	float diff = saturate(NdotL);
+	float3 r = reflect(l, n);
+	float spec = pow(saturate(dot(v, r)), shininess) * (NdotL > 0.0);
+	return diff * diffuseColor + spec * specularColor;
+}
+
+float4 Shade(uint material, float3 albedo, float3 normal, float3 Position)
+{
+	//The ray marching shaders skip the lights that are in the lightmap and add it instead, and take the
+	//ray direction for the view where the floor and model shaders take the way to the eye
+	bool raymarched = material == MATERIAL_ROOM || material == MATERIAL_PILLAR;
+	float3 viewDir = raymarched ? normalize(Position - Eye.xyz) : normalize(Eye.xyz - Position);
+
+	//The room tints a green highlight with its texture, everything else has a white one
+	float4 diff = float4(albedo, 1.0);
+	float4 spec = material == MATERIAL_ROOM ? float4(0, albedo.g, 0, 1) : float4(1, 1, 1, 1);
+
+	float4 output = (float4)0;
+	uint2 range = clusterRanges[ClusterIndex(Position)];
+	for (uint i = 0; i < min(range.y, NUMLIGHTS); i++)
+	{
+		uint index = clusterLightIndices[range.x + i];
+		if (raymarched && index < bakedLights)
+			continue;
+
+		ClusterLight light = clusterLights[index];
+		float3 lightDir = normalize(light.position - Position);
+		output += float4(light.color, 1.0) * ClusterAttenuation(light, Position) * Phong(normal, lightDir, viewDir, 40, diff, spec);
+	}
+
+	//The floor's normal map only bends the lighting, its occlusion is looked up above the floor
+	output *= SurfaceOcclusion(txSampler, Position, material == MATERIAL_FLOOR ? float3(0, 1, 0) : normal);
+
+	if (raymarched && bakedLights > 0)
+		output += float4(albedo * BakedLight(txSampler, Position), 1.0);
+
+	float scale = material == MATERIAL_FLOOR ? 0.5 : 1.0;
+	return saturate(LightColor * scale * output);
+}
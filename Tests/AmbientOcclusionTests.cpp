@@ -0,0 +1,233 @@
+﻿#include "TestHarness.h"
+
+#include "AmbientOcclusion.h"
+#include "FusedRaymarch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	const float GoldenAngle = 2.39996323f;
+
+	float3 Gradient(const float3& Position)
+	{
+		const float h = 0.001f;
+		return normalize(float3(
+			FusedRaymarch::Scene(Position + float3(h, 0, 0)) - FusedRaymarch::Scene(Position - float3(h, 0, 0)),
+			FusedRaymarch::Scene(Position + float3(0, h, 0)) - FusedRaymarch::Scene(Position - float3(0, h, 0)),
+			FusedRaymarch::Scene(Position + float3(0, 0, h)) - FusedRaymarch::Scene(Position - float3(0, 0, h))));
+	}
+
+	float3 HemisphereDirection(uint32_t i, uint32_t count, const float3& normal)
+	{
+		float r = std::sqrt((i + 0.5f) / count);
+		float phi = i * GoldenAngle;
+
+		float3 helper = std::fabs(normal.y) < 0.99f ? float3(0.0f, 1.0f, 0.0f) : float3(1.0f, 0.0f, 0.0f);
+		float3 tangent = normalize(cross(helper, normal));
+		float3 bitangent = cross(normal, tangent);
+		return r * std::cos(phi) * tangent + r * std::sin(phi) * bitangent + std::sqrt(std::max(0.0f, 1.0f - r * r)) * normal;
+	}
+
+	// Brute force occlusion of a surface point: rays cosine distributed over the hemisphere,
+	// the fraction that leave settings.distance without hitting the scene.
+	float BruteForce(const AmbientOcclusion::Settings& settings, const float3& surface, const float3& normal, uint32_t rays)
+	{
+		float3 origin = surface + 0.01f * normal;
+
+		uint32_t open = 0;
+		for (uint32_t r = 0; r < rays; r++)
+		{
+			float3 direction = HemisphereDirection(r, rays, normal);
+
+			bool hit = false;
+			float t = 0.01f;
+			for (uint32_t i = 0; i < 128 && t < settings.distance; i++)
+			{
+				float d = FusedRaymarch::Scene(origin + t * direction);
+				if (d < 0.001f)
+				{
+					hit = true;
+					break;
+				}
+				t += d;
+			}
+			open += hit ? 0 : 1;
+		}
+		return rays > 0 ? float(open) / rays : 1.0f;
+	}
+
+	// Every pixel of camera that hits the room or a pillar, shaded with brute force occlusion
+	// and with the volume.
+	struct Comparison
+	{
+		uint32_t	hits;
+		double		meanError;		// Mean absolute difference, occlusion goes from 0 to 1.
+		double		maxError;
+		double		meanBruteForce;	// Mean occlusion of each, to see any bias.
+		double		meanVolume;
+		double		bruteForceMilliseconds;
+		double		volumeMilliseconds;
+	};
+
+	Comparison Compare(const AmbientOcclusion::Settings& settings, const AmbientOcclusionVolume& volume,
+		const RaymarchCamera& camera, uint32_t rays)
+	{
+		uint32_t width = static_cast<uint32_t>(camera.width);
+		uint32_t height = static_cast<uint32_t>(camera.height);
+
+		Comparison result = {};
+
+		// Hits first, so that the timings only cover the occlusion.
+		std::vector<float3> surfaces, normals;
+		for (uint32_t y = 0; y < height; y++)
+		{
+			for (uint32_t x = 0; x < width; x++)
+			{
+				float3 direction = camera.Ray(x + 0.5f, y + 0.5f);
+				float t;
+				if (FusedRaymarch::March(FusedRaymarch::Scene, camera.eye, direction, t))
+				{
+					float3 surface = camera.eye + t * direction;
+					surfaces.push_back(surface);
+					normals.push_back(Gradient(surface));
+				}
+			}
+		}
+		result.hits = static_cast<uint32_t>(surfaces.size());
+
+		std::vector<float> bruteForce(surfaces.size()), sampled(surfaces.size());
+		result.bruteForceMilliseconds = TestHarness::Milliseconds([&]() {
+			for (size_t i = 0; i < surfaces.size(); i++)
+				bruteForce[i] = BruteForce(settings, surfaces[i], normals[i], rays);
+		});
+		result.volumeMilliseconds = TestHarness::Milliseconds([&]() {
+			for (size_t i = 0; i < surfaces.size(); i++)
+				sampled[i] = AmbientOcclusion::Sample(volume, AmbientOcclusion::SurfaceSamplePoint(settings, surfaces[i], normals[i]));
+		});
+
+		for (size_t i = 0; i < surfaces.size(); i++)
+		{
+			double error = std::fabs(double(bruteForce[i]) - sampled[i]);
+			result.meanError += error;
+			result.maxError = std::max(result.maxError, error);
+			result.meanBruteForce += bruteForce[i];
+			result.meanVolume += sampled[i];
+		}
+
+		if (result.hits > 0)
+		{
+			result.meanError /= result.hits;
+			result.meanBruteForce /= result.hits;
+			result.meanVolume /= result.hits;
+		}
+		return result;
+	}
+
+	AmbientOcclusion::Settings SmallSettings()
+	{
+		AmbientOcclusion::Settings settings = AmbientOcclusion::DefaultSettings();
+		settings.resolution = 24;
+		return settings;
+	}
+
+	const RaymarchCamera Camera = { float3(0.0f, 3.5f, 5.0f), 1.0f, 0.016f, 160.0f, 90.0f };
+}
+
+TEST(GenerateDoesNotDependOnThreadCount)
+{
+	AmbientOcclusion::Settings settings = SmallSettings();
+	WorkStealingPool single(1), many(4);
+	AmbientOcclusionVolume volume = AmbientOcclusion::Generate(settings, many);
+	AmbientOcclusionVolume reference = AmbientOcclusion::Generate(settings, single);
+
+	EXPECT(volume.values.size() == size_t(24) * 24 * 24);
+	EXPECT(volume.values.size() == reference.values.size());
+	EXPECT(std::memcmp(volume.values.data(), reference.values.data(), volume.values.size() * sizeof(float)) == 0);
+}
+
+TEST(CacheRoundTripsAndRejectsOtherSettings)
+{
+	AmbientOcclusion::Settings settings = SmallSettings();
+	WorkStealingPool pool(2);
+	AmbientOcclusionVolume volume = AmbientOcclusion::Generate(settings, pool);
+
+	std::stringstream stream;
+	EXPECT(AmbientOcclusion::Save(volume, stream));
+
+	AmbientOcclusionVolume loaded;
+	EXPECT(AmbientOcclusion::Load(stream, volume.key, loaded));
+	EXPECT(loaded.resolution == volume.resolution);
+	EXPECT(loaded.values.size() == volume.values.size() &&
+		std::memcmp(loaded.values.data(), volume.values.data(), volume.values.size() * sizeof(float)) == 0);
+
+	AmbientOcclusion::Settings other = settings;
+	other.cones++;
+	EXPECT(AmbientOcclusion::Key(other) != volume.key);
+	stream.clear();
+	stream.seekg(0);
+	EXPECT(!AmbientOcclusion::Load(stream, AmbientOcclusion::Key(other), loaded));
+}
+
+TEST(VolumeMatchesBruteForce)
+{
+	AmbientOcclusion::Settings settings = AmbientOcclusion::DefaultSettings();
+	WorkStealingPool pool(0);
+	AmbientOcclusionVolume volume = AmbientOcclusion::Generate(settings, pool);
+
+	RaymarchCamera camera = Camera;
+	camera.width = 80.0f;
+	camera.height = 45.0f;
+	camera.zoom *= 2.0f;
+	Comparison comparison = Compare(settings, volume, camera, 64);
+	std::printf("%u hits, mean error %.4f, max %.4f, brute force %.3f, volume %.3f\n", comparison.hits,
+		comparison.meanError, comparison.maxError, comparison.meanBruteForce, comparison.meanVolume);
+
+	EXPECT(comparison.hits > 1000);
+	EXPECT(comparison.meanError < 0.15);
+	EXPECT(std::fabs(comparison.meanBruteForce - comparison.meanVolume) < 0.1);
+}
+
+BENCHMARK(CompareWithBruteForce)
+{
+	AmbientOcclusion::Settings settings = AmbientOcclusion::DefaultSettings();
+	WorkStealingPool pool(0);
+	AmbientOcclusionVolume volume = AmbientOcclusion::Generate(settings, pool);
+
+	for (uint32_t rays : { 64u, 256u })
+	{
+		Comparison comparison = Compare(settings, volume, Camera, rays);
+		std::printf("%u rays: %u hits, mean error %.4f, max %.4f, brute force %.1f ms, volume %.2f ms\n", rays,
+			comparison.hits, comparison.meanError, comparison.maxError, comparison.bruteForceMilliseconds,
+			comparison.volumeMilliseconds);
+	}
+}
+
+BENCHMARK(GenerateResolutions)
+{
+	WorkStealingPool pool(0);
+	for (uint32_t resolution : { 32u, 48u, 64u, 96u })
+	{
+		AmbientOcclusion::Settings settings = AmbientOcclusion::DefaultSettings();
+		settings.resolution = resolution;
+		double milliseconds = TestHarness::Milliseconds([&]() { AmbientOcclusion::Generate(settings, pool); });
+		std::printf("%3u^3 voxels %8.1f ms, %.2f Mvoxels/s\n", resolution, milliseconds,
+			double(resolution) * resolution * resolution / (milliseconds * 1000.0));
+	}
+}
+
+BENCHMARK(GenerateScaling)
+{
+	AmbientOcclusion::Settings settings = AmbientOcclusion::DefaultSettings();
+	TestHarness::PrintScaling(0, [&](uint32_t threads) {
+		WorkStealingPool pool(threads);
+		AmbientOcclusion::Generate(settings, pool);
+	});
+}
@@ -0,0 +1,182 @@
+﻿#include "TestHarness.h"
+
+#include "Colonnade.h"
+#include "TemporalReprojection.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	uint32_t Hash(uint32_t x)
+	{
+		x ^= x >> 16;
+		x *= 0x7feb352du;
+		x ^= x >> 15;
+		x *= 0x846ca68bu;
+		x ^= x >> 16;
+		return x;
+	}
+
+	// The distance from every pillar, to check Colonnade::Pillars against.
+	float PillarsBruteForce(const ColonnadeLayout& layout, const float3& p)
+	{
+		float Fun = std::numeric_limits<float>::max();
+		for (uint32_t j = 0; j < layout.pillarsPerSide; j++)
+		{
+			for (uint32_t i = 0; i < layout.pillarsPerSide; i++)
+			{
+				float2 centre = Colonnade::PillarCentre(layout, i, j);
+				Fun = std::min(Fun, length(float2(p.x - centre.x, p.z - centre.y)) - layout.radius);
+			}
+		}
+		return Fun;
+	}
+
+	// Colonnade::March with PillarsBruteForce and no clamping to the cells, what listing every
+	// pillar costs.
+	FusedRaymarch::Hit MarchBruteForce(const ColonnadeLayout& layout, const float3& origin, const float3& direction)
+	{
+		float3 OMIN = (-layout.hallSize - origin) / direction;
+		float3 OMAX = (layout.hallSize - origin) / direction;
+		float3 MAX = max(OMAX, OMIN);
+		float3 MIN = min(OMAX, OMIN);
+		float final = std::min(MAX.x, std::min(MAX.y, MAX.z));
+		float t = std::max(std::max(MIN.x, 0.0f), std::max(MIN.y, MIN.z));
+
+		FusedRaymarch::Hit hit = { FusedRaymarch::Material::None, -1.0f };
+		if (final <= t)
+			return hit;
+
+		for (uint32_t i = 0; i < Colonnade::MaxSteps && t < final; i++)
+		{
+			float distance = PillarsBruteForce(layout, origin + t * direction);
+			if (distance < Colonnade::HitEpsilon)
+			{
+				hit.material = FusedRaymarch::Material::Pillar;
+				hit.t = t;
+				return hit;
+			}
+			t += distance;
+		}
+
+		hit.material = FusedRaymarch::Material::Room;
+		hit.t = final;
+		return hit;
+	}
+
+	// Largest amount Pillars exceeds PillarsBruteForce by at points spread through the hall. It
+	// must be 0, anything more lets a step go through a pillar.
+	float MaxOverestimate(const ColonnadeLayout& layout, uint32_t samples)
+	{
+		float worst = 0.0f;
+		for (uint32_t s = 0; s < samples; s++)
+		{
+			uint32_t h = Hash(s);
+			float3 p(
+				(float(h & 0xffffu) / 65535.0f * 2.0f - 1.0f) * layout.hallSize.x,
+				0.0f,
+				(float(h >> 16) / 65535.0f * 2.0f - 1.0f) * layout.hallSize.z);
+			worst = std::max(worst, Colonnade::Pillars(layout, p) - PillarsBruteForce(layout, p));
+		}
+		return worst;
+	}
+
+	RaymarchCamera MakeCamera(float width, float height)
+	{
+		RaymarchCamera camera = { float3(0.0f, 3.5f, 5.0f), 1.0f, 0.004f * 640.0f / width, width, height };
+		return camera;
+	}
+}
+
+TEST(PillarsNeverOverestimate)
+{
+	for (uint32_t perSide : { 2u, 3u, 7u, 20u, 60u })
+	{
+		EXPECT(MaxOverestimate(Colonnade::MakeLayout(perSide), 20000) <= 0.0f);
+	}
+}
+
+TEST(PillarsAreExactNearThePillars)
+{
+	ColonnadeLayout layout = Colonnade::MakeLayout(7);
+	for (uint32_t j = 0; j < layout.pillarsPerSide; j++)
+	{
+		for (uint32_t i = 0; i < layout.pillarsPerSide; i++)
+		{
+			float2 centre = Colonnade::PillarCentre(layout, i, j);
+			float3 p(centre.x + layout.radius + 0.1f, 1.0f, centre.y);
+			EXPECT(std::fabs(Colonnade::Pillars(layout, p) - PillarsBruteForce(layout, p)) < 1e-4f);
+		}
+	}
+}
+
+TEST(MarchHitsWhatBruteForceHits)
+{
+	RaymarchCamera camera = MakeCamera(160.0f, 120.0f);
+	for (uint32_t perSide : { 2u, 7u, 20u })
+	{
+		ColonnadeLayout layout = Colonnade::MakeLayout(perSide);
+		uint32_t mismatches = 0, pillars = 0;
+		for (uint32_t y = 0; y < 120; y++)
+		{
+			for (uint32_t x = 0; x < 160; x++)
+			{
+				float3 direction = camera.Ray(x + 0.5f, y + 0.5f);
+				uint32_t steps;
+				FusedRaymarch::Hit hit = Colonnade::March(layout, camera.eye, direction, steps);
+				FusedRaymarch::Hit reference = MarchBruteForce(layout, camera.eye, direction);
+				mismatches += hit.material != reference.material ? 1 : 0;
+				pillars += hit.material == FusedRaymarch::Material::Pillar ? 1 : 0;
+			}
+		}
+		std::printf("%u pillars: %u pixels hit a pillar, %u differ\n", perSide * perSide, pillars, mismatches);
+
+		EXPECT(pillars > 0);
+		EXPECT(mismatches <= 160 * 120 / 1000);
+	}
+}
+
+// A pixel costs the same from 400 pillars on, once the grid fills the view. The 4 pillar hall is the
+// room, with fewer cells to cross and rays outside the grid checking fewer pillars, so it is faster.
+BENCHMARK(MarchAgainstGridSize)
+{
+	RaymarchCamera camera = MakeCamera(640.0f, 480.0f);
+	std::vector<float3> directions;
+	for (uint32_t y = 0; y < 480; y++)
+		for (uint32_t x = 0; x < 640; x++)
+			directions.push_back(camera.Ray(x + 0.5f, y + 0.5f));
+	double pixels = double(directions.size());
+
+	for (uint32_t perSide : { 2u, 20u, 200u })
+	{
+		ColonnadeLayout layout = Colonnade::MakeLayout(perSide);
+		uint64_t steps = 0;
+		double milliseconds = TestHarness::Milliseconds([&]() {
+			for (const float3& direction : directions)
+			{
+				uint32_t raySteps;
+				Colonnade::March(layout, camera.eye, direction, raySteps);
+				steps += raySteps;
+			}
+		});
+		std::printf("%6u pillars: %.2f Mrays/s, %.2f steps per pixel", perSide * perSide,
+			pixels / (milliseconds * 1000.0), steps / pixels);
+
+		// Listing every pillar is only timed where it finishes in reasonable time.
+		if (perSide <= 20)
+		{
+			double bruteForce = TestHarness::Milliseconds([&]() {
+				for (const float3& direction : directions)
+					MarchBruteForce(layout, camera.eye, direction);
+			});
+			std::printf(", brute force %.2f Mrays/s", pixels / (bruteForce * 1000.0));
+		}
+		std::printf("\n");
+	}
+}
@@ -0,0 +1,144 @@
+﻿#include "TestHarness.h"
+
+#include "ConeMarch.h"
+
+#include <algorithm>
+#include <cstdio>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	// Spacing of the samples that look for surfaces in front of a bound.
+	const float CheckSpacing = 0.005f;
+
+	// Every pixel of the room and pillar passes marched from its box entry and from its tile's
+	// bound. A mismatch is a pixel whose hit changed at all, an unsafe pixel has a surface before its
+	// bound, found by sampling the ray finely. Steps are averaged over all pixels.
+	struct TileBoundsResult
+	{
+		uint32_t	pixels;
+		uint32_t	mismatches;
+		uint32_t	unsafePixels;
+		double		roomStepsFull;
+		double		roomStepsSeeded;
+		double		pillarStepsFull;
+		double		pillarStepsSeeded;
+		double		meanBound;
+	};
+
+	TileBoundsResult MeasureTileBounds(const RaymarchCamera& camera)
+	{
+		std::vector<float> bounds;
+		ConeMarch::BuildTileBounds(camera, bounds);
+
+		uint32_t width = static_cast<uint32_t>(camera.width);
+		uint32_t height = static_cast<uint32_t>(camera.height);
+		uint32_t tilesX = ConeMarch::TileCount(width);
+
+		TileBoundsResult result = {};
+		result.pixels = width * height;
+
+		uint64_t roomFull = 0, roomSeeded = 0, pillarFull = 0, pillarSeeded = 0;
+		double boundSum = 0.0;
+
+		for (uint32_t y = 0; y < height; y++)
+		{
+			for (uint32_t x = 0; x < width; x++)
+			{
+				float3 direction = camera.Ray(x + 0.5f, y + 0.5f);
+				float bound = bounds[(y / ConeMarch::TileSize) * tilesX + x / ConeMarch::TileSize];
+				boundSum += bound;
+
+				FusedRaymarch::Field fields[2] = { FusedRaymarch::Room, FusedRaymarch::Pillars };
+				for (int pass = 0; pass < 2; pass++)
+				{
+					float fullT = 0.0f, seededT = 0.0f;
+					uint32_t fullSteps, seededSteps;
+					bool fullHit = ConeMarch::MarchFrom(fields[pass], camera.eye, direction, 0.0f, fullT, fullSteps);
+					bool seededHit = ConeMarch::MarchFrom(fields[pass], camera.eye, direction, bound, seededT, seededSteps);
+
+					if (fullHit != seededHit || (fullHit && fullT != seededT))
+						result.mismatches++;
+
+					(pass == 0 ? roomFull : pillarFull) += fullSteps;
+					(pass == 0 ? roomSeeded : pillarSeeded) += seededSteps;
+				}
+
+				// Independent of the march grid: the scene must stay positive all the way to the bound.
+				float start, final;
+				if (FusedRaymarch::IntersectBox(camera.eye, direction, start, final))
+				{
+					for (float t = std::max(start, ConeMarch::MinimumStart); t < bound; t += CheckSpacing)
+					{
+						if (FusedRaymarch::Scene(camera.eye + t * direction) <= 0.0f)
+						{
+							result.unsafePixels++;
+							break;
+						}
+					}
+				}
+			}
+		}
+
+		double perPixel = result.pixels > 0 ? 1.0 / result.pixels : 0.0;
+		result.roomStepsFull = roomFull * perPixel;
+		result.roomStepsSeeded = roomSeeded * perPixel;
+		result.pillarStepsFull = pillarFull * perPixel;
+		result.pillarStepsSeeded = pillarSeeded * perPixel;
+		result.meanBound = boundSum * perPixel;
+		return result;
+	}
+
+	void Print(const TileBoundsResult& result)
+	{
+		std::printf("%u pixels, %u mismatches, %u unsafe, room steps %.1f -> %.1f, pillar steps %.1f -> %.1f, mean bound %.2f\n",
+			result.pixels, result.mismatches, result.unsafePixels, result.roomStepsFull, result.roomStepsSeeded,
+			result.pillarStepsFull, result.pillarStepsSeeded, result.meanBound);
+	}
+
+	RaymarchCamera MakeCamera(float width, float height)
+	{
+		RaymarchCamera camera = { float3(0.0f, 3.5f, 5.0f), 1.0f, 0.004f * 640.0f / width, width, height };
+		return camera;
+	}
+}
+
+TEST(TileBoundsKeepEveryHit)
+{
+	TileBoundsResult result = MeasureTileBounds(MakeCamera(320.0f, 240.0f));
+	Print(result);
+
+	EXPECT(result.mismatches == 0);
+	EXPECT(result.unsafePixels == 0);
+	EXPECT(result.meanBound > 0.0);
+	EXPECT(result.roomStepsSeeded < result.roomStepsFull);
+	EXPECT(result.pillarStepsSeeded < result.pillarStepsFull);
+}
+
+TEST(ConeNeverPassesASurface)
+{
+	RaymarchCamera camera = MakeCamera(320.0f, 240.0f);
+	uint32_t tilesX = ConeMarch::TileCount(320), tilesY = ConeMarch::TileCount(240);
+	for (uint32_t tileY = 0; tileY < tilesY; tileY++)
+	{
+		for (uint32_t tileX = 0; tileX < tilesX; tileX++)
+		{
+			float3 axis = ConeMarch::TileAxis(camera, tileX, tileY);
+			float start, final;
+			if (!FusedRaymarch::IntersectBox(camera.eye, axis, start, final))
+				continue;
+
+			float bound = ConeMarch::MarchCone(FusedRaymarch::Scene, camera.eye, axis,
+				ConeMarch::TileSpread(camera, tileX, tileY), start, final);
+			EXPECT(bound >= start && bound <= final);
+		}
+	}
+}
+
+BENCHMARK(TileBoundSteps)
+{
+	Print(MeasureTileBounds(MakeCamera(640.0f, 480.0f)));
+	Print(MeasureTileBounds(MakeCamera(1280.0f, 720.0f)));
+}
@@ -0,0 +1,313 @@
+﻿#include "TestHarness.h"
+
+#include "DdsDecoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <utility>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	const uint32_t Magic = 0x20534444;	// "DDS "
+	const uint32_t HeaderSize = 124;
+
+	const uint32_t FourCcFlag = 0x4;
+	const uint32_t RgbFlag = 0x40;
+	const uint32_t LuminanceFlag = 0x20000;
+
+	// The DXGI formats the files are written in.
+	enum Format
+	{
+		R8G8Unorm = 49,
+		R16Unorm = 56,
+		R8G8B8A8Unorm = 28,
+		R8G8B8A8UnormSrgb = 29,
+		Bc1Unorm = 71,
+		Bc3Unorm = 77,
+		Bc4Unorm = 80,
+		Bc5Unorm = 83,
+	};
+
+	// Every layout is written from the same bytes, 6 by 5 so that blocks run past the edges.
+	const uint32_t Width = 6, Height = 5;
+
+	uint32_t FourCc(char a, char b, char c, char d)
+	{
+		return uint32_t(uint8_t(a)) | (uint32_t(uint8_t(b)) << 8) | (uint32_t(uint8_t(c)) << 16) | (uint32_t(uint8_t(d)) << 24);
+	}
+
+	float3 Rgb565(uint32_t color)
+	{
+		return float3(((color >> 11) & 31) / 31.0f, ((color >> 5) & 63) / 63.0f, (color & 31) / 31.0f);
+	}
+
+	// Little endian writers for the files the tests decode.
+	void Put32(std::vector<uint8_t>& file, uint32_t value)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			file.push_back(uint8_t(value >> (8 * i)));
+		}
+	}
+
+	// Header of a width by height file with one mip. A fourCc of DX10 is followed by format.
+	std::vector<uint8_t> Header(uint32_t width, uint32_t height, uint32_t flags, uint32_t fourCc, uint32_t bits,
+		uint32_t r, uint32_t g, uint32_t b, uint32_t a, uint32_t format)
+	{
+		std::vector<uint8_t> file;
+		Put32(file, Magic);
+		Put32(file, HeaderSize);
+		Put32(file, 0x1007);	// Caps, height, width and pixel format.
+		Put32(file, height);
+		Put32(file, width);
+		Put32(file, 0);
+		Put32(file, 0);
+		Put32(file, 1);
+		for (int i = 0; i < 11; i++)
+		{
+			Put32(file, 0);
+		}
+		Put32(file, 32);
+		Put32(file, flags);
+		Put32(file, fourCc);
+		Put32(file, bits);
+		Put32(file, r);
+		Put32(file, g);
+		Put32(file, b);
+		Put32(file, a);
+		Put32(file, 0x1000);	// A plain texture.
+		for (int i = 0; i < 4; i++)
+		{
+			Put32(file, 0);
+		}
+
+		if (fourCc == FourCc('D', 'X', '1', '0'))
+		{
+			Put32(file, format);
+			Put32(file, 3);		// Texture2D.
+			Put32(file, 0);
+			Put32(file, 1);
+			Put32(file, 0);
+		}
+		return file;
+	}
+
+	bool Near(const float4& a, const float4& b, float tolerance)
+	{
+		return std::fabs(a.x - b.x) <= tolerance && std::fabs(a.y - b.y) <= tolerance &&
+			std::fabs(a.z - b.z) <= tolerance && std::fabs(a.w - b.w) <= tolerance;
+	}
+
+	// A file and the texels it holds.
+	struct Case
+	{
+		std::vector<uint8_t>	file;
+		std::vector<float4>		expected;
+		float					tolerance;
+	};
+
+	std::vector<Case> WriteCases()
+	{
+		std::vector<uint8_t> bytes(Width * Height * 4);
+		for (size_t i = 0; i < bytes.size(); i++)
+		{
+			bytes[i] = uint8_t((i * 37 + 11) & 255);
+		}
+
+		std::vector<Case> cases;
+
+		auto addUncompressed = [&](std::vector<uint8_t> file, uint32_t texelBytes, float4 (*expect)(const uint8_t*)) {
+			Case c;
+			for (uint32_t i = 0; i < Width * Height; i++)
+			{
+				file.insert(file.end(), &bytes[i * 4], &bytes[i * 4] + texelBytes);
+				c.expected.push_back(expect(&bytes[i * 4]));
+			}
+			c.file = file;
+			c.tolerance = 1e-6f;
+			cases.push_back(c);
+		};
+
+		const uint32_t dx10 = FourCc('D', 'X', '1', '0');
+		addUncompressed(Header(Width, Height, RgbFlag, 0, 32, 0xff, 0xff00, 0xff0000, 0xff000000, 0), 4,
+			[](const uint8_t* p) { return float4(p[0] / 255.0f, p[1] / 255.0f, p[2] / 255.0f, p[3] / 255.0f); });
+		addUncompressed(Header(Width, Height, RgbFlag, 0, 32, 0xff0000, 0xff00, 0xff, 0xff000000, 0), 4,
+			[](const uint8_t* p) { return float4(p[2] / 255.0f, p[1] / 255.0f, p[0] / 255.0f, p[3] / 255.0f); });
+		addUncompressed(Header(Width, Height, LuminanceFlag, 0, 8, 0xff, 0, 0, 0, 0), 1,
+			[](const uint8_t* p) { return float4(p[0] / 255.0f, 0.0f, 0.0f, 1.0f); });
+		addUncompressed(Header(Width, Height, FourCcFlag, dx10, 0, 0, 0, 0, 0, R8G8B8A8Unorm), 4,
+			[](const uint8_t* p) { return float4(p[0] / 255.0f, p[1] / 255.0f, p[2] / 255.0f, p[3] / 255.0f); });
+		addUncompressed(Header(Width, Height, FourCcFlag, dx10, 0, 0, 0, 0, 0, R8G8Unorm), 2,
+			[](const uint8_t* p) { return float4(p[0] / 255.0f, p[1] / 255.0f, 0.0f, 1.0f); });
+		addUncompressed(Header(Width, Height, FourCcFlag, dx10, 0, 0, 0, 0, 0, R16Unorm), 2,
+			[](const uint8_t* p) { return float4((p[0] | (p[1] << 8)) / 65535.0f, 0.0f, 0.0f, 1.0f); });
+		addUncompressed(Header(Width, Height, FourCcFlag, dx10, 0, 0, 0, 0, 0, R8G8B8A8UnormSrgb), 4,
+			[](const uint8_t* p) { return float4(std::pow(p[0] / 255.0f, 2.2f), std::pow(p[1] / 255.0f, 2.2f), std::pow(p[2] / 255.0f, 2.2f), p[3] / 255.0f); });
+		cases.back().tolerance = 0.02f;	// Against the plain 2.2 gamma curve.
+
+		// Block compressed layouts, with the palettes worked out by hand. Both BC1 modes are covered by
+		// swapping the end points of the second row of blocks.
+		const uint32_t blocks = 2 * 2;
+		auto bc4Block = [](uint8_t e0, uint8_t e1, uint32_t seed, std::vector<uint8_t>& file, float values[16]) {
+			file.push_back(e0);
+			file.push_back(e1);
+			uint64_t indices = 0;
+			for (int i = 0; i < 16; i++)
+			{
+				uint64_t index = (seed * 7 + i * 5) & 7;
+				indices |= index << (3 * i);
+
+				float a = e0 / 255.0f, b = e1 / 255.0f;
+				if (index < 2)
+					values[i] = index == 0 ? a : b;
+				else if (e0 > e1)
+					values[i] = ((8 - index) * a + (index - 1) * b) / 7.0f;
+				else
+					values[i] = index == 6 ? 0.0f : index == 7 ? 1.0f : ((6 - index) * a + (index - 1) * b) / 5.0f;
+			}
+			for (int i = 0; i < 6; i++)
+			{
+				file.push_back(uint8_t(indices >> (8 * i)));
+			}
+		};
+		auto bc1Block = [](uint32_t c0, uint32_t c1, uint32_t seed, bool fourColorsOnly, std::vector<uint8_t>& file, float4 texels[16]) {
+			Put32(file, c0 | (c1 << 16));
+			uint32_t indices = 0;
+			for (int i = 0; i < 16; i++)
+			{
+				uint32_t index = (seed + i * 3) & 3;
+				indices |= index << (2 * i);
+
+				float3 a = Rgb565(c0), b = Rgb565(c1);
+				if (index < 2)
+					texels[i] = float4(index == 0 ? a : b, 1.0f);
+				else if (c0 > c1 || fourColorsOnly)
+					texels[i] = float4(index == 2 ? (a * 2.0f + b) / 3.0f : (a + b * 2.0f) / 3.0f, 1.0f);
+				else
+					texels[i] = index == 2 ? float4((a + b) * 0.5f, 1.0f) : float4(0.0f, 0.0f, 0.0f, 0.0f);
+			}
+			Put32(file, indices);
+		};
+
+		const Format blockFormats[] = { Bc1Unorm, Bc3Unorm, Bc4Unorm, Bc5Unorm };
+		for (Format format : blockFormats)
+		{
+			Case c;
+			c.file = format == Bc1Unorm ? Header(Width, Height, FourCcFlag, FourCc('D', 'X', 'T', '1'), 0, 0, 0, 0, 0, 0) :
+				format == Bc4Unorm ? Header(Width, Height, FourCcFlag, FourCc('A', 'T', 'I', '1'), 0, 0, 0, 0, 0, 0) :
+				Header(Width, Height, FourCcFlag, dx10, 0, 0, 0, 0, 0, format);
+
+			std::vector<float4> decoded(blocks * 16);
+			for (uint32_t b = 0; b < blocks; b++)
+			{
+				float4* texels = &decoded[b * 16];
+				float red[16], green[16];
+				uint8_t e0 = bytes[b * 4], e1 = bytes[b * 4 + 1];
+				if (b >= 2)
+					std::swap(e0, e1);
+				uint32_t c0 = bytes[b * 4] * 257u, c1 = bytes[b * 4 + 2] * 129u;
+				if (b >= 2)
+					std::swap(c0, c1);
+
+				switch (format)
+				{
+				case Bc1Unorm:
+					bc1Block(c0, c1, b, false, c.file, texels);
+					break;
+				case Bc3Unorm:
+					bc4Block(e0, e1, b, c.file, red);
+					bc1Block(c0, c1, b, true, c.file, texels);
+					for (int i = 0; i < 16; i++)
+					{
+						texels[i].w = red[i];
+					}
+					break;
+				case Bc4Unorm:
+					bc4Block(e0, e1, b, c.file, red);
+					for (int i = 0; i < 16; i++)
+					{
+						texels[i] = float4(red[i], 0.0f, 0.0f, 1.0f);
+					}
+					break;
+				default:
+					bc4Block(e0, e1, b, c.file, red);
+					bc4Block(e1, e0, b + 1, c.file, green);
+					for (int i = 0; i < 16; i++)
+					{
+						texels[i] = float4(red[i], green[i], 0.0f, 1.0f);
+					}
+					break;
+				}
+			}
+
+			for (uint32_t y = 0; y < Height; y++)
+			{
+				for (uint32_t x = 0; x < Width; x++)
+				{
+					uint32_t block = (y / 4) * 2 + x / 4;
+					c.expected.push_back(decoded[block * 16 + (y % 4) * 4 + x % 4]);
+				}
+			}
+			c.tolerance = 1e-5f;
+			cases.push_back(c);
+		}
+
+		return cases;
+	}
+}
+
+TEST(EveryLayoutDecodes)
+{
+	for (const Case& c : WriteCases())
+	{
+		DdsImage image;
+		EXPECT(DdsDecoder::Decode(c.file.data(), c.file.size(), image));
+		EXPECT(image.width == Width && image.height == Height);
+		if (image.texels.size() != c.expected.size())
+			continue;
+
+		uint32_t wrong = 0;
+		for (size_t i = 0; i < c.expected.size(); i++)
+		{
+			if (!Near(image.texels[i], c.expected[i], c.tolerance))
+				wrong++;
+		}
+		EXPECT(wrong == 0);
+	}
+}
+
+TEST(TruncatedFileIsRefused)
+{
+	std::vector<Case> cases = WriteCases();
+	for (const Case& c : cases)
+	{
+		DdsImage image;
+		EXPECT(!DdsDecoder::Decode(c.file.data(), c.file.size() - 1, image));
+	}
+
+	DdsImage image;
+	EXPECT(!DdsDecoder::Decode(cases[0].file.data(), HeaderSize, image));
+}
+
+TEST(AssetDecodes)
+{
+	std::vector<uint8_t> file = TestHarness::ReadAsset("Textures/StoneWall_1024_height.DDS");
+	EXPECT(!file.empty());
+
+	DdsImage image;
+	EXPECT(DdsDecoder::Decode(file.data(), file.size(), image));
+	EXPECT(image.width == 1024 && image.height == 1024);
+
+	float low = 1.0f, high = 0.0f;
+	for (const float4& texel : image.texels)
+	{
+		low = std::min(low, texel.x);
+		high = std::max(high, texel.x);
+	}
+	std::printf("heights from %.3f to %.3f\n", low, high);
+	EXPECT(low >= 0.0f && high <= 1.0f && low < high);
+}
@@ -0,0 +1,204 @@
+﻿#include "TestHarness.h"
+
+#include "DeferredShading.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	typedef FusedRaymarch::Material Material;
+
+	float3 Gradient(FusedRaymarch::Field field, const float3& Position)
+	{
+		const float h = 0.001f;
+		return normalize(float3(
+			field(Position + float3(h, 0, 0)) - field(Position - float3(h, 0, 0)),
+			field(Position + float3(0, h, 0)) - field(Position - float3(0, h, 0)),
+			field(Position + float3(0, 0, h)) - field(Position - float3(0, 0, h))));
+	}
+
+	// Stands in for the textures, which the CPU does not have.
+	float3 Albedo(const float3& Position)
+	{
+		return float3(
+			0.5f + 0.5f * std::sin(3.0f * Position.x),
+			0.5f + 0.5f * std::sin(5.0f * Position.y + 1.0f),
+			0.5f + 0.5f * std::sin(7.0f * Position.z + 2.0f));
+	}
+
+	// Writes the room, the pillars and the floor as the canvas camera sees them into a G-buffer,
+	// resolves it, and compares with the forward fused pass, which lights the same hits with the
+	// same Shade at full precision. The shading counts are per frame, the separate ones the way the
+	// separate passes paint over each other: the room pass shades every pixel of the room, the
+	// floor and the pillars on top.
+	struct Comparison
+	{
+		uint32_t	pixels;
+		uint32_t	visible;			// Pixels the G-buffer holds a surface for.
+		uint32_t	materialMismatches;	// Texels whose material did not survive packing.
+		double		meanError;			// Largest of rgb, from storing albedo and normal in 8 and 10 bits.
+		double		maxError;
+		uint32_t	separateShaded;
+		uint32_t	deferredShaded;
+	};
+
+	Comparison Compare(const RaymarchCamera& camera, uint32_t torches)
+	{
+		uint32_t width = static_cast<uint32_t>(camera.width);
+		uint32_t height = static_cast<uint32_t>(camera.height);
+
+		Comparison result = {};
+		result.pixels = width * height;
+
+		// The scene lights and the torches the way UpdateLightClusters sorts them, with a coarse
+		// lightmap and occlusion volume so that both are part of the comparison.
+		std::vector<LightmapLight> sceneLights = LightmapBaker::SceneLights();
+		std::vector<ClusterLight> lights;
+		for (const LightmapLight& sceneLight : sceneLights)
+		{
+			lights.push_back(LightClusters::SceneLight(sceneLight.position, sceneLight.color));
+		}
+		std::vector<ClusterLight> wallTorches = LightClusters::WallTorches(torches);
+		lights.insert(lights.end(), wallTorches.begin(), wallTorches.end());
+
+		ClusterFrustum frustum = LightClusters::MakeFrustum(camera);
+		std::vector<ClusterRange> ranges;
+		std::vector<uint32_t> indices;
+		LightClusters::Build(frustum, lights, ranges, indices);
+
+		WorkStealingPool pool(0);
+		LightmapBaker::Settings lightmapSettings = LightmapBaker::DefaultSettings();
+		lightmapSettings.resolution = 16;
+		Lightmap lightmap = LightmapBaker::Bake(lightmapSettings, sceneLights, pool);
+
+		AmbientOcclusion::Settings occlusionSettings = AmbientOcclusion::DefaultSettings();
+		occlusionSettings.resolution = 16;
+		AmbientOcclusionVolume occlusion = AmbientOcclusion::Generate(occlusionSettings, pool);
+
+		DeferredShading::Lighting lighting;
+		lighting.eye = camera.eye;
+		lighting.lightColor = float3(1.0f);
+		lighting.frustum = &frustum;
+		lighting.lights = &lights;
+		lighting.ranges = &ranges;
+		lighting.indices = &indices;
+		lighting.lightsPerCluster = LightClusters::MaxLights;
+		lighting.bakedLights = static_cast<uint32_t>(sceneLights.size());
+		lighting.lightmap = &lightmap;
+		lighting.occlusion = &occlusion;
+
+		std::vector<DeferredShading::Texel> gbuffer(result.pixels);
+		std::vector<float4> fused(result.pixels);
+		for (uint32_t y = 0; y < height; y++)
+		{
+			for (uint32_t x = 0; x < width; x++)
+			{
+				float3 direction = camera.Ray(x + 0.5f, y + 0.5f);
+				float t;
+				result.separateShaded += FusedRaymarch::March(FusedRaymarch::Room, camera.eye, direction, t) ? 1 : 0;
+				result.separateShaded += FusedRaymarch::HitsFloor(camera.eye, direction, t) ? 1 : 0;
+				result.separateShaded += FusedRaymarch::March(FusedRaymarch::Pillars, camera.eye, direction, t) ? 1 : 0;
+
+				DeferredShading::Texel& texel = gbuffer[y * width + x];
+				texel.albedo = DeferredShading::PackAlbedo(float3(), Material::None);
+				texel.normal = 0;
+
+				FusedRaymarch::Hit hit = FusedRaymarch::Fused(camera.eye, direction);
+				if (hit.material == Material::None)
+					continue;
+
+				float3 Position = camera.eye + hit.t * direction;
+				float3 normal = hit.material == Material::Floor ? float3(0.0f, 1.0f, 0.0f) :
+					Gradient(hit.material == Material::Pillar ? FusedRaymarch::Pillars : FusedRaymarch::Room, Position);
+				float3 albedo = Albedo(Position);
+
+				texel.albedo = DeferredShading::PackAlbedo(albedo, hit.material);
+				texel.normal = DeferredShading::PackNormal(normal);
+				texel.position = Position;
+				fused[y * width + x] = DeferredShading::Shade(lighting, hit.material, albedo, normal, Position);
+
+				result.visible++;
+				result.materialMismatches += DeferredShading::UnpackMaterial(texel.albedo) != hit.material ? 1 : 0;
+			}
+		}
+
+		std::vector<float4> deferred;
+		DeferredShading::Resolve(lighting, gbuffer, deferred);
+		result.deferredShaded = result.visible;
+
+		for (size_t i = 0; i < gbuffer.size(); i++)
+		{
+			if (DeferredShading::UnpackMaterial(gbuffer[i].albedo) == Material::None)
+				continue;
+
+			double error = std::max(std::fabs(deferred[i].x - fused[i].x),
+				std::max(std::fabs(deferred[i].y - fused[i].y), std::fabs(deferred[i].z - fused[i].z)));
+			result.meanError += error;
+			result.maxError = std::max(result.maxError, error);
+		}
+		if (result.visible > 0)
+			result.meanError /= result.visible;
+
+		return result;
+	}
+
+	const RaymarchCamera Camera = { float3(0.0f, 3.5f, 5.0f), 1.0f, 0.016f, 160.0f, 90.0f };
+}
+
+TEST(ResolveMatchesFusedForwardShading)
+{
+	for (uint32_t torches : { 0u, 64u })
+	{
+		Comparison result = Compare(Camera, torches);
+		std::printf("%u torches: %u visible, mean error %.5f, max %.5f, %u separate and %u deferred shades\n", torches,
+			result.visible, result.meanError, result.maxError, result.separateShaded, result.deferredShaded);
+
+		EXPECT(result.visible > result.pixels / 2);
+		EXPECT(result.materialMismatches == 0);
+		EXPECT(result.meanError < 0.001);
+		EXPECT(result.maxError < 1.0 / 255.0);
+		EXPECT(result.deferredShaded < result.separateShaded);
+	}
+}
+
+TEST(PackingRoundTrips)
+{
+	const Material materials[] = { Material::None, Material::Room, Material::Pillar, Material::Floor, Material::Model };
+	for (Material material : materials)
+	{
+		uint32_t albedo = DeferredShading::PackAlbedo(float3(0.25f, 0.5f, 1.0f), material);
+		EXPECT(DeferredShading::UnpackMaterial(albedo) == material);
+
+		float3 unpacked = DeferredShading::UnpackAlbedo(albedo);
+		EXPECT(std::fabs(unpacked.x - 0.25f) < 0.5f / 255.0f && std::fabs(unpacked.z - 1.0f) < 0.5f / 255.0f);
+	}
+
+	float3 normal = normalize(float3(0.3f, -0.8f, 0.5f));
+	float3 unpacked = DeferredShading::UnpackNormal(DeferredShading::PackNormal(normal));
+	EXPECT(length(unpacked - normal) < 2.0f / 1023.0f);
+}
+
+TEST(MemoryAddsAlbedoAndNormals)
+{
+	DeferredShading::MemoryUsage memory = DeferredShading::Memory(1920, 1080);
+	EXPECT(memory.albedoBytes == 1920ull * 1080 * DeferredShading::AlbedoBytes);
+	EXPECT(memory.normalBytes == 1920ull * 1080 * DeferredShading::NormalBytes);
+	EXPECT(memory.extraBytes == memory.albedoBytes + memory.normalBytes);
+	EXPECT(memory.totalBytes == memory.albedoBytes + memory.normalBytes + memory.depthBytes);
+}
+
+BENCHMARK(GBufferMemory)
+{
+	uint32_t sizes[][2] = { { 1280, 720 }, { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 } };
+	for (auto& size : sizes)
+	{
+		DeferredShading::MemoryUsage memory = DeferredShading::Memory(size[0], size[1]);
+		std::printf("%4ux%-4u total %6.1f MiB, %6.1f MiB more than depth tested\n", memory.width, memory.height,
+			memory.totalBytes / 1048576.0, memory.extraBytes / 1048576.0);
+	}
+}
@@ -0,0 +1,195 @@
+﻿#include "TestHarness.h"
+
+#include "DisplacementPyramid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	struct Random
+	{
+		uint32_t	state;
+
+		float Next()
+		{
+			state = state * 1664525u + 1013904223u;
+			return static_cast<float>(state >> 8) / 16777216.0f;
+		}
+
+		float Range(float low, float high)		{ return low + (high - low) * Next(); }
+	};
+
+	// The texels along an axis of size that bilinear sampling touches between coordinates low and
+	// high, all of them and without wrapping.
+	std::vector<uint32_t> FootprintTexels(float low, float high, uint32_t size)
+	{
+		int64_t first = int64_t(std::floor(low * size - 0.5f));
+		int64_t last = int64_t(std::floor(high * size - 0.5f)) + 1;
+
+		std::vector<uint32_t> texels;
+		for (int64_t i = first; i <= last && i < first + int64_t(size); i++)
+		{
+			int64_t wrapped = i % int64_t(size);
+			texels.push_back(uint32_t(wrapped < 0 ? wrapped + int64_t(size) : wrapped));
+		}
+		return texels;
+	}
+
+	// Lowest and highest texel of the footprint of the region, texel by texel.
+	DisplacementRange FootprintRange(const DisplacementPyramidLevel& base, const float2& textureMin, const float2& textureMax)
+	{
+		DisplacementRange range = { 1e30f, -1e30f };
+		for (uint32_t y : FootprintTexels(textureMin.y, textureMax.y, base.height))
+		{
+			for (uint32_t x : FootprintTexels(textureMin.x, textureMax.x, base.width))
+			{
+				float value = base.low[size_t(y) * base.width + x];
+				range.low = std::min(range.low, value);
+				range.high = std::max(range.high, value);
+			}
+		}
+		return range;
+	}
+
+	// Range over random regions of a pyramid against the exact bounds of each region's footprint.
+	struct RegionResult
+	{
+		uint32_t	regions;
+		uint32_t	unsafeRegions;		// Range misses a texel of the footprint.
+		double		meanTightness;		// Exact footprint range over Range's range, 1 is exact.
+		double		meanWholeFraction;	// Range's range over the whole texture's range.
+	};
+
+	RegionResult CheckRegions(const DisplacementPyramid& pyramid, Random& random, uint32_t regions)
+	{
+		RegionResult result = {};
+		DisplacementRange whole = DisplacementBounds::Whole(pyramid);
+		for (uint32_t i = 0; i < regions; i++)
+		{
+			// From a texel or two up to more than the whole texture, anywhere including past its edges.
+			float size = std::pow(2.0f, random.Range(-11.0f, 0.5f));
+			float2 textureMin(random.Range(-1.0f, 2.0f), random.Range(-1.0f, 2.0f));
+			float2 textureMax(textureMin.x + size * random.Range(0.25f, 1.0f), textureMin.y + size * random.Range(0.25f, 1.0f));
+
+			DisplacementRange exact = FootprintRange(pyramid.levels[0], textureMin, textureMax);
+			DisplacementRange bounds = DisplacementBounds::Range(pyramid, textureMin, textureMax);
+
+			result.regions++;
+			result.unsafeRegions += bounds.low > exact.low || bounds.high < exact.high;
+
+			float boundsSize = bounds.high - bounds.low;
+			result.meanTightness += boundsSize > 0.0f ? (exact.high - exact.low) / boundsSize : 1.0;
+			result.meanWholeFraction += whole.high > whole.low ? boundsSize / (whole.high - whole.low) : 1.0;
+		}
+
+		if (result.regions > 0)
+		{
+			result.meanTightness /= result.regions;
+			result.meanWholeFraction /= result.regions;
+		}
+		return result;
+	}
+
+	// Texels of any level that differ between the two pyramids, or 1 for each level of another size.
+	uint32_t Mismatches(const DisplacementPyramid& a, const DisplacementPyramid& b)
+	{
+		uint32_t mismatches = 0;
+		for (size_t level = 0; level < std::min(a.levels.size(), b.levels.size()); level++)
+		{
+			const DisplacementPyramidLevel& x = a.levels[level];
+			const DisplacementPyramidLevel& y = b.levels[level];
+			if (x.width != y.width || x.height != y.height)
+			{
+				mismatches++;
+				continue;
+			}
+			for (size_t i = 0; i < x.low.size(); i++)
+			{
+				mismatches += std::memcmp(&x.low[i], &y.low[i], sizeof(float)) != 0 || std::memcmp(&x.high[i], &y.high[i], sizeof(float)) != 0;
+			}
+		}
+		return mismatches + uint32_t(std::max(a.levels.size(), b.levels.size()) - std::min(a.levels.size(), b.levels.size()));
+	}
+
+	DdsImage RandomImage(uint32_t width, uint32_t height, Random& random)
+	{
+		DdsImage image;
+		image.width = width;
+		image.height = height;
+		for (uint32_t i = 0; i < width * height; i++)
+		{
+			image.texels.push_back(float4(0.0f, random.Next(), 0.0f, 1.0f));
+		}
+		return image;
+	}
+}
+
+TEST(SimdBuildMatchesScalar)
+{
+	std::printf("reduced with %s\n", DisplacementBounds::GetSimdName());
+
+	// Odd sizes as well, where the last texel of each level covers only one below.
+	Random random = { 29 };
+	const uint32_t sizes[][2] = { { 1, 1 }, { 37, 23 }, { 64, 64 }, { 257, 130 } };
+	for (auto& size : sizes)
+	{
+		DdsImage image = RandomImage(size[0], size[1], random);
+		DisplacementPyramid simd = DisplacementBounds::Build(image);
+		EXPECT(simd.levels.back().width == 1 && simd.levels.back().height == 1);
+		EXPECT(Mismatches(simd, DisplacementBounds::BuildScalar(image)) == 0);
+	}
+}
+
+TEST(RangeCoversEveryFootprint)
+{
+	Random random = { 29 };
+	const uint32_t sizes[][2] = { { 37, 23 }, { 256, 256 } };
+	for (auto& size : sizes)
+	{
+		DisplacementPyramid pyramid = DisplacementBounds::Build(RandomImage(size[0], size[1], random));
+		RegionResult result = CheckRegions(pyramid, random, 4000);
+		std::printf("%ux%u: %u regions, %u unsafe, tightness %.3f, %.3f of the whole range\n", size[0], size[1],
+			result.regions, result.unsafeRegions, result.meanTightness, result.meanWholeFraction);
+
+		EXPECT(result.unsafeRegions == 0);
+		EXPECT(result.meanTightness > 0.5);
+	}
+}
+
+TEST(WholeIsTheTexturesRange)
+{
+	Random random = { 7 };
+	DdsImage image = RandomImage(19, 11, random);
+	float low = 1.0f, high = 0.0f;
+	for (const float4& texel : image.texels)
+	{
+		low = std::min(low, texel.y);
+		high = std::max(high, texel.y);
+	}
+
+	DisplacementRange whole = DisplacementBounds::Whole(DisplacementBounds::Build(image));
+	EXPECT(whole.low == low && whole.high == high);
+
+	DisplacementRange unknown = DisplacementBounds::Whole(DisplacementPyramid());
+	EXPECT(unknown.low == 0.0f && unknown.high == 1.0f);
+}
+
+BENCHMARK(BuildAgainstScalar)
+{
+	Random random = { 29 };
+	DdsImage image = RandomImage(2048, 2048, random);
+
+	double simd = 1e30, scalar = 1e30;
+	for (uint32_t run = 0; run < 5; run++)
+	{
+		simd = std::min(simd, TestHarness::Milliseconds([&]() { DisplacementBounds::Build(image); }));
+		scalar = std::min(scalar, TestHarness::Milliseconds([&]() { DisplacementBounds::BuildScalar(image); }));
+	}
+	std::printf("2048x2048: %s %.2f ms, scalar %.2f ms, %.2fx\n", DisplacementBounds::GetSimdName(), simd, scalar, scalar / simd);
+}
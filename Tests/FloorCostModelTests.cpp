@@ -0,0 +1,175 @@
+﻿#include "TestHarness.h"
+
+#include "FloorCostModel.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+
+using namespace Mystery_Treasure_Chamber;
+
+namespace
+{
+	struct Random
+	{
+		uint32_t	state;
+
+		float Next()
+		{
+			state = state * 1664525u + 1013904223u;
+			return static_cast<float>(state >> 8) / 16777216.0f;
+		}
+
+		float Range(float low, float high)		{ return low + (high - low) * Next(); }
+	};
+
+	// True costs of the modes in one simulated frame, in milliseconds.
+	typedef double (*CostFunction)(FloorMode mode, uint32_t frame, uint32_t frames);
+
+	struct Simulation
+	{
+		uint32_t	frames[FloorCostModel::ModeCount];	// Frames each mode was drawn.
+		uint32_t	firstFrameOff;		// First frame of the second half not drawn with the mesh.
+		uint32_t	secondHalfSwitches;
+		FloorMode	last;
+	};
+
+	// Frames with noisy costs and measurements that arrive two frames late.
+	Simulation Simulate(DeviceClass device, CostFunction cost, uint32_t meshFrame, uint32_t frames, uint32_t seed)
+	{
+		Simulation simulation = {};
+		simulation.firstFrameOff = UINT32_MAX;
+
+		FloorCostModel model(device);
+		Random random = { seed };
+		std::deque<std::pair<FloorMode, double>> inFlight;
+		uint32_t switches = 0;
+		for (uint32_t frame = 0; frame < frames; frame++)
+		{
+			model.SetAvailable(FloorMode::BakedMesh, frame >= meshFrame);
+			FloorMode mode = model.Choose();
+			simulation.frames[static_cast<uint32_t>(mode)]++;
+			if (frame == frames / 2)
+				switches = model.GetSwitches();
+			if (frame >= frames / 2 && mode != FloorMode::BakedMesh && simulation.firstFrameOff == UINT32_MAX)
+				simulation.firstFrameOff = frame;
+
+			// Timestamp queries come back a couple of frames after the draw.
+			inFlight.push_back(std::make_pair(mode, cost(mode, frame, frames) * random.Range(0.9f, 1.1f)));
+			if (inFlight.size() > 2)
+			{
+				model.Record(inFlight.front().first, inFlight.front().second);
+				inFlight.pop_front();
+			}
+			simulation.last = mode;
+		}
+		simulation.secondHalfSwitches = model.GetSwitches() - switches;
+		return simulation;
+	}
+
+	double HardwareCost(FloorMode mode, uint32_t, uint32_t)
+	{
+		return mode == FloorMode::Tessellated ? 1.2 : mode == FloorMode::BakedMesh ? 0.5 : 0.8;
+	}
+
+	double WarpCost(FloorMode mode, uint32_t, uint32_t)
+	{
+		return mode == FloorMode::Tessellated ? 60.0 : mode == FloorMode::BakedMesh ? 14.0 : 9.0;
+	}
+
+	// The mesh gets three times as expensive halfway, as if the window grew much larger.
+	double ChangingCost(FloorMode mode, uint32_t frame, uint32_t frames)
+	{
+		return mode == FloorMode::BakedMesh && frame >= frames / 2 ? 1.5 : HardwareCost(mode, frame, frames);
+	}
+
+	double CloseCost(FloorMode mode, uint32_t, uint32_t)
+	{
+		return mode == FloorMode::Tessellated ? 1.2 : mode == FloorMode::BakedMesh ? 0.50 : 0.52;
+	}
+
+	// Frames of each simulation.
+	const uint32_t Frames = 2000;
+}
+
+TEST(SettlesOnTheCheapestMode)
+{
+	// The mesh arrives a while after the start, as its bake finishes.
+	Simulation hardware = Simulate(DeviceClass::Hardware, HardwareCost, Frames / 10, Frames, 3);
+	EXPECT(hardware.last == FloorMode::BakedMesh);
+	EXPECT(hardware.secondHalfSwitches == 0);
+}
+
+TEST(WarpBarelyTessellates)
+{
+	// Guessed more than skipFactor times as expensive as the others, tessellation is never drawn.
+	Simulation warp = Simulate(DeviceClass::Warp, WarpCost, 0, Frames, 5);
+	EXPECT(warp.last == FloorMode::Parallax);
+	EXPECT(warp.frames[static_cast<uint32_t>(FloorMode::Tessellated)] == 0);
+}
+
+TEST(AdaptsWhenAModeGetsExpensive)
+{
+	Simulation changing = Simulate(DeviceClass::Hardware, ChangingCost, 0, Frames, 7);
+	std::printf("left the mesh %u frames after it got expensive\n", changing.firstFrameOff - Frames / 2);
+	EXPECT(changing.firstFrameOff != UINT32_MAX);
+	EXPECT(changing.firstFrameOff - Frames / 2 < 100);
+}
+
+TEST(CloseModesDoNotFlicker)
+{
+	Simulation close = Simulate(DeviceClass::Hardware, CloseCost, 0, Frames, 11);
+	EXPECT(close.secondHalfSwitches == 0);
+}
+
+TEST(UnavailableModesAreSkipped)
+{
+	FloorCostModel model(DeviceClass::Hardware);
+	model.SetAvailable(FloorMode::BakedMesh, false);
+	for (uint32_t frame = 0; frame < 100; frame++)
+	{
+		FloorMode mode = model.Choose();
+		EXPECT(mode != FloorMode::BakedMesh);
+		model.Record(mode, mode == FloorMode::Parallax ? 0.7 : 1.1);
+	}
+	EXPECT(model.GetCurrent() == FloorMode::Parallax);
+	EXPECT(model.GetSamples(FloorMode::BakedMesh) == 0);
+	EXPECT(model.GetSamples(FloorMode::Tessellated) > 0);
+	std::printf("%ls\n", model.Report().c_str());
+}
+
+TEST(CalibratesUntilEveryModeWorthTryingIsMeasured)
+{
+	FloorCostModel model(DeviceClass::Warp);
+	EXPECT(model.IsCalibrating());
+
+	uint32_t frames = 0;
+	while (model.IsCalibrating() && frames < 100)
+	{
+		FloorMode mode = model.Choose();
+		model.Record(mode, WarpCost(mode, frames, 100));
+		frames++;
+	}
+	EXPECT(!model.IsCalibrating());
+	EXPECT(model.GetSamples(FloorMode::BakedMesh) >= FloorCostModel::DefaultSettings().calibrationSamples);
+	EXPECT(model.GetSamples(FloorMode::Parallax) >= FloorCostModel::DefaultSettings().calibrationSamples);
+	EXPECT(model.GetSamples(FloorMode::Tessellated) == 0);
+
+	// The mesh arriving after its bake has to be measured too, and nothing is left to measure
+	// without any mode.
+	model.Reset(DeviceClass::Hardware);
+	model.SetAvailable(FloorMode::BakedMesh, false);
+	for (frames = 0; frames < 100; frames++)
+	{
+		FloorMode mode = model.Choose();
+		model.Record(mode, HardwareCost(mode, frames, 100));
+	}
+	EXPECT(!model.IsCalibrating());
+	model.SetAvailable(FloorMode::BakedMesh, true);
+	EXPECT(model.IsCalibrating());
+
+	model.SetAvailable(FloorMode::BakedMesh, false);
+	model.SetAvailable(FloorMode::Parallax, false);
+	model.SetAvailable(FloorMode::Tessellated, false);
+	EXPECT(!model.IsCalibrating());
+}
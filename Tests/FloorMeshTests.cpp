@@ -0,0 +1,220 @@
+﻿#include "TestHarness.h"
+
+#include "FloorMesh.h"
+#include "RaymarchDepth.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	// (1 - t) a + t b, the way the domain shader blends its control points.
+	float3 Blend(const float3& a, const float3& b, float t)
+	{
+		return a * (1.0f - t) + b * t;
+	}
+
+	float2 Blend(const float2& a, const float2& b, float t)
+	{
+		return a * (1.0f - t) + b * t;
+	}
+
+	bool SameLod(const FloorMeshLod& a, const FloorMeshLod& b)
+	{
+		return a.segments == b.segments && a.vertices.size() == b.vertices.size() && a.indices.size() == b.indices.size() &&
+			std::memcmp(a.vertices.data(), b.vertices.data(), a.vertices.size() * sizeof(FloorMeshVertex)) == 0 &&
+			std::memcmp(a.indices.data(), b.indices.data(), a.indices.size() * sizeof(uint32_t)) == 0;
+	}
+
+	// The displacement the app loads is not in the repository, so the tests bake the stone wall's
+	// height map, which is single channel. The floor reads green, so red is copied there.
+	std::vector<uint8_t> HeightFile()
+	{
+		return TestHarness::ReadAsset("Textures/StoneWall_1024_height.DDS");
+	}
+
+	bool DecodeHeight(const std::vector<uint8_t>& file, DdsImage& image)
+	{
+		if (!DdsDecoder::Decode(file.data(), file.size(), image))
+			return false;
+
+		for (float4& texel : image.texels)
+		{
+			texel.y = texel.x;
+		}
+		return true;
+	}
+
+	// The finest level and the tessellated floor at factor 32, evaluated the way the domain
+	// shader does.
+	struct Comparison
+	{
+		uint32_t	vertices;
+		uint32_t	tessellatedVertices;	// Domain points of the patch grid compared with the mesh.
+		double		maxError;				// Largest distance between the two, in object space.
+	};
+
+	Comparison CompareWithTessellation(const DdsImage& image, const FloorMesh& mesh)
+	{
+		Comparison result = {};
+		const FloorMeshLod& finest = mesh.lods[0];
+		result.vertices = static_cast<uint32_t>(finest.vertices.size());
+
+		// Every domain point of every patch at factor 32, as DomainShader.hlsl places it. The patch's
+		// u runs along x and v from z1 back to z0, so the point lands on the mesh's vertex
+		// (x * factor + i, z * factor + factor - j).
+		const uint32_t patches = FloorTessellation::DefaultPatches, factor = 32;
+		std::vector<FloorControlPoint> points;
+		FloorTessellation::BuildPatchGrid(patches, points);
+		uint32_t row = finest.segments + 1;
+		for (uint32_t z = 0; z < patches; z++)
+		{
+			for (uint32_t x = 0; x < patches; x++)
+			{
+				const FloorControlPoint* patch = &points[(size_t(z) * patches + x) * 4];
+				for (uint32_t j = 0; j <= factor; j++)
+				{
+					for (uint32_t i = 0; i <= factor; i++)
+					{
+						float u = float(i) / factor, v = float(j) / factor;
+						float3 position = Blend(Blend(patch[0].position, patch[1].position, v), Blend(patch[2].position, patch[3].position, v), u);
+						float2 texture = Blend(Blend(patch[0].texture, patch[1].texture, v), Blend(patch[2].texture, patch[3].texture, v), u);
+						position.y -= FloorTessellation::DisplacementScale * FloorMeshBaker::Displacement(image, texture);
+
+						const FloorMeshVertex& vertex = finest.vertices[size_t(z * factor + factor - j) * row + x * factor + i];
+						result.maxError = std::max(result.maxError, double(length(vertex.position - position)));
+						result.tessellatedVertices++;
+					}
+				}
+			}
+		}
+		return result;
+	}
+}
+
+TEST(FinestLevelMatchesTessellation)
+{
+	DdsImage image;
+	EXPECT(DecodeHeight(HeightFile(), image));
+
+	FloorMeshBaker::Settings settings = FloorMeshBaker::DefaultSettings();
+	EXPECT(settings.segments == FloorTessellation::DefaultPatches * 32);
+	FloorMesh mesh = FloorMeshBaker::Bake(settings, image, 0);
+	EXPECT(!mesh.lods.empty());
+	if (mesh.lods.empty())
+		return;
+
+	Comparison comparison = CompareWithTessellation(image, mesh);
+	std::printf("%u vertices, %u domain points, max error %g\n", comparison.vertices, comparison.tessellatedVertices,
+		comparison.maxError);
+	EXPECT(comparison.tessellatedVertices > comparison.vertices);
+	EXPECT(comparison.maxError < 1e-5);
+}
+
+TEST(EveryTriangleFacesUp)
+{
+	DdsImage image;
+	EXPECT(DecodeHeight(HeightFile(), image));
+	FloorMesh mesh = FloorMeshBaker::Bake(FloorMeshBaker::DefaultSettings(), image, 0);
+
+	// Front faces are clockwise seen from above, so their normals as D3D winds them point down.
+	uint32_t triangles = 0, flipped = 0;
+	for (const FloorMeshLod& lod : mesh.lods)
+	{
+		for (size_t t = 0; t < lod.indices.size(); t += 3)
+		{
+			float3 a = lod.vertices[lod.indices[t]].position;
+			float3 b = lod.vertices[lod.indices[t + 1]].position;
+			float3 c = lod.vertices[lod.indices[t + 2]].position;
+			flipped += cross(b - a, c - a).y >= 0.0f;
+			triangles++;
+		}
+	}
+	EXPECT(triangles > 0);
+	EXPECT(flipped == 0);
+}
+
+TEST(TexelCentresSampleTheTexel)
+{
+	DdsImage image;
+	EXPECT(DecodeHeight(HeightFile(), image));
+
+	uint32_t errors = 0;
+	for (uint32_t y = 0; y < image.height; y += 7)
+	{
+		for (uint32_t x = 0; x < image.width; x += 7)
+		{
+			float2 centre((x + 0.5f) / image.width, (y + 0.5f) / image.height);
+			errors += std::fabs(FloorMeshBaker::Displacement(image, centre) - image.texels[size_t(y) * image.width + x].y) > 1e-6f;
+		}
+	}
+	EXPECT(errors == 0);
+}
+
+TEST(CacheRoundTripsAndRejectsOtherTextures)
+{
+	std::vector<uint8_t> file = HeightFile();
+	DdsImage image;
+	EXPECT(DecodeHeight(file, image));
+
+	FloorMeshBaker::Settings settings = FloorMeshBaker::DefaultSettings();
+	uint64_t key = FloorMeshBaker::Key(settings, file.data(), file.size());
+	FloorMesh mesh = FloorMeshBaker::Bake(settings, image, key);
+
+	std::stringstream stream(std::ios::in | std::ios::out | std::ios::binary);
+	EXPECT(FloorMeshBaker::Save(mesh, stream));
+	FloorMesh loaded;
+	EXPECT(FloorMeshBaker::Load(stream, key, loaded));
+	EXPECT(loaded.lods.size() == mesh.lods.size());
+	for (size_t lod = 0; lod < std::min(loaded.lods.size(), mesh.lods.size()); lod++)
+	{
+		EXPECT(SameLod(loaded.lods[lod], mesh.lods[lod]));
+	}
+
+	std::vector<uint8_t> changed = file;
+	changed[changed.size() / 2] ^= 1;
+	stream.clear();
+	stream.seekg(0);
+	EXPECT(!FloorMeshBaker::Load(stream, FloorMeshBaker::Key(settings, changed.data(), changed.size()), loaded));
+}
+
+TEST(FartherEyesSelectCoarserLevels)
+{
+	std::vector<uint32_t> segments = { 1024, 512, 256, 128, 64 };
+	const float fov = 70.0f * 3.14159265f / 180.0f;
+	uint32_t previous = 0;
+	for (float distance : { 1.0f, 5.0f, 20.0f, 80.0f })
+	{
+		float3 eye(0.0f, -2.5f + distance, distance);
+		float4x4 viewProjection = mul(RaymarchDepth::LookAtRH(eye, float3(0.0f, -2.5f, 0.0f), float3(0.0f, 1.0f, 0.0f)),
+			RaymarchDepth::PerspectiveFovRH(fov, 16.0f / 9.0f, 0.01f, 100.0f));
+		FloorTessellation::Settings settings = FloorTessellation::DefaultSettings(eye, viewProjection, fov, 1080.0f);
+
+		uint32_t lod = FloorMeshBaker::SelectLod(segments, settings);
+		EXPECT(lod >= previous && lod < segments.size());
+		previous = lod;
+
+		settings.targetPixels = 0.0f;
+		EXPECT(FloorMeshBaker::SelectLod(segments, settings) == 0);
+	}
+	EXPECT(previous > 0);
+}
+
+BENCHMARK(Bake)
+{
+	DdsImage image;
+	DecodeHeight(HeightFile(), image);
+	FloorMesh mesh;
+	double milliseconds = TestHarness::Milliseconds([&]() { mesh = FloorMeshBaker::Bake(FloorMeshBaker::DefaultSettings(), image, 0); });
+	std::printf("baked in %.1f ms\n", milliseconds);
+	for (const FloorMeshLod& lod : mesh.lods)
+	{
+		std::printf("%5u segments: %8zu vertices, %8zu triangles\n", lod.segments, lod.vertices.size(), lod.indices.size() / 3);
+	}
+}
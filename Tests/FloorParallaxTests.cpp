@@ -0,0 +1,161 @@
+﻿#include "TestHarness.h"
+
+#include "FloorParallax.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	struct Random
+	{
+		uint32_t	state;
+
+		float Next()
+		{
+			state = state * 1664525u + 1013904223u;
+			return static_cast<float>(state >> 8) / 16777216.0f;
+		}
+
+		float Range(float low, float high)		{ return low + (high - low) * Next(); }
+	};
+
+	// The stone wall's height map, which is single channel, with red copied to the green the
+	// floor reads.
+	DdsImage HeightImage()
+	{
+		std::vector<uint8_t> file = TestHarness::ReadAsset("Textures/StoneWall_1024_height.DDS");
+		DdsImage image = {};
+		if (DdsDecoder::Decode(file.data(), file.size(), image))
+		{
+			for (float4& texel : image.texels)
+			{
+				texel.y = texel.x;
+			}
+		}
+		return image;
+	}
+
+	// Rays from random eyes in the room to random points of the floor. The CPU samples only
+	// the top mip, where the shader picks a mip by the pixel's footprint.
+	struct Comparison
+	{
+		uint32_t	rays;
+		double		meanError;			// Distance between March and Trace, in world units.
+		double		maxError;
+		double		flatMeanError;		// Distance between the flat floor and Trace, what drawing it flat gets wrong.
+		double		meanLayers;
+		uint32_t	grazingRays;		// Rays less than 15 degrees above the floor, where the layers are thinnest.
+		double		grazingMeanError;
+	};
+
+	Comparison Compare(const FloorParallax::Settings& settings, const DdsImage& image, uint32_t rays)
+	{
+		Comparison result = {};
+		Random random = { 43 };
+		const float size = FloorTessellation::FloorScale;
+		const float grazing = std::sin(15.0f * 3.14159265f / 180.0f);
+
+		double error = 0.0, flatError = 0.0, layers = 0.0, grazingError = 0.0;
+		for (uint32_t ray = 0; ray < rays; ray++)
+		{
+			// Eyes anywhere in the room at least half a unit above the floor.
+			float3 eye(random.Range(-0.9f * size, 0.9f * size), random.Range(FloorTessellation::FloorHeight + 0.5f, 0.9f * size),
+				random.Range(-0.9f * size, 0.9f * size));
+			float3 floor(random.Range(-size, size), FloorTessellation::FloorHeight, random.Range(-size, size));
+
+			FloorParallax::Hit marched = FloorParallax::March(settings, image, eye, floor);
+			FloorParallax::Hit traced = FloorParallax::Trace(image, eye, floor);
+
+			double distance = length(marched.worldPosition - traced.worldPosition);
+			error += distance;
+			result.maxError = std::max(result.maxError, distance);
+			flatError += length(floor - traced.worldPosition);
+			layers += marched.layers;
+
+			if (-normalize(floor - eye).y < grazing)
+			{
+				result.grazingRays++;
+				grazingError += distance;
+			}
+			result.rays++;
+		}
+
+		result.meanError = result.rays > 0 ? error / result.rays : 0.0;
+		result.flatMeanError = result.rays > 0 ? flatError / result.rays : 0.0;
+		result.meanLayers = result.rays > 0 ? layers / result.rays : 0.0;
+		result.grazingMeanError = result.grazingRays > 0 ? grazingError / result.grazingRays : 0.0;
+		return result;
+	}
+
+	void Print(const FloorParallax::Settings& settings, const Comparison& result)
+	{
+		std::printf("%u to %u layers: mean error %.5f, max %.4f, flat %.5f, %.1f layers, %u grazing rays at %.5f\n",
+			settings.minLayers, settings.maxLayers, result.meanError, result.maxError, result.flatMeanError,
+			result.meanLayers, result.grazingRays, result.grazingMeanError);
+	}
+}
+
+TEST(MarchFollowsTheDisplacedSurface)
+{
+	DdsImage image = HeightImage();
+	EXPECT(!image.texels.empty());
+	if (image.texels.empty())
+		return;
+
+	FloorParallax::Settings settings = FloorParallax::DefaultSettings();
+	Comparison result = Compare(settings, image, 4000);
+	Print(settings, result);
+
+	EXPECT(result.rays == 4000);
+	EXPECT(result.meanError < 0.01 * result.flatMeanError);
+	EXPECT(result.meanLayers >= settings.minLayers && result.meanLayers <= settings.maxLayers);
+	EXPECT(result.grazingRays > 0);
+}
+
+TEST(MoreLayersAreMoreAccurate)
+{
+	DdsImage image = HeightImage();
+	if (image.texels.empty())
+		return;
+
+	FloorParallax::Settings coarse = { 4, 16 }, fine = { 16, 64 };
+	EXPECT(Compare(fine, image, 1000).meanError < Compare(coarse, image, 1000).meanError);
+}
+
+TEST(QuadCoversTheFloorFacingUp)
+{
+	FloorMeshLod quad = FloorParallax::Quad();
+	EXPECT(quad.vertices.size() == 4 && quad.indices.size() == 6);
+
+	// Front faces are clockwise seen from above, like the baked mesh.
+	for (size_t t = 0; t + 2 < quad.indices.size(); t += 3)
+	{
+		float3 a = quad.vertices[quad.indices[t]].position;
+		float3 b = quad.vertices[quad.indices[t + 1]].position;
+		float3 c = quad.vertices[quad.indices[t + 2]].position;
+		EXPECT(cross(b - a, c - a).y < 0.0f);
+	}
+
+	// The quad's corners and FloorTexture agree on the texture coordinates.
+	for (const FloorMeshVertex& vertex : quad.vertices)
+	{
+		float2 texture = FloorParallax::FloorTexture(vertex.position * FloorTessellation::FloorScale);
+		EXPECT(std::fabs(texture.x - vertex.texture.x) < 1e-6f && std::fabs(texture.y - vertex.texture.y) < 1e-6f);
+	}
+}
+
+BENCHMARK(LayerCounts)
+{
+	DdsImage image = HeightImage();
+	uint32_t layers[][2] = { { 4, 16 }, { 8, 32 }, { 16, 64 }, { 32, 128 } };
+	for (auto& layer : layers)
+	{
+		FloorParallax::Settings settings = { layer[0], layer[1] };
+		Print(settings, Compare(settings, image, 20000));
+	}
+}
@@ -0,0 +1,252 @@
+﻿#include "TestHarness.h"
+
+#include "FloorTessellation.h"
+#include "RaymarchDepth.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	struct Random
+	{
+		uint32_t	state;
+
+		float Next()
+		{
+			state = state * 1664525u + 1013904223u;
+			return static_cast<float>(state >> 8) / 16777216.0f;
+		}
+
+		float Range(float low, float high)		{ return low + (high - low) * Next(); }
+	};
+
+	float3 RandomPoint(Random& random, float size)
+	{
+		return float3(random.Range(-size, size), random.Range(-size, size), random.Range(-size, size));
+	}
+
+	void WorldCorners(uint32_t patches, uint32_t x, uint32_t z, float3 corners[4])
+	{
+		FloorTessellation::PatchCorners(patches, x, z, corners);
+		for (int i = 0; i < 4; i++)
+		{
+			corners[i] = FloorTessellation::ToWorld(corners[i]);
+		}
+	}
+
+	const float FovAngleY = 70.0f * 3.14159265f / 180.0f;
+
+	FloorTessellation::Settings Camera(const float3& eye, const float3& at)
+	{
+		float4x4 viewProjection = mul(RaymarchDepth::LookAtRH(eye, at, float3(0.0f, 1.0f, 0.0f)),
+			RaymarchDepth::PerspectiveFovRH(FovAngleY, 16.0f / 9.0f, 0.01f, 100.0f));
+		return FloorTessellation::DefaultSettings(eye, viewProjection, FovAngleY, 1080.0f);
+	}
+
+	// A random camera in or around the room looking anywhere, like the one in the app.
+	FloorTessellation::Settings RandomCamera(Random& random)
+	{
+		float3 eye = RandomPoint(random, 8.0f);
+		FloorTessellation::Settings settings = Camera(eye, eye + RandomPoint(random, 1.0f));
+		settings.targetPixels = random.Range(2.0f, 32.0f);
+		return settings;
+	}
+
+	// Factors of every patch of a grid, row after row.
+	std::vector<PatchFactors> GridFactors(const FloorTessellation::Settings& settings, uint32_t patches)
+	{
+		std::vector<PatchFactors> grid(patches * patches);
+		for (uint32_t z = 0; z < patches; z++)
+		{
+			for (uint32_t x = 0; x < patches; x++)
+			{
+				float3 corners[4];
+				WorldCorners(patches, x, z, corners);
+				grid[z * patches + x] = FloorTessellation::Factors(settings, corners);
+			}
+		}
+		return grid;
+	}
+
+	const uint32_t Samples = 20000;
+}
+
+TEST(EdgeFactorIsSymmetric)
+{
+	Random random = { 23 };
+	uint32_t asymmetric = 0;
+	for (uint32_t i = 0; i < Samples; i++)
+	{
+		FloorTessellation::Settings settings = RandomCamera(random);
+		float3 a = RandomPoint(random, 5.0f);
+		float3 b = a + RandomPoint(random, random.Range(0.01f, 5.0f));
+
+		float ab = FloorTessellation::EdgeFactor(settings, a, b), ba = FloorTessellation::EdgeFactor(settings, b, a);
+		asymmetric += std::memcmp(&ab, &ba, sizeof(float)) != 0;
+	}
+	EXPECT(asymmetric == 0);
+}
+
+TEST(SegmentsStayWithinTarget)
+{
+	Random random = { 29 };
+	uint32_t oversized = 0;
+	for (uint32_t i = 0; i < Samples; i++)
+	{
+		FloorTessellation::Settings settings = RandomCamera(random);
+		float3 a = RandomPoint(random, 5.0f);
+		float3 b = a + RandomPoint(random, random.Range(0.01f, 5.0f));
+		float factor = FloorTessellation::EdgeFactor(settings, a, b);
+
+		// Same measure as EdgeFactor, per segment once the tessellator has rounded.
+		float3 centre = (a + b) * 0.5f;
+		float diameter = length(a - b);
+		float pixels = diameter * settings.screenScale / std::max(length(centre - settings.eye), 0.5f * diameter);
+		if (factor < settings.maxFactor && pixels / FloorTessellation::RoundFactor(factor) > settings.targetPixels * 1.0001f)
+			oversized++;
+	}
+	EXPECT(oversized == 0);
+}
+
+TEST(SharedEdgesDoNotCrack)
+{
+	// The u = 1 edge of a patch is the u = 0 edge of the one after it in x, and its v = 0 edge, at
+	// the larger z, is the v = 1 edge of the one after it in z. Only edges between two drawn
+	// patches can crack.
+	Random random = { 31 };
+	uint32_t shared = 0, cracked = 0;
+	for (uint32_t patches = 1; patches <= 16; patches *= 2)
+	{
+		for (uint32_t i = 0; i < Samples / 64; i++)
+		{
+			FloorTessellation::Settings settings = RandomCamera(random);
+			settings.maxSlope = FloorTessellation::TessellatedSlope(settings, patches);
+			std::vector<PatchFactors> grid = GridFactors(settings, patches);
+
+			for (uint32_t z = 0; z < patches; z++)
+			{
+				for (uint32_t x = 0; x < patches; x++)
+				{
+					const PatchFactors& patch = grid[z * patches + x];
+					if (patch.edges[0] == 0.0f)
+						continue;
+
+					const PatchFactors* right = x + 1 < patches ? &grid[z * patches + x + 1] : nullptr;
+					if (right && right->edges[0] != 0.0f)
+					{
+						shared++;
+						cracked += std::memcmp(&patch.edges[2], &right->edges[0], sizeof(float)) != 0;
+					}
+					const PatchFactors* next = z + 1 < patches ? &grid[(z + 1) * patches + x] : nullptr;
+					if (next && next->edges[0] != 0.0f)
+					{
+						shared++;
+						cracked += std::memcmp(&patch.edges[1], &next->edges[3], sizeof(float)) != 0;
+					}
+				}
+			}
+		}
+	}
+	std::printf("%u shared edges\n", shared);
+	EXPECT(shared > 0);
+	EXPECT(cracked == 0);
+}
+
+TEST(CulledPatchesShowNothing)
+{
+	// Points anywhere in the displacement range on a culled patch, with normals as steep as the
+	// tessellation allows, must be out of view or facing away.
+	Random random = { 37 };
+	uint32_t culled = 0, unsafe = 0;
+	for (uint32_t patches = 2; patches <= 16; patches *= 2)
+	{
+		for (uint32_t i = 0; i < Samples / 64; i++)
+		{
+			FloorTessellation::Settings settings = RandomCamera(random);
+			settings.maxSlope = FloorTessellation::TessellatedSlope(settings, patches);
+			std::vector<PatchFactors> grid = GridFactors(settings, patches);
+
+			for (uint32_t z = 0; z < patches; z++)
+			{
+				for (uint32_t x = 0; x < patches; x++)
+				{
+					if (grid[z * patches + x].edges[0] != 0.0f)
+						continue;
+
+					culled++;
+					float3 corners[4];
+					WorldCorners(patches, x, z, corners);
+					for (int j = 0; j < 16; j++)
+					{
+						float3 p(random.Range(corners[0].x, corners[2].x),
+							FloorTessellation::FloorHeight + random.Range(settings.displacementLow, settings.displacementHigh),
+							random.Range(corners[1].z, corners[0].z));
+						float3 n = normalize(float3(random.Range(-settings.maxSlope, settings.maxSlope), 1.0f,
+							random.Range(-settings.maxSlope, settings.maxSlope)));
+
+						float4 clip = mul(float4(p, 1.0f), settings.viewProjection);
+						bool inView = std::fabs(clip.x) <= clip.w && std::fabs(clip.y) <= clip.w && clip.z >= 0.0f && clip.z <= clip.w;
+						if (inView && dot(n, settings.eye - p) > 0.0f)
+						{
+							unsafe++;
+							break;
+						}
+					}
+				}
+			}
+		}
+	}
+	std::printf("%u culled patches\n", culled);
+	EXPECT(culled > 0);
+	EXPECT(unsafe == 0);
+}
+
+TEST(TriangleCountIsExact)
+{
+	for (uint32_t n = 1; n <= 64; n++)
+	{
+		for (uint32_t m = 1; m <= 64; m += 7)
+		{
+			if ((n > 1 && m > 1) || (n == 1 && m == 1))
+			{
+				PatchFactors factors = { { float(m), float(n), float(m), float(n) }, { float(n), float(m) } };
+				EXPECT(FloorTessellation::TriangleCount(factors) == 2 * n * m);
+			}
+		}
+	}
+}
+
+TEST(VisibilityCullsBehindTheCamera)
+{
+	// Looking at the floor from above sees all of it, looking up from under the ceiling none of it.
+	FloorTessellation::Settings down = Camera(float3(0.0f, 30.0f, 0.01f), float3(0.0f, FloorTessellation::FloorHeight, 0.0f));
+	FloorTessellation::Visibility all = FloorTessellation::MeasureVisibility(down, 8);
+	EXPECT(all.patches == 64 && all.visiblePatches == 64);
+
+	FloorTessellation::Settings up = Camera(float3(0.0f, 4.0f, 0.0f), float3(0.0f, 10.0f, 0.01f));
+	FloorTessellation::Visibility none = FloorTessellation::MeasureVisibility(up, 8);
+	EXPECT(none.visiblePatches == 0 && none.triangles == 0);
+	EXPECT(none.outsideFrustum + none.facingAway == 64);
+}
+
+BENCHMARK(TrianglesAgainstTarget)
+{
+	FloorTessellation::Settings settings = Camera(float3(0.0f, 3.5f, 5.0f), float3(0.0f, FloorTessellation::FloorHeight, 0.0f));
+	for (float target : { 0.0f, 4.0f, 8.0f, 16.0f, 32.0f })
+	{
+		settings.targetPixels = target;
+		std::printf("target %4.0f pixels:", target);
+		for (uint32_t patches : { 1u, 4u, 8u, 16u })
+		{
+			FloorTessellation::Visibility visibility = FloorTessellation::MeasureVisibility(settings, patches);
+			std::printf("  %ux%u %7u triangles", patches, patches, visibility.triangles);
+		}
+		std::printf("\n");
+	}
+}
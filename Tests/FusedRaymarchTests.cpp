@@ -0,0 +1,232 @@
+﻿#include "TestHarness.h"
+
+#include "FusedRaymarch.h"
+#include "TemporalReprojection.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	typedef FusedRaymarch::Material Material;
+
+	struct Random
+	{
+		uint32_t	state;
+
+		float Next()
+		{
+			state = state * 1664525u + 1013904223u;
+			return static_cast<float>(state >> 8) / 16777216.0f;
+		}
+
+		float Range(float low, float high)		{ return low + (high - low) * Next(); }
+	};
+
+	const float BoxSize = 5.0f;
+	const int Intervals = 200;	// Steps of March across the room's box.
+
+	// The canvas camera, with the zoom scaled so every size sees the same view as 640 wide.
+	RaymarchCamera MakeCamera(float width, float height)
+	{
+		RaymarchCamera camera = { float3(0.0f, 3.5f, 5.0f), 1.0f, 0.004f * 640.0f / width, width, height };
+		return camera;
+	}
+
+	// First crossing of field along the ray, found with steps a hundred times finer than March's
+	// and bisected. -1 if there is none.
+	float ReferenceHit(FusedRaymarch::Field field, const float3& origin, const float3& direction)
+	{
+		float start, final;
+		if (!FusedRaymarch::IntersectBox(origin, direction, start, final))
+			return -1.0f;
+
+		const int steps = 100 * Intervals;
+		float step = (final - start) / steps;
+		final += step;
+		float left = field(origin + start * direction);
+		for (int i = 1; i <= steps + 1; i++)
+		{
+			float time = start + i * step;
+			float right = field(origin + time * direction);
+			if ((left > 0.0f) != (right > 0.0f))
+			{
+				float low = time - step, high = time;
+				for (int j = 0; j < 30; j++)
+				{
+					float middle = 0.5f * (low + high);
+					if ((field(origin + middle * direction) > 0.0f) == (left > 0.0f))
+						low = middle;
+					else
+						high = middle;
+				}
+				return 0.5f * (low + high);
+			}
+			left = right;
+		}
+		return -1.0f;
+	}
+
+	// Fused against TwoPass over every pixel of a camera.
+	struct Comparison
+	{
+		uint32_t	pixels;
+		uint32_t	materials[5];		// Fused pixels of each material.
+		uint32_t	materialMismatches;
+		uint32_t	distanceMismatches;	// Same material, hits further apart than one step of the march.
+		double		maxDistance;
+	};
+
+	Comparison Compare(const RaymarchCamera& camera)
+	{
+		Comparison result = {};
+		for (uint32_t y = 0; y < uint32_t(camera.height); y++)
+		{
+			for (uint32_t x = 0; x < uint32_t(camera.width); x++)
+			{
+				float3 direction = camera.Ray(x + 0.5f, y + 0.5f);
+				FusedRaymarch::Hit fused = FusedRaymarch::Fused(camera.eye, direction);
+				FusedRaymarch::Hit twoPass = FusedRaymarch::TwoPass(camera.eye, direction);
+
+				result.pixels++;
+				result.materials[uint32_t(fused.material)]++;
+				if (fused.material != twoPass.material)
+				{
+					result.materialMismatches++;
+					continue;
+				}
+
+				float start, final;
+				FusedRaymarch::IntersectBox(camera.eye, direction, start, final);
+				double distance = std::fabs(fused.t - twoPass.t);
+				result.maxDistance = std::max(result.maxDistance, distance);
+				result.distanceMismatches += distance > (final - start) / Intervals ? 1 : 0;
+			}
+		}
+		return result;
+	}
+}
+
+// The fused pass must show what the room pass, the floor and the pillar pass show together.
+TEST(FusedMatchesTheSeparatePasses)
+{
+	for (float width : { 160.0f, 320.0f, 640.0f })
+	{
+		Comparison result = Compare(MakeCamera(width, width * 9.0f / 16.0f));
+		std::printf("%4.0f wide: %u pixels, %u room, %u pillar, %u floor, %u material and %u distance mismatches, max %g\n",
+			width, result.pixels, result.materials[1], result.materials[2], result.materials[3],
+			result.materialMismatches, result.distanceMismatches, result.maxDistance);
+
+		EXPECT(result.materials[1] > 0 && result.materials[2] > 0 && result.materials[3] > 0);
+		EXPECT(result.materials[0] == 0);
+		EXPECT(result.materialMismatches == 0);
+		EXPECT(result.distanceMismatches == 0);
+	}
+}
+
+// From anywhere in the room, in any direction, the fixed step march lands within a step of the
+// first crossing a much finer march finds, and the fused pass picks the surface it crossed. The
+// room's walls are the faces of the box the march runs across, so a wall straight ahead is only
+// crossed at the last sample, where rounding decides. Those rays are counted, not compared.
+TEST(MarchFindsTheFirstCrossing)
+{
+	Random random = { 13 };
+	uint32_t rays = 0, atExit = 0, misses = 0, farHits = 0, wrongMaterials = 0;
+	for (uint32_t i = 0; i < 4000; i++)
+	{
+		float3 origin(random.Range(-4.9f, 4.9f), random.Range(-4.9f, 4.9f), random.Range(-4.9f, 4.9f));
+		if (FusedRaymarch::Pillars(origin) < 0.05f)
+			continue;
+		float3 direction = normalize(float3(random.Range(-1.0f, 1.0f), random.Range(-1.0f, 1.0f), random.Range(-1.0f, 1.0f)));
+
+		float start, final;
+		FusedRaymarch::IntersectBox(origin, direction, start, final);
+		float step = (final - start) / Intervals;
+
+		const FusedRaymarch::Field fields[] = { FusedRaymarch::Room, FusedRaymarch::Pillars, FusedRaymarch::Scene };
+		for (FusedRaymarch::Field field : fields)
+		{
+			float reference = ReferenceHit(field, origin, direction);
+			rays++;
+			if (reference > final - step)
+			{
+				atExit++;
+				continue;
+			}
+
+			float t = -1.0f;
+			bool hit = FusedRaymarch::March(field, origin, direction, t);
+			if (hit != (reference >= 0.0f))
+			{
+				misses++;
+				continue;
+			}
+			farHits += hit && std::fabs(t - reference) > step ? 1 : 0;
+		}
+
+		float reference = ReferenceHit(FusedRaymarch::Scene, origin, direction);
+		if (reference < 0.0f || reference > final - step)
+			continue;
+
+		FusedRaymarch::Hit fused = FusedRaymarch::Fused(origin, direction);
+		if (fused.material != Material::Floor)
+		{
+			float3 Position = origin + reference * direction;
+			Material crossed = std::fabs(FusedRaymarch::Pillars(Position)) < std::fabs(FusedRaymarch::Room(Position)) ? Material::Pillar : Material::Room;
+			wrongMaterials += fused.material != crossed ? 1 : 0;
+		}
+	}
+	std::printf("%u rays, %u at the exit, %u misses, %u hits more than a step off, %u wrong materials\n", rays, atExit,
+		misses, farHits, wrongMaterials);
+	EXPECT(rays - atExit > 3000);
+	EXPECT(misses == 0);
+	EXPECT(farHits == 0);
+	EXPECT(wrongMaterials == 0);
+}
+
+TEST(IntersectBoxStartsInsideAtTheEye)
+{
+	float start, final;
+	EXPECT(FusedRaymarch::IntersectBox(float3(0.0f), float3(1.0f, 0.0f, 0.0f), start, final));
+	EXPECT(start == 0.0f && std::fabs(final - BoxSize) < 1e-6f);
+
+	EXPECT(FusedRaymarch::IntersectBox(float3(-8.0f, 0.0f, 0.0f), float3(1.0f, 0.0f, 0.0f), start, final));
+	EXPECT(std::fabs(start - 3.0f) < 1e-6f && std::fabs(final - 13.0f) < 1e-6f);
+
+	EXPECT(!FusedRaymarch::IntersectBox(float3(-8.0f, 0.0f, 0.0f), float3(-1.0f, 0.0f, 0.0f), start, final));
+}
+
+TEST(FusedMovesLessThanTwoPasses)
+{
+	for (uint32_t height : { 720u, 1080u, 2160u })
+	{
+		uint32_t width = height * 16 / 9;
+		FusedRaymarch::TrafficEstimate estimate = FusedRaymarch::EstimateTraffic(width, height, width * height * 36 / 100);
+		EXPECT(estimate.fusedBytes < estimate.twoPassBytes);
+		EXPECT(estimate.intermediateBytes == uint64_t(width) * height * 16);
+	}
+}
+
+BENCHMARK(FusedAgainstTwoPass)
+{
+	RaymarchCamera camera = MakeCamera(640.0f, 360.0f);
+	for (uint32_t run = 0; run < 2; run++)
+	{
+		uint32_t hits = 0;
+		double fused = TestHarness::Milliseconds([&]() {
+			for (uint32_t y = 0; y < uint32_t(camera.height); y++)
+				for (uint32_t x = 0; x < uint32_t(camera.width); x++)
+					hits += FusedRaymarch::Fused(camera.eye, camera.Ray(x + 0.5f, y + 0.5f)).material != Material::None;
+		});
+		double twoPass = TestHarness::Milliseconds([&]() {
+			for (uint32_t y = 0; y < uint32_t(camera.height); y++)
+				for (uint32_t x = 0; x < uint32_t(camera.width); x++)
+					hits += FusedRaymarch::TwoPass(camera.eye, camera.Ray(x + 0.5f, y + 0.5f)).material != Material::None;
+		});
+		std::printf("640x360: fused %.1f ms, two pass %.1f ms, %u hits\n", fused, twoPass, hits);
+	}
+}
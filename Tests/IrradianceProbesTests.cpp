@@ -0,0 +1,199 @@
+﻿#include "TestHarness.h"
+
+#include "FusedRaymarch.h"
+#include "IrradianceProbes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	const float Pi = 3.14159265f;
+
+	struct Random
+	{
+		uint32_t	state;
+
+		float Next()
+		{
+			state = state * 1664525u + 1013904223u;
+			return static_cast<float>(state >> 8) / 16777216.0f;
+		}
+
+		float Range(float low, float high)		{ return low + (high - low) * Next(); }
+	};
+
+	float3 RandomDirection(Random& random)
+	{
+		float y = random.Range(-1.0f, 1.0f);
+		float r = std::sqrt(std::max(0.0f, 1.0f - y * y));
+		float phi = random.Range(0.0f, 2.0f * Pi);
+		return float3(r * std::cos(phi), y, r * std::sin(phi));
+	}
+
+	float LargestDifference(const float3& a, const float3& b)
+	{
+		return std::max(std::fabs(a.x - b.x), std::max(std::fabs(a.y - b.y), std::fabs(a.z - b.z)));
+	}
+
+	// Interpolated grid against a probe evaluated right there, at random points in free space lit
+	// from a random side. A shadow edge between two probes can make the largest error the whole light.
+	struct InterpolationResult
+	{
+		uint32_t	points;
+		double		meanError;
+		double		maxError;
+	};
+
+	InterpolationResult CompareInterpolation(const IrradianceProbes::Settings& settings, uint32_t points)
+	{
+		std::vector<LightmapLight> lights = LightmapBaker::SceneLights();
+		WorkStealingPool pool(0);
+		IrradianceProbeGrid grid = IrradianceProbes::Bake(settings, lights, pool);
+
+		// Probes closer than this to a surface are moved, so points there are not compared.
+		float clearance = 0.5f * IrradianceProbes::BoxSize / settings.resolution;
+
+		Random random = { 17 };
+		InterpolationResult result = {};
+		while (result.points < points)
+		{
+			const float size = IrradianceProbes::BoxSize;
+			float3 Position(random.Range(-size, size), random.Range(-size, size), random.Range(-size, size));
+			if (FusedRaymarch::Scene(Position) < clearance)
+				continue;
+
+			float3 normal = RandomDirection(random);
+			double error = LargestDifference(IrradianceProbes::Evaluate(IrradianceProbes::Interpolate(grid, Position), normal),
+				IrradianceProbes::Evaluate(IrradianceProbes::EvaluateProbe(settings, lights, Position), normal));
+			result.meanError += error;
+			result.maxError = std::max(result.maxError, error);
+			result.points++;
+		}
+		if (result.points > 0)
+			result.meanError /= result.points;
+		return result;
+	}
+}
+
+TEST(ProjectionHoldsConstantAndLinearFunctions)
+{
+	// L2 holds both exactly, so all that is left is the quadrature.
+	const uint32_t directions = 1024;
+	ShL2 constant = IrradianceProbes::Project([](const float3&) { return float3(0.7f); }, directions);
+	ShL2 linear = IrradianceProbes::Project([](const float3& d) {
+		return float3(0.5f + 0.3f * d.x, 0.5f - 0.2f * d.y, 0.5f + 0.4f * d.z);
+	}, directions);
+
+	Random random = { 17 };
+	float constantError = 0.0f, linearError = 0.0f;
+	for (uint32_t i = 0; i < 4096; i++)
+	{
+		float3 d = RandomDirection(random);
+		float3 expected(0.5f + 0.3f * d.x, 0.5f - 0.2f * d.y, 0.5f + 0.4f * d.z);
+		constantError = std::max(constantError, LargestDifference(IrradianceProbes::Evaluate(constant, d), float3(0.7f)));
+		linearError = std::max(linearError, LargestDifference(IrradianceProbes::Evaluate(linear, d), expected));
+	}
+	std::printf("constant error %.2e, linear error %.2e\n", constantError, linearError);
+
+	EXPECT(constantError < 1e-3f);
+	EXPECT(linearError < 1e-2f);
+}
+
+TEST(CosineIrradianceIsCloseToTheClampedCosine)
+{
+	// Irradiance of one light is a clamped cosine, which L2 only approximates.
+	float3 light = normalize(float3(0.3f, 0.8f, -0.5f));
+	ShL2 cosine = IrradianceProbes::ConvolveCosine(IrradianceProbes::ProjectDirectional(light, float3(1.0f)));
+
+	Random random = { 17 };
+	const uint32_t samples = 4096;
+	double meanError = 0.0, maxError = 0.0;
+	for (uint32_t i = 0; i < samples; i++)
+	{
+		float3 d = RandomDirection(random);
+		double error = std::fabs(IrradianceProbes::Evaluate(cosine, d).x - std::max(0.0f, dot(d, light)));
+		meanError += error;
+		maxError = std::max(maxError, error);
+	}
+	meanError /= samples;
+	std::printf("mean error %.4f, max %.4f\n", meanError, maxError);
+
+	EXPECT(meanError < 0.05);
+	EXPECT(maxError < 0.2);
+}
+
+TEST(BakeDoesNotDependOnThreadCount)
+{
+	IrradianceProbes::Settings settings = IrradianceProbes::DefaultSettings();
+	settings.resolution = 4;
+	std::vector<LightmapLight> lights = LightmapBaker::SceneLights();
+
+	WorkStealingPool single(1), many(4);
+	IrradianceProbeGrid grid = IrradianceProbes::Bake(settings, lights, many);
+	IrradianceProbeGrid reference = IrradianceProbes::Bake(settings, lights, single);
+
+	EXPECT(grid.probes.size() == size_t(4) * 4 * 4);
+	EXPECT(grid.probes.size() == reference.probes.size());
+	EXPECT(std::memcmp(grid.probes.data(), reference.probes.data(), grid.probes.size() * sizeof(ShL2)) == 0);
+}
+
+TEST(CacheRoundTripsAndRejectsMovedLights)
+{
+	IrradianceProbes::Settings settings = IrradianceProbes::DefaultSettings();
+	settings.resolution = 4;
+	std::vector<LightmapLight> lights = LightmapBaker::SceneLights();
+	WorkStealingPool pool(2);
+	IrradianceProbeGrid grid = IrradianceProbes::Bake(settings, lights, pool);
+
+	std::stringstream stream;
+	EXPECT(IrradianceProbes::Save(grid, stream));
+
+	IrradianceProbeGrid loaded;
+	EXPECT(IrradianceProbes::Load(stream, grid.key, loaded));
+	EXPECT(loaded.resolution == grid.resolution);
+	EXPECT(loaded.probes.size() == grid.probes.size() &&
+		std::memcmp(loaded.probes.data(), grid.probes.data(), grid.probes.size() * sizeof(ShL2)) == 0);
+
+	std::vector<LightmapLight> moved = lights;
+	moved[0].position.x += 1.0f;
+	EXPECT(IrradianceProbes::Key(settings, moved) != grid.key);
+	stream.clear();
+	stream.seekg(0);
+	EXPECT(!IrradianceProbes::Load(stream, IrradianceProbes::Key(settings, moved), loaded));
+}
+
+TEST(InterpolationMatchesProbesInFreeSpace)
+{
+	InterpolationResult result = CompareInterpolation(IrradianceProbes::DefaultSettings(), 500);
+	std::printf("%u points, mean error %.4f, max %.4f\n", result.points, result.meanError, result.maxError);
+
+	EXPECT(result.meanError < 0.1);
+}
+
+BENCHMARK(InterpolationAgainstResolution)
+{
+	for (uint32_t resolution : { 4u, 8u, 16u })
+	{
+		IrradianceProbes::Settings settings = IrradianceProbes::DefaultSettings();
+		settings.resolution = resolution;
+		InterpolationResult result = CompareInterpolation(settings, 1000);
+		std::printf("%2u^3 probes: mean error %.4f, max %.4f\n", resolution, result.meanError, result.maxError);
+	}
+}
+
+BENCHMARK(BakeScaling)
+{
+	IrradianceProbes::Settings settings = IrradianceProbes::DefaultSettings();
+	std::vector<LightmapLight> lights = LightmapBaker::SceneLights();
+	TestHarness::PrintScaling(0, [&](uint32_t threads) {
+		WorkStealingPool pool(threads);
+		IrradianceProbes::Bake(settings, lights, pool);
+	});
+}
@@ -0,0 +1,203 @@
+﻿#include "TestHarness.h"
+
+#include "LightClusters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	struct Random
+	{
+		uint32_t	state;
+
+		float Next()
+		{
+			state = state * 1664525u + 1013904223u;
+			return static_cast<float>(state >> 8) / 16777216.0f;
+		}
+
+		float Range(float low, float high)		{ return low + (high - low) * Next(); }
+	};
+
+	const float BoxSize = 5.0f;
+
+	const RaymarchCamera Camera = { float3(0.0f, 3.5f, 5.0f), 1.0f, 0.004f, 640.0f, 360.0f };
+
+	// Random lights through the camera. A light is missed when a point inside its sphere is in a
+	// cluster that does not list it, which must never happen.
+	struct CoverageResult
+	{
+		uint32_t	listMismatches;		// Clusters whose list differs from BuildReference.
+		uint32_t	missedLights;
+		double		meanPerCluster;
+		uint32_t	maxPerCluster;
+	};
+
+	CoverageResult MeasureCoverage(const RaymarchCamera& camera, uint32_t lightCount, uint32_t points)
+	{
+		ClusterFrustum frustum = LightClusters::MakeFrustum(camera);
+		std::vector<ClusterLight> lights = LightClusters::RandomLights(lightCount, 1);
+
+		std::vector<ClusterRange> ranges, referenceRanges;
+		std::vector<uint32_t> indices, referenceIndices;
+		LightClusters::Build(frustum, lights, ranges, indices);
+		LightClusters::BuildReference(frustum, lights, referenceRanges, referenceIndices);
+
+		CoverageResult result = {};
+		for (uint32_t i = 0; i < LightClusters::ClusterCount; i++)
+		{
+			const ClusterRange& a = ranges[i];
+			const ClusterRange& b = referenceRanges[i];
+			bool same = a.count == b.count;
+			for (uint32_t j = 0; same && j < a.count; j++)
+				same = indices[a.offset + j] == referenceIndices[b.offset + j];
+			result.listMismatches += same ? 0 : 1;
+			result.maxPerCluster = std::max(result.maxPerCluster, a.count);
+		}
+		result.meanPerCluster = double(indices.size()) / LightClusters::ClusterCount;
+
+		// Points inside the room, and inside each light's sphere so every light is checked.
+		Random random = { 7 };
+		std::vector<bool> listed(lightCount);
+		for (uint32_t p = 0; p < points; p++)
+		{
+			float3 Position;
+			if (lightCount > 0 && (p & 1))
+			{
+				const ClusterLight& light = lights[p / 2 % lightCount];
+				float3 offset = float3(random.Range(-1.0f, 1.0f), random.Range(-1.0f, 1.0f), random.Range(-1.0f, 1.0f));
+				Position = light.position + (light.radius * 0.999f / std::sqrt(3.0f)) * offset;
+			}
+			else
+			{
+				Position = float3(random.Range(-BoxSize, BoxSize), random.Range(-BoxSize, BoxSize), random.Range(-BoxSize, BoxSize));
+			}
+
+			const ClusterRange& range = ranges[LightClusters::ClusterOf(frustum, Position)];
+			std::fill(listed.begin(), listed.end(), false);
+			for (uint32_t j = 0; j < range.count; j++)
+				listed[indices[range.offset + j]] = true;
+
+			for (uint32_t l = 0; l < lightCount; l++)
+			{
+				if (!listed[l] && length(Position - lights[l].position) < lights[l].radius)
+					result.missedLights++;
+			}
+		}
+		return result;
+	}
+}
+
+TEST(BuildMatchesReferenceAndMissesNoLight)
+{
+	for (uint32_t count : { 0u, 1u, 3u, 5u, 17u, 64u, 256u, 1000u })
+	{
+		CoverageResult result = MeasureCoverage(Camera, count, 20000);
+		std::printf("%4u lights: %u mismatches, %u missed, %.2f per cluster, at most %u\n", count,
+			result.listMismatches, result.missedLights, result.meanPerCluster, result.maxPerCluster);
+
+		EXPECT(result.listMismatches == 0);
+		EXPECT(result.missedLights == 0);
+	}
+}
+
+TEST(WallTorchesStayInsideTheRoom)
+{
+	std::vector<ClusterLight> torches = LightClusters::WallTorches(24);
+	EXPECT(torches.size() == 24);
+	for (const ClusterLight& torch : torches)
+	{
+		EXPECT(std::fabs(torch.position.x) <= BoxSize && std::fabs(torch.position.y) <= BoxSize && std::fabs(torch.position.z) <= BoxSize);
+		EXPECT(torch.radius > 0.0f);
+	}
+}
+
+TEST(RandomLightsRepeatForASeed)
+{
+	std::vector<ClusterLight> a = LightClusters::RandomLights(16, 3);
+	std::vector<ClusterLight> b = LightClusters::RandomLights(16, 3);
+	std::vector<ClusterLight> c = LightClusters::RandomLights(16, 4);
+	EXPECT(a.size() == 16 && b.size() == 16);
+	for (size_t i = 0; i < a.size(); i++)
+		EXPECT(a[i].position.x == b[i].position.x && a[i].radius == b[i].radius);
+	EXPECT(a[0].position.x != c[0].position.x);
+}
+
+// The scene lights are far outside the room. Their spheres must still reach all of it, so that
+// they lead the list of every cluster a point of the room is in, ahead of the torches.
+TEST(SceneLightsLeadEveryClusterOfTheRoom)
+{
+	const float3 positions[] = { float3(-10.0f, 10.0f, -50.0f), float3(10.0f, 10.0f, 50.0f), float3(0.0f, 60.0f, 5.0f) };
+	std::vector<ClusterLight> lights;
+	for (const float3& position : positions)
+	{
+		ClusterLight light = LightClusters::SceneLight(position, float3(1.0f));
+		EXPECT(light.falloff == 0.0f);
+		for (uint32_t corner = 0; corner < 8; corner++)
+		{
+			float3 Position((corner & 1) ? BoxSize : -BoxSize, (corner & 2) ? BoxSize : -BoxSize, (corner & 4) ? BoxSize : -BoxSize);
+			EXPECT(length(Position - position) <= light.radius);
+		}
+		EXPECT(light.radius < 100.0f);
+		lights.push_back(light);
+	}
+	std::vector<ClusterLight> torches = LightClusters::WallTorches(64);
+	lights.insert(lights.end(), torches.begin(), torches.end());
+
+	ClusterFrustum frustum = LightClusters::MakeFrustum(Camera);
+	std::vector<ClusterRange> ranges;
+	std::vector<uint32_t> indices;
+	LightClusters::Build(frustum, lights, ranges, indices);
+
+	Random random = { 11 };
+	uint32_t unlit = 0;
+	for (uint32_t p = 0; p < 20000; p++)
+	{
+		float3 Position(random.Range(-BoxSize, BoxSize), random.Range(-BoxSize, BoxSize), random.Range(-BoxSize, BoxSize));
+		const ClusterRange& range = ranges[LightClusters::ClusterOf(frustum, Position)];
+		bool lit = range.count >= 3;
+		for (uint32_t i = 0; lit && i < 3; i++)
+			lit = indices[range.offset + i] == i;
+		unlit += lit ? 0 : 1;
+	}
+	EXPECT(unlit == 0);
+
+	// The shaders loop over up to MaxLights of a cluster, which is then every light it has.
+	for (const ClusterRange& range : ranges)
+		EXPECT(range.count <= LightClusters::MaxLights);
+}
+
+BENCHMARK(BuildAgainstReference)
+{
+	ClusterFrustum frustum = LightClusters::MakeFrustum(Camera);
+	const uint32_t repeats = 50;
+	for (uint32_t count : { 1u, 4u, 16u, 64u, 256u, 1024u, 4096u })
+	{
+		std::vector<ClusterLight> lights = LightClusters::RandomLights(count, 1);
+		std::vector<ClusterRange> ranges;
+		std::vector<uint32_t> indices;
+
+		double build = TestHarness::Milliseconds([&]() {
+			for (uint32_t i = 0; i < repeats; i++)
+				LightClusters::Build(frustum, lights, ranges, indices);
+		}) * 1000.0 / repeats;
+		std::printf("%4u lights: %8.1f us, %6zu indices, %.2f per cluster", count, build, indices.size(),
+			double(indices.size()) / LightClusters::ClusterCount);
+
+		// The reference is only timed where it finishes in reasonable time.
+		if (count <= 256)
+		{
+			double reference = TestHarness::Milliseconds([&]() {
+				for (uint32_t i = 0; i < repeats; i++)
+					LightClusters::BuildReference(frustum, lights, ranges, indices);
+			}) * 1000.0 / repeats;
+			std::printf(", reference %.1f us", reference);
+		}
+		std::printf("\n");
+	}
+}
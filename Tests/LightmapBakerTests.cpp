@@ -0,0 +1,191 @@
+﻿#include "TestHarness.h"
+
+#include "FusedRaymarch.h"
+#include "LightmapBaker.h"
+#include "SdfScene.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	struct Random
+	{
+		uint32_t	state;
+
+		float Next()
+		{
+			state = state * 1664525u + 1013904223u;
+			return static_cast<float>(state >> 8) / 16777216.0f;
+		}
+
+		float Range(float low, float high)		{ return low + (high - low) * Next(); }
+	};
+
+	float LargestDifference(const float4& a, const float4& b)
+	{
+		return std::max(std::fabs(a.x - b.x), std::max(std::fabs(a.y - b.y), std::fabs(a.z - b.z)));
+	}
+
+	LightmapBaker::Settings SmallSettings()
+	{
+		LightmapBaker::Settings settings = LightmapBaker::DefaultSettings();
+		settings.resolution = 16;
+		return settings;
+	}
+
+	// Sample against Evaluate at random points on the six walls, away from the pillars, and on the
+	// pillars. Points off by more than 0.1 are all within a texel of where two surfaces meet.
+	struct SampleResult
+	{
+		uint32_t	points;
+		double		meanError;		// Largest of rgb.
+		double		maxError;
+		uint32_t	largeErrors;
+	};
+
+	SampleResult CompareSamples(const LightmapBaker::Settings& settings, const Lightmap& lightmap, uint32_t points)
+	{
+		std::vector<LightmapLight> lights = LightmapBaker::SceneLights();
+		const float size = LightmapBaker::BoxSize;
+
+		Random random = { 11 };
+		SampleResult result = {};
+		while (result.points < points)
+		{
+			float3 surface, normal;
+			if (random.Next() < 0.5f)
+			{
+				uint32_t axis = std::min(static_cast<uint32_t>(random.Next() * 3.0f), 2u);
+				float side = random.Next() < 0.5f ? -1.0f : 1.0f;
+				surface = float3(random.Range(-size, size), random.Range(-size, size), random.Range(-size, size));
+				surface[axis] = side * size;
+				normal = float3();
+				normal[axis] = -side;
+				if (FusedRaymarch::Pillars(surface) < 0.05f)
+					continue;
+			}
+			else
+			{
+				uint32_t pillar = std::min(static_cast<uint32_t>(random.Next() * SdfScene::PillarCount), SdfScene::PillarCount - 1);
+				float angle = random.Range(0.0f, 6.2831853f);
+				normal = float3(std::cos(angle), 0.0f, std::sin(angle));
+				surface = -SdfScene::PillarOffsets[pillar] + SdfScene::PillarRadius * normal;
+				surface.y = random.Range(-size, size);
+			}
+
+			double error = LargestDifference(LightmapBaker::Sample(lightmap, surface),
+				LightmapBaker::Evaluate(settings, lights, surface, normal));
+			result.meanError += error;
+			result.maxError = std::max(result.maxError, error);
+			result.largeErrors += error > 0.1 ? 1 : 0;
+			result.points++;
+		}
+		if (result.points > 0)
+			result.meanError /= result.points;
+		return result;
+	}
+}
+
+TEST(BakeDoesNotDependOnThreadCount)
+{
+	LightmapBaker::Settings settings = SmallSettings();
+	std::vector<LightmapLight> lights = LightmapBaker::SceneLights();
+
+	WorkStealingPool single(1), many(4);
+	Lightmap lightmap = LightmapBaker::Bake(settings, lights, many);
+	Lightmap reference = LightmapBaker::Bake(settings, lights, single);
+
+	EXPECT(lightmap.texels.size() == size_t(16) * 16 * 16);
+	EXPECT(lightmap.texels.size() == reference.texels.size());
+	EXPECT(std::memcmp(lightmap.texels.data(), reference.texels.data(), lightmap.texels.size() * sizeof(float4)) == 0);
+}
+
+TEST(OnlyTexelsNearASurfaceAreBaked)
+{
+	LightmapBaker::Settings settings = SmallSettings();
+	WorkStealingPool pool(2);
+	Lightmap lightmap = LightmapBaker::Bake(settings, LightmapBaker::SceneLights(), pool);
+
+	// Centres more than two texels from every surface are left black, the ones on a surface are lit.
+	const uint32_t resolution = settings.resolution;
+	const float texel = 2.0f * LightmapBaker::BoxSize / resolution;
+	uint32_t far = 0, near = 0;
+	for (uint32_t z = 0; z < resolution; z++)
+	{
+		for (uint32_t y = 0; y < resolution; y++)
+		{
+			for (uint32_t x = 0; x < resolution; x++)
+			{
+				float3 centre = float3(-LightmapBaker::BoxSize) + texel * float3(x + 0.5f, y + 0.5f, z + 0.5f);
+				float distance = std::fabs(FusedRaymarch::Scene(centre));
+				const float4& value = lightmap.texels[(size_t(z) * resolution + y) * resolution + x];
+				if (distance > 2.0f * texel)
+				{
+					EXPECT(value.w == 0.0f);
+					far++;
+				}
+				else if (distance < 0.5f * texel)
+				{
+					EXPECT(value.w > 0.0f);
+					near++;
+				}
+			}
+		}
+	}
+	EXPECT(far > 0 && near > 0);
+}
+
+TEST(CacheRoundTripsAndRejectsMovedLights)
+{
+	LightmapBaker::Settings settings = SmallSettings();
+	std::vector<LightmapLight> lights = LightmapBaker::SceneLights();
+	WorkStealingPool pool(2);
+	Lightmap lightmap = LightmapBaker::Bake(settings, lights, pool);
+
+	std::stringstream stream;
+	EXPECT(LightmapBaker::Save(lightmap, stream));
+
+	Lightmap loaded;
+	EXPECT(LightmapBaker::Load(stream, lightmap.key, loaded));
+	EXPECT(loaded.resolution == lightmap.resolution);
+	EXPECT(loaded.texels.size() == lightmap.texels.size() &&
+		std::memcmp(loaded.texels.data(), lightmap.texels.data(), lightmap.texels.size() * sizeof(float4)) == 0);
+
+	std::vector<LightmapLight> moved = lights;
+	moved[0].position.x += 1.0f;
+	EXPECT(LightmapBaker::Key(settings, moved) != lightmap.key);
+	stream.clear();
+	stream.seekg(0);
+	EXPECT(!LightmapBaker::Load(stream, LightmapBaker::Key(settings, moved), loaded));
+}
+
+TEST(SampleMatchesEvaluateOnTheSurfaces)
+{
+	LightmapBaker::Settings settings = LightmapBaker::DefaultSettings();
+	WorkStealingPool pool(0);
+	Lightmap lightmap = LightmapBaker::Bake(settings, LightmapBaker::SceneLights(), pool);
+
+	SampleResult result = CompareSamples(settings, lightmap, 20000);
+	std::printf("%u points, mean error %.4f, max %.4f, %u above 0.1\n", result.points, result.meanError,
+		result.maxError, result.largeErrors);
+
+	EXPECT(result.meanError < 0.03);
+	EXPECT(result.largeErrors < result.points / 20);
+}
+
+BENCHMARK(BakeScaling)
+{
+	LightmapBaker::Settings settings = LightmapBaker::DefaultSettings();
+	std::vector<LightmapLight> lights = LightmapBaker::SceneLights();
+	TestHarness::PrintScaling(0, [&](uint32_t threads) {
+		WorkStealingPool pool(threads);
+		LightmapBaker::Bake(settings, lights, pool);
+	});
+}
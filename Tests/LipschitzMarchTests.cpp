@@ -0,0 +1,157 @@
+﻿#include "TestHarness.h"
+
+#include "LipschitzMarch.h"
+#include "SdfScene.h"
+
+#include <cstdio>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	// Step of the reference crossing search, and how far past it a hit may be before it counts as
+	// an overshoot.
+	const float ReferenceSpacing = 0.0005f;
+	const float Tolerance = 2.0f * ReferenceSpacing + LipschitzMarch::HitEpsilon;
+
+	struct Random
+	{
+		uint32_t	state;
+
+		float Next()
+		{
+			state = state * 1664525u + 1013904223u;
+			return static_cast<float>(state >> 8) / 16777216.0f;
+		}
+
+		float Range(float low, float high)		{ return low + (high - low) * Next(); }
+	};
+
+	// Rays marched through one scene with each kind of scaling. An overshoot is a trace that hits
+	// further than the reference crossing, or misses where the reference hits. Hits where the
+	// reference finds nothing are rays grazing a surface and do not count.
+	struct CaseResult
+	{
+		float		lipschitz;			// Of the whole scene, for the radius its rays reach.
+		uint32_t	rays;
+		uint32_t	referenceHits;
+		uint32_t	overshoots[3];		// Indexed by Scaling.
+		uint32_t	exhausted[3];
+		double		meanSteps[3];
+	};
+
+	// Rays from a sphere of radius distance around centre towards points within size of it.
+	template <class E>
+	CaseResult RunCase(const SdfExpression::Expression<E>& e, const float3& centre, float size, float distance, uint32_t rays)
+	{
+		float tMax = 2.0f * distance;
+
+		CaseResult result = {};
+		result.lipschitz = SdfExpression::Lipschitz(e, length(centre) + distance + tMax);
+		result.rays = rays;
+
+		Random random = { 1 };
+		uint64_t steps[3] = {};
+		for (uint32_t ray = 0; ray < rays; ray++)
+		{
+			float3 from = normalize(float3(random.Range(-1.0f, 1.0f), random.Range(-1.0f, 1.0f), random.Range(-1.0f, 1.0f)));
+			float3 origin = centre + distance * from;
+			float3 target = centre + size * float3(random.Range(-1.0f, 1.0f), random.Range(-1.0f, 1.0f), random.Range(-1.0f, 1.0f));
+			float3 direction = normalize(target - origin);
+
+			// Starting inside a surface says nothing about stepping through one.
+			if (SdfExpression::Evaluate(e, origin) <= 0.0f)
+				continue;
+
+			float reference = 0.0f;
+			bool referenceHit = LipschitzMarch::FirstCrossing(e, origin, direction, tMax, ReferenceSpacing, reference);
+			result.referenceHits += referenceHit ? 1 : 0;
+
+			for (int scaling = 0; scaling < 3; scaling++)
+			{
+				LipschitzMarch::Trace trace = LipschitzMarch::March(e, static_cast<LipschitzMarch::Scaling>(scaling),
+					result.lipschitz, origin, direction, tMax);
+				steps[scaling] += trace.steps;
+
+				if (trace.exhausted)
+					result.exhausted[scaling]++;
+				else if (referenceHit && (!trace.hit || trace.t > reference + Tolerance))
+					result.overshoots[scaling]++;
+			}
+		}
+
+		for (int scaling = 0; scaling < 3; scaling++)
+			result.meanSteps[scaling] = rays > 0 ? static_cast<double>(steps[scaling]) / rays : 0.0;
+		return result;
+	}
+
+	void Print(const char* name, const CaseResult& result)
+	{
+		std::printf("%-20s L %7.2f, %u of %u rays hit, overshoots %u %u %u, exhausted %u %u %u, steps %.1f %.1f %.1f\n",
+			name, result.lipschitz, result.referenceHits, result.rays,
+			result.overshoots[0], result.overshoots[1], result.overshoots[2],
+			result.exhausted[0], result.exhausted[1], result.exhausted[2],
+			result.meanSteps[0], result.meanSteps[1], result.meanSteps[2]);
+	}
+
+	// Global and PerNode must never step through a surface.
+	void ExpectNoOvershoot(const char* name, const CaseResult& result)
+	{
+		Print(name, result);
+		EXPECT(result.referenceHits > 0);
+		EXPECT(result.overshoots[int(LipschitzMarch::Scaling::Global)] == 0);
+		EXPECT(result.overshoots[int(LipschitzMarch::Scaling::PerNode)] == 0);
+	}
+
+	const uint32_t Rays = 2000;
+}
+
+// Twist swaps y and z, so the bar stands along y.
+TEST(TwistedBar)
+{
+	using namespace SdfExpression;
+	CaseResult result = RunCase(Twist(Box(float3(0.3f, 0.1f, 1.0f))), float3(0.0f), 1.0f, 3.0f, Rays);
+	ExpectNoOvershoot("twist", result);
+
+	// The twist is what the plain distance steps through.
+	EXPECT(result.overshoots[int(LipschitzMarch::Scaling::None)] > 0);
+}
+
+TEST(SoftUnion)
+{
+	using namespace SdfExpression;
+	auto blob = SoftUnion(Translate(Sphere(0.5f), float3(0.4f, 0.0f, 0.0f)), Box(float3(0.3f, 0.6f, 0.3f)), 0.5f);
+	ExpectNoOvershoot("soft union", RunCase(blob, float3(0.0f), 0.8f, 3.0f, Rays));
+}
+
+TEST(SoftIntersect)
+{
+	using namespace SdfExpression;
+	auto lens = SoftIntersect(Sphere(0.8f), Translate(Sphere(0.8f), float3(0.6f, 0.0f, 0.0f)), 0.5f);
+	ExpectNoOvershoot("soft intersect", RunCase(lens, float3(-0.3f, 0.0f, 0.0f), 0.6f, 3.0f, Rays));
+}
+
+TEST(CappedCone)
+{
+	using namespace SdfExpression;
+	ExpectNoOvershoot("capped cone", RunCase(CappedCone(float3(0.8f, 0.6f, 1.0f)), float3(0.0f), 1.0f, 3.0f, Rays));
+}
+
+// Only the bar is slow to march, so PerNode should take far fewer steps than Global here.
+TEST(TwistAmongPillars)
+{
+	using namespace SdfExpression;
+	auto hall = Union(SdfScene::Pillars(), Translate(Twist(Box(float3(0.3f, 0.1f, 1.0f))), float3(0.0f, 0.0f, 2.0f)));
+	CaseResult result = RunCase(hall, float3(0.0f, 0.0f, -1.75f), 4.0f, 7.0f, Rays);
+	ExpectNoOvershoot("twist among pillars", result);
+	EXPECT(result.meanSteps[int(LipschitzMarch::Scaling::PerNode)] < result.meanSteps[int(LipschitzMarch::Scaling::Global)]);
+}
+
+// True distances everywhere, so every scaling is exact.
+TEST(Pillars)
+{
+	CaseResult result = RunCase(SdfScene::Pillars(), float3(0.0f, 0.0f, -1.75f), 4.0f, 7.0f, Rays);
+	ExpectNoOvershoot("pillars", result);
+	EXPECT(result.overshoots[int(LipschitzMarch::Scaling::None)] == 0);
+}
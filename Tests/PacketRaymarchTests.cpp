@@ -0,0 +1,117 @@
+﻿#include "TestHarness.h"
+
+#include "FusedRaymarch.h"
+#include "PacketRaymarch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	// An odd width, so the last packet of each row is only partly filled.
+	RaymarchCamera MakeCamera(float width, float height)
+	{
+		RaymarchCamera camera = { float3(0.0f, 3.5f, 5.0f), 1.0f, 0.004f * 640.0f / width, width, height };
+		return camera;
+	}
+
+	const PacketRaymarch::SimdLevel Levels[] =
+	{
+		PacketRaymarch::SimdLevel::Scalar,
+		PacketRaymarch::SimdLevel::Avx2,
+		PacketRaymarch::SimdLevel::Avx512,
+	};
+}
+
+TEST(EveryLevelMatchesScalar)
+{
+	RaymarchCamera camera = MakeCamera(323.0f, 180.0f);
+	RaymarchLighting lighting = RaymarchLighting::Default();
+	std::printf("best level %s\n", PacketRaymarch::GetLevelName(PacketRaymarch::GetBestLevel()));
+
+	std::vector<RaymarchSample> reference, image;
+	PacketRaymarch::Render(PacketRaymarch::SimdLevel::Scalar, camera, lighting, reference);
+	EXPECT(reference.size() == size_t(323) * 180);
+
+	for (PacketRaymarch::SimdLevel level : Levels)
+	{
+		PacketRaymarch::Render(level, camera, lighting, image);
+		uint32_t mismatches = PacketRaymarch::CountMismatches(reference, image, 1e-4f);
+		std::printf("%s: %u of %zu pixels differ\n", PacketRaymarch::GetLevelName(level), mismatches, image.size());
+		EXPECT(mismatches == 0);
+	}
+}
+
+TEST(ScalarHitsWhatFusedRaymarchHits)
+{
+	RaymarchCamera camera = MakeCamera(160.0f, 90.0f);
+	std::vector<RaymarchSample> image;
+	PacketRaymarch::Render(PacketRaymarch::SimdLevel::Scalar, camera, RaymarchLighting::Default(), image);
+
+	uint32_t disagreements = 0;
+	float largestDepthError = 0.0f;
+	for (uint32_t y = 0; y < 90; y++)
+	{
+		for (uint32_t x = 0; x < 160; x++)
+		{
+			float t;
+			bool hit = FusedRaymarch::March(FusedRaymarch::Scene, camera.eye, camera.Ray(x + 0.5f, y + 0.5f), t);
+			const RaymarchSample& sample = image[y * 160 + x];
+			if (hit != (sample.depth >= 0.0f))
+				disagreements++;
+			else if (hit)
+				largestDepthError = std::max(largestDepthError, std::fabs(t - sample.depth));
+		}
+	}
+	std::printf("%u disagreements, largest depth error %g\n", disagreements, largestDepthError);
+
+	EXPECT(disagreements == 0);
+	EXPECT(largestDepthError < 1e-3f);
+}
+
+TEST(TilesAddUpToTheFrame)
+{
+	RaymarchCamera camera = MakeCamera(100.0f, 60.0f);
+	RaymarchLighting lighting = RaymarchLighting::Default();
+	PacketRaymarch::SimdLevel level = PacketRaymarch::GetBestLevel();
+
+	std::vector<RaymarchSample> frame, tiled(100 * 60);
+	PacketRaymarch::Render(level, camera, lighting, frame);
+	for (uint32_t y = 0; y < 60; y += 16)
+	{
+		for (uint32_t x = 0; x < 100; x += 16)
+		{
+			PacketRaymarch::RenderTile(level, camera, lighting, x, y, std::min(16u, 100 - x), std::min(16u, 60 - y), 1, tiled.data());
+		}
+	}
+	EXPECT(PacketRaymarch::CountMismatches(frame, tiled, 0.0f) == 0);
+}
+
+BENCHMARK(RaysPerSecond)
+{
+	RaymarchCamera camera = MakeCamera(643.0f, 360.0f);
+	RaymarchLighting lighting = RaymarchLighting::Default();
+	std::vector<RaymarchSample> image;
+
+	for (PacketRaymarch::SimdLevel level : Levels)
+	{
+		if (!PacketRaymarch::IsSupported(level))
+		{
+			std::printf("%s: not supported\n", PacketRaymarch::GetLevelName(level));
+			continue;
+		}
+
+		// One frame first, so allocating the image is not timed.
+		PacketRaymarch::Render(level, camera, lighting, image);
+		const uint32_t frames = 3;
+		double milliseconds = TestHarness::Milliseconds([&]() {
+			for (uint32_t i = 0; i < frames; i++)
+				PacketRaymarch::Render(level, camera, lighting, image);
+		});
+		std::printf("%s: %.3g rays/s\n", PacketRaymarch::GetLevelName(level), image.size() * frames / (milliseconds / 1000.0));
+	}
+}
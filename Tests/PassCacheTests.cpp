@@ -0,0 +1,140 @@
+﻿#include "TestHarness.h"
+
+#include "PassCache.h"
+
+#include <cstdio>
+#include <functional>
+#include <utility>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	// Stand ins for what the renderer keeps, which RoomPassInputs points into.
+	struct Scene
+	{
+		float4						camera[3];		// Like PixelShaderConstantBuffer's eye, light colour and background.
+		float2						canvas;
+		uint32_t					resolution;
+		bool						fused;
+		uint32_t					pillarsPerSide;
+		std::vector<ClusterLight>	lights;
+		int							target;			// Only their addresses are hashed.
+		int							textures[4];
+	};
+
+	Scene MakeScene()
+	{
+		Scene scene = {};
+		scene.camera[0] = float4(0.0f, 3.5f, 5.0f, 1.0f);
+		scene.camera[1] = float4(1.0f, 0.9f, 0.8f, 1.0f);
+		scene.canvas = float2(1280.0f, 720.0f);
+		scene.pillarsPerSide = 7;
+		scene.lights = LightClusters::WallTorches(4);
+		return scene;
+	}
+
+	RoomPassInputs MakeInputs(const Scene& scene)
+	{
+		RoomPassInputs inputs;
+		inputs.constants = { PassBytes::Of(scene.camera), PassBytes::Of(scene.canvas) };
+		inputs.modes = { PassBytes::Of(scene.resolution), PassBytes::Of(scene.fused), PassBytes::Of(scene.pillarsPerSide) };
+		inputs.lights = scene.lights.data();
+		inputs.lightCount = scene.lights.size();
+		inputs.viewport = { 0.0f, 0.0f, scene.canvas.x, scene.canvas.y, 0.0f, 1.0f };
+		inputs.floorMode = FloorMode::Tessellated;
+		inputs.bakedLights = 3;
+		inputs.occlusion = true;
+		inputs.resources = { &scene.target, &scene.textures[0], &scene.textures[1], &scene.textures[2], &scene.textures[3] };
+		return inputs;
+	}
+
+	uint64_t Hash(const RoomPassInputs& inputs)
+	{
+		PassHash hash;
+		hash.AddRoomPass(inputs);
+		return hash.GetValue();
+	}
+
+	// One input of the room pass changing, to the inputs themselves or to what they point at.
+	struct Change
+	{
+		const char*											name;
+		std::function<void(Scene&, RoomPassInputs&)>		apply;
+	};
+}
+
+TEST(SameInputsReuseTheOutput)
+{
+	Scene scene = MakeScene();
+	PassCache cache;
+	EXPECT(!cache.Reuse(Hash(MakeInputs(scene))));
+	EXPECT(cache.Reuse(Hash(MakeInputs(scene))));
+	EXPECT(cache.Reuse(Hash(MakeInputs(scene))));
+	EXPECT(cache.GetHits() == 2 && cache.GetMisses() == 1);
+
+	// A copy of the scene lives elsewhere, so its target and textures are other objects.
+	Scene copy = scene;
+	EXPECT(!cache.Reuse(Hash(MakeInputs(copy))));
+}
+
+TEST(EveryInputInvalidatesTheOutput)
+{
+	const Change changes[] =
+	{
+		{ "viewport size", [](Scene&, RoomPassInputs& inputs) { inputs.viewport.width = 640.0f; } },
+		{ "viewport origin", [](Scene&, RoomPassInputs& inputs) { inputs.viewport.x = 1.0f; } },
+		{ "viewport depth", [](Scene&, RoomPassInputs& inputs) { inputs.viewport.maxDepth = 0.5f; } },
+		{ "floor mode", [](Scene&, RoomPassInputs& inputs) { inputs.floorMode = FloorMode::Parallax; } },
+		{ "baked lights", [](Scene&, RoomPassInputs& inputs) { inputs.bakedLights = 0; } },
+		{ "occlusion", [](Scene&, RoomPassInputs& inputs) { inputs.occlusion = false; } },
+		{ "light position", [](Scene& scene, RoomPassInputs&) { scene.lights[2].position.y += 0.01f; } },
+		{ "light colour", [](Scene& scene, RoomPassInputs&) { scene.lights[0].color.x *= 0.5f; } },
+		{ "light radius", [](Scene& scene, RoomPassInputs&) { scene.lights[3].radius += 1.0f; } },
+		{ "light count", [](Scene&, RoomPassInputs& inputs) { inputs.lightCount--; } },
+		{ "camera", [](Scene& scene, RoomPassInputs&) { scene.camera[0].z = 4.0f; } },
+		{ "canvas", [](Scene& scene, RoomPassInputs&) { scene.canvas.y = 1080.0f; } },
+		{ "resolution", [](Scene& scene, RoomPassInputs&) { scene.resolution = 1; } },
+		{ "fused", [](Scene& scene, RoomPassInputs&) { scene.fused = true; } },
+		{ "colonnade", [](Scene& scene, RoomPassInputs&) { scene.pillarsPerSide = 8; } },
+		{ "mode moved to the constants", [](Scene&, RoomPassInputs& inputs) {
+			inputs.constants.push_back(inputs.modes.front());
+			inputs.modes.erase(inputs.modes.begin());
+		} },
+		{ "target", [](Scene& scene, RoomPassInputs& inputs) { inputs.resources[0] = &scene.textures[0]; } },
+		{ "texture", [](Scene& scene, RoomPassInputs& inputs) { inputs.resources[4] = &scene.target; } },
+		{ "texture order", [](Scene&, RoomPassInputs& inputs) { std::swap(inputs.resources[1], inputs.resources[2]); } },
+	};
+
+	for (const Change& change : changes)
+	{
+		Scene scene = MakeScene();
+		PassCache cache;
+		EXPECT(!cache.Reuse(Hash(MakeInputs(scene))));
+		EXPECT(cache.Reuse(Hash(MakeInputs(scene))));
+
+		RoomPassInputs inputs = MakeInputs(scene);
+		change.apply(scene, inputs);
+		bool reused = cache.Reuse(Hash(inputs));
+		if (reused)
+		{
+			std::printf("%s did not invalidate the pass\n", change.name);
+		}
+		EXPECT(!reused);
+		EXPECT(cache.Reuse(Hash(inputs)));
+	}
+}
+
+TEST(InvalidateForgetsTheOutput)
+{
+	Scene scene = MakeScene();
+	uint64_t hash = Hash(MakeInputs(scene));
+
+	PassCache cache;
+	EXPECT(!cache.Reuse(hash));
+	cache.Invalidate();
+	EXPECT(!cache.Reuse(hash));
+	EXPECT(cache.Reuse(hash));
+	EXPECT(cache.GetHits() == 1 && cache.GetMisses() == 2);
+}
@@ -0,0 +1,141 @@
+﻿#include "TestHarness.h"
+
+#include "FusedRaymarch.h"
+#include "RaymarchDepth.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	struct Random
+	{
+		uint32_t	state;
+
+		float Next()
+		{
+			state = state * 1664525u + 1013904223u;
+			return static_cast<float>(state >> 8) / 16777216.0f;
+		}
+
+		float Range(float low, float high)		{ return low + (high - low) * Next(); }
+	};
+
+	const float NearZ = 0.01f;
+	const float FarZ = 100.0f;
+
+	// The raster camera of CreateWindowSizeDependentResources, which the depth tested marcher
+	// shoots its rays through.
+	struct Camera
+	{
+		float3		eye;
+		float4x4	viewProjection;
+		float4x4	inverseViewProjection;
+	};
+
+	Camera MakeCamera()
+	{
+		Camera camera;
+		camera.eye = float3(0.0f, 3.5f, 5.0f);
+		camera.viewProjection = mul(RaymarchDepth::LookAtRH(camera.eye, float3(0.0f, -0.1f, 0.0f), float3(0.0f, 1.0f, 0.0f)),
+			RaymarchDepth::PerspectiveFovRH(70.0f * 3.14159265f / 180.0f, 16.0f / 9.0f, NearZ, FarZ));
+		camera.inverseViewProjection = RaymarchDepth::Inverse(camera.viewProjection);
+		return camera;
+	}
+
+	// Distance along the view axis of Position, which is what the depth buffer orders by.
+	float ViewDistance(const Camera& camera, const float3& Position)
+	{
+		float3 axis = normalize(float3(0.0f, -0.1f, 0.0f) - camera.eye);
+		return dot(Position - camera.eye, axis);
+	}
+}
+
+TEST(DepthRoundTripsThroughRayDistance)
+{
+	Camera camera = MakeCamera();
+	Random random = { 5 };
+
+	float worst = 0.0f, worstQuantized = 0.0f;
+	for (uint32_t i = 0; i < 10000; i++)
+	{
+		float2 ndc = RaymarchDepth::PixelToNdc(random.Range(0.0f, 1280.0f), random.Range(0.0f, 720.0f), 1280.0f, 720.0f);
+		float3 direction = RaymarchDepth::PixelRay(camera.inverseViewProjection, camera.eye, ndc);
+		float t = random.Range(0.1f, 20.0f);
+
+		float depth = RaymarchDepth::ProjectDepth(camera.viewProjection, camera.eye + t * direction);
+		EXPECT(depth > 0.0f && depth < 1.0f);
+
+		float back = RaymarchDepth::RayDistance(camera.inverseViewProjection, camera.eye, direction, ndc, depth);
+		float quantized = RaymarchDepth::RayDistance(camera.inverseViewProjection, camera.eye, direction, ndc,
+			RaymarchDepth::QuantizeDepth(depth));
+		worst = std::max(worst, std::fabs(back - t) / t);
+		worstQuantized = std::max(worstQuantized, std::fabs(quantized - t) / t);
+	}
+	std::printf("largest relative error %g, %g through a 24 bit buffer\n", worst, worstQuantized);
+	EXPECT(worst < 1e-3f);
+	EXPECT(worstQuantized < 2e-3f);
+}
+
+TEST(DepthGrowsFromTheNearToTheFarPlane)
+{
+	Camera camera = MakeCamera();
+	const float2 corners[] = { float2(-1.0f, -1.0f), float2(1.0f, 1.0f), float2(0.0f, 0.0f), float2(0.9f, -0.3f) };
+	for (const float2& ndc : corners)
+	{
+		float3 direction = RaymarchDepth::PixelRay(camera.inverseViewProjection, camera.eye, ndc);
+		float3 nearPoint = camera.eye + (NearZ / ViewDistance(camera, camera.eye + direction)) * direction;
+		float3 farPoint = camera.eye + (FarZ / ViewDistance(camera, camera.eye + direction)) * direction;
+		EXPECT(std::fabs(RaymarchDepth::ProjectDepth(camera.viewProjection, nearPoint)) < 1e-4f);
+		EXPECT(std::fabs(RaymarchDepth::ProjectDepth(camera.viewProjection, farPoint) - 1.0f) < 1e-4f);
+
+		float previous = -1.0f;
+		for (float t = 0.05f; t < 50.0f; t *= 1.5f)
+		{
+			float depth = RaymarchDepth::ProjectDepth(camera.viewProjection, camera.eye + t * direction);
+			EXPECT(depth > previous);
+			previous = depth;
+		}
+	}
+}
+
+// What the depth tested fused pass writes for the room and the pillars. The canvas quad it draws
+// is at depth 0 and the shader declares SV_DepthGreaterEqual, so every depth it writes must be at
+// least that, and must lead back to the hit.
+TEST(MarchedHitsWriteTheirDepthBehindTheCanvas)
+{
+	Camera camera = MakeCamera();
+	const uint32_t width = 160, height = 90;
+
+	uint32_t hits = 0, behind = 0, mismatches = 0;
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			float2 ndc = RaymarchDepth::PixelToNdc(float(x), float(y), float(width), float(height));
+			float3 direction = RaymarchDepth::PixelRay(camera.inverseViewProjection, camera.eye, ndc);
+
+			float room = 1e30f, pillar = 1e30f;
+			bool hitRoom = FusedRaymarch::March(FusedRaymarch::Room, camera.eye, direction, room);
+			bool hitPillar = FusedRaymarch::March(FusedRaymarch::Pillars, camera.eye, direction, pillar);
+			if (!hitRoom && !hitPillar)
+				continue;
+
+			float t = std::min(hitRoom ? room : 1e30f, hitPillar ? pillar : 1e30f);
+			float depth = RaymarchDepth::ProjectDepth(camera.viewProjection, camera.eye + t * direction);
+			hits++;
+			behind += depth >= 0.0f && depth <= 1.0f ? 1 : 0;
+
+			float back = RaymarchDepth::RayDistance(camera.inverseViewProjection, camera.eye, direction, ndc, depth);
+			mismatches += std::fabs(back - t) > 1e-3f * t ? 1 : 0;
+		}
+	}
+	std::printf("%u of %u pixels hit, %u behind the canvas, %u mismatches\n", hits, width * height, behind, mismatches);
+	EXPECT(hits > width * height / 2);
+	EXPECT(behind == hits);
+	EXPECT(mismatches == 0);
+}
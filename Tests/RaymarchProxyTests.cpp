@@ -0,0 +1,205 @@
+﻿#include "TestHarness.h"
+
+#include "ConeMarch.h"
+#include "RaymarchProxy.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	bool IntersectProxy(const RaymarchProxy& proxy, const float3& origin, const float3& direction, float& timeIn, float& timeOut)
+	{
+		float3 OMIN = (proxy.minimum - origin) / direction;
+		float3 OMAX = (proxy.maximum - origin) / direction;
+		float3 MAX = max(OMAX, OMIN);
+		float3 MIN = min(OMAX, OMIN);
+		timeOut = std::min(MAX.x, std::min(MAX.y, MAX.z));
+		timeIn = std::max(std::max(MIN.x, 0.0f), std::max(MIN.y, MIN.z));
+
+		return timeOut > timeIn;
+	}
+
+	struct ScreenPoint
+	{
+		float	x;
+		float	y;
+	};
+
+	ScreenPoint ToScreen(const RaymarchCamera& camera, const float4& clip)
+	{
+		ScreenPoint point;
+		point.x = (clip.x / clip.w + 1.0f) * 0.5f * camera.width;
+		point.y = (1.0f - clip.y / clip.w) * 0.5f * camera.height;
+		return point;
+	}
+
+	// Twice the signed area in pixel coordinates, y down. Positive for triangles that look clockwise.
+	float Edge(const ScreenPoint& a, const ScreenPoint& b, float x, float y)
+	{
+		return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+	}
+
+	// Every pixel of the pillar pass through camera, with and without proxies.
+	struct CoverageResult
+	{
+		uint32_t	pixels;
+		uint32_t	coveredPixels;		// Inside at least one box, the pixels that march.
+		uint32_t	fragments;			// Back face pixels rasterized over all boxes.
+		uint32_t	rasterMismatches;	// Pixels where the rasterized mesh and the ray box tests disagree.
+		uint32_t	windingErrors;		// Triangles facing away from the eye that would not be rasterized.
+		uint32_t	hitMismatches;		// Pixels whose pillar hit changed at all.
+		double		fullSteps;			// Field evaluations per pixel.
+		double		proxySteps;
+	};
+
+	CoverageResult MeasureCoverage(const RaymarchCamera& camera)
+	{
+		std::vector<RaymarchProxy> proxies = RaymarchProxies::PillarProxies();
+		std::vector<float3> vertices;
+		std::vector<uint16_t> indices;
+		RaymarchProxies::BuildMesh(proxies, vertices, indices);
+
+		uint32_t width = static_cast<uint32_t>(camera.width);
+		uint32_t height = static_cast<uint32_t>(camera.height);
+
+		CoverageResult result = {};
+		result.pixels = width * height;
+
+		// The back faces, which the pass draws with front faces culled.
+		std::vector<uint8_t> rasterized(result.pixels, 0);
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			float3 a = vertices[indices[i]], b = vertices[indices[i + 1]], c = vertices[indices[i + 2]];
+			ScreenPoint p0 = ToScreen(camera, RaymarchProxies::ProjectToCanvas(camera, a));
+			ScreenPoint p1 = ToScreen(camera, RaymarchProxies::ProjectToCanvas(camera, b));
+			ScreenPoint p2 = ToScreen(camera, RaymarchProxies::ProjectToCanvas(camera, c));
+			float area = Edge(p0, p1, p2.x, p2.y);
+
+			// A face whose outside points away from the eye is seen from behind and must come out
+			// counterclockwise on screen.
+			const RaymarchProxy& proxy = proxies[i / (3 * RaymarchProxies::TrianglesPerProxy)];
+			float3 outward = cross(b - a, c - a);
+			if (dot(outward, a - 0.5f * (proxy.minimum + proxy.maximum)) < 0.0f)
+				outward = -outward;
+			bool facesAway = dot(outward, a - camera.eye) > 0.0f;
+			if (facesAway != (area < 0.0f) && area != 0.0f)
+				result.windingErrors++;
+
+			if (area >= 0.0f)
+				continue;
+
+			int x0 = std::max(0, static_cast<int>(std::floor(std::min(p0.x, std::min(p1.x, p2.x)))));
+			int x1 = std::min(static_cast<int>(width) - 1, static_cast<int>(std::ceil(std::max(p0.x, std::max(p1.x, p2.x)))));
+			int y0 = std::max(0, static_cast<int>(std::floor(std::min(p0.y, std::min(p1.y, p2.y)))));
+			int y1 = std::min(static_cast<int>(height) - 1, static_cast<int>(std::ceil(std::max(p0.y, std::max(p1.y, p2.y)))));
+			for (int y = y0; y <= y1; y++)
+			{
+				for (int x = x0; x <= x1; x++)
+				{
+					float px = x + 0.5f, py = y + 0.5f;
+					if (Edge(p0, p1, px, py) <= 0.0f && Edge(p1, p2, px, py) <= 0.0f && Edge(p2, p0, px, py) <= 0.0f)
+					{
+						rasterized[y * width + x] = 1;
+						result.fragments++;
+					}
+				}
+			}
+		}
+
+		uint64_t fullSteps = 0, proxySteps = 0;
+		for (uint32_t y = 0; y < height; y++)
+		{
+			for (uint32_t x = 0; x < width; x++)
+			{
+				float3 direction = camera.Ray(x + 0.5f, y + 0.5f);
+
+				float fullT = 0.0f;
+				uint32_t steps;
+				bool fullHit = ConeMarch::MarchFrom(FusedRaymarch::Pillars, camera.eye, direction, 0.0f, fullT, steps);
+				fullSteps += steps;
+
+				// Overlapping boxes each march, the depth test keeps the nearest hit.
+				bool covered = false, proxyHit = false;
+				float proxyT = 0.0f;
+				for (const RaymarchProxy& proxy : proxies)
+				{
+					float timeIn, timeOut, t;
+					if (!IntersectProxy(proxy, camera.eye, direction, timeIn, timeOut))
+						continue;
+
+					covered = true;
+					if (RaymarchProxies::MarchRange(FusedRaymarch::Pillars, camera.eye, direction, timeIn, timeOut, t, steps) &&
+						(!proxyHit || t < proxyT))
+					{
+						proxyHit = true;
+						proxyT = t;
+					}
+					proxySteps += steps;
+				}
+
+				result.coveredPixels += covered ? 1 : 0;
+				if (covered != (rasterized[y * width + x] != 0))
+					result.rasterMismatches++;
+				if (fullHit != proxyHit || (fullHit && fullT != proxyT))
+					result.hitMismatches++;
+			}
+		}
+
+		double perPixel = result.pixels > 0 ? 1.0 / result.pixels : 0.0;
+		result.fullSteps = fullSteps * perPixel;
+		result.proxySteps = proxySteps * perPixel;
+		return result;
+	}
+
+	void Print(const CoverageResult& result)
+	{
+		std::printf("%u pixels, %u covered, %u fragments, %u raster mismatches, %u winding errors, %u hit mismatches, steps %.2f -> %.2f\n",
+			result.pixels, result.coveredPixels, result.fragments, result.rasterMismatches, result.windingErrors,
+			result.hitMismatches, result.fullSteps, result.proxySteps);
+	}
+
+	RaymarchCamera MakeCamera(float width, float height)
+	{
+		RaymarchCamera camera = { float3(0.0f, 3.5f, 5.0f), 1.0f, 0.004f * 640.0f / width, width, height };
+		return camera;
+	}
+}
+
+TEST(ProxiesKeepEveryPillarHit)
+{
+	CoverageResult result = MeasureCoverage(MakeCamera(320.0f, 240.0f));
+	Print(result);
+
+	EXPECT(result.windingErrors == 0);
+	EXPECT(result.hitMismatches == 0);
+	EXPECT(result.coveredPixels < result.pixels);
+	EXPECT(result.proxySteps < result.fullSteps);
+
+	// Pixel centres exactly on a box edge can go either way.
+	EXPECT(result.rasterMismatches <= result.pixels / 1000);
+}
+
+TEST(MeshHasAllBoxes)
+{
+	std::vector<RaymarchProxy> proxies = RaymarchProxies::PillarProxies();
+	std::vector<float3> vertices;
+	std::vector<uint16_t> indices;
+	RaymarchProxies::BuildMesh(proxies, vertices, indices);
+
+	EXPECT(!proxies.empty() && proxies.size() <= RaymarchProxies::MaxProxies);
+	EXPECT(vertices.size() == proxies.size() * RaymarchProxies::VerticesPerProxy);
+	EXPECT(indices.size() == proxies.size() * RaymarchProxies::TrianglesPerProxy * 3);
+	for (uint16_t index : indices)
+		EXPECT(index < vertices.size());
+}
+
+BENCHMARK(StepsWithAndWithoutProxies)
+{
+	Print(MeasureCoverage(MakeCamera(640.0f, 480.0f)));
+	Print(MeasureCoverage(MakeCamera(1280.0f, 720.0f)));
+}
@@ -0,0 +1,147 @@
+﻿#include "TestHarness.h"
+
+#include "PacketRaymarch.h"
+#include "RaymarchReconstruction.h"
+
+#include <cmath>
+#include <cstdio>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	// The canvas camera, with the zoom scaled so every size sees the same view as 640 wide.
+	RaymarchCamera MakeCamera(float width, float height)
+	{
+		RaymarchCamera camera = { float3(0.0f, 3.5f, 5.0f), 1.0f, 0.004f * 640.0f / width, width, height };
+		return camera;
+	}
+
+	// What the pass marches of the full rate frame: the marched pixels in the layout MarchedSize
+	// describes. The pixels left out are poisoned, so reading one shows in the comparison.
+	std::vector<RaymarchSample> March(RaymarchResolution resolution, const std::vector<RaymarchSample>& full, uint32_t width, uint32_t height)
+	{
+		uint32_t marchedWidth, marchedHeight;
+		RaymarchReconstruction::MarchedSize(resolution, width, height, marchedWidth, marchedHeight);
+
+		RaymarchSample poison = { float4(100.0f, 100.0f, 100.0f, 1.0f), float3(0.0f, 0.0f, 1.0f), 1000.0f };
+		std::vector<RaymarchSample> marched(marchedWidth * marchedHeight, poison);
+		for (uint32_t y = 0; y < height; y++)
+		{
+			for (uint32_t x = 0; x < width; x++)
+			{
+				if (!RaymarchReconstruction::IsMarched(resolution, x, y))
+					continue;
+				if (resolution == RaymarchResolution::Half)
+					marched[(y / 2) * marchedWidth + x / 2] = full[y * width + x];
+				else
+					marched[y * width + x] = full[y * width + x];
+			}
+		}
+		return marched;
+	}
+
+	struct Quality
+	{
+		double		psnr;			// Over the colour channels, infinite for an exact image.
+		uint32_t	mismatches;		// Pixels more than 0.1 off in any channel.
+	};
+
+	Quality Compare(const std::vector<RaymarchSample>& full, const std::vector<float4>& image)
+	{
+		Quality quality = {};
+		double squares = 0.0;
+		for (size_t i = 0; i < full.size(); i++)
+		{
+			const float4& color = full[i].color;
+			float error[3] = { image[i].x - color.x, image[i].y - color.y, image[i].z - color.z };
+			bool mismatch = false;
+			for (float channel : error)
+			{
+				squares += double(channel) * channel;
+				mismatch |= std::fabs(channel) > 0.1f;
+			}
+			quality.mismatches += mismatch ? 1 : 0;
+		}
+		double mean = squares / (3.0 * full.size());
+		quality.psnr = mean > 0.0 ? 10.0 * std::log10(1.0 / mean) : INFINITY;
+		return quality;
+	}
+
+	Quality Reconstruct(RaymarchResolution resolution, const std::vector<RaymarchSample>& full, uint32_t width, uint32_t height)
+	{
+		std::vector<float4> image;
+		RaymarchReconstruction::Reconstruct(resolution, March(resolution, full, width, height), width, height, nullptr, image);
+		return Compare(full, image);
+	}
+
+	// Sizes that are odd both ways, so the half resolution image has a partial last row and column.
+	const uint32_t Width = 321;
+	const uint32_t Height = 181;
+
+	std::vector<RaymarchSample> RenderFull(uint32_t width, uint32_t height)
+	{
+		std::vector<RaymarchSample> full;
+		PacketRaymarch::Render(PacketRaymarch::GetBestLevel(), MakeCamera(float(width), float(height)), RaymarchLighting::Default(), full);
+		return full;
+	}
+}
+
+TEST(FullIsTheMarchedFrame)
+{
+	std::vector<RaymarchSample> full = RenderFull(Width, Height);
+	Quality quality = Reconstruct(RaymarchResolution::Full, full, Width, Height);
+	EXPECT(quality.mismatches == 0);
+	EXPECT(std::isinf(quality.psnr));
+}
+
+TEST(CheckerboardIsCloseToTheFullFrame)
+{
+	std::vector<RaymarchSample> full = RenderFull(Width, Height);
+	Quality quality = Reconstruct(RaymarchResolution::Checkerboard, full, Width, Height);
+	std::printf("checkerboard: %.1f dB, %u mismatches\n", quality.psnr, quality.mismatches);
+	EXPECT(quality.psnr > 35.0);
+	EXPECT(quality.mismatches < Width * Height / 100);
+}
+
+TEST(HalfIsCloseToTheFullFrame)
+{
+	std::vector<RaymarchSample> full = RenderFull(Width, Height);
+	Quality quality = Reconstruct(RaymarchResolution::Half, full, Width, Height);
+	std::printf("half: %.1f dB, %u mismatches\n", quality.psnr, quality.mismatches);
+	EXPECT(quality.psnr > 25.0);
+	EXPECT(quality.mismatches < Width * Height / 20);
+}
+
+BENCHMARK(QualityAndCostOfEachMode)
+{
+	const uint32_t width = 640, height = 360;
+	RaymarchCamera camera = MakeCamera(float(width), float(height));
+	std::vector<RaymarchSample> full;
+	double march = TestHarness::Milliseconds([&]() {
+		PacketRaymarch::Render(PacketRaymarch::GetBestLevel(), camera, RaymarchLighting::Default(), full);
+	});
+
+	std::printf("mode          marched  PSNR vs full  mismatches  reconstruct\n");
+	const RaymarchResolution resolutions[] = { RaymarchResolution::Full, RaymarchResolution::Checkerboard, RaymarchResolution::Half };
+	const char* const names[] = { "full", "checkerboard", "half" };
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		std::vector<RaymarchSample> marched = March(resolutions[i], full, width, height);
+		std::vector<float4> image;
+		double reconstruct = TestHarness::Milliseconds([&]() {
+			RaymarchReconstruction::Reconstruct(resolutions[i], marched, width, height, nullptr, image);
+		});
+
+		uint32_t count = 0;
+		for (uint32_t y = 0; y < height; y++)
+			for (uint32_t x = 0; x < width; x++)
+				count += RaymarchReconstruction::IsMarched(resolutions[i], x, y) ? 1 : 0;
+
+		Quality quality = Compare(full, image);
+		std::printf("%-12s  %5.1f%%  %9.1f dB  %10u  %8.2f ms\n", names[i], 100.0 * count / (width * height),
+			quality.psnr, quality.mismatches, reconstruct);
+	}
+	std::printf("full rate march %.1f ms\n", march);
+}
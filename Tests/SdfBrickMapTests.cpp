@@ -0,0 +1,274 @@
+﻿#include "TestHarness.h"
+
+#include "SdfBrickMap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	struct Random
+	{
+		uint32_t	state;
+
+		float Next()
+		{
+			state = state * 1664525u + 1013904223u;
+			return static_cast<float>(state >> 8) / 16777216.0f;
+		}
+
+		float Range(float low, float high)		{ return low + (high - low) * Next(); }
+	};
+
+	float Box(const float3& p, const float3& size)
+	{
+		float3 d = abs(p) - size;
+		return std::min(std::max(d.x, std::max(d.y, d.z)), 0.0f) + length(max(d, 0.0f));
+	}
+
+	// Today's chamber is the inside of a box of half size 5 with the four pillars of the scene. A
+	// larger one keeps the pillars' spacing and fills the floor with them.
+	struct Chamber
+	{
+		float	halfSize;
+
+		float operator()(const float3& p) const
+		{
+			const float spacing = 3.5f;
+			float x = p.x - spacing * std::round(p.x / spacing);
+			float z = p.z - spacing * std::round(p.z / spacing);
+			float pillar = length(float2(x, z)) - 0.5f;
+			return std::min(-Box(p, float3(halfSize)), pillar);
+		}
+	};
+
+	// Half size of a chamber with volume times today's.
+	Chamber ScaledChamber(float volume)
+	{
+		Chamber chamber = { 5.0f * std::cbrt(volume) };
+		return chamber;
+	}
+
+	const float VoxelSize = 0.05f;
+
+	void Build(SdfBrickMap& map, const Chamber& chamber)
+	{
+		float bound = chamber.halfSize + 0.5f;
+		map.Build(chamber, float3(-bound), float3(bound), VoxelSize);
+	}
+
+	// Where the field first reaches zero along a ray from free space, found with small fixed steps.
+	bool FirstCrossing(const Chamber& chamber, const float3& origin, const float3& direction, float final, float& t)
+	{
+		const float spacing = 0.002f;
+		float left = chamber(origin);
+		for (float time = spacing; time <= final; time += spacing)
+		{
+			float right = chamber(origin + time * direction);
+			if (left > 0.0f && right <= 0.0f)
+			{
+				t = time - spacing * right / (right - left);
+				return true;
+			}
+			left = right;
+		}
+		return false;
+	}
+
+	struct Ray
+	{
+		float3	origin;
+		float3	direction;
+	};
+
+	// Rays from random points of free space inside the chamber, in random directions.
+	std::vector<Ray> RandomRays(const Chamber& chamber, uint32_t count)
+	{
+		Random random = { 3 };
+		std::vector<Ray> rays;
+		float size = 0.95f * chamber.halfSize;
+		while (rays.size() < count)
+		{
+			Ray ray;
+			ray.origin = float3(random.Range(-size, size), random.Range(-size, size), random.Range(-size, size));
+			ray.direction = normalize(float3(random.Range(-1.0f, 1.0f), random.Range(-1.0f, 1.0f), random.Range(-1.0f, 1.0f)));
+			if (chamber(ray.origin) >= 0.1f)
+				rays.push_back(ray);
+		}
+		return rays;
+	}
+
+	// RayMarch against FirstCrossing. A ray that only grazes a surface, closer than the bricks'
+	// interpolation error, can hit in one and miss in the other, so these count as disagreements
+	// rather than errors.
+	struct MarchResult
+	{
+		uint32_t	disagreements;	// Missed, spurious or more than a voxel away from the reference hit.
+		double		meanError;		// Distance between the two hits, for the others.
+		double		maxError;
+		double		meanSteps;
+	};
+
+	MarchResult CompareMarch(const SdfBrickMap& map, const Chamber& chamber, const std::vector<Ray>& rays)
+	{
+		MarchResult result = {};
+		uint64_t steps = 0;
+		float final = 4.0f * chamber.halfSize;
+		for (const Ray& ray : rays)
+		{
+			float reference = 0.0f, t = 0.0f;
+			uint32_t raySteps = 0;
+			bool referenceHit = FirstCrossing(chamber, ray.origin, ray.direction, final, reference);
+			bool hit = map.RayMarch(ray.origin, ray.direction, 0.0f, final, t, &raySteps);
+			steps += raySteps;
+
+			double error = std::fabs(t - reference);
+			if (hit != referenceHit || (hit && error > VoxelSize))
+				result.disagreements++;
+			else if (hit)
+			{
+				result.meanError += error;
+				result.maxError = std::max(result.maxError, error);
+			}
+		}
+		result.meanError /= std::max<size_t>(1, rays.size() - result.disagreements);
+		result.meanSteps = double(steps) / std::max<size_t>(1, rays.size());
+		return result;
+	}
+
+	// Plain sphere tracing of Sample, what RayMarch's skipping of empty cells is measured against.
+	uint32_t SphereTrace(const SdfBrickMap& map, const Ray& ray, float final)
+	{
+		uint32_t steps = 0;
+		for (float t = 0.0f; t < final; steps++)
+		{
+			float d = map.Sample(ray.origin + t * ray.direction);
+			if (d < 0.001f)
+				break;
+			t += std::max(d, 0.5f * VoxelSize);
+		}
+		return steps;
+	}
+}
+
+TEST(SampleIsCloseNearTheSurfaceAndConservativeAway)
+{
+	Chamber chamber = ScaledChamber(1.0f);
+	SdfBrickMap map;
+	Build(map, chamber);
+
+	Random random = { 5 };
+	float largestNearError = 0.0f;
+	uint32_t unsafe = 0;
+	for (uint32_t i = 0; i < 20000; i++)
+	{
+		float3 p(random.Range(-5.0f, 5.0f), random.Range(-5.0f, 5.0f), random.Range(-5.0f, 5.0f));
+		float sampled = map.Sample(p), exact = chamber(p);
+		if (std::fabs(exact) < 0.2f)
+			largestNearError = std::max(largestNearError, std::fabs(sampled - exact));
+
+		// Skipping on a bound larger than the distance could jump through a surface.
+		if (std::fabs(sampled) > std::fabs(exact) + 1e-3f && (sampled < 0.0f) == (exact < 0.0f))
+			unsafe++;
+	}
+	std::printf("largest error near the surface %.4f, %u unsafe samples\n", largestNearError, unsafe);
+
+	EXPECT(largestNearError < VoxelSize);
+	EXPECT(unsafe == 0);
+}
+
+TEST(OnlyCellsNearTheSurfaceHaveBricks)
+{
+	Chamber chamber = ScaledChamber(1.0f);
+	SdfBrickMap map;
+	Build(map, chamber);
+
+	EXPECT(map.GetBrickCount() > 0);
+	EXPECT(map.GetBrickCount() < map.GetCellCount() / 2);
+	EXPECT(map.GetMemoryUsage() < map.GetDenseMemoryUsage());
+}
+
+TEST(RayMarchHitsWhatTheFieldHits)
+{
+	Chamber chamber = ScaledChamber(1.0f);
+	SdfBrickMap map;
+	Build(map, chamber);
+
+	MarchResult result = CompareMarch(map, chamber, RandomRays(chamber, 4000));
+	std::printf("4000 rays, %u disagree, error mean %.5f max %.5f, %.1f steps\n",
+		result.disagreements, result.meanError, result.maxError, result.meanSteps);
+
+	EXPECT(result.disagreements <= 4);
+	EXPECT(result.meanError < 0.1f * VoxelSize);
+}
+
+// A field that jumps from one sign to the other on a cell face, which leaves no surface inside any
+// empty cell. The hit is where the ray leaves the last empty cell, not somewhere inside it.
+TEST(SignChangeOnACellFaceIsFound)
+{
+	const float cellSize = VoxelSize * (SdfBrickMap::BrickSize - 1);
+	const float face = -2.0f + 9 * cellSize;
+	auto step = [face](const float3& p) { return p.x < face ? 0.5f : -0.1f; };
+
+	SdfBrickMap map;
+	map.Build(step, float3(-2.0f), float3(2.0f), VoxelSize);
+
+	Random random = { 9 };
+	float largestError = 0.0f;
+	for (uint32_t i = 0; i < 1000; i++)
+	{
+		float3 origin(-1.9f, random.Range(-1.0f, 1.0f), random.Range(-1.0f, 1.0f));
+		float3 direction = normalize(float3(1.0f, random.Range(-0.2f, 0.2f), random.Range(-0.2f, 0.2f)));
+		float t = 0.0f;
+		EXPECT(map.RayMarch(origin, direction, 0.0f, 8.0f, t));
+		largestError = std::max(largestError, std::fabs((origin + t * direction).x - face));
+	}
+	std::printf("largest error %.5f\n", largestError);
+	EXPECT(largestError < 0.02f * VoxelSize);
+}
+
+// Today's chamber and ones with 10 and 100 times its volume. Rays are timed on their own, at the
+// best of three runs so that neither way pays for warming the caches, then compared with the
+// reference.
+BENCHMARK(LargerChambers)
+{
+	for (float volume : { 1.0f, 10.0f, 100.0f })
+	{
+		Chamber chamber = ScaledChamber(volume);
+		SdfBrickMap map;
+		double build = TestHarness::Milliseconds([&]() { Build(map, chamber); });
+		std::printf("%3.0fx volume, +-%.1f: %u cells, %u bricks, %.1f MB against %.1f MB dense, build %.0f ms\n",
+			volume, chamber.halfSize, map.GetCellCount(), map.GetBrickCount(), map.GetMemoryUsage() / 1048576.0,
+			map.GetDenseMemoryUsage() / 1048576.0, build);
+
+		std::vector<Ray> rays = RandomRays(chamber, 20000);
+		float final = 4.0f * chamber.halfSize;
+		uint64_t traceSteps = 0;
+		double march = INFINITY, trace = INFINITY;
+		for (int run = 0; run < 3; run++)
+		{
+			march = std::min(march, TestHarness::Milliseconds([&]() {
+				for (const Ray& ray : rays)
+				{
+					float t;
+					map.RayMarch(ray.origin, ray.direction, 0.0f, final, t);
+				}
+			}));
+			traceSteps = 0;
+			trace = std::min(trace, TestHarness::Milliseconds([&]() {
+				for (const Ray& ray : rays)
+					traceSteps += SphereTrace(map, ray, final);
+			}));
+		}
+
+		rays.resize(2000);
+		MarchResult result = CompareMarch(map, chamber, rays);
+		std::printf("      RayMarch %.2f Mrays/s, %.1f steps per ray, sphere tracing Sample %.2f Mrays/s, %.1f steps, "
+			"%u of 2000 rays disagree with the field\n", 20000 / (march * 1000.0), result.meanSteps,
+			20000 / (trace * 1000.0), traceSteps / 20000.0, result.disagreements);
+	}
+}
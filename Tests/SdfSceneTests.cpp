@@ -0,0 +1,341 @@
+﻿#include "TestHarness.h"
+
+#include "FusedRaymarch.h"
+#include "SdfScene.h"
+#include "TemporalReprojection.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	typedef std::function<float(const float3&)> TreeNode;
+
+	// The pillars as nodes joined at run time, the way a scene loaded from data would be evaluated.
+	TreeNode BuildPillarTree()
+	{
+		auto cylinder = [](float3 offset) -> TreeNode
+		{
+			return [offset](const float3& p)
+			{
+				float3 q = p + offset;
+				return std::sqrt(q.x * q.x + q.z * q.z) - 0.5f;
+			};
+		};
+
+		auto join = [](TreeNode a, TreeNode b) -> TreeNode
+		{
+			return [a, b](const float3& p) { return std::min(a(p), b(p)); };
+		};
+
+		return join(join(join(
+			cylinder(float3(3.5f, 0.0f, 3.5f)),
+			cylinder(float3(-3.5f, 0.0f, 3.5f))),
+			cylinder(float3(-3.5f, 0.0f, 0.0f))),
+			cylinder(float3(3.5f, 0.0f, 0.0f)));
+	}
+
+	// Points spread through the room on a fixed sequence, so every run sees the same ones.
+	void RoomPoints(uint32_t points, std::vector<float>& x, std::vector<float>& y, std::vector<float>& z)
+	{
+		uint32_t state = 1;
+		auto next = [&state]()
+		{
+			state = state * 1664525u + 1013904223u;
+			return (state >> 8) * (10.0f / 16777216.0f) - 5.0f;
+		};
+
+		x.resize(points);
+		y.resize(points);
+		z.resize(points);
+		for (uint32_t i = 0; i < points; i++)
+		{
+			x[i] = next();
+			y[i] = next();
+			z[i] = next();
+		}
+	}
+
+	// Smallest finite difference step, so hits next to the eye do not lose all precision.
+	const float MinimumEpsilon = 0.001f;
+
+	const float CentralStep = 0.01f;
+
+	// Angle in degrees between a normal and one from double precision central differences.
+	struct NormalError
+	{
+		double	sum;
+		double	max;
+
+		void Add(const float3& normal, const float3& reference)
+		{
+			double cosine = std::min(1.0, std::max(-1.0, static_cast<double>(dot(normalize(normal), reference))));
+			double degrees = std::acos(cosine) * (180.0 / 3.14159265358979323846);
+			sum += degrees;
+			max = std::max(max, degrees);
+		}
+	};
+
+	template <class E>
+	float3 ReferenceNormal(const E& e, const float3& p)
+	{
+		using namespace SdfExpression;
+		const double h = 1e-5;
+		double x = p.x, y = p.y, z = p.z;
+		double gx = e.Evaluate(MakePoint(x + h, y, z)) - e.Evaluate(MakePoint(x - h, y, z));
+		double gy = e.Evaluate(MakePoint(x, y + h, z)) - e.Evaluate(MakePoint(x, y - h, z));
+		double gz = e.Evaluate(MakePoint(x, y, z + h)) - e.Evaluate(MakePoint(x, y, z - h));
+		double length = std::sqrt(gx * gx + gy * gy + gz * gz);
+		return float3(static_cast<float>(gx / length), static_cast<float>(gy / length), static_cast<float>(gz / length));
+	}
+
+	template <class E>
+	float3 CentralNormal(const E& e, const float3& p)
+	{
+		using namespace SdfExpression;
+		const float h = CentralStep;
+		return float3(
+			e.Evaluate(MakePoint(p.x + h, p.y, p.z)) - e.Evaluate(MakePoint(p.x - h, p.y, p.z)),
+			e.Evaluate(MakePoint(p.x, p.y + h, p.z)) - e.Evaluate(MakePoint(p.x, p.y - h, p.z)),
+			e.Evaluate(MakePoint(p.x, p.y, p.z + h)) - e.Evaluate(MakePoint(p.x, p.y, p.z - h)));
+	}
+
+	template <class E>
+	float3 TetrahedralNormal(const E& e, const float3& p, float epsilon)
+	{
+		using namespace SdfExpression;
+		Point<float> gradient;
+		TetrahedralGradient(e, MakePoint(p.x, p.y, p.z), epsilon, gradient);
+		return float3(gradient.x, gradient.y, gradient.z);
+	}
+
+	// Normals at every hit of the room and the pillars seen by camera, with the epsilon of
+	// NormalEpsilon for the hit distance, against a double precision reference. The evaluations
+	// count primitive distance evaluations per hit pixel for each way of taking the normal.
+	struct NormalAccuracy
+	{
+		uint32_t	hits;
+		NormalError	central;		// Six taps CentralStep apart, as the shaders used to.
+		NormalError	tetrahedral;	// Four taps on the whole field.
+		NormalError	gradient;		// SdfExpression::Gradient.
+		double		centralEvaluations;
+		double		tetrahedralEvaluations;
+		double		gradientEvaluations;
+	};
+
+	// The angle one pixel covers at the centre of camera's image, the slope NormalEpsilon uses.
+	float PixelAngle(const RaymarchCamera& camera)
+	{
+		float x = 0.5f * camera.width;
+		float y = 0.5f * camera.height;
+		return std::acos(std::min(1.0f, dot(camera.Ray(x, y), camera.Ray(x + 1.0f, y))));
+	}
+
+	NormalAccuracy MeasureNormals(const RaymarchCamera& camera)
+	{
+		using namespace SdfExpression;
+
+		auto room = SdfScene::Room();
+		auto pillars = SdfScene::Pillars();
+		float pixelAngle = PixelAngle(camera);
+
+		NormalAccuracy result = {};
+		uint64_t centralCost = 0, tetrahedralCost = 0, gradientCost = 0;
+
+		uint32_t width = static_cast<uint32_t>(camera.width);
+		uint32_t height = static_cast<uint32_t>(camera.height);
+		for (uint32_t y = 0; y < height; y++)
+		{
+			for (uint32_t x = 0; x < width; x++)
+			{
+				float3 direction = camera.Ray(x + 0.5f, y + 0.5f);
+
+				// The pillar pass draws over the room, as in the shaders.
+				float t;
+				bool pillar = FusedRaymarch::March(FusedRaymarch::Pillars, camera.eye, direction, t);
+				if (!pillar && !FusedRaymarch::March(FusedRaymarch::Room, camera.eye, direction, t))
+					continue;
+
+				float3 p = camera.eye + direction * t;
+				float epsilon = NormalEpsilon(t, pixelAngle, MinimumEpsilon);
+				result.hits++;
+
+				if (pillar)
+				{
+					float3 reference = ReferenceNormal(pillars, p);
+					result.central.Add(CentralNormal(pillars, p), reference);
+					result.tetrahedral.Add(TetrahedralNormal(pillars, p, epsilon), reference);
+					result.gradient.Add(Normal(pillars, p, epsilon), reference);
+					centralCost += CentralDifferenceCost<decltype(pillars)>();
+					tetrahedralCost += TetrahedralCost<decltype(pillars)>();
+					gradientCost += GradientCost<decltype(pillars)>();
+				}
+				else
+				{
+					float3 reference = ReferenceNormal(room, p);
+					result.central.Add(CentralNormal(room, p), reference);
+					result.tetrahedral.Add(TetrahedralNormal(room, p, epsilon), reference);
+					result.gradient.Add(Normal(room, p, epsilon), reference);
+					centralCost += CentralDifferenceCost<decltype(room)>();
+					tetrahedralCost += TetrahedralCost<decltype(room)>();
+					gradientCost += GradientCost<decltype(room)>();
+				}
+			}
+		}
+
+		double perHit = result.hits > 0 ? 1.0 / result.hits : 0.0;
+		result.centralEvaluations = centralCost * perHit;
+		result.tetrahedralEvaluations = tetrahedralCost * perHit;
+		result.gradientEvaluations = gradientCost * perHit;
+		return result;
+	}
+
+	void Print(const char* name, const NormalError& error, uint32_t hits, double evaluations)
+	{
+		std::printf("%-12s mean %.4f degrees, max %.4f, %.1f evaluations per hit\n", name,
+			hits > 0 ? error.sum / hits : 0.0, error.max, evaluations);
+	}
+
+	const RaymarchCamera Camera = { float3(0.0f, 3.5f, 5.0f), 1.0f, 0.008f, 320.0f, 240.0f };
+
+	uint32_t Occurrences(const std::string& text, const std::string& word)
+	{
+		uint32_t count = 0;
+		for (size_t at = text.find(word); at != std::string::npos; at = text.find(word, at + word.size()))
+		{
+			count++;
+		}
+		return count;
+	}
+}
+
+TEST(CheckedInHlslIsUpToDate)
+{
+	std::vector<uint8_t> file = TestHarness::ReadAsset("../SdfScene.hlsli");
+	std::string generated = SdfScene::GenerateHlsl();
+	EXPECT(!file.empty());
+	EXPECT(std::string(file.begin(), file.end()) == generated);
+}
+
+// The normals of the pillar pass: one distance per pillar, and the gradient of the one that is hit.
+TEST(CheckedInPillarGradientEvaluatesEachPillarOnce)
+{
+	std::vector<uint8_t> file = TestHarness::ReadAsset("../SdfScene.hlsli");
+	std::string source(file.begin(), file.end());
+	size_t begin = source.find("float3 pillarsGradient(");
+	size_t end = source.find("\n}\n", begin);
+	EXPECT(begin != std::string::npos && end != std::string::npos);
+	if (begin == std::string::npos || end == std::string::npos)
+		return;
+
+	std::string function = source.substr(begin, end - begin);
+	EXPECT(Occurrences(function, "sdCylinder(") == SdfScene::PillarCount);
+	EXPECT(Occurrences(function, "sdCylinderGradient(") == SdfScene::PillarCount);
+	EXPECT(Occurrences(function, "?") == 0);
+}
+
+// Nested unions and a subtraction, where comparing whole subtrees again at every level would
+// evaluate the deepest primitives once per level.
+TEST(GeneratedGradientEvaluatesEachPrimitiveOnce)
+{
+	using namespace SdfExpression;
+	CylinderNode pillar(float3(0.0f, 0.0f, 0.5f));
+	auto scene = Subtract(Union(Union(Union(
+		Translate(pillar, float3(1.0f, 0.0f, 0.0f)),
+		Translate(pillar, float3(-1.0f, 0.0f, 0.0f))),
+		Repeat(Sphere(0.25f), float3(2.0f, 2.0f, 2.0f))),
+		-Box(float3(4.0f, 4.0f, 4.0f))),
+		Torus(float2(1.0f, 0.25f)));
+
+	std::string source = GenerateHlslGradientFunction("scene", scene);
+
+	EXPECT(Occurrences(source, "sdCylinder(") == 2);
+	EXPECT(Occurrences(source, "sdSphere(") == 1);
+	EXPECT(Occurrences(source, "sdBox(") == 1);
+	EXPECT(Occurrences(source, "sdTorus(") == 1);
+	EXPECT(Occurrences(source, "sdCylinderGradient(") == 2);
+	EXPECT(Occurrences(source, "normalize(") == 1);
+	EXPECT(Occurrences(source, "sdBoxGradient(") == 1);
+	EXPECT(Occurrences(source, "sdTorusGradient(") == 1);
+	EXPECT(Occurrences(source, "gradient = ") == 5 + 2);	// One per primitive, and the two negations.
+}
+
+TEST(ExpressionsMatchTheHandWrittenScene)
+{
+	std::vector<float> x, y, z, distance(4096);
+	RoomPoints(4096, x, y, z);
+	SdfExpression::EvaluateBatch(SdfScene::Pillars(), x.data(), y.data(), z.data(), distance.data(), 4096);
+
+	TreeNode tree = BuildPillarTree();
+	auto room = SdfScene::Room();
+	float largest = 0.0f;
+	for (uint32_t i = 0; i < 4096; i++)
+	{
+		float3 p(x[i], y[i], z[i]);
+		largest = std::max(largest, std::fabs(distance[i] - FusedRaymarch::Pillars(p)));
+		largest = std::max(largest, std::fabs(distance[i] - tree(p)));
+		largest = std::max(largest, std::fabs(SdfExpression::Evaluate(room, p) - FusedRaymarch::Room(p)));
+	}
+	EXPECT(largest < 1e-5f);
+}
+
+TEST(GradientNormalsAreTheMostAccurate)
+{
+	NormalAccuracy result = MeasureNormals(Camera);
+	Print("central", result.central, result.hits, result.centralEvaluations);
+	Print("tetrahedral", result.tetrahedral, result.hits, result.tetrahedralEvaluations);
+	Print("gradient", result.gradient, result.hits, result.gradientEvaluations);
+
+	EXPECT(result.hits > 0);
+	EXPECT(result.gradient.sum <= result.central.sum);
+	EXPECT(result.gradient.max < 1.0);
+	EXPECT(result.gradientEvaluations < result.centralEvaluations);
+}
+
+BENCHMARK(EvaluationsPerSecond)
+{
+	const uint32_t points = 1 << 16, repeats = 50;
+	std::vector<float> x, y, z, distance(points), treeDistance(points), handDistance(points);
+	RoomPoints(points, x, y, z);
+
+	auto pillars = SdfScene::Pillars();
+	TreeNode tree = BuildPillarTree();
+	double evaluations = double(points) * repeats;
+
+	double expression = TestHarness::Milliseconds([&]() {
+		for (uint32_t r = 0; r < repeats; r++)
+			SdfExpression::EvaluateBatch(pillars, x.data(), y.data(), z.data(), distance.data(), points);
+	});
+	double treeTime = TestHarness::Milliseconds([&]() {
+		for (uint32_t r = 0; r < repeats; r++)
+			for (uint32_t i = 0; i < points; i++)
+				treeDistance[i] = tree(float3(x[i], y[i], z[i]));
+	});
+	double hand = TestHarness::Milliseconds([&]() {
+		for (uint32_t r = 0; r < repeats; r++)
+			for (uint32_t i = 0; i < points; i++)
+				handDistance[i] = FusedRaymarch::Pillars(float3(x[i], y[i], z[i]));
+	});
+
+	std::printf("expression templates %.3g/s, std::function tree %.3g/s, hand written %.3g/s\n",
+		evaluations / (expression / 1000.0), evaluations / (treeTime / 1000.0), evaluations / (hand / 1000.0));
+}
+
+BENCHMARK(NormalsAtFullResolution)
+{
+	RaymarchCamera camera = Camera;
+	camera.width = 640.0f;
+	camera.height = 480.0f;
+	camera.zoom = 0.004f;
+	NormalAccuracy result = MeasureNormals(camera);
+	Print("central", result.central, result.hits, result.centralEvaluations);
+	Print("tetrahedral", result.tetrahedral, result.hits, result.tetrahedralEvaluations);
+	Print("gradient", result.gradient, result.hits, result.gradientEvaluations);
+}
@@ -0,0 +1,153 @@
+﻿#include "TestHarness.h"
+
+#include "ShaderPermutations.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+
+using namespace Mystery_Treasure_Chamber;
+
+namespace
+{
+	const char* Index =
+		"# comment\n"
+		"\n"
+		"tier low 1 100\n"
+		"tier high 16 200\n"
+		"variant Room 1 100 Room_L1_S100.cso\n"
+		"variant Room 3 150 Room_L3_S150.cso\n"
+		"variant Room 16 200 Room.cso\n"
+		"variant Floor 1 0 Floor_L1.cso\n"
+		"variant Floor 16 0 Floor.cso\n";
+
+	bool Load(ShaderPermutations& permutations, const std::string& text)
+	{
+		std::istringstream stream(text);
+		return permutations.Load(stream);
+	}
+
+	std::string File(const ShaderVariant* variant)
+	{
+		return variant ? std::string(variant->file.begin(), variant->file.end()) : std::string("none");
+	}
+
+	std::string Text(const std::vector<uint8_t>& bytes)
+	{
+		return std::string(bytes.begin(), bytes.end());
+	}
+
+	// The value of #define name in source, 0 if it has none. Only the first counts, which in the
+	// shaders is the default the wrappers override.
+	uint32_t Define(const std::string& source, const std::string& name)
+	{
+		size_t at = source.find("#define " + name + " ");
+		return at == std::string::npos ? 0 : static_cast<uint32_t>(std::strtoul(source.c_str() + at + name.size() + 9, nullptr, 10));
+	}
+
+	// The source of a plain shader, which is either at the top of the project or in Content\.
+	std::string ShaderSource(const std::string& shader)
+	{
+		std::vector<uint8_t> file = TestHarness::ReadAsset("../" + shader + ".hlsl");
+		if (file.empty())
+			file = TestHarness::ReadAsset("../Content/" + shader + ".hlsl");
+		return Text(file);
+	}
+}
+
+TEST(LoadReadsTiersAndVariants)
+{
+	ShaderPermutations permutations;
+	EXPECT(Load(permutations, Index));
+	EXPECT(permutations.GetTierCount() == 2);
+	EXPECT(permutations.GetTier(1).name == "high" && permutations.GetTier(1).keys.lights == 16);
+	EXPECT(permutations.GetVariants().size() == 5);
+	EXPECT(permutations.FindTier("low") == 0);
+	EXPECT(permutations.FindTier("ultra") == permutations.GetTierCount());
+}
+
+TEST(LoadRejectsBrokenLines)
+{
+	const char* broken[] =
+	{
+		"tier low 1\n",
+		"variant Room 1 100\n",
+		"tier low one 100\n",
+		"shader Room 1 100 Room.cso\n",
+	};
+
+	for (const char* line : broken)
+	{
+		ShaderPermutations permutations;
+		EXPECT(!Load(permutations, std::string(Index) + line));
+		EXPECT(permutations.GetTierCount() == 0 && permutations.GetVariants().empty());
+	}
+}
+
+TEST(SelectPicksTheCheapestThatIsEnough)
+{
+	ShaderPermutations permutations;
+	Load(permutations, Index);
+
+	EXPECT(File(permutations.Select("Room", 0)) == "Room_L1_S100.cso");
+	EXPECT(File(permutations.Select("Room", 1)) == "Room.cso");
+	EXPECT(File(permutations.Select("Room", PermutationKeys{ 2, 120 })) == "Room_L3_S150.cso");
+	EXPECT(File(permutations.Select("Room", PermutationKeys{ 1, 180 })) == "Room.cso");
+
+	// Floor has no march steps, so any march step requirement is met.
+	EXPECT(File(permutations.Select("Floor", PermutationKeys{ 1, 200 })) == "Floor_L1.cso");
+
+	// Nothing is enough, so the most capable.
+	EXPECT(File(permutations.Select("Room", PermutationKeys{ 32, 400 })) == "Room.cso");
+
+	EXPECT(permutations.Select("Pillar", 0) == nullptr);
+	EXPECT(permutations.Select("Room", 2) == nullptr);
+}
+
+// The index the app loads: every variant's wrapper exists, includes its shader and defines the
+// keys the index lists for it, and each plain shader's defaults are the keys of its plain variant.
+TEST(IndexMatchesTheShaders)
+{
+	ShaderPermutations permutations;
+	EXPECT(Load(permutations, Text(TestHarness::ReadAsset("Shaders/Permutations.txt"))));
+	EXPECT(permutations.GetTierCount() > 0);
+
+	for (const ShaderVariant& variant : permutations.GetVariants())
+	{
+		std::string file(variant.file.begin(), variant.file.end());
+		std::string name = file.substr(0, file.rfind(".cso"));
+		std::string plain = ShaderSource(variant.shader);
+		EXPECT(!plain.empty());
+
+		std::string source = plain;
+		if (name != variant.shader)
+		{
+			source = Text(TestHarness::ReadAsset("../Permutations/" + name + ".hlsl"));
+			EXPECT(source.find("#include \"../") != std::string::npos && source.find(variant.shader + ".hlsl\"") != std::string::npos);
+		}
+
+		uint32_t lights = Define(source, "NUMLIGHTS");
+		uint32_t steps = Define(source, "INTERVALS");
+		if (lights != variant.keys.lights || steps != variant.keys.marchSteps)
+		{
+			std::printf("%s defines %u lights and %u steps, the index says %u and %u\n", file.c_str(), lights, steps,
+				variant.keys.lights, variant.keys.marchSteps);
+		}
+		EXPECT(lights == variant.keys.lights);
+		EXPECT(steps == variant.keys.marchSteps);
+
+		// A wrapper only overrides what it defines, the rest comes from the shader.
+		EXPECT(lights != 0 || Define(plain, "NUMLIGHTS") == 0);
+		EXPECT(steps != 0 || Define(plain, "INTERVALS") == 0);
+	}
+
+	// Every tier finds a variant of every shader.
+	for (uint32_t tier = 0; tier < permutations.GetTierCount(); tier++)
+	{
+		for (const ShaderVariant& variant : permutations.GetVariants())
+		{
+			EXPECT(permutations.Select(variant.shader, tier) != nullptr);
+		}
+	}
+}
@@ -0,0 +1,157 @@
+﻿#include "TestHarness.h"
+
+#include "PacketRaymarch.h"
+#include "TemporalReprojection.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	// A multiple of the refresh pattern both ways.
+	const uint32_t Width = 320;
+	const uint32_t Height = 180;
+
+	RaymarchCamera MakeCamera(const float3& eye)
+	{
+		RaymarchCamera camera = { eye, 1.0f, 0.008f, float(Width), float(Height) };
+		return camera;
+	}
+
+	const float3 Eye(0.0f, 3.5f, 5.0f);
+
+	std::vector<RaymarchSample> March(const RaymarchCamera& camera)
+	{
+		std::vector<RaymarchSample> image;
+		PacketRaymarch::Render(PacketRaymarch::GetBestLevel(), camera, RaymarchLighting::Default(), image);
+		return image;
+	}
+
+	float ColorDifference(const float4& a, const float4& b)
+	{
+		return std::max(std::fabs(a.x - b.x), std::max(std::fabs(a.y - b.y), std::fabs(a.z - b.z)));
+	}
+}
+
+TEST(StaticCameraOnlyRefreshes)
+{
+	RaymarchCamera camera = MakeCamera(Eye);
+	std::vector<RaymarchSample> history = March(camera), output;
+	std::vector<bool> remarch;
+	std::vector<uint32_t> refreshes(Width * Height, 0);
+
+	for (uint32_t frame = 0; frame < TemporalReprojection::RefreshPeriod; frame++)
+	{
+		uint32_t count = TemporalReprojection::ReprojectFrame(camera, camera, history, frame, output, remarch);
+		EXPECT(count == Width * Height / TemporalReprojection::RefreshPeriod);
+
+		uint32_t changed = 0;
+		for (uint32_t y = 0; y < Height; y++)
+		{
+			for (uint32_t x = 0; x < Width; x++)
+			{
+				uint32_t i = y * Width + x;
+				EXPECT(remarch[i] == TemporalReprojection::IsRefreshed(x, y, frame));
+				refreshes[i] += remarch[i] ? 1 : 0;
+				changed += !remarch[i] && (output[i].depth != history[i].depth || ColorDifference(output[i].color, history[i].color) != 0.0f) ? 1 : 0;
+			}
+		}
+		EXPECT(changed == 0);
+	}
+
+	// Over one period every pixel is marched again exactly once.
+	EXPECT(std::all_of(refreshes.begin(), refreshes.end(), [](uint32_t count) { return count == 1; }));
+}
+
+TEST(SmallMoveMatchesAFreshMarch)
+{
+	RaymarchCamera previous = MakeCamera(Eye);
+	RaymarchCamera current = MakeCamera(Eye + float3(0.02f, 0.01f, -0.02f));
+	std::vector<RaymarchSample> history = March(previous), fresh = March(current), output;
+	std::vector<bool> remarch;
+
+	uint32_t count = TemporalReprojection::ReprojectFrame(previous, current, history, 1, output, remarch);
+
+	uint32_t reused = 0, atExit = 0, wrong = 0;
+	float worst = 0.0f;
+	for (uint32_t i = 0; i < Width * Height; i++)
+	{
+		if (remarch[i])
+			continue;
+		reused++;
+
+		// The walls are the faces of the box the march runs across, so a wall straight ahead is only
+		// crossed at the last sample, where rounding decides whether the fresh march hits it. Those
+		// rays are counted, not compared.
+		if (fresh[i].depth < 0.0f)
+		{
+			atExit++;
+			continue;
+		}
+		float difference = ColorDifference(output[i].color, fresh[i].color);
+		worst = std::max(worst, difference);
+		wrong += difference > 0.05f ? 1 : 0;
+	}
+	std::printf("%u marched again, %u reused, %u at the exit, %u off by more than 0.05, worst %g\n", count, reused, atExit,
+		wrong, worst);
+	EXPECT(reused - atExit > Width * Height * 3 / 4);
+	EXPECT(wrong == 0);
+}
+
+// Moving sideways uncovers the room behind the pillars' edges. What the new eye sees there was
+// hidden from the old one, so history has nothing for it.
+TEST(DisocclusionIsMarchedAgain)
+{
+	RaymarchCamera previous = MakeCamera(Eye);
+	RaymarchCamera current = MakeCamera(Eye + float3(0.3f, 0.0f, 0.0f));
+	std::vector<RaymarchSample> history = March(previous), fresh = March(current), output;
+	std::vector<bool> remarch;
+
+	TemporalReprojection::ReprojectFrame(previous, current, history, 1, output, remarch);
+
+	uint32_t disoccluded = 0, reused = 0;
+	for (uint32_t y = 0; y < Height; y++)
+	{
+		for (uint32_t x = 0; x < Width; x++)
+		{
+			const RaymarchSample& sample = fresh[y * Width + x];
+			if (sample.depth < 0.0f)
+				continue;
+
+			// Hidden from the old eye if something nearer was hit where it projects to.
+			float3 hit = current.eye + current.Ray(x + 0.5f, y + 0.5f) * sample.depth;
+			float px, py;
+			if (!previous.Project(hit, px, py) || px < 0.0f || py < 0.0f || px >= Width || py >= Height)
+				continue;
+			const RaymarchSample& seen = history[uint32_t(py) * Width + uint32_t(px)];
+			if (seen.depth < 0.0f || seen.depth > 0.8f * length(hit - previous.eye))
+				continue;
+
+			disoccluded++;
+			reused += remarch[y * Width + x] ? 0 : 1;
+		}
+	}
+	std::printf("%u disoccluded pixels, %u of them reused\n", disoccluded, reused);
+	EXPECT(disoccluded > 100);
+	EXPECT(reused == 0);
+}
+
+BENCHMARK(ReprojectAgainstMarch)
+{
+	RaymarchCamera previous = MakeCamera(Eye);
+	RaymarchCamera current = MakeCamera(Eye + float3(0.02f, 0.0f, 0.0f));
+	std::vector<RaymarchSample> history = March(previous), output;
+	std::vector<bool> remarch;
+
+	uint32_t count = 0;
+	double reproject = TestHarness::Milliseconds([&]() {
+		count = TemporalReprojection::ReprojectFrame(previous, current, history, 1, output, remarch);
+	});
+	double march = TestHarness::Milliseconds([&]() { March(current); });
+	std::printf("%ux%u: reproject %.2f ms, %u pixels to march again, full march %.2f ms\n", Width, Height, reproject,
+		count, march);
+}
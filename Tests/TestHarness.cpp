@@ -0,0 +1,106 @@
+﻿#include "TestHarness.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+#ifndef CHAMBER_ASSETS
+#define CHAMBER_ASSETS "Assets"
+#endif
+
+namespace
+{
+	struct Case
+	{
+		const char*					name;
+		TestHarness::CaseFunction	run;
+		bool						benchmark;
+	};
+
+	std::vector<Case>& Cases()
+	{
+		static std::vector<Case> cases;
+		return cases;
+	}
+
+	uint32_t failures = 0;
+}
+
+TestHarness::Registrar::Registrar(const char* name, CaseFunction run, bool benchmark)
+{
+	Case registered = { name, run, benchmark };
+	Cases().push_back(registered);
+}
+
+void TestHarness::Fail(const char* file, int line, const char* expression)
+{
+	std::printf("%s(%d): failed: %s\n", file, line, expression);
+	failures++;
+}
+
+std::vector<uint8_t> TestHarness::ReadAsset(const std::string& path)
+{
+	std::ifstream file(std::string(CHAMBER_ASSETS) + "/" + path, std::ios::binary);
+	if (!file)
+		return std::vector<uint8_t>();
+	return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+double TestHarness::Milliseconds(const std::function<void()>& run)
+{
+	auto start = std::chrono::steady_clock::now();
+	run();
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void TestHarness::PrintScaling(uint32_t maxThreads, const std::function<void(uint32_t threads)>& run)
+{
+	if (maxThreads == 0)
+		maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	std::vector<uint32_t> counts;
+	for (uint32_t threads = 1; threads < maxThreads; threads *= 2)
+	{
+		counts.push_back(threads);
+	}
+	counts.push_back(maxThreads);
+
+	double single = 0.0;
+	for (uint32_t threads : counts)
+	{
+		double milliseconds = Milliseconds([&]() { run(threads); });
+		if (threads == 1)
+			single = milliseconds;
+
+		double speedup = milliseconds > 0.0 ? single / milliseconds : 1.0;
+		std::printf("%3u threads %10.1f ms, speedup %.2f, efficiency %.2f\n", threads, milliseconds, speedup, speedup / threads);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bool benchmark = argc > 1 && std::strcmp(argv[1], "--benchmark") == 0;
+	const char* only = argc > 1 && !benchmark ? argv[1] : nullptr;
+
+	uint32_t ran = 0;
+	for (const Case& test : Cases())
+	{
+		if (only ? std::strcmp(only, test.name) != 0 : test.benchmark != benchmark)
+			continue;
+
+		std::printf("[ %s ]\n", test.name);
+		std::fflush(stdout);
+		uint32_t before = failures;
+		test.run();
+		std::printf("[ %s %s ]\n", test.name, failures == before ? "passed" : "FAILED");
+		ran++;
+	}
+
+	std::printf("%u cases, %u failed expectations\n", ran, failures);
+	return failures == 0 && (ran > 0 || benchmark) ? 0 : 1;
+}
@@ -0,0 +1,46 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// A small harness for the tests of the platform independent modules in Content\, which build
+// without Windows. Each test executable registers its cases with TEST and BENCHMARK. Run without
+// arguments, as ctest does, it runs the TEST cases and fails if any EXPECT did. Run with
+// --benchmark it runs the BENCHMARK cases instead, which print timings and check nothing. Any
+// other argument runs only the cases of that name.
+namespace TestHarness
+{
+	typedef void (*CaseFunction)();
+
+	struct Registrar
+	{
+		Registrar(const char* name, CaseFunction run, bool benchmark);
+	};
+
+	void Fail(const char* file, int line, const char* expression);
+
+	// Bytes of a file under Assets\ of the app, empty if it cannot be read.
+	std::vector<uint8_t> ReadAsset(const std::string& path);
+
+	// Wall clock time of one call of run.
+	double Milliseconds(const std::function<void()>& run);
+
+	// Calls run with 1, 2, 4, ... up to maxThreads threads (0 for the hardware thread count,
+	// which is always measured last) and prints the time of each and its speedup over one thread.
+	void PrintScaling(uint32_t maxThreads, const std::function<void(uint32_t threads)>& run);
+}
+
+#define TEST(name) \
+	static void name(); \
+	static TestHarness::Registrar name##Registrar(#name, name, false); \
+	static void name()
+
+#define BENCHMARK(name) \
+	static void name(); \
+	static TestHarness::Registrar name##Registrar(#name, name, true); \
+	static void name()
+
+#define EXPECT(condition) \
+	do { if (!(condition)) TestHarness::Fail(__FILE__, __LINE__, #condition); } while (0)
@@ -0,0 +1,80 @@
+﻿#include "TestHarness.h"
+
+#include "TileRenderer.h"
+
+#include <cstdio>
+
+using namespace Mystery_Treasure_Chamber;
+using namespace Mystery_Treasure_Chamber::Sdf;
+
+namespace
+{
+	// Sizes that are not a multiple of the tiles, so the last row and column are partial.
+	const RaymarchCamera Camera = { float3(0.0f, 3.5f, 5.0f), 1.0f, 0.008f, 321.0f, 179.0f };
+}
+
+TEST(EveryThreadCountMatchesTheSingleThreadedFrame)
+{
+	RaymarchLighting lighting = RaymarchLighting::Default();
+	PacketRaymarch::SimdLevel level = PacketRaymarch::GetBestLevel();
+	std::vector<RaymarchSample> reference, image;
+	PacketRaymarch::Render(level, Camera, lighting, reference);
+
+	for (uint32_t threads : { 1u, 3u, 8u })
+	{
+		TileRenderer renderer(threads, 32);
+		uint32_t stages = renderer.Render(level, Camera, lighting, RefinementMode::Full, image, nullptr, nullptr);
+		EXPECT(stages == TileRenderer::GetStageCount(RefinementMode::Full));
+		EXPECT(PacketRaymarch::CountMismatches(reference, image, 0.0f) == 0);
+		EXPECT(renderer.GetTileCosts().size() == size_t(11) * 6);
+		EXPECT(renderer.GetImbalance() >= 1.0);
+	}
+}
+
+TEST(ProgressivePassesEndWithTheFullFrame)
+{
+	RaymarchLighting lighting = RaymarchLighting::Default();
+	PacketRaymarch::SimdLevel level = PacketRaymarch::GetBestLevel();
+	std::vector<RaymarchSample> reference, image;
+	PacketRaymarch::Render(level, Camera, lighting, reference);
+
+	TileRenderer renderer(3, 32);
+	std::vector<uint32_t> mismatches;
+	uint32_t stages = renderer.Render(level, Camera, lighting, RefinementMode::Progressive, image, nullptr, [&](uint32_t) {
+		mismatches.push_back(PacketRaymarch::CountMismatches(reference, image, 1e-4f));
+	});
+
+	EXPECT(stages == TileRenderer::GetStageCount(RefinementMode::Progressive));
+	EXPECT(mismatches.size() == stages);
+	for (size_t i = 1; i < mismatches.size(); i++)
+		EXPECT(mismatches[i] < mismatches[i - 1]);
+	EXPECT(!mismatches.empty() && mismatches.back() == 0);
+}
+
+TEST(CancelKeepsTheLastFinishedPass)
+{
+	RaymarchLighting lighting = RaymarchLighting::Default();
+	std::vector<RaymarchSample> image;
+
+	TileRenderer renderer(3, 32);
+	std::atomic<bool> cancel(false);
+	uint32_t stages = renderer.Render(PacketRaymarch::GetBestLevel(), Camera, lighting, RefinementMode::Progressive, image,
+		&cancel, [&](uint32_t stage) { if (stage == 0) cancel = true; });
+
+	EXPECT(stages == 1);
+	EXPECT(image.size() == size_t(321) * 179);
+}
+
+BENCHMARK(RenderScaling)
+{
+	RaymarchCamera camera = { float3(0.0f, 3.5f, 5.0f), 1.0f, 0.004f, 640.0f, 480.0f };
+	RaymarchLighting lighting = RaymarchLighting::Default();
+	PacketRaymarch::SimdLevel level = PacketRaymarch::GetBestLevel();
+	std::vector<RaymarchSample> image;
+
+	TestHarness::PrintScaling(0, [&](uint32_t threads) {
+		TileRenderer renderer(threads, 32);
+		for (uint32_t frame = 0; frame < 4; frame++)
+			renderer.Render(level, camera, lighting, RefinementMode::Full, image, nullptr, nullptr);
+	});
+}